@@ -1,5 +1,5 @@
-#include <ArduinoJson.h>
 #include <wrfarduinolib.h>
+#include <json_tape.h>
 
 typedef void ButtonPressCallback();							
 ButtonPressCallback *button_press_cb = NULL;
@@ -119,13 +119,11 @@ void onMessageReceived(char* msg)
 	Serial.println("++ onMessageReceived ++");
 
 	//When we received a message, we check that we suppot the introspect and handle it. 
-	DynamicJsonBuffer jsonBuffer;
-	JsonObject& root = jsonBuffer.parseObject(String(msg));
-	JsonObject& dd = root[INTERFACE_NAME];
-	if (dd.containsKey(POWER_PARAM)) {
-		String val = dd[POWER_PARAM].as<String>();
+	json_slice power_value = json_find(msg, strlen(msg), INTERFACE_NAME, POWER_PARAM);
+	int64_t val;
+	if (json_slice_int(&power_value, &val)) {
 		// If it is a power message we set the light to correct value
-		setLight(val.toInt());
+		setLight((int)val);
 		// Then we check if there are any pending upgrades
 		wrf.checkPendingUpgrades();
 	}
@@ -25,9 +25,22 @@ uint32_t WRFArduino::write_serial(unsigned char* str, int length) {
 	return 0;
 }
 
+uint32_t WRFArduino::write_serial_segments(const wrf_segment* segments, int count) {
+	for (int i = 0; i < count; i++)
+		Serial1.write(segments[i].data, segments[i].length);
+	return 0;
+}
+
 void WRFArduino::read_serial() {
-	while (Serial1.available() > 0)
-		registerChar(Serial1.read());
+	uint8_t bytes[64];
+	int available;
+	// Only what is already received is read, so readBytes never waits for its timeout
+	while ((available = Serial1.available()) > 0) {
+		size_t length = Serial1.readBytes(bytes, available < (int)sizeof(bytes) ? available : sizeof(bytes));
+		if (length == 0)
+			break;
+		registerBytes(bytes, length);
+	}
 }
 
 #pragma endregion
@@ -44,10 +57,10 @@ void WRFArduino::handle_poll(long now_ms)
 	}
 }
 
-void WRFArduino::handle_sendfile_cb( int length)
+int WRFArduino::read_file_from_memory(int offset, unsigned char* dst, int max_length)
 {
-	WRF* wrf = WRF::getInstance();
-	wrf->sendFilePacket(_data_to_send, length);	
+	memcpy(dst, _data_to_send + offset, max_length);
+	return max_length;
 }
 
 WRFArduino::WRFArduino() :
@@ -60,6 +73,7 @@ WRF() {
 		(wrf_write_string)write_serial, 
 		DEFAULT_WRF_RECEIVE_BUFFER_SIZE, 
 		DEFAULT_WRF_QUEUE_SIZE);
+	setSegmentWriter(write_serial_segments);
 	set_handle_response_override(handle_response);
 	WRF::setInstance(this);
 }
@@ -71,6 +85,7 @@ WRF() {
 	last_poll = 0;
 	poll_intervall = 10000;
 	WRF::init_instance((wrf_write_string)write_serial, receive_buffer, queue_size);
+	setSegmentWriter(write_serial_segments);
 	WRF::setInstance(this);
 }
 
@@ -84,7 +99,8 @@ bool WRFArduino::handle_response(wrf_result_code code, void * object)
 		break;
 	case WRF_LOCAL_ERROR:
 	case WRF_REMOTE_ERROR:
-		if (((wrf_error*)object)->code != WRF_ERROR_SYSTEM_BUSY)
+		// Neither answers the poll
+		if (((wrf_error*)object)->code != WRF_ERROR_SYSTEM_BUSY && ((wrf_error*)object)->code != LIB_ERROR_COMMAND_TOO_LONG)
 			((WRFArduino*)instance)->awaiting_poll = false;
 		break;
 	default:
@@ -106,7 +122,7 @@ void WRFArduino::init(wrf_config & config)
 void WRFArduino::handle()
 {
 	read_serial();
-	handleSendQueue();
+	process();
 	handle_poll(millis());
 }
 
@@ -140,7 +156,13 @@ void WRFArduino::sendFile(String file_name, int file_size, unsigned char* file)
 {
 	char *name = const_cast<char*>(file_name.c_str());
 	_data_to_send = file;
-	instance->sendFile(name, file_size, handle_sendfile_cb);
+	instance->sendFile(name, file_size, read_file_from_memory);
+}
+
+void WRFArduino::sendFile(String file_name, int file_size, file_reader* reader)
+{
+	char *name = const_cast<char*>(file_name.c_str());
+	instance->sendFile(name, file_size, reader);
 }
 
 
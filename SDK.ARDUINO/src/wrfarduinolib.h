@@ -31,6 +31,7 @@ class WRFArduino : public WRF {
 private:
 
 	static uint32_t write_serial(unsigned char *str, int length);
+	static uint32_t write_serial_segments(const wrf_segment* segments, int count);
 	void read_serial();
 
 	bool is_polling;
@@ -39,7 +40,7 @@ private:
 	int poll_intervall;
 
 	void handle_poll(long now_ms);
-	static void handle_sendfile_cb( int length);
+	static int read_file_from_memory(int offset, unsigned char* dst, int max_length);
 
 protected:
 	WRFArduino();
@@ -60,6 +61,7 @@ public:
 	void send(String raw_string);
 
 	void sendFile(String file_name, int file_size, unsigned char* file);
+	void sendFile(String file_name, int file_size, file_reader* reader);
 
 	void sendIntrospect(String introspect);
 	void startClientUpgrade(int delay);
@@ -0,0 +1,136 @@
+/*	Copyright 2017 DeviceDrive AS
+*
+*	Licensed under the Apache License, Version 2.0 (the "License");
+*	you may not use this file except in compliance with the License.
+*	You may obtain a copy of the License at
+*
+*	http ://www.apache.org/licenses/LICENSE-2.0
+*
+*	Unless required by applicable law or agreed to in writing, software
+*	distributed under the License is distributed on an "AS IS" BASIS,
+*	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*	See the License for the specific language governing permissions and
+*	limitations under the License.
+*
+*/
+
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#pragma region Heap counting
+
+static bench_heap_counters heap = { 0, 0, 0 };
+
+extern "C" {
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+void __real_free(void* ptr);
+
+void* __wrap_malloc(size_t size)
+{
+	heap.allocations++;
+	heap.bytes += size;
+	return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size)
+{
+	heap.allocations++;
+	heap.bytes += count * size;
+	return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size)
+{
+	heap.allocations++;
+	heap.bytes += size;
+	return __real_realloc(ptr, size);
+}
+
+void __wrap_free(void* ptr)
+{
+	if (ptr)
+		heap.frees++;
+	__real_free(ptr);
+}
+}
+
+bench_heap_counters bench_heap()
+{
+	return heap;
+}
+
+#pragma endregion
+
+static const char* name_filter = NULL;
+static double min_time = 0.2;
+static const char* pending_header = NULL;
+
+static double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void bench_filter(const char* filter)
+{
+	name_filter = filter;
+}
+
+void bench_min_time(double seconds)
+{
+	min_time = seconds;
+}
+
+void bench_header(const char* title)
+{
+	// Printed with the first result, so filtered out groups leave no empty table
+	pending_header = title;
+}
+
+void bench_run(const char* name, bench_function* function, void* context, size_t bytes_per_op)
+{
+	if (name_filter && !strstr(name, name_filter))
+		return;
+
+	if (pending_header) {
+		printf("\n%-40s %12s %10s %12s\n", pending_header, "ns/op", "allocs/op", "MB/s");
+		pending_header = NULL;
+	}
+
+	// Warm up and find an iteration count that takes long enough
+	uint64_t iterations = 1;
+	uint64_t done = 0;
+	double elapsed;
+	for (;;) {
+		double start = now();
+		for (uint64_t i = 0; i < iterations; i++)
+			function(done + i, context);
+		elapsed = now() - start;
+		done += iterations;
+		if (elapsed >= min_time / 10)
+			break;
+		iterations *= 4;
+	}
+
+	iterations = (uint64_t)(iterations * (min_time / elapsed)) + 1;
+	bench_heap_counters before = bench_heap();
+	double start = now();
+	for (uint64_t i = 0; i < iterations; i++)
+		function(done + i, context);
+	elapsed = now() - start;
+	bench_heap_counters after = bench_heap();
+
+	double ns_per_op = elapsed * 1e9 / iterations;
+	double allocs_per_op = (double)(after.allocations - before.allocations) / iterations;
+	if (bytes_per_op)
+		printf("%-40s %12.1f %10.2f %12.1f\n", name, ns_per_op, allocs_per_op,
+			bytes_per_op * (double)iterations / elapsed / (1024 * 1024));
+	else
+		printf("%-40s %12.1f %10.2f %12s\n", name, ns_per_op, allocs_per_op, "-");
+}
@@ -0,0 +1,58 @@
+/*	Copyright 2017 DeviceDrive AS
+*
+*	Licensed under the Apache License, Version 2.0 (the "License");
+*	you may not use this file except in compliance with the License.
+*	You may obtain a copy of the License at
+*
+*	http ://www.apache.org/licenses/LICENSE-2.0
+*
+*	Unless required by applicable law or agreed to in writing, software
+*	distributed under the License is distributed on an "AS IS" BASIS,
+*	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*	See the License for the specific language governing permissions and
+*	limitations under the License.
+*
+*/
+
+/**@file
+*
+*	@brief		Minimal microbenchmark runner
+*
+*	@details	Runs an operation until enough time has passed to time it reliably and
+*				reports nanoseconds and heap allocations per operation. Allocations
+*				are counted by wrapping malloc, calloc and realloc at link time
+*				(-Wl,--wrap=...), so they include those made inside the C SDK.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*	@brief	Heap calls since the program started. */
+struct bench_heap_counters {
+	uint64_t allocations;
+	uint64_t frees;
+	uint64_t bytes;
+};
+
+bench_heap_counters bench_heap();
+
+/*	@brief	An operation to measure, called with the iteration number. */
+typedef void bench_function(uint64_t iteration, void* context);
+
+/*	@brief		Measures @ref function and prints one result line.
+*
+*	@param		bytes_per_op	Bytes handled per operation, for a throughput column.
+*								0 if throughput does not apply.
+*/
+void bench_run(const char* name, bench_function* function, void* context, size_t bytes_per_op);
+
+/*	@brief	Prints the header of the result table. */
+void bench_header(const char* title);
+
+/*	@brief	Only benchmarks whose name contains this are run, NULL for all. */
+void bench_filter(const char* filter);
+
+/*	@brief	Minimum measuring time per benchmark. */
+void bench_min_time(double seconds);
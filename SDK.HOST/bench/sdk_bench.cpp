@@ -0,0 +1,346 @@
+/*	Copyright 2017 DeviceDrive AS
+*
+*	Licensed under the Apache License, Version 2.0 (the "License");
+*	you may not use this file except in compliance with the License.
+*	You may obtain a copy of the License at
+*
+*	http ://www.apache.org/licenses/LICENSE-2.0
+*
+*	Unless required by applicable law or agreed to in writing, software
+*	distributed under the License is distributed on an "AS IS" BASIS,
+*	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*	See the License for the specific language governing permissions and
+*	limitations under the License.
+*
+*/
+
+/*	Microbenchmarks of the SDK paths that run for every message.
+*
+*		sdk_bench [name filter] [seconds per benchmark]
+*/
+
+#include "bench.h"
+#include "wrf_sdk.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include "json.h"
+}
+#include "json_tape.h"
+
+static volatile uint32_t sink;
+
+#pragma region Responses
+
+struct shape {
+	const char* name;
+	const char* frame;
+};
+
+/*	One frame of every response shape the SDK handles. */
+static const shape responses[] = {
+	{ "result OK", "{\"devicedrive\":{\"result\":\"OK\"}}\x04" },
+	{ "result EMPTY", "{\"devicedrive\":{\"result\":\"EMPTY\"}}\x04" },
+	{ "error SYSTEM_BUSY", "{\"devicedrive\":{\"error\":\"SYSTEM_BUSY\"}}\x04" },
+	{ "remote error", "{\"DeviceDrive\":{\"ErrorCode\":\"INVALID_TOKEN\"}}\x04" },
+	{ "status", "{\"devicedrive\":{\"status\":{\"connection_status\":\"GOT_IP\",\"ip\":\"192.168.1.20\",\"visibility\":\"OFF\","
+		"\"last_error\":\"NONE\",\"last_error_msg\":\"\",\"successful_transfers\":\"12\"}}}\x04" },
+	{ "time", "{\"devicedrive\":{\"time\":[1500000000,5,14,7,2017,2,40,0,0,0]}}\x04" },
+	{ "upgrade list", "{\"devicedrive\":{\"upgrade\":[\"WRF01\",\"CLIENT\"]}}\x04" },
+	{ "upgrade package", "{\"devicedrive\":{\"upgrade\":{\"length\":20480,\"crc\":305419896}}}\x04" },
+	{ "send_file", "{\"devicedrive\":{\"max_packet_size\":\"512\"}}\x04" },
+	{ "configuration", "{\"configuration\":{\"mac\":\"A020A6123456\"},\"device_state\":{\"rssi\":\"-55\"}}\x04" },
+	{ "cloud message", "{\"com.devicedrive.light\":{\"power\":1,\"brightness\":80,\"color\":\"#ffaa00\"}}\x04" },
+};
+static const int num_responses = sizeof(responses) / sizeof(responses[0]);
+
+static void count_response(wrf_result_code code, void* object)
+{
+	sink += code;
+}
+
+static void bench_handle_response(uint64_t iteration, void* context)
+{
+	wrf_handle_response((char*)context);
+}
+
+#pragma endregion
+
+#pragma region Encoding
+
+static uint32_t count_bytes(unsigned char* buffer, int length)
+{
+	sink += length;
+	return 0;
+}
+
+static void bench_status_command(uint64_t iteration, void* context)
+{
+	wrf_ask_status();
+}
+
+static void bench_setup_command(uint64_t iteration, void* context)
+{
+	wrf_param params[] = {
+		{ (char*)WRF_SETUP_SILENT_CONNECT_STR, (char*)"0" },
+		{ (char*)WRF_SETUP_VISIBILITY_STR, (char*)"60" }
+	};
+	wrf_send_command(WRF_COMMAND_SETUP, params, 2);
+}
+
+static void bench_send_config(uint64_t iteration, void* context)
+{
+	wrf_send_config((wrf_config*)context);
+}
+
+#pragma endregion
+
+#pragma region Queue
+
+static char queue_message[] = "{\"com.devicedrive.light\":{\"power\":1,\"brightness\":80}}\x04";
+
+static void bench_queue_push_pop(uint64_t iteration, void* context)
+{
+	Queue* queue = (Queue*)context;
+	queue->push(queue_message);
+	queue->pop();
+}
+
+static void bench_queue_segments(uint64_t iteration, void* context)
+{
+	Queue* queue = (Queue*)context;
+	static const unsigned char eot[] = { WRF_EOT };
+	wrf_segment segments[2] = {
+		{ (const unsigned char*)queue_message, (int)sizeof(queue_message) - 2 },
+		{ eot, 1 }
+	};
+	queue->push(segments, 2);
+	queue->pop();
+}
+
+/*	Keeps the queue half full, so push and pop work on different parts of the ring. */
+static void bench_queue_steady(uint64_t iteration, void* context)
+{
+	Queue* queue = (Queue*)context;
+	queue->push(queue_message);
+	if (queue->count() > 4)
+		queue->pop();
+}
+
+#pragma endregion
+
+#pragma region Receive
+
+static void bench_register_chars(uint64_t iteration, void* context)
+{
+	const std::string* stream = (const std::string*)context;
+	WRF* wrf = WRF::getInstance();
+	for (size_t i = 0; i < stream->size(); i++)
+		wrf->registerChar((*stream)[i]);
+}
+
+#pragma endregion
+
+#pragma region CRC
+
+static void bench_register_bytes(uint64_t iteration, void* context)
+{
+	const std::string* stream = (const std::string*)context;
+	WRF::getInstance()->registerBytes((const uint8_t*)stream->data(), stream->size());
+}
+
+/* The application parses each message again, as the examples did */
+static void on_message_json_parse(char* msg)
+{
+	json_value* root = json_parse(msg, strcspn(msg, "\x04"));
+	if (root)
+		sink += (uint32_t)root->type;
+	json_value_free(root);
+}
+
+static void on_message_parsed(const json_tape* message, const char* raw, size_t length, wrf_parse_result result)
+{
+	if (message)
+		sink += (uint32_t)JsonTapeValue(message)["com.devicedrive.light"]["power"].asInt();
+}
+
+/* Bytes arrive a UART FIFO at a time, like WRFArduino::read_serial hands them over */
+static void bench_register_fifo(uint64_t iteration, void* context)
+{
+	const std::string* stream = (const std::string*)context;
+	WRF* wrf = WRF::getInstance();
+	for (size_t i = 0; i < stream->size(); i += 64) {
+		size_t length = stream->size() - i < 64 ? stream->size() - i : 64;
+		wrf->registerBytes((const uint8_t*)stream->data() + i, length);
+	}
+}
+
+static void bench_crc(uint64_t iteration, void* context)
+{
+	std::vector<unsigned char>* buffer = (std::vector<unsigned char>*)context;
+	sink += calcCrc(&(*buffer)[0], (int)buffer->size());
+}
+
+#pragma endregion
+
+#pragma region JSON
+
+static const shape cloud_messages[] = {
+	{ "small", "{\"com.devicedrive.light\":{\"power\":1}}" },
+	{ "typical", "{\"com.devicedrive.light\":{\"power\":1,\"brightness\":80,\"color\":\"#ffaa00\",\"name\":\"Kitchen\"}}" },
+	{ "introspect", "{\"interfaces\":[[\"com.devicedrive.light\",\"@power>b\",\"@brightness>i\",\"@color>s\"],"
+		"[\"com.devicedrive.sensor\",\"@temperature>d\",\"@humidity>d\",\"@pressure>d\"]]}" },
+	{ "numbers", "{\"com.devicedrive.sensor\":{\"temperature\":21.5,\"humidity\":45.25,\"pressure\":1013.2,\"samples\":[1,2,3,4,5,6,7,8]}}" },
+};
+static const int num_cloud_messages = sizeof(cloud_messages) / sizeof(cloud_messages[0]);
+
+static void bench_json_parse(uint64_t iteration, void* context)
+{
+	const char* json = (const char*)context;
+	json_value* value = json_parse(json, strlen(json));
+	sink += value->type;
+	json_value_free(value);
+}
+
+/*	The message is copied back first, as the parse writes over it. */
+static void bench_json_parse_inplace(uint64_t iteration, void* context)
+{
+	std::string& buffer = *(std::string*)context;
+	char json[256];
+	memcpy(json, buffer.data(), buffer.size());
+	json_value* value = json_parse_inplace(json, buffer.size());
+	sink += value->type;
+	json_value_free_inplace(value);
+}
+
+static void bench_json_tape_parse(uint64_t iteration, void* context)
+{
+	const char* json = (const char*)context;
+	uint32_t entries[64];
+	json_tape tape;
+	json_tape_parse(&tape, json, strlen(json), entries, 64);
+	sink += tape.count;
+}
+
+/*	Parse and read one property, the way a message handler would */
+static void bench_json_tape_lookup(uint64_t iteration, void* context)
+{
+	const char* json = (const char*)context;
+	uint32_t entries[64];
+	json_tape tape;
+	json_tape_parse(&tape, json, strlen(json), entries, 64);
+	sink += (uint32_t)JsonTapeValue(&tape)["com.devicedrive.light"]["power"].asInt();
+}
+
+static void bench_json_find(uint64_t iteration, void* context)
+{
+	const char* json = (const char*)context;
+	json_slice power = json_find(json, strlen(json), "com.devicedrive.light", "power");
+	int64_t value = 0;
+	json_slice_int(&power, &value);
+	sink += (uint32_t)value;
+}
+
+#pragma endregion
+
+int main(int argc, char** argv)
+{
+	if (argc > 1 && strcmp(argv[1], "all") != 0)
+		bench_filter(argv[1]);
+	if (argc > 2)
+		bench_min_time(atof(argv[2]));
+
+	char name[64];
+
+	bench_header("wrf_handle_response");
+	wrf_on_response(count_response);
+	for (int i = 0; i < num_responses; i++) {
+		snprintf(name, sizeof(name), "handle_response %s", responses[i].name);
+		std::string frame = responses[i].frame;
+		bench_run(name, bench_handle_response, &frame[0], frame.size());
+	}
+
+	bench_header("Encoding");
+	wrf_init(count_bytes);
+	wrf_init_segments(NULL);
+	bench_run("wrf_ask_status", bench_status_command, NULL, 0);
+	bench_run("wrf_send_command setup", bench_setup_command, NULL, 0);
+	wrf_config config;
+	DEFAULT_WRF_CONFIG(config);
+	config.network_ssid = (char*)"DeviceDrive";
+	config.network_pwd = (char*)"secret";
+	config.token = (char*)"0123456789abcdef0123456789abcdef";
+	config.product_key = (char*)"fedcba9876543210";
+	config.version = (char*)"1.0.0";
+	bench_run("wrf_send_config", bench_send_config, &config, 0);
+
+	bench_header("Queue");
+	{
+		Queue queue(10);
+		bench_run("Queue push/pop", bench_queue_push_pop, &queue, sizeof(queue_message) - 1);
+		bench_run("Queue push segments/pop", bench_queue_segments, &queue, sizeof(queue_message) - 1);
+		queue.clear();
+		bench_run("Queue steady at 5 messages", bench_queue_steady, &queue, sizeof(queue_message) - 1);
+	}
+
+	bench_header("WRF::registerChar/registerBytes");
+	{
+		WRF* wrf = WRF::createInstance(count_bytes, 1024, 10);
+		// send_file would start a file transfer, so it is left out
+		std::string stream;
+		for (int i = 0; i < num_responses; i++)
+			if (strcmp(responses[i].name, "send_file") != 0)
+				stream += responses[i].frame;
+		bench_run("registerChar all shapes", bench_register_chars, &stream, stream.size());
+		bench_run("registerBytes all shapes", bench_register_bytes, &stream, stream.size());
+		bench_run("registerBytes all shapes, 64 byte reads", bench_register_fifo, &stream, stream.size());
+
+		std::string messages;
+		for (int i = 0; i < 20; i++)
+			messages += responses[num_responses - 1].frame;
+		bench_run("registerChar cloud messages", bench_register_chars, &messages, messages.size());
+		bench_run("registerBytes cloud messages", bench_register_bytes, &messages, messages.size());
+		wrf->onMessageReceived(on_message_json_parse);
+		bench_run("registerBytes messages, json_parse", bench_register_bytes, &messages, messages.size());
+		wrf->onMessageReceived(NULL);
+		wrf->onMessageParsed(on_message_parsed);
+		bench_run("registerBytes messages, onMessageParsed", bench_register_bytes, &messages, messages.size());
+		WRF::freeInstance();
+		(void)wrf;
+	}
+
+	bench_header("calcCrc");
+	{
+		int sizes[] = { 40, 512, 4096 };
+		for (int i = 0; i < 3; i++) {
+			std::vector<unsigned char> buffer(sizes[i]);
+			for (int j = 0; j < sizes[i]; j++)
+				buffer[j] = (unsigned char)(j * 131 + 7);
+			snprintf(name, sizeof(name), "calcCrc %d bytes", sizes[i]);
+			bench_run(name, bench_crc, &buffer, buffer.size());
+		}
+	}
+
+	bench_header("json_parse");
+	for (int i = 0; i < num_cloud_messages; i++) {
+		snprintf(name, sizeof(name), "json_parse %s", cloud_messages[i].name);
+		bench_run(name, bench_json_parse, (void*)cloud_messages[i].frame, strlen(cloud_messages[i].frame));
+	}
+	for (int i = 0; i < num_cloud_messages; i++) {
+		snprintf(name, sizeof(name), "json_parse_inplace %s", cloud_messages[i].name);
+		std::string buffer = cloud_messages[i].frame;
+		bench_run(name, bench_json_parse_inplace, &buffer, buffer.size());
+	}
+	for (int i = 0; i < num_cloud_messages; i++) {
+		snprintf(name, sizeof(name), "json_tape_parse %s", cloud_messages[i].name);
+		bench_run(name, bench_json_tape_parse, (void*)cloud_messages[i].frame, strlen(cloud_messages[i].frame));
+	}
+	bench_run("json_tape lookup power", bench_json_tape_lookup, (void*)cloud_messages[1].frame, strlen(cloud_messages[1].frame));
+	bench_run("json_find power", bench_json_find, (void*)cloud_messages[1].frame, strlen(cloud_messages[1].frame));
+
+	return 0;
+}
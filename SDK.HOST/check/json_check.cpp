@@ -0,0 +1,828 @@
+/*	Copyright 2017 DeviceDrive AS
+*
+*	Licensed under the Apache License, Version 2.0 (the "License");
+*	you may not use this file except in compliance with the License.
+*	You may obtain a copy of the License at
+*
+*	http ://www.apache.org/licenses/LICENSE-2.0
+*
+*	Unless required by applicable law or agreed to in writing, software
+*	distributed under the License is distributed on an "AS IS" BASIS,
+*	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*	See the License for the specific language governing permissions and
+*	limitations under the License.
+*
+*/
+
+/*	Checks the results of the JSON parsers in SDK/ against each other and against
+*	known answers.
+*
+*		json_check
+*
+*	inplace		json_parse_inplace builds the same tree as json_parse, also with
+*				max_memory set, and gives back all its memory.
+*	numbers		Numbers come out as strtod reads them: exactly for up to 15
+*				digits and exponents up to 22, within 4 ulp beyond. Overflow
+*				and underflow, and the errors for malformed numbers.
+*	tape		json_tape_parse accepts the same documents as json_parse, over
+*				known documents and many changed ones, and gives the same tree.
+*				Only what json_parse lets through that is not JSON, like a comma
+*				before a closing bracket, the tape rejects.
+*	find		json_find passes over members whose strings hold brackets and
+*				quotes, finds every member the tape finds at the same text, and
+*				stays inside the text when it is changed or cut short.
+*	stream		json_stream takes the same documents as json_tape_parse, and
+*				numbers only as the JSON grammar has them.
+*
+*	Built with JSON_NO_DOUBLE as json_check_no_double, the numbers are checked
+*	as json_fixed instead, with the errors for numbers that do not fit.
+*
+*	Exits with 1 if anything did not come out as expected.
+*/
+
+extern "C" {
+#include "json.h"
+}
+#include "json_stream.h"
+#include "json_tape.h"
+#include "wrf_memory.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+static int failures = 0;
+
+/*	Prints the result of a check, and what went wrong before it. */
+static void report(const char* name, int bad)
+{
+	printf("%-24s %s\n", name, bad ? "FAILED" : "ok");
+	if (bad)
+		failures++;
+}
+
+/*	A json_value as text, with names and strings at their full length so
+*	embedded zeros and missing terminators show.
+*/
+static std::string dump(const json_value* value)
+{
+	char number[64];
+	switch (value->type)
+	{
+	case json_object:
+	{
+		std::string text = "{";
+		for (unsigned int i = 0; i < value->u.object.length; i++) {
+			const json_object_entry* entry = &value->u.object.values[i];
+			text += std::string(entry->name, entry->name_length) + "#" + std::to_string(strlen(entry->name));
+			text += ":" + dump(entry->value) + ",";
+			if (entry->value->parent != value)
+				text += "<parent>";
+		}
+		return text + "}";
+	}
+	case json_array:
+	{
+		std::string text = "[";
+		for (unsigned int i = 0; i < value->u.array.length; i++)
+			text += dump(value->u.array.values[i]) + ",";
+		return text + "]";
+	}
+	case json_integer:
+		snprintf(number, sizeof(number), "%lld", (long long)value->u.integer);
+		return number;
+#ifndef JSON_NO_DOUBLE
+	case json_double:
+		snprintf(number, sizeof(number), "%.17g", value->u.dbl);
+		return number;
+#endif
+	case json_string:
+		return "\"" + std::string(value->u.string.ptr, value->u.string.length) + "\"#" + std::to_string(strlen(value->u.string.ptr));
+	case json_fixed:
+		snprintf(number, sizeof(number), "%lldf", (long long)value->u.integer);
+		return number;
+	case json_boolean:
+		return value->u.boolean ? "true" : "false";
+	case json_null:
+		return "null";
+	default:
+		snprintf(number, sizeof(number), "<type %d>", (int)value->type);
+		return number;
+	}
+}
+
+#pragma region Documents
+
+static const char* valid_documents[] = {
+	"{\"com.devicedrive.light\":{\"power\":1}}",
+	"{\"devicedrive\":{\"status\":{\"connection_status\":\"GOT_IP\",\"ip\":\"192.168.1.20\",\"visibility\":\"ON\"}}}",
+	"{\"interfaces\":[[\"com.devicedrive.light\",\"@power>b\",\"@brightness>i\"],[\"com.devicedrive.sensor\",\"@temperature>i\"]]}",
+	"{\"a\":[{\"b\":[[],[1],{}]},{\"c\\/d\":\"\\t\"}],\"e\":{}}",
+	"[1,-3,true,false,null,\"a\\\"b\"]",
+	"\"x\\u00e9\\ud83d\\ude00\\n\\/\"",
+	"  {\"k\" : \"v\" }  ",
+	"{\"\":0}",
+	"[[],{}]",
+	"[]",
+	"{}",
+	"12",
+};
+
+static const char* invalid_documents[] = {
+	"", "[", "]", "{,}", "[1,]", "{\"a\":1,}", "{\"a\"}", "{\"a\":}", "[01]", "[1.]",
+	"tru", "[1 2]", "1 2", "\"a", "{1:2}", "[\"\\u12\"]", "nul", "[}", "{]",
+};
+
+#define COUNT(ARRAY) (int)(sizeof(ARRAY) / sizeof(ARRAY[0]))
+
+/*	A document deeper and longer than the in place parser's first block and stack. */
+static std::string big_document()
+{
+	std::string text = "[";
+	for (int i = 0; i < 3000; i++)
+		text += "{\"k" + std::to_string(i) + "\":[" + std::to_string(i) + ",\"s\\n\"]},";
+	for (int i = 0; i < 40; i++)
+		text += "[";
+	for (int i = 0; i < 40; i++)
+		text += "]";
+	return text + "]";
+}
+
+#pragma endregion
+
+#pragma region Checks
+
+/*	Parses @ref text both ways and returns 1 if the trees differ. */
+static int compare_inplace(const std::string& text, size_t max_memory)
+{
+	json_value* expected = json_parse(text.data(), text.size());
+	std::string copy = text;
+	json_settings settings = {};
+	settings.max_memory = max_memory;
+	char error[json_error_max];
+	json_value* value = json_parse_inplace_ex(&settings, &copy[0], copy.size(), error);
+
+	std::string a = expected ? dump(expected) : "NULL";
+	std::string b = value ? dump(value) : "NULL";
+	// With a memory limit the in place parser may give up, but never differ
+	bool ok = a == b || (max_memory && !value);
+	if (!ok)
+		printf("    %.60s\n    json_parse         %.200s\n    json_parse_inplace %.200s\n", text.c_str(), a.c_str(), b.c_str());
+	json_value_free(expected);
+	json_value_free_inplace(value);
+	return ok ? 0 : 1;
+}
+
+static void check_inplace()
+{
+	wrf_memory_stats before, after;
+	wrf_get_memory_stats(&before);
+	int bad = 0;
+	for (int i = 0; i < COUNT(valid_documents); i++)
+		bad += compare_inplace(valid_documents[i], 0) + compare_inplace(valid_documents[i], 200);
+	for (int i = 0; i < COUNT(invalid_documents); i++)
+		bad += compare_inplace(invalid_documents[i], 0);
+
+	std::string big = big_document();
+	bad += compare_inplace(big, 0);
+	// Every way of cutting it short fails, and frees what was built
+	for (size_t length = 0; length < big.size(); length += 97) {
+		std::string text = big.substr(0, length);
+		json_value* value = json_parse_inplace(&text[0], text.size());
+		if (value) {
+			printf("    accepted the first %d bytes\n", (int)length);
+			json_value_free_inplace(value);
+			bad++;
+		}
+	}
+	wrf_get_memory_stats(&after);
+	if (after.bytes_live != before.bytes_live) {
+		printf("    %d bytes not freed\n", (int)(after.bytes_live - before.bytes_live));
+		bad++;
+	}
+	report("inplace", bad);
+}
+
+/*	Parses one number, NULL and the error in @ref error if it fails. */
+static json_value* parse_number(const char* text, char* error)
+{
+	json_settings settings = {};
+	error[0] = 0x0;
+	return json_parse_ex(&settings, text, strlen(text), error);
+}
+
+static const char* malformed_numbers[] = { "01", "-01", "1.", ".5", "1e", "1e+", "1.2.3", "-1.e3", "+1", "1-" };
+
+/*	A number and the json_integer or json_fixed it comes out as. */
+struct number_case {
+	const char* text;
+	json_type type;
+	long long integer;
+};
+
+#ifndef JSON_NO_DOUBLE
+
+static int ulp_distance(double a, double b)
+{
+	if (a == b)
+		return 0;
+	int64_t x, y;
+	memcpy(&x, &a, sizeof(x));
+	memcpy(&y, &b, sizeof(y));
+	int64_t distance = x > y ? x - y : y - x;
+	return distance > 1000 ? 1000 : (int)distance;
+}
+
+/*	Returns 1 if @ref text does not come out within @ref ulp of strtod. */
+static int check_double(const char* text, int ulp)
+{
+	char error[json_error_max];
+	json_value* value = parse_number(text, error);
+	double expected = strtod(text, NULL);
+	int bad = 0;
+	if (!value || value->type != json_double) {
+		printf("    %s is not a double: %s\n", text, error);
+		bad = 1;
+	}
+	else if (ulp_distance(value->u.dbl, expected) > ulp) {
+		printf("    %s is %.17g, not %.17g\n", text, value->u.dbl, expected);
+		bad = 1;
+	}
+	json_value_free(value);
+	return bad;
+}
+
+static const number_case integer_numbers[] = {
+	{ "0", json_integer, 0 },
+	{ "-0", json_integer, 0 },
+	{ "1013", json_integer, 1013 },
+	{ "-12", json_integer, -12 },
+	{ "9223372036854775807", json_integer, 9223372036854775807LL },
+	{ "-9223372036854775807", json_integer, -9223372036854775807LL },
+};
+
+static void check_numbers()
+{
+	int bad = 0;
+	char error[json_error_max];
+
+	for (int i = 0; i < COUNT(integer_numbers); i++) {
+		json_value* value = parse_number(integer_numbers[i].text, error);
+		if (!value || value->type != json_integer || value->u.integer != integer_numbers[i].integer) {
+			printf("    %s is not the integer %lld\n", integer_numbers[i].text, integer_numbers[i].integer);
+			bad++;
+		}
+		json_value_free(value);
+	}
+
+	// Exactly as strtod rounds them
+	static const char* exact[] = {
+		"1.5", "-1.25", "21.5", "1013.2", "0.1", "0.3", "1e3", "1E-3", "2.5e+2", "0.000123e3",
+		"4.35e-3", "1e22", "1e-22", "123.456e-7", "1e15", "-0.0", "3.14159265358979323846264338",
+		"123456789012345678901234567890", "9223372036854775808", "1.7976931348623157e308",
+		"2.2250738585072014e-308", "1e23",
+	};
+	for (int i = 0; i < COUNT(exact); i++)
+		bad += check_double(exact[i], i < 16 ? 0 : 4);
+
+	// The same over many numbers, exact within the range where it is promised
+	uint32_t seed = 1;
+	for (int i = 0; i < 200000; i++) {
+		char text[40];
+		int length = 0;
+		bool fast = i % 2 == 0;
+		int digits = 1 + (int)((seed = seed * 1103515245 + 12345) >> 16) % (fast ? 15 : 17);
+		text[length++] = (char)('1' + (seed >> 8) % 9);
+		for (int j = 1; j < digits; j++)
+			text[length++] = (char)('0' + ((seed = seed * 1103515245 + 12345) >> 16) % 10);
+		int exponent = (int)((seed = seed * 1103515245 + 12345) >> 16) % (fast ? 45 : 630);
+		snprintf(text + length, sizeof(text) - length, "e%d", exponent - (fast ? 22 : 320));
+		if (check_double(text, fast ? 0 : 4) && ++bad > 10)
+			break;
+	}
+
+	// Too large or too small for a double
+	json_value* value = parse_number("1e400", error);
+	if (!value || value->type != json_double || !(value->u.dbl > 1.7976931348623157e308)) {
+		printf("    1e400 is not infinite\n");
+		bad++;
+	}
+	json_value_free(value);
+	value = parse_number("-1e400", error);
+	if (!value || value->type != json_double || !(value->u.dbl < -1.7976931348623157e308)) {
+		printf("    -1e400 is not infinite\n");
+		bad++;
+	}
+	json_value_free(value);
+	value = parse_number("1e-400", error);
+	if (!value || value->type != json_double || value->u.dbl != 0) {
+		printf("    1e-400 is not 0\n");
+		bad++;
+	}
+	json_value_free(value);
+	value = parse_number("4.9e-324", error);
+	if (!value || value->type != json_double || value->u.dbl == 0) {
+		printf("    4.9e-324 is 0\n");
+		bad++;
+	}
+	json_value_free(value);
+
+	for (int i = 0; i < COUNT(malformed_numbers); i++) {
+		value = parse_number(malformed_numbers[i], error);
+		if (value) {
+			printf("    %s was accepted\n", malformed_numbers[i]);
+			bad++;
+		}
+		json_value_free(value);
+	}
+	report("numbers", bad);
+}
+
+#else
+
+static const number_case fixed_numbers[] = {
+	{ "12", json_integer, 12 },
+	{ "9223372036854775807", json_integer, 9223372036854775807LL },
+	{ "1.5", json_fixed, 1500 },
+	{ "-1.25", json_fixed, -1250 },
+	{ "1013.2", json_fixed, 1013200 },
+	{ "1E-3", json_fixed, 1 },
+	{ "0.0005", json_fixed, 0 },
+	{ "2.5e+2", json_fixed, 250000 },
+	{ "0.1", json_fixed, 100 },
+	{ "3.14159265358979323846264338", json_fixed, 3141 },
+	{ "1e-400", json_fixed, 0 },
+	{ "9223372036854775.807", json_fixed, 9223372036854775807LL },
+	{ "-9223372036854775.807", json_fixed, -9223372036854775807LL },
+	{ "922337203685477.5808", json_fixed, 922337203685477580LL },
+};
+
+static const char* too_large_numbers[] = {
+	"9223372036854775808", "-9223372036854775808", "123456789012345678901234567890",
+	"1e400", "9223372036854775.808", "12345678901234567.5", "1.7976931348623157e308",
+};
+
+static void check_numbers()
+{
+	int bad = 0;
+	char error[json_error_max];
+
+	for (int i = 0; i < COUNT(fixed_numbers); i++) {
+		const number_case* number = &fixed_numbers[i];
+		json_value* value = parse_number(number->text, error);
+		if (!value || value->type != number->type || value->u.integer != number->integer) {
+			printf("    %s is not %lld%s\n", number->text, number->integer, number->type == json_fixed ? "f" : "");
+			bad++;
+		}
+		json_value_free(value);
+	}
+
+	for (int i = 0; i < COUNT(too_large_numbers); i++) {
+		json_value* value = parse_number(too_large_numbers[i], error);
+		if (value || !strstr(error, "Number too large")) {
+			printf("    %s did not fail as too large: %s\n", too_large_numbers[i], error);
+			bad++;
+		}
+		json_value_free(value);
+	}
+
+	for (int i = 0; i < COUNT(malformed_numbers); i++) {
+		json_value* value = parse_number(malformed_numbers[i], error);
+		if (value) {
+			printf("    %s was accepted\n", malformed_numbers[i]);
+			bad++;
+		}
+		json_value_free(value);
+	}
+	report("numbers", bad);
+}
+
+#endif
+
+/*	A value on a tape as text in the form of @ref dump, so the two can be compared.
+*	Numbers that are not integers go through json_parse on their own, and the
+*	lookups by key and index must find every child the walk finds.
+*/
+static std::string dump_tape(const json_tape* tape, uint32_t value)
+{
+	char text[256];
+	size_t length;
+	switch (json_tape_type_of(tape, value))
+	{
+	case JSON_TAPE_OBJECT:
+	{
+		std::string result = "{";
+		for (uint32_t child = json_tape_first(tape, value); child != JSON_TAPE_END; child = json_tape_next(tape, value, child)) {
+			length = json_tape_string(tape, child - 1, text, sizeof(text));
+			result += std::string(text, length) + "#" + std::to_string(strlen(text));
+			result += ":" + dump_tape(tape, child) + ",";
+			if (json_tape_get(tape, value, text) == JSON_TAPE_END)
+				result += "<get>";
+		}
+		return result + "}";
+	}
+	case JSON_TAPE_ARRAY:
+	{
+		std::string result = "[";
+		uint32_t index = 0;
+		for (uint32_t child = json_tape_first(tape, value); child != JSON_TAPE_END; child = json_tape_next(tape, value, child), index++) {
+			result += dump_tape(tape, child) + ",";
+			if (json_tape_at(tape, value, index) != child)
+				result += "<at>";
+		}
+		if (index != json_tape_length(tape, value))
+			result += "<length>";
+		return result + "]";
+	}
+	case JSON_TAPE_NUMBER:
+	{
+		int64_t integer;
+		if (json_tape_int(tape, value, &integer))
+			return std::to_string((long long)integer);
+		const char* raw = json_tape_raw(tape, value, &length);
+		json_value* number = json_parse(raw, length);
+		std::string result = number ? dump(number) : "<number>";
+		json_value_free(number);
+		return result;
+	}
+	case JSON_TAPE_STRING:
+	{
+		length = json_tape_string(tape, value, text, sizeof(text));
+		std::string result = "\"" + std::string(text, length) + "\"#" + std::to_string(strlen(text));
+		if (!json_tape_equals(tape, value, text))
+			result += "<equals>";
+		return result;
+	}
+	case JSON_TAPE_TRUE:
+		return "true";
+	case JSON_TAPE_FALSE:
+		return "false";
+	case JSON_TAPE_NULL:
+		return "null";
+	default:
+		return "<none>";
+	}
+}
+
+/*	True if @ref text is not JSON only in ways json_parse lets through: a comma
+*	before a closing bracket, a minus sign without digits, an unknown escape or a
+*	control character in a string.
+*/
+static bool is_lenient(const std::string& text)
+{
+	bool in_string = false;
+	for (size_t i = 0; i < text.size(); i++) {
+		char c = text[i];
+		char next = i + 1 < text.size() ? text[i + 1] : 0x0;
+		if (in_string) {
+			if ((unsigned char)c < 0x20)
+				return true;
+			if (c == '\\') {
+				if (!next || !strchr("\"\\/bfnrtu", next))
+					return true;
+				i++;
+			}
+			else if (c == '"')
+				in_string = false;
+			continue;
+		}
+		if (c == '"')
+			in_string = true;
+		else if (c == '-' && !(next >= '0' && next <= '9'))
+			return true;
+		else if (c == ',') {
+			size_t j = text.find_first_not_of(" \t\r\n", i + 1);
+			if (j != std::string::npos && (text[j] == ']' || text[j] == '}'))
+				return true;
+		}
+	}
+	return false;
+}
+
+/*	Parses @ref text both ways and returns 1 if the tape accepts what json_parse
+*	does not, or gives a different tree, or rejects JSON that is not lenient.
+*/
+static int compare_tape(const std::string& text)
+{
+	uint32_t entries[256];
+	json_tape tape;
+	bool valid = json_tape_parse(&tape, text.data(), text.size(), entries, COUNT(entries));
+	json_value* expected = json_parse(text.data(), text.size());
+
+	std::string a = expected ? dump(expected) : "NULL";
+	std::string b = valid ? dump_tape(&tape, 0) : "NULL";
+	json_value_free(expected);
+	if (a == b || (!valid && is_lenient(text)))
+		return 0;
+	printf("    %.60s\n    json_parse      %.200s\n    json_tape_parse %.200s\n", text.c_str(), a.c_str(), b.c_str());
+	return 1;
+}
+
+/*	Not JSON, but json_parse takes them. */
+static const char* lenient_documents[] = {
+	"[1,]", "{\"a\":1,}", "[-]", "[\"\\q\"]", "[\"\t\"]",
+};
+
+static void check_tape()
+{
+	int bad = 0;
+	for (int i = 0; i < COUNT(valid_documents); i++)
+		bad += compare_tape(valid_documents[i]);
+	for (int i = 0; i < COUNT(invalid_documents); i++)
+		bad += compare_tape(invalid_documents[i]);
+	for (int i = 0; i < COUNT(invalid_documents); i++) {
+		json_tape tape;
+		uint32_t entries[16];
+		const char* text = invalid_documents[i];
+		if (!json_tape_parse(&tape, text, strlen(text), entries, COUNT(entries)) && tape.too_large) {
+			printf("    %s is too large, not invalid\n", text);
+			bad++;
+		}
+	}
+	for (int i = 0; i < COUNT(lenient_documents); i++) {
+		json_tape tape;
+		uint32_t entries[16];
+		const char* text = lenient_documents[i];
+		json_value* value = json_parse(text, strlen(text));
+		if (!value || json_tape_parse(&tape, text, strlen(text), entries, COUNT(entries))) {
+			printf("    %s is not taken by json_parse only\n", text);
+			bad++;
+		}
+		json_value_free(value);
+	}
+
+	// One entry per value and per key, and no more
+	const char* light = valid_documents[0];
+	uint32_t entries[5];
+	json_tape tape;
+	if (json_tape_parse(&tape, light, strlen(light), entries, 4) || tape.count != 0 || !tape.too_large) {
+		printf("    accepted with 4 entries, or not as too large\n");
+		bad++;
+	}
+	if (!json_tape_parse(&tape, light, strlen(light), entries, 5)) {
+		printf("    rejected with 5 entries\n");
+		bad++;
+	}
+	else if (JsonTapeValue(&tape)["com.devicedrive.light"]["power"].asInt() != 1
+			|| JsonTapeValue(&tape)["com.devicedrive.light"]["x"][3].type() != JSON_TAPE_NONE
+			|| JsonTapeValue(&tape)[-1].type() != JSON_TAPE_NONE) {
+		printf("    JsonTapeValue lookups\n");
+		bad++;
+	}
+
+	// The values as the types they are stored in
+	const char* light_on = "{\"power\":5,\"on\":true}";
+	uint32_t light_on_entries[5];
+	json_tape_parse(&tape, light_on, strlen(light_on), light_on_entries, COUNT(light_on_entries));
+	int power = JsonTapeValue(&tape)["power"].asInt();
+	bool on = JsonTapeValue(&tape)["on"].asBool();
+	if (power != 5 || !on || JsonTapeValue(&tape)["power"].asBool() || JsonTapeValue(&tape)["on"].asInt() != 0) {
+		printf("    JsonTapeValue power %d on %d\n", power, (int)on);
+		bad++;
+	}
+
+	// Changed a character or a few at a time, the two parsers still agree
+	std::string base = valid_documents[3];
+	const char* alphabet = "{}[]\":,\\u0a1-e.tfn ";
+	uint32_t seed = 1;
+	for (int i = 0; i < 100000 && bad <= 10; i++) {
+		std::string text = base;
+		int changes = 1 + (int)((seed = seed * 1103515245 + 12345) >> 16) % 4;
+		for (int j = 0; j < changes; j++) {
+			size_t at = ((seed = seed * 1103515245 + 12345) >> 16) % text.size();
+			char c = alphabet[((seed = seed * 1103515245 + 12345) >> 16) % strlen(alphabet)];
+			switch (((seed = seed * 1103515245 + 12345) >> 16) % 3) {
+			case 0: text[at] = c; break;
+			case 1: text.insert(at, 1, c); break;
+			default: text.erase(at, 1); break;
+			}
+			if (text.empty())
+				text = "1";
+		}
+		bad += compare_tape(text);
+	}
+	report("tape", bad);
+}
+
+/*	Brackets and escaped quotes inside strings, in members that are passed over. */
+static const char* find_document =
+	" { \"a\" : {\"x\":[1,{\"}\":\"]\"}], \"b\\u0041\" : 5, \"q\":\"\\\"}\"}, \"com.devicedrive.light\" : "
+	"{ \"brightness\":80, \"power\" : \"1\" , \"on\":true, \"n\":-12 , \"s\":\"h\\\"i\"} } ";
+
+/*	Looks up every member that can be reached through objects from @ref value with
+*	json_find_path and returns the number that do not give what the tape has.
+*/
+static int compare_find(const json_tape* tape, uint32_t value, const char** keys, int count)
+{
+	if (json_tape_type_of(tape, value) != JSON_TAPE_OBJECT || count == JSON_TAPE_MAX_DEPTH)
+		return 0;
+	int bad = 0;
+	char key[64];
+	for (uint32_t child = json_tape_first(tape, value); child != JSON_TAPE_END; child = json_tape_next(tape, value, child)) {
+		size_t length = json_tape_string(tape, child - 1, key, sizeof(key));
+		// json_find gives the first of keys that repeat
+		if (length >= sizeof(key) || strlen(key) != length || json_tape_get(tape, value, key) != child)
+			continue;
+		keys[count] = key;
+		json_slice found = json_find_path(tape->json, tape->length, keys, count + 1);
+		json_slice expected = json_tape_slice(tape, child);
+		if (found.type != json_tape_type_of(tape, child)
+				|| (expected.type != JSON_TAPE_NONE && (found.text != expected.text || found.length != expected.length))) {
+			printf("    %.60s\n    %s is %.*s\n", tape->json, key, (int)found.length, found.text ? found.text : "");
+			bad++;
+		}
+		bad += compare_find(tape, child, keys, count + 1);
+	}
+	return bad;
+}
+
+static void check_find()
+{
+	int bad = 0;
+	const char* text = find_document;
+	size_t length = strlen(text);
+	int64_t integer = 0;
+	char string[16];
+
+	json_slice slice = json_find(text, length, "com.devicedrive.light", "power");
+	if (!json_slice_int(&slice, &integer) || integer != 1) {
+		printf("    power\n");
+		bad++;
+	}
+	slice = json_find(text, length, "a", "bA");
+	if (!json_slice_int(&slice, &integer) || integer != 5) {
+		printf("    bA\n");
+		bad++;
+	}
+	slice = json_find(text, length, "com.devicedrive.light", "on");
+	if (!json_slice_bool(&slice)) {
+		printf("    on\n");
+		bad++;
+	}
+	slice = json_find(text, length, "com.devicedrive.light", "n");
+	if (!json_slice_int(&slice, &integer) || integer != -12) {
+		printf("    n\n");
+		bad++;
+	}
+	slice = json_find(text, length, "com.devicedrive.light", "s");
+	json_slice_string(&slice, string, sizeof(string));
+	if (strcmp(string, "h\"i") || !json_slice_equals(&slice, "h\"i")) {
+		printf("    s is %s\n", string);
+		bad++;
+	}
+	slice = json_find(text, length, "a", "x");
+	if (slice.type != JSON_TAPE_ARRAY || std::string(slice.text, slice.length) != "[1,{\"}\":\"]\"}]") {
+		printf("    x is %.*s\n", (int)slice.length, slice.text);
+		bad++;
+	}
+	slice = json_find(text, length, "a");
+	json_slice inner = json_find(slice.text, slice.length, "bA");
+	if (!json_slice_int(&inner, &integer) || integer != 5) {
+		printf("    bA in a\n");
+		bad++;
+	}
+	if (json_find(text, length, "a", "zz").type != JSON_TAPE_NONE
+			|| json_find(text, length, "a", "x", "y").type != JSON_TAPE_NONE
+			|| json_find(text, length, "}").type != JSON_TAPE_NONE) {
+		printf("    found a key that is not there\n");
+		bad++;
+	}
+
+	// Every member of the documents the tape takes, the way the tape finds it
+	const char* keys[JSON_TAPE_MAX_DEPTH];
+	uint32_t entries[256];
+	json_tape tape;
+	for (int i = 0; i < COUNT(valid_documents); i++) {
+		json_tape_parse(&tape, valid_documents[i], strlen(valid_documents[i]), entries, COUNT(entries));
+		bad += compare_find(&tape, 0, keys, 0);
+	}
+
+	// Changed and cut short, in a buffer of just that size so reading past it shows
+	std::string base = text;
+	const char* alphabet = "{}[]\":,\\ua1-";
+	uint32_t seed = 2;
+	for (int i = 0; i < 100000 && bad <= 10; i++) {
+		std::string changed = base;
+		int changes = 1 + (int)((seed = seed * 1103515245 + 12345) >> 16) % 3;
+		for (int j = 0; j < changes; j++) {
+			size_t at = ((seed = seed * 1103515245 + 12345) >> 16) % changed.size();
+			changed[at] = alphabet[((seed = seed * 1103515245 + 12345) >> 16) % strlen(alphabet)];
+		}
+		changed.resize(((seed = seed * 1103515245 + 12345) >> 16) % (changed.size() + 1));
+		char* buffer = (char*)malloc(changed.empty() ? 1 : changed.size());
+		memcpy(buffer, changed.data(), changed.size());
+		json_slice found = json_find(buffer, changed.size(), "com.devicedrive.light", "s");
+		json_slice_string(&found, string, sizeof(string));
+		json_slice_equals(&found, "x");
+		found = json_find(buffer, changed.size(), "a", "x");
+		json_slice_int(&found, &integer);
+		if (found.type != JSON_TAPE_NONE && (found.text < buffer || found.text + found.length > buffer + changed.size())) {
+			printf("    %s\n    gave a value outside the text\n", changed.c_str());
+			bad++;
+		}
+		if (json_tape_parse(&tape, buffer, changed.size(), entries, COUNT(entries)))
+			bad += compare_find(&tape, 0, keys, 0);
+		free(buffer);
+	}
+	report("find", bad);
+}
+
+/*	Keeps the text of the last number token. */
+static void on_number(const json_token* token, void* user_data)
+{
+	if (token->type == JSON_TOKEN_NUMBER)
+		*(std::string*)user_data = std::string(token->text, token->length);
+}
+
+/*	Feeds @ref text to a json_stream and returns whether it took it as one value. */
+static bool stream_valid(const std::string& text, std::string* number)
+{
+	json_stream stream;
+	json_stream_init(&stream, on_number, number);
+	for (size_t i = 0; i < text.size(); i++)
+		if (!json_stream_feed(&stream, text[i]))
+			return false;
+	return json_stream_finish(&stream);
+}
+
+/*	Returns 1 if the stream and the tape do not agree on whether @ref text is JSON. */
+static int compare_stream(const std::string& text)
+{
+	uint32_t entries[256];
+	json_tape tape;
+	std::string number;
+	bool expected = json_tape_parse(&tape, text.data(), text.size(), entries, COUNT(entries));
+	if (stream_valid(text, &number) == expected)
+		return 0;
+	printf("    %.60s\n    json_stream %s it, json_tape_parse does not\n", text.c_str(), expected ? "rejects" : "takes");
+	return 1;
+}
+
+static const char* stream_numbers[] = {
+	"0", "-0", "12", "-12.5e+3", "1E-7", "0.5", "1e1", "-0.0e0", "9223372036854775808",
+};
+
+static const char* stream_malformed[] = {
+	"-", "1-2", "1..2", "1e", "1e+", "1E+-2", "-a", "--1", "1.e3", "[-]", "[1e]", "{\"a\":1.}", "[1-2]", "[00]",
+};
+
+static void check_stream()
+{
+	int bad = 0;
+	std::string number;
+	for (int i = 0; i < COUNT(stream_numbers); i++) {
+		if (!stream_valid(stream_numbers[i], &number) || number != stream_numbers[i]) {
+			printf("    %s came out as %s\n", stream_numbers[i], number.c_str());
+			bad++;
+		}
+		bad += compare_stream(stream_numbers[i]);
+	}
+	for (int i = 0; i < COUNT(stream_malformed); i++) {
+		if (stream_valid(stream_malformed[i], &number)) {
+			printf("    %s was accepted\n", stream_malformed[i]);
+			bad++;
+		}
+		bad += compare_stream(stream_malformed[i]);
+	}
+	for (int i = 0; i < COUNT(malformed_numbers); i++)
+		bad += compare_stream(malformed_numbers[i]);
+	for (int i = 0; i < COUNT(valid_documents); i++)
+		bad += compare_stream(valid_documents[i]);
+	for (int i = 0; i < COUNT(invalid_documents); i++)
+		bad += compare_stream(invalid_documents[i]);
+	for (int i = 0; i < COUNT(lenient_documents); i++)
+		bad += compare_stream(lenient_documents[i]);
+
+	// Changed a character or a few at a time, mostly in the numbers
+	std::string base = "{\"a\":[-1.5e3,0,{\"b\":[12,-0.25]}],\"c\":1E+2}";
+	const char* alphabet = "0123456789.eE+-,]} ";
+	uint32_t seed = 3;
+	for (int i = 0; i < 100000 && bad <= 10; i++) {
+		std::string text = base;
+		int changes = 1 + (int)((seed = seed * 1103515245 + 12345) >> 16) % 3;
+		for (int j = 0; j < changes; j++) {
+			size_t at = ((seed = seed * 1103515245 + 12345) >> 16) % text.size();
+			char c = alphabet[((seed = seed * 1103515245 + 12345) >> 16) % strlen(alphabet)];
+			switch (((seed = seed * 1103515245 + 12345) >> 16) % 3) {
+			case 0: text[at] = c; break;
+			case 1: text.insert(at, 1, c); break;
+			default: text.erase(at, 1); break;
+			}
+		}
+		bad += compare_stream(text);
+	}
+	report("stream", bad);
+}
+
+#pragma endregion
+
+int main(int argc, char** argv)
+{
+	check_inplace();
+	check_numbers();
+	check_tape();
+	check_find();
+	check_stream();
+	return failures ? 1 : 0;
+}
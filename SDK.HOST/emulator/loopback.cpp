@@ -0,0 +1,457 @@
+/*	Copyright 2017 DeviceDrive AS
+*
+*	Licensed under the Apache License, Version 2.0 (the "License");
+*	you may not use this file except in compliance with the License.
+*	You may obtain a copy of the License at
+*
+*	http ://www.apache.org/licenses/LICENSE-2.0
+*
+*	Unless required by applicable law or agreed to in writing, software
+*	distributed under the License is distributed on an "AS IS" BASIS,
+*	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*	See the License for the specific language governing permissions and
+*	limitations under the License.
+*
+*/
+
+/*	Runs the SDK against the emulator in one process with a simulated clock, goes
+*	through every exchange the emulator knows and checks the callbacks. Prints the
+*	simulated time each exchange takes on the configured link.
+*
+*		loopback [baud rate] [latency us] [file size] [trace file]
+*
+*	With a trace file, the SDK's event trace is written to it for wrf_trace_decode.
+*	Exits with 1 if anything did not happen as expected.
+*/
+
+#include "wrf01_emulator.h"
+#include "wrf_sdk.h"
+#include "wrf_keywords.h"
+#include <algorithm>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+static Wrf01Emulator* emulator;
+static WRF* wrf;
+static uint64_t now_us = 0;
+static int failures = 0;
+
+static std::vector<std::string> events;
+static std::vector<unsigned char> file;
+static FILE* trace_file;
+
+#pragma region Link
+
+static uint32_t write_to_emulator(unsigned char* data, int length)
+{
+	emulator->input(data, length, now_us);
+	return 0;
+}
+
+static uint32_t write_segments_to_emulator(const wrf_segment* segments, int count)
+{
+	for (int i = 0; i < count; i++)
+		emulator->input(segments[i].data, segments[i].length, now_us);
+	return 0;
+}
+
+/*	Delivers the emulator's answers at the time they arrive until nothing more is
+*	going to happen, and returns the simulated time that took.
+*/
+static uint64_t run()
+{
+	uint64_t start = now_us;
+	unsigned char buffer[64];
+
+	for (;;) {
+		wrf->handleSendQueue();
+		// An exchange that never ends, like a packet NAKed forever, fails its check
+		if (emulator->idle() || now_us - start > 60000000)
+			break;
+
+		uint64_t next = emulator->nextOutputTime();
+		if (next > now_us)
+			now_us = next;
+		int length;
+		while ((length = emulator->output(buffer, sizeof(buffer), now_us)) > 0)
+			for (int i = 0; i < length; i++)
+				wrf->registerChar((char)buffer[i]);
+	}
+	return now_us - start;
+}
+
+static uint32_t trace_clock()
+{
+	return (uint32_t)now_us;
+}
+
+static uint32_t write_trace(unsigned char* data, int length)
+{
+	return fwrite(data, 1, length, trace_file) == (size_t)length ? 0 : 1;
+}
+
+#pragma endregion
+
+#pragma region Callbacks
+
+static void add_event(const char* format, ...)
+{
+	char event[256];
+	va_list args;
+	va_start(args, format);
+	vsnprintf(event, sizeof(event), format, args);
+	va_end(args);
+	events.push_back(event);
+}
+
+static void on_power_up() { add_event("power_up"); }
+static void on_sent() { add_event("sent"); }
+static void on_error(wrf_error* error) { add_event("error %s", error->msg); }
+static void on_message(char* msg) { add_event("message %.*s", (int)strcspn(msg, "\x04"), msg); }
+static void on_message_parsed(const json_tape* message, const char* raw, size_t length, wrf_parse_result result)
+{
+	if (message)
+		add_event("parsed power %d length %d", (int)JsonTapeValue(message)["com.devicedrive.light"]["power"].asInt(), (int)length);
+	else
+		add_event("not parsed %s length %d", result == WRF_PARSE_TOO_LARGE ? "too large" : "not json", (int)length);
+}
+static void on_connected(wrf_device_state* state) { add_event("connected %s %d", state->mac, state->rssi); }
+static void on_status(wrf_status* status) { add_event("status %d %s %d", status->connection_status, status->ip_addr, status->successful_transfer_count); }
+static void on_time(wrf_time* time) { add_event("time %d-%02d-%02d", time->year, time->month, time->day); }
+static void on_client_packet(ota_packet* packet) { add_event("client_packet %d %08x", packet->size, (unsigned)packet->crc); }
+static void on_send_file(wrf_send_file_status* status) { add_event("send_file %s", status->msg); }
+
+static void on_upgrades(wrf_module_list* list)
+{
+	std::string modules;
+	for (int i = 0; i < list->size; i++)
+		modules += list->modules[i] == OTA_WRF01 ? " WRF01" : " CLIENT";
+	add_event("upgrades%s", modules.c_str());
+}
+
+static int read_file(int offset, unsigned char* dst, int max_length)
+{
+	memcpy(dst, &file[offset], max_length);
+	return max_length;
+}
+
+/*	Hands the file over one packet at a time from a single buffer, and spoils
+*	the buffer as soon as the WRF has it.
+*/
+static int handler_offset;
+
+static void send_packet(int max_length)
+{
+	static unsigned char buffer[4096];
+	int length = max_length < (int)sizeof(buffer) ? max_length : (int)sizeof(buffer);
+	memcpy(buffer, &file[handler_offset], length);
+	handler_offset += length;
+	wrf->sendFilePacket(buffer, length);
+	memset(buffer, 0xAA, length);
+}
+
+#pragma endregion
+
+/*	Checks that an exchange produced exactly @ref expected events. */
+static void check(const char* name, uint64_t time, std::vector<std::string> expected)
+{
+	bool ok = events == expected;
+	printf("%-24s %8.2f ms  %s\n", name, time / 1000.0, ok ? "ok" : "FAILED");
+	if (!ok) {
+		failures++;
+		for (size_t i = 0; i < events.size(); i++)
+			printf("    got      %s\n", events[i].c_str());
+		for (size_t i = 0; i < expected.size(); i++)
+			printf("    expected %s\n", expected[i].c_str());
+	}
+	events.clear();
+}
+
+/*	Runs one exchange and checks that it produced exactly @ref expected events. */
+static void expect(const char* name, std::vector<std::string> expected)
+{
+	uint64_t time = run();
+	check(name, time, expected);
+}
+
+#pragma region Several WRFs
+
+/*	A WRF made with WRF::create and the emulator on the other end of its link. */
+struct Module {
+	int number;
+	Wrf01Emulator* emulator;
+	WRF* wrf;
+};
+
+static uint32_t write_to_module(WRF* wrf, const wrf_segment* segments, int count)
+{
+	Module* module = (Module*)wrf->getUserData();
+	for (int i = 0; i < count; i++)
+		module->emulator->input(segments[i].data, segments[i].length, now_us);
+	return 0;
+}
+
+static void on_module_response(WRF* wrf, wrf_result_code code, void* object)
+{
+	Module* module = (Module*)wrf->getUserData();
+	if (code == WRF_MESSAGE)
+		add_event("module %d message %.*s", module->number, (int)strcspn((char*)object, "\x04"), (char*)object);
+	else if (code == WRF_STATUS)
+		add_event("module %d status %d", module->number, ((wrf_status*)object)->connection_status);
+	else
+		add_event("module %d result %d", module->number, code);
+}
+
+/*	Same as @ref run, for all the modules at once. */
+static uint64_t run_modules(std::vector<Module>& modules)
+{
+	uint64_t start = now_us;
+	unsigned char buffer[64];
+
+	for (;;) {
+		uint64_t next = UINT64_MAX;
+		for (size_t i = 0; i < modules.size(); i++) {
+			modules[i].wrf->handleSendQueue();
+			if (!modules[i].emulator->idle() && modules[i].emulator->nextOutputTime() < next)
+				next = modules[i].emulator->nextOutputTime();
+		}
+		if (next == UINT64_MAX)
+			break;
+
+		if (next > now_us)
+			now_us = next;
+		for (size_t i = 0; i < modules.size(); i++) {
+			int length;
+			while ((length = modules[i].emulator->output(buffer, sizeof(buffer), now_us)) > 0)
+				modules[i].wrf->registerBytes(buffer, length);
+		}
+	}
+	return now_us - start;
+}
+
+/*	Polls and asks for status on several WRFs at once, and checks that every
+*	answer goes to the WRF whose emulator sent it.
+*/
+static void check_modules(const wrf01_emulator_config& config, int count)
+{
+	std::vector<Module> modules(count);
+	for (int i = 0; i < count; i++) {
+		modules[i].number = i;
+		modules[i].emulator = new Wrf01Emulator(config);
+		modules[i].wrf = WRF::create(write_to_module, &modules[i], 1024, 10);
+		modules[i].wrf->onResponse(on_module_response);
+
+		char message[64];
+		snprintf(message, sizeof(message), "{\"module\":%d}", i);
+		modules[i].emulator->queueCloudMessage(message);
+	}
+
+	std::vector<std::string> expected;
+	for (int i = 0; i < count; i++) {
+		modules[i].wrf->poll();
+		// The C API on the context of the WRF goes to its queue as well
+		wrf_ctx_ask_status(modules[i].wrf->getContext());
+
+		char event[64];
+		snprintf(event, sizeof(event), "module %d message {\"module\":%d}", i, i);
+		expected.push_back(event);
+		snprintf(event, sizeof(event), "module %d status %d", i, WRF_GOT_IP);
+		expected.push_back(event);
+	}
+
+	uint64_t time = run_modules(modules);
+	// Answers come in the order they were sent in, per module
+	std::stable_sort(events.begin(), events.end(), [](const std::string& a, const std::string& b) {
+		return a.compare(0, 9, b, 0, 9) < 0;
+	});
+	check("several WRFs", time, expected);
+
+	for (int i = 0; i < count; i++) {
+		delete modules[i].wrf;
+		delete modules[i].emulator;
+	}
+}
+
+#pragma endregion
+
+int main(int argc, char** argv)
+{
+	wrf01_emulator_config config;
+	WRF01_EMULATOR_DEFAULT_CONFIG(config);
+	if (argc > 1) config.baud_rate = atoi(argv[1]);
+	if (argc > 2) config.latency_us = atoi(argv[2]);
+	int file_size = argc > 3 ? atoi(argv[3]) : 20000;
+	const char* trace_name = argc > 4 ? argv[4] : NULL;
+	config.nak_every = 5;
+
+	emulator = new Wrf01Emulator(config);
+	wrf = WRF::createInstance(write_to_emulator, 1024, 10);
+	wrf->setSegmentWriter(write_segments_to_emulator);
+	wrf->onPowerUp(on_power_up);
+	wrf->onMessageSent(on_sent);
+	wrf->onError(on_error);
+	wrf->onMessageReceived(on_message);
+	wrf->onMessageParsed(on_message_parsed);
+	wrf->onConnected(on_connected);
+	wrf->onStatusReceived(on_status);
+	wrf->onTimeReceived(on_time);
+	wrf->onPendingUpgrades(on_upgrades);
+	wrf->onReceivedClientUpgrade(on_client_packet);
+	wrf->onSendFileEvents(on_send_file);
+	if (trace_name)
+		wrf->setTraceClock(trace_clock);
+
+	printf("%d baud, %d us latency\n", config.baud_rate, config.latency_us);
+
+	if (!wrf_keyword_table_is_current())
+		add_event("wrf_keywords_table.h is not generated from the keywords, run tools/wrf_keywords.py");
+	check("keyword table", 0, {});
+
+	emulator->powerUp(now_us);
+	expect("power up", { "power_up" });
+
+	wrf_config setup;
+	DEFAULT_WRF_CONFIG(setup);
+	setup.product_key = (char*)"product";
+	setup.version = (char*)"1.0";
+	wrf->send_config(setup);
+	expect("setup", {});
+
+	wrf->setVisibility(60, true);
+	expect("setup and connect", { "connected A020A6123456 -55" });
+
+	wrf->requestStatus();
+	expect("status", { "status 2 192.168.1.20 0" });
+
+	emulator->setBusy(1);
+	wrf->requestStatus();
+	expect("status when busy", { "error SYSTEM_BUSY", "status 2 192.168.1.20 0" });
+
+	wrf->requestTime();
+	expect("get_time", { "time 2017-07-14" });
+
+	// Reported at once, while the status request is still waiting for its answer
+	std::string introspect = "\"introspect\":\"" + std::string(WRF_MESSAGE_MAX_SIZE, 'x') + "\"";
+	wrf->requestStatus();
+	wrf->sendIntrospect((char*)introspect.c_str());
+	expect("command too long", { "error " LIB_ERROR_COMMAND_TOO_LONG_STR, "status 2 192.168.1.20 0" });
+
+	emulator->queueCloudMessage("{\"com.devicedrive.light\":{\"power\":1}}");
+	emulator->queueCloudMessage("{\"com.devicedrive.light\":{\"power\":0}}");
+	wrf->poll();
+	wrf->poll();
+	wrf->poll();
+	expect("poll", {
+		"parsed power 1 length 37",
+		"message {\"com.devicedrive.light\":{\"power\":1}}",
+		"parsed power 0 length 37",
+		"message {\"com.devicedrive.light\":{\"power\":0}}" });
+
+	// Ordinary messages parse up to the size of the receive buffer, others say why not
+	std::string large = "{\"com.devicedrive.light\":{\"power\":1";
+	for (int i = 0; i < 40; i++)
+		large += ",\"setting" + std::to_string(i) + "\":\"value\"";
+	large += "}}";
+	std::string dense = "[0";
+	for (int i = 0; i < 300; i++)
+		dense += ",0";
+	dense += "]";
+	std::string malformed = "{\"com.devicedrive.light\":{\"power\":-}}";
+	for (const std::string* message : { &large, &dense, &malformed }) {
+		emulator->queueCloudMessage(message->c_str());
+		wrf->poll();
+	}
+	char large_event[32], dense_event[48], malformed_event[48];
+	snprintf(large_event, sizeof(large_event), "parsed power 1 length %d", (int)large.size());
+	snprintf(dense_event, sizeof(dense_event), "not parsed too large length %d", (int)dense.size());
+	snprintf(malformed_event, sizeof(malformed_event), "not parsed not json length %d", (int)malformed.size());
+	expect("parsed message sizes", {
+		large_event, ("message " + large).substr(0, 255),
+		dense_event, ("message " + dense).substr(0, 255),
+		malformed_event, "message " + malformed });
+
+	wrf->send((char*)"{\"com.devicedrive.light\":{\"power\":1}}");
+	wrf->sendWithoutReceive((char*)"{\"com.devicedrive.light\":{\"power\":0}}");
+	expect("send", { "sent", "sent" });
+
+	emulator->setPendingUpgrades({ WRF_OTA_WRF01_STR, WRF_OTA_CLIENT_STR });
+	wrf->checkPendingUpgrades();
+	expect("check_upgrade", { "upgrades WRF01 CLIENT" });
+
+	ota_params params;
+	DEFAULT_OTA_PARAMS(params);
+	params.module = OTA_CLIENT;
+	wrf->startClientUpgrade(params);
+	expect("get_upgrade", { "client_packet 22 357ebcf9" });
+
+	wrf->startWrfUpgrade();
+	expect("get_upgrade WRF01", { "power_up" });
+
+	for (int i = 0; i < file_size; i++)
+		file.push_back((unsigned char)(i * 7));
+	wrf->sendFile((char*)"file.bin", file_size, read_file);
+	uint64_t start = now_us;
+	expect("send_file", { "send_file " WRF_RESULT_FILE_SENT_STR });
+	if (emulator->lastFile() != file) {
+		printf("    received file differs\n");
+		failures++;
+	}
+	printf("%-24s %8.0f bytes/s with %d NAKs\n", "", file_size / ((now_us - start) / 1e6), emulator->stats().file_naks);
+
+	int naks = emulator->stats().file_naks;
+	handler_offset = 0;
+	wrf->sendFile((char*)"file.bin", file_size, send_packet);
+	expect("send_file handler", { "send_file " WRF_RESULT_FILE_SENT_STR });
+	if (emulator->lastFile() != file || emulator->stats().file_naks == naks) {
+		printf("    received file differs, or no packet was resent\n");
+		failures++;
+	}
+
+	emulator->config().cancel_after = 2;
+	wrf->sendFile((char*)"file.bin", file_size, read_file);
+	expect("send_file canceled", { "send_file " WRF_RESULT_FILE_CANCEL_STR });
+
+	// The wrf_ functions go to the instance
+	wrf_ask_status();
+	expect("wrf_ask_status", { "status 2 192.168.1.20 2" });
+
+	check_modules(config, 4);
+
+	const wrf01_emulator_stats& stats = emulator->stats();
+	printf("%d frames, %d commands, %lld bytes in, %lld bytes out, %.2f s\n",
+		stats.frames, stats.commands, stats.bytes_in, stats.bytes_out, now_us / 1e6);
+
+	wrf_memory_stats memory = WRF::getMemoryStats();
+	printf("SDK heap peak %d bytes\n", (int)memory.peak_bytes);
+	for (int i = 0; i < WRF_ALLOC_SITES; i++) {
+		const wrf_alloc_stats& site = memory.sites[i];
+		if (site.allocs)
+			printf("    %-20s %5u allocs %5u frees %6d bytes peak\n", wrf_alloc_site_name((wrf_alloc_site)i),
+				site.allocs, site.frees, (int)site.peak_bytes);
+	}
+
+	if (trace_name) {
+		trace_file = fopen(trace_name, "wb");
+		if (!trace_file) {
+			perror(trace_name);
+			return 1;
+		}
+		wrf->dumpTrace(write_trace);
+		fclose(trace_file);
+	}
+
+	WRF::freeInstance();
+	delete emulator;
+
+	// The emulator parses with json_parse too, so what is left there is not checked
+	memory = WRF::getMemoryStats();
+	if (memory.bytes_live != memory.sites[WRF_ALLOC_JSON].bytes_live) {
+		printf("SDK memory left after freeInstance\n");
+		failures++;
+	}
+	return failures ? 1 : 0;
+}
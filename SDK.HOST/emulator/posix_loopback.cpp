@@ -0,0 +1,263 @@
+/*	Copyright 2017 DeviceDrive AS
+*
+*	Licensed under the Apache License, Version 2.0 (the "License");
+*	you may not use this file except in compliance with the License.
+*	You may obtain a copy of the License at
+*
+*	http ://www.apache.org/licenses/LICENSE-2.0
+*
+*	Unless required by applicable law or agreed to in writing, software
+*	distributed under the License is distributed on an "AS IS" BASIS,
+*	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*	See the License for the specific language governing permissions and
+*	limitations under the License.
+*
+*/
+
+/*	Runs WRFPosix (SDK.POSIX) on one end of a pseudo terminal and the emulator on
+*	the other, in a thread with the real clock, and checks the callbacks the way
+*	loopback does.
+*
+*		posix_loopback [file size] [max packet size]
+*
+*	During the file transfer the emulator stops reading for a while, so the tty
+*	fills up and WRFPosix has to finish its writes when there is room again.
+*	Exits with 1 if anything did not happen as expected.
+*/
+
+#include "wrf01_emulator.h"
+#include "wrf_posix.h"
+#include <atomic>
+#include <errno.h>
+#include <fcntl.h>
+#include <mutex>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <termios.h>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+static Wrf01Emulator* emulator;
+static std::mutex emulator_lock;
+static std::atomic<bool> stop(false);
+static std::atomic<int> stall_after_packet(0);
+static WRFPosix* wrf;
+static int failures = 0;
+static std::vector<std::string> events;
+static std::vector<unsigned char> file;
+
+static uint64_t now_us()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+#pragma region Emulator thread
+
+static int open_pty(char* name, size_t size)
+{
+	int master = posix_openpt(O_RDWR | O_NOCTTY);
+	if (master < 0 || grantpt(master) < 0 || unlockpt(master) < 0)
+		return -1;
+	const char* slave_name = ptsname(master);
+	if (!slave_name)
+		return -1;
+	snprintf(name, size, "%s", slave_name);
+
+	struct termios tio;
+	if (tcgetattr(master, &tio) == 0) {
+		cfmakeraw(&tio);
+		tcsetattr(master, TCSANOW, &tio);
+	}
+	return master;
+}
+
+static void run_emulator(int master)
+{
+	unsigned char buffer[4096];
+	bool stalled = false;
+	while (!stop.load()) {
+		int timeout = 10;
+		{
+			std::lock_guard<std::mutex> lock(emulator_lock);
+			uint64_t now = now_us(), next = emulator->nextOutputTime();
+			if (next != UINT64_MAX)
+				timeout = next > now ? (int)((next - now + 999) / 1000) : 0;
+			if (timeout > 10)
+				timeout = 10;
+
+			int packet = stall_after_packet.load();
+			if (packet && emulator->stats().file_packets == packet && !stalled) {
+				stalled = true;
+				timeout = -2;
+			}
+		}
+		if (timeout == -2) {
+			// The WRF keeps writing the next packet, until the tty is full
+			usleep(200000);
+			continue;
+		}
+
+		struct pollfd pfd = { master, POLLIN, 0 };
+		int ready = poll(&pfd, 1, timeout);
+		std::lock_guard<std::mutex> lock(emulator_lock);
+		if (ready > 0 && (pfd.revents & POLLIN)) {
+			ssize_t length = read(master, buffer, sizeof(buffer));
+			if (length > 0)
+				emulator->input(buffer, (int)length, now_us());
+		}
+		int length;
+		while ((length = emulator->output(buffer, sizeof(buffer), now_us())) > 0)
+			if (write(master, buffer, length) < 0)
+				break;
+	}
+}
+
+#pragma endregion
+
+#pragma region Callbacks
+
+static void add_event(const char* format, ...)
+{
+	char event[256];
+	va_list args;
+	va_start(args, format);
+	vsnprintf(event, sizeof(event), format, args);
+	va_end(args);
+	events.push_back(event);
+}
+
+static void on_power_up() { add_event("power_up"); }
+static void on_sent() { add_event("sent"); }
+static void on_error(wrf_error* error) { add_event("error %s", error->msg); }
+static void on_message(char* msg) { add_event("message %.*s", (int)strcspn(msg, "\x04"), msg); }
+static void on_connected(wrf_device_state* state) { add_event("connected %s %d", state->mac, state->rssi); }
+static void on_send_file(wrf_send_file_status* status) { add_event("send_file %s", status->msg); }
+
+static int read_file(int offset, unsigned char* dst, int max_length)
+{
+	memcpy(dst, &file[offset], max_length);
+	return max_length;
+}
+
+#pragma endregion
+
+/*	Runs the WRF until @ref expected events have happened or five seconds have
+*	passed, and checks them.
+*/
+static void expect(const char* name, std::vector<std::string> expected)
+{
+	uint64_t start = now_us();
+	while (events.size() < expected.size() && now_us() - start < 5000000)
+		if (wrf->runOnce(50) < 0) {
+			perror("runOnce");
+			break;
+		}
+	// Anything more that is on its way
+	while (wrf->runOnce(20) > 0)
+		;
+
+	bool ok = events == expected;
+	printf("%-24s %8.2f ms  %s\n", name, (now_us() - start) / 1000.0, ok ? "ok" : "FAILED");
+	if (!ok) {
+		failures++;
+		for (size_t i = 0; i < events.size(); i++)
+			printf("    got      %s\n", events[i].c_str());
+		for (size_t i = 0; i < expected.size(); i++)
+			printf("    expected %s\n", expected[i].c_str());
+	}
+	events.clear();
+}
+
+int main(int argc, char** argv)
+{
+	int file_size = argc > 1 ? atoi(argv[1]) : 200000;
+	wrf01_emulator_config config;
+	WRF01_EMULATOR_DEFAULT_CONFIG(config);
+	config.baud_rate = 921600;
+	config.latency_us = 1000;
+	config.max_packet_size = argc > 2 ? atoi(argv[2]) : 65536;
+
+	char name[128];
+	int master = open_pty(name, sizeof(name));
+	if (master < 0) {
+		perror("pty");
+		return 1;
+	}
+	wrf = WRFPosix::open(name, 921600);
+	if (!wrf) {
+		perror(name);
+		return 1;
+	}
+	wrf->onPowerUp(on_power_up);
+	wrf->onMessageSent(on_sent);
+	wrf->onError(on_error);
+	wrf->onMessageReceived(on_message);
+	wrf->onConnected(on_connected);
+	wrf->onSendFileEvents(on_send_file);
+
+	emulator = new Wrf01Emulator(config);
+	std::thread emulator_thread(run_emulator, master);
+	printf("%s\n", name);
+
+	{
+		std::lock_guard<std::mutex> lock(emulator_lock);
+		emulator->powerUp(now_us());
+	}
+	expect("power up", { "power_up" });
+
+	wrf_config setup;
+	DEFAULT_WRF_CONFIG(setup);
+	setup.product_key = (char*)"product";
+	setup.version = (char*)"1.0";
+	wrf->send_config(setup);
+	wrf->setVisibility(60, true);
+	expect("setup and connect", { "connected A020A6123456 -55" });
+
+	{
+		std::lock_guard<std::mutex> lock(emulator_lock);
+		emulator->queueCloudMessage("{\"com.devicedrive.light\":{\"power\":1}}");
+	}
+	wrf->startPoll(100);
+	expect("poll timer", { "message {\"com.devicedrive.light\":{\"power\":1}}" });
+	wrf->stopPoll();
+
+	wrf->send((char*)"{\"com.devicedrive.light\":{\"power\":1}}");
+	expect("send", { "sent" });
+
+	for (int i = 0; i < file_size; i++)
+		file.push_back((unsigned char)(i * 7));
+	stall_after_packet = 1;
+	wrf->sendFile((char*)"file.bin", file_size, read_file);
+	expect("send_file", { "send_file " WRF_RESULT_FILE_SENT_STR });
+	{
+		std::lock_guard<std::mutex> lock(emulator_lock);
+		if (emulator->lastFile() != file) {
+			printf("    received file differs\n");
+			failures++;
+		}
+	}
+
+	const wrf_posix_stats& stats = wrf->stats();
+	printf("%llu bytes in by %u reads, %llu bytes out, %u partial writes, %u polls\n",
+		(unsigned long long)stats.bytes_read, stats.reads, (unsigned long long)stats.bytes_written,
+		stats.partial_writes, stats.polls);
+	if (stats.partial_writes == 0 && file_size > 0) {
+		printf("    the tty never filled up, partial writes were not tried\n");
+		failures++;
+	}
+
+	stop = true;
+	emulator_thread.join();
+	delete wrf;
+	delete emulator;
+	close(master);
+	return failures ? 1 : 0;
+}
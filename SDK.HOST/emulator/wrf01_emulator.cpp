@@ -0,0 +1,446 @@
+/*	Copyright 2017 DeviceDrive AS
+*
+*	Licensed under the Apache License, Version 2.0 (the "License");
+*	you may not use this file except in compliance with the License.
+*	You may obtain a copy of the License at
+*
+*	http ://www.apache.org/licenses/LICENSE-2.0
+*
+*	Unless required by applicable law or agreed to in writing, software
+*	distributed under the License is distributed on an "AS IS" BASIS,
+*	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*	See the License for the specific language governing permissions and
+*	limitations under the License.
+*
+*/
+
+#include "wrf01_emulator.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+extern "C" {
+#include "wrf.h"
+#include "json.h"
+#include "crc32.h"
+}
+
+#define ACK_BYTE 0x06
+#define NAK_BYTE 0x15
+#define CAN_BYTE 0x18
+#define FILE_PACKET_HEADER_SIZE 5
+#define FILE_PACKET_TRAILER_SIZE 5
+
+#define REBOOT_TIME_US 200000
+
+#pragma region Helpers
+
+/*	Returns the string member @ref name of the "devicedrive" object, or "" if
+*	there is none.
+*/
+static std::string command_param(json_value* root, const char* name)
+{
+	if (!root || root->type != json_object || root->u.object.length == 0)
+		return "";
+
+	json_value* object = root->u.object.values[0].value;
+	if (object->type != json_object)
+		return "";
+
+	for (unsigned int i = 0; i < object->u.object.length; i++) {
+		json_value* value = object->u.object.values[i].value;
+		if (strcmp(object->u.object.values[i].name, name) != 0)
+			continue;
+		if (value->type == json_string)
+			return std::string(value->u.string.ptr, value->u.string.length);
+		if (value->type == json_integer) {
+			char number[24];
+			snprintf(number, sizeof(number), "%lld", (long long)value->u.integer);
+			return number;
+		}
+	}
+	return "";
+}
+
+static bool is_command(json_value* root)
+{
+	return root && root->type == json_object && root->u.object.length == 1 &&
+		strcmp(root->u.object.values[0].name, WRF_LOCAL_RESPONSE_STR) == 0 &&
+		root->u.object.values[0].value->type == json_object;
+}
+
+#pragma endregion
+
+static wrf01_emulator_config default_config()
+{
+	wrf01_emulator_config config;
+	WRF01_EMULATOR_DEFAULT_CONFIG(config);
+	return config;
+}
+
+Wrf01Emulator::Wrf01Emulator() :
+	Wrf01Emulator(default_config())
+{
+}
+
+Wrf01Emulator::Wrf01Emulator(const wrf01_emulator_config& config)
+{
+	_config = config;
+	memset(&_stats, 0, sizeof(_stats));
+	_mode = MODE_NORMAL;
+	_rx_line_free = 0;
+	_tx_line_free = 0;
+	_busy_count = 0;
+	_time_base = 1500000000;
+	_file_length = 0;
+	_file_packet_count = 0;
+	_nak_pending = false;
+}
+
+#pragma region Link
+
+uint64_t Wrf01Emulator::byteTime(int bytes)
+{
+	return (uint64_t)bytes * 10 * 1000000 / _config.baud_rate;
+}
+
+/*	Answers start @ref latency_us after @ref now, or when the line is free. */
+void Wrf01Emulator::send(const std::string& data, uint64_t now)
+{
+	uint64_t time = now + _config.latency_us;
+	if (time < _tx_line_free)
+		time = _tx_line_free;
+
+	for (size_t i = 0; i < data.size(); i++) {
+		time += byteTime(1);
+		Byte byte = { time, (unsigned char)data[i] };
+		_output.push_back(byte);
+	}
+	_tx_line_free = time;
+	_stats.bytes_out += data.size();
+}
+
+void Wrf01Emulator::sendFrame(const std::string& json, uint64_t now)
+{
+	send(json + (char)WRF_EOT, now);
+}
+
+void Wrf01Emulator::sendResult(const char* result, uint64_t now)
+{
+	sendFrame(std::string("{\"" WRF_LOCAL_RESPONSE_STR "\":{\"" WRF_RESULT_STR "\":\"") + result + "\"}}", now);
+}
+
+void Wrf01Emulator::sendError(const char* error, uint64_t now)
+{
+	sendFrame(std::string("{\"" WRF_LOCAL_RESPONSE_STR "\":{\"" WRF_ERROR_STR "\":\"") + error + "\"}}", now);
+}
+
+void Wrf01Emulator::powerUp(uint64_t now)
+{
+	_mode = MODE_NORMAL;
+	_frame.clear();
+	std::string power_up;
+	power_up += STX_CHAR;
+	power_up += ETX_CHAR;
+	send(power_up, now);
+}
+
+void Wrf01Emulator::input(const unsigned char* data, int length, uint64_t now)
+{
+	for (int i = 0; i < length; i++) {
+		uint64_t arrival = (now > _rx_line_free ? now : _rx_line_free) + byteTime(1);
+		_rx_line_free = arrival;
+		_stats.bytes_in++;
+
+		if (_mode == MODE_FILE) {
+			handleFileByte(data[i], arrival);
+			continue;
+		}
+
+		_frame += (char)data[i];
+		if (data[i] == (unsigned char)WRF_EOT)
+			handleFrame(arrival);
+	}
+}
+
+int Wrf01Emulator::output(unsigned char* dst, int max_length, uint64_t now)
+{
+	int length = 0;
+	while (length < max_length && !_output.empty() && _output.front().time <= now) {
+		dst[length++] = _output.front().value;
+		_output.pop_front();
+	}
+	return length;
+}
+
+uint64_t Wrf01Emulator::nextOutputTime()
+{
+	return _output.empty() ? UINT64_MAX : _output.front().time;
+}
+
+uint64_t Wrf01Emulator::inputDoneTime()
+{
+	return _rx_line_free;
+}
+
+bool Wrf01Emulator::idle()
+{
+	return _output.empty();
+}
+
+#pragma endregion
+
+#pragma region Protocol
+
+void Wrf01Emulator::handleFrame(uint64_t now)
+{
+	std::string frame = _frame.substr(0, _frame.size() - 1);
+	_frame.clear();
+	_stats.frames++;
+
+	if (frame.empty()) {
+		// Poll
+		_stats.polls++;
+		if (!_cloud_messages.empty()) {
+			sendFrame(_cloud_messages.front(), now);
+			_cloud_messages.pop_front();
+		}
+		else
+			sendResult(WRF_RESULT_EMPTY_STR, now);
+		return;
+	}
+
+	bool send_only = frame[frame.size() - 1] == ETX_CHAR;
+	if (send_only)
+		frame.erase(frame.size() - 1);
+
+	json_value* root = json_parse(frame.c_str(), frame.size());
+	if (is_command(root)) {
+		handleCommand(command_param(root, WRF_COMMAND_STR), frame, now);
+		json_value_free(root);
+		return;
+	}
+	if (root)
+		json_value_free(root);
+
+	// A message for the cloud, answered with a message from the cloud if there is one
+	_stats.messages++;
+	_sent_messages.push_back(frame);
+	if (!send_only && !_cloud_messages.empty()) {
+		sendFrame(_cloud_messages.front(), now);
+		_cloud_messages.pop_front();
+	}
+	else
+		sendResult(WRF_RESULT_SENT_STR, now);
+}
+
+void Wrf01Emulator::handleCommand(const std::string& command, const std::string& json, uint64_t now)
+{
+	_stats.commands++;
+	if (_busy_count > 0) {
+		_busy_count--;
+		_stats.busy++;
+		sendError(WRF_ERROR_SYSTEM_BUSY_STR, now);
+		now += _config.busy_latency_us;
+	}
+	answerCommand(command, json, now);
+}
+
+void Wrf01Emulator::answerCommand(const std::string& command, const std::string& json, uint64_t now)
+{
+	json_value* root = json_parse(json.c_str(), json.size());
+	char frame[512];
+
+	if (command == WRF_COMMAND_SETUP_STR) {
+		sendResult(WRF_RESULT_OK_STR, now);
+		if (command_param(root, WRF_SETUP_SILENT_CONNECT_STR) == "0") {
+			snprintf(frame, sizeof(frame),
+				"{\"" WRF_CONFIG_STR "\":{\"" WRF_CONFIG_MAC_STR "\":\"%s\"},\"" WRF_CONFIG_DEVICE_STATE_STR "\":{\"" WRF_CONFIG_RSSI_STR "\":\"%d\"}}",
+				_config.mac, _config.rssi);
+			sendFrame(frame, now);
+		}
+	}
+	else if (command == WRF_COMMAND_STATUS_STR) {
+		snprintf(frame, sizeof(frame),
+			"{\"" WRF_LOCAL_RESPONSE_STR "\":{\"" WRF_COMMAND_STATUS_STR "\":{"
+			"\"" WRF_STATUS_CONNECTION_STR "\":\"" WRF_GOT_IP_STR "\",\"" WRF_STATUS_IP_STR "\":\"%s\","
+			"\"" WRF_STATUS_VISIBILITY_STR "\":\"OFF\",\"" WRF_STATUS_LAST_ERROR_STR "\":\"" WRF_ERROR_NONE_STR "\","
+			"\"" WRF_STATUS_LAST_ERROR_MSG_STR "\":\"\",\"" WRF_STATUS_TRANSFERS_STR "\":\"%d\"}}}",
+			_config.ip, _stats.messages);
+		sendFrame(frame, now);
+	}
+	else if (command == WRF_COMMAND_GET_TIME_STR) {
+		time_t timestamp = (time_t)(_time_base + now / 1000000);
+		struct tm t;
+		gmtime_r(&timestamp, &t);
+		snprintf(frame, sizeof(frame),
+			"{\"" WRF_LOCAL_RESPONSE_STR "\":{\"" WRF_RESULT_TIME_STR "\":[%lld,%d,%d,%d,%d,%d,%d,%d,0,0]}}",
+			(long long)timestamp, t.tm_wday, t.tm_mday, t.tm_mon + 1, t.tm_year + 1900, t.tm_hour, t.tm_min, t.tm_sec);
+		sendFrame(frame, now);
+	}
+	else if (command == WRF_COMMAND_CHECK_UPGRADE_STR) {
+		std::string modules;
+		for (size_t i = 0; i < _pending_upgrades.size(); i++)
+			modules += (i ? ",\"" : "\"") + _pending_upgrades[i] + "\"";
+		sendFrame("{\"" WRF_LOCAL_RESPONSE_STR "\":{\"" WRF_COMMAND_UPGRADE_STR "\":[" + modules + "]}}", now);
+	}
+	else if (command == WRF_COMMAND_GET_UPGRADE_STR) {
+		if (command_param(root, WRF_OTA_MODULE_STR) == WRF_OTA_CLIENT_STR) {
+			static const unsigned char image[] = "emulated client image";
+			snprintf(frame, sizeof(frame),
+				"{\"" WRF_LOCAL_RESPONSE_STR "\":{\"" WRF_COMMAND_UPGRADE_STR "\":{\"" WRF_SIZE_STR "\":%d,\"crc\":%u}}}",
+				(int)sizeof(image), calcCrc((unsigned char*)image, sizeof(image)));
+			sendFrame(frame, now);
+		}
+		else {
+			sendResult(WRF_RESULT_OK_STR, now);
+			powerUp(now + REBOOT_TIME_US);
+		}
+	}
+	else if (command == WRF_COMMAND_SEND_FILE_STR) {
+		_file_name = command_param(root, WRF_SEND_FILE_FILE_NAME_STR);
+		_file_length = atoi(command_param(root, WRF_SEND_FILE_LENGTH_STR).c_str());
+		_file.clear();
+		_file_packet.clear();
+		_file_packet_count = 0;
+		_nak_pending = false;
+		_mode = MODE_FILE;
+		snprintf(frame, sizeof(frame),
+			"{\"" WRF_LOCAL_RESPONSE_STR "\":{\"" WRF_COMMAND_SEND_FILE_MAX_PACKET_SIZE_STR "\":\"%d\"}}",
+			_config.max_packet_size);
+		sendFrame(frame, now);
+	}
+	else if (command == WRF_COMMAND_REBOOT_STR) {
+		sendResult(WRF_RESULT_OK_STR, now);
+		powerUp(now + REBOOT_TIME_US);
+	}
+	else if (command == WRF_COMMAND_DEEP_SLEEP_STR || command == WRF_COMMAND_CLEAR_STR ||
+		command == WRF_COMMAND_FACTORY_RESET_STR || command == WRF_COMMAND_SMART_LINKUP_STR ||
+		command == WRF_COMMAND_INTROSPECT_STR) {
+		sendResult(WRF_RESULT_OK_STR, now);
+	}
+	else
+		sendError(WRF_ERROR_COMMAND_FAILED_STR, now);
+
+	if (root)
+		json_value_free(root);
+}
+
+/*	File packets are STX, a 32 bit length, the payload, a CRC32 and EOT, all little
+*	endian. An EOT instead of a packet ends the file.
+*/
+void Wrf01Emulator::handleFileByte(unsigned char c, uint64_t now)
+{
+	if (_file_packet.empty()) {
+		if (c == (unsigned char)WRF_EOT) {
+			_mode = MODE_NORMAL;
+			_stats.files++;
+			_last_file = _file;
+			if ((int)_file.size() == _file_length)
+				sendResult(WRF_RESULT_FILE_SENT_STR, now);
+			else
+				sendError(WRF_ERROR_COMMAND_FAILED_STR, now);
+			return;
+		}
+		if (c != (unsigned char)STX_CHAR)
+			return;
+	}
+
+	_file_packet.push_back(c);
+	if (_file_packet.size() < FILE_PACKET_HEADER_SIZE)
+		return;
+
+	uint32_t length;
+	memcpy(&length, &_file_packet[1], sizeof(length));
+	if (length > (uint32_t)_config.max_packet_size) {
+		_file_packet.clear();
+		_stats.file_naks++;
+		send(std::string(1, (char)NAK_BYTE), now);
+		return;
+	}
+	if (_file_packet.size() < FILE_PACKET_HEADER_SIZE + length + FILE_PACKET_TRAILER_SIZE)
+		return;
+
+	const unsigned char* payload = &_file_packet[FILE_PACKET_HEADER_SIZE];
+	uint32_t crc;
+	memcpy(&crc, payload + length, sizeof(crc));
+	bool valid = payload[length + 4] == (unsigned char)WRF_EOT &&
+		crc == calcCrc((unsigned char*)payload, length);
+
+	_stats.file_packets++;
+	_file_packet_count++;
+	bool inject_nak = _config.nak_every > 0 && !_nak_pending &&
+		_file_packet_count % _config.nak_every == 0;
+	if (!valid || inject_nak) {
+		_nak_pending = true;
+		_stats.file_naks++;
+		_file_packet.clear();
+		send(std::string(1, (char)NAK_BYTE), now);
+		return;
+	}
+
+	_nak_pending = false;
+	_file.insert(_file.end(), payload, payload + length);
+	_file_packet.clear();
+
+	if (_config.cancel_after > 0 && _file_packet_count >= _config.cancel_after) {
+		_mode = MODE_NORMAL;
+		_last_file = _file;
+		send(std::string(1, (char)CAN_BYTE), now);
+		sendResult(WRF_RESULT_FILE_CANCEL_STR, now);
+		return;
+	}
+	send(std::string(1, (char)ACK_BYTE), now);
+}
+
+#pragma endregion
+
+#pragma region Settings
+
+void Wrf01Emulator::queueCloudMessage(const char* json)
+{
+	_cloud_messages.push_back(json);
+}
+
+void Wrf01Emulator::setBusy(int count)
+{
+	_busy_count = count;
+}
+
+void Wrf01Emulator::setPendingUpgrades(const std::vector<std::string>& modules)
+{
+	_pending_upgrades = modules;
+}
+
+void Wrf01Emulator::setTime(uint64_t timestamp)
+{
+	_time_base = timestamp;
+}
+
+wrf01_emulator_config& Wrf01Emulator::config()
+{
+	return _config;
+}
+
+const wrf01_emulator_stats& Wrf01Emulator::stats()
+{
+	return _stats;
+}
+
+const std::vector<std::string>& Wrf01Emulator::sentMessages()
+{
+	return _sent_messages;
+}
+
+const std::vector<unsigned char>& Wrf01Emulator::lastFile()
+{
+	return _last_file;
+}
+
+const std::string& Wrf01Emulator::lastFileName()
+{
+	return _file_name;
+}
+
+#pragma endregion
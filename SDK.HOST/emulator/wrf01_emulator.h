@@ -0,0 +1,166 @@
+/*	Copyright 2017 DeviceDrive AS
+*
+*	Licensed under the Apache License, Version 2.0 (the "License");
+*	you may not use this file except in compliance with the License.
+*	You may obtain a copy of the License at
+*
+*	http ://www.apache.org/licenses/LICENSE-2.0
+*
+*	Unless required by applicable law or agreed to in writing, software
+*	distributed under the License is distributed on an "AS IS" BASIS,
+*	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*	See the License for the specific language governing permissions and
+*	limitations under the License.
+*
+*/
+
+/**@file
+*
+*	@brief		WRF01 emulator for running the SDK on a host
+*
+*	@details	Answers the WRF01 serial protocol the way the SDK expects it: power up,
+*				setup, status, poll with queued cloud messages, SYSTEM_BUSY, get_time,
+*				check/get_upgrade and send_file with ACK, NAK and CAN.
+*
+*				The emulator does no I/O itself. Bytes from the micro controller are
+*				given to @ref Wrf01Emulator::input and the answers are taken out with
+*				@ref Wrf01Emulator::output. Every byte is stamped with the time it
+*				arrives on the other end of the link, from the configured baud rate
+*				and response latency. The same emulator is used in process with a
+*				simulated clock and behind a pty with the real clock.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <deque>
+#include <string>
+#include <vector>
+
+/*	@brief	Emulator settings. */
+struct wrf01_emulator_config {
+	int baud_rate;				// Bits per second in both directions, 10 bits per byte
+	int latency_us;				// From the end of a command to the start of the answer
+	int busy_latency_us;		// From SYSTEM_BUSY to the real answer
+	int max_packet_size;		// Answer to send_file
+	int nak_every;				// NAK every n-th packet of a file once, 0 for never
+	int cancel_after;			// Send CAN after n packets of a file, 0 for never
+	int rssi;
+	const char* mac;
+	const char* ip;
+};
+
+#define WRF01_EMULATOR_DEFAULT_CONFIG(C)	\
+	C.baud_rate = 115200;					\
+	C.latency_us = 2000;					\
+	C.busy_latency_us = 50000;				\
+	C.max_packet_size = 512;				\
+	C.nak_every = 0;						\
+	C.cancel_after = 0;						\
+	C.rssi = -55;							\
+	C.mac = "A020A6123456";					\
+	C.ip = "192.168.1.20";
+
+/*	@brief	What the emulator has seen, for checking a session. */
+struct wrf01_emulator_stats {
+	int frames;
+	int commands;
+	int polls;
+	int messages;				// Messages from the micro controller to the cloud
+	int busy;
+	int file_packets;
+	int file_naks;
+	int files;
+	long long bytes_in;
+	long long bytes_out;
+};
+
+class Wrf01Emulator
+{
+private:
+	enum Mode {
+		MODE_NORMAL,
+		MODE_FILE
+	};
+
+	struct Byte {
+		uint64_t time;
+		unsigned char value;
+	};
+
+	wrf01_emulator_config _config;
+	wrf01_emulator_stats _stats;
+	Mode _mode;
+
+	std::string _frame;
+	std::deque<Byte> _output;
+	uint64_t _rx_line_free;		// When the last byte from the micro controller has arrived
+	uint64_t _tx_line_free;		// When the last answer byte has left
+
+	std::deque<std::string> _cloud_messages;
+	std::vector<std::string> _sent_messages;
+	std::vector<std::string> _pending_upgrades;
+	int _busy_count;
+	uint64_t _time_base;
+
+	std::string _file_name;
+	int _file_length;
+	std::vector<unsigned char> _file;
+	std::vector<unsigned char> _file_packet;
+	std::vector<unsigned char> _last_file;
+	int _file_packet_count;
+	bool _nak_pending;
+
+	uint64_t byteTime(int bytes);
+	void send(const std::string& data, uint64_t now);
+	void sendFrame(const std::string& json, uint64_t now);
+	void sendResult(const char* result, uint64_t now);
+	void sendError(const char* error, uint64_t now);
+
+	void handleFrame(uint64_t now);
+	void handleCommand(const std::string& command, const std::string& json, uint64_t now);
+	void answerCommand(const std::string& command, const std::string& json, uint64_t now);
+	void handleFileByte(unsigned char c, uint64_t now);
+
+public:
+	Wrf01Emulator();
+	Wrf01Emulator(const wrf01_emulator_config& config);
+
+	/*	@brief	Queues STX ETX, as the WRF01 does when it is powered or rebooted. */
+	void powerUp(uint64_t now);
+
+	/*	@brief	Bytes written by the micro controller at @ref now. */
+	void input(const unsigned char* data, int length, uint64_t now);
+
+	/*	@brief	Copies the answer bytes that have arrived by @ref now.
+	*	@retval	Number of bytes copied.
+	*/
+	int output(unsigned char* dst, int max_length, uint64_t now);
+
+	/*	@brief	Arrival time of the next answer byte, or UINT64_MAX if there is none. */
+	uint64_t nextOutputTime();
+
+	/*	@brief	When the last byte written by the micro controller has arrived. */
+	uint64_t inputDoneTime();
+
+	bool idle();
+
+	/*	@brief	Queues a message from the cloud, delivered on the next poll or send. */
+	void queueCloudMessage(const char* json);
+
+	/*	@brief	Answers the next @ref count commands with SYSTEM_BUSY first. */
+	void setBusy(int count);
+
+	/*	@brief	Modules reported by check_upgrade. */
+	void setPendingUpgrades(const std::vector<std::string>& modules);
+
+	/*	@brief	Sets the time reported by get_time, in seconds since 1970. */
+	void setTime(uint64_t timestamp);
+
+	/*	@note	Changes take effect from the next byte. */
+	wrf01_emulator_config& config();
+	const wrf01_emulator_stats& stats();
+	const std::vector<std::string>& sentMessages();
+	const std::vector<unsigned char>& lastFile();
+	const std::string& lastFileName();
+};
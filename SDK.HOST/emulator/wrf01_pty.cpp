@@ -0,0 +1,138 @@
+/*	Copyright 2017 DeviceDrive AS
+*
+*	Licensed under the Apache License, Version 2.0 (the "License");
+*	you may not use this file except in compliance with the License.
+*	You may obtain a copy of the License at
+*
+*	http ://www.apache.org/licenses/LICENSE-2.0
+*
+*	Unless required by applicable law or agreed to in writing, software
+*	distributed under the License is distributed on an "AS IS" BASIS,
+*	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*	See the License for the specific language governing permissions and
+*	limitations under the License.
+*
+*/
+
+/*	Runs the emulator behind a pseudo terminal, so anything that talks to a serial
+*	port can talk to it. Prints the path of the terminal and runs until killed.
+*
+*		wrf01_pty [-b baud] [-l latency us] [-p max packet size] [-n nak every]
+*		          [-c cancel after] [-B busy count] [-m cloud message]...
+*/
+
+#include "wrf01_emulator.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+static uint64_t now_us()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int open_pty(char* name, size_t size)
+{
+	int master = posix_openpt(O_RDWR | O_NOCTTY);
+	if (master < 0 || grantpt(master) < 0 || unlockpt(master) < 0)
+		return -1;
+
+	const char* slave_name = ptsname(master);
+	if (!slave_name)
+		return -1;
+	snprintf(name, size, "%s", slave_name);
+
+	// Raw mode, so the line discipline does not touch the protocol bytes
+	struct termios tio;
+	if (tcgetattr(master, &tio) == 0) {
+		cfmakeraw(&tio);
+		tcsetattr(master, TCSANOW, &tio);
+	}
+	return master;
+}
+
+int main(int argc, char** argv)
+{
+	wrf01_emulator_config config;
+	WRF01_EMULATOR_DEFAULT_CONFIG(config);
+	int busy = 0;
+	std::vector<const char*> messages;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "b:l:p:n:c:B:m:")) != -1) {
+		switch (opt) {
+		case 'b': config.baud_rate = atoi(optarg); break;
+		case 'l': config.latency_us = atoi(optarg); break;
+		case 'p': config.max_packet_size = atoi(optarg); break;
+		case 'n': config.nak_every = atoi(optarg); break;
+		case 'c': config.cancel_after = atoi(optarg); break;
+		case 'B': busy = atoi(optarg); break;
+		case 'm': messages.push_back(optarg); break;
+		default:
+			fprintf(stderr, "usage: %s [-b baud] [-l latency us] [-p max packet size] [-n nak every] "
+				"[-c cancel after] [-B busy count] [-m cloud message]...\n", argv[0]);
+			return 1;
+		}
+	}
+
+	char name[128];
+	int master = open_pty(name, sizeof(name));
+	if (master < 0) {
+		perror("pty");
+		return 1;
+	}
+
+	// Keeps the terminal open while no one else has it, so reads do not fail with EIO
+	int slave = open(name, O_RDWR | O_NOCTTY);
+
+	Wrf01Emulator emulator(config);
+	emulator.setBusy(busy);
+	for (size_t i = 0; i < messages.size(); i++)
+		emulator.queueCloudMessage(messages[i]);
+
+	printf("%s\n", name);
+	fflush(stdout);
+	emulator.powerUp(now_us());
+
+	unsigned char buffer[256];
+	for (;;) {
+		uint64_t now = now_us();
+		uint64_t next = emulator.nextOutputTime();
+		int timeout = -1;
+		if (next != UINT64_MAX)
+			timeout = next > now ? (int)((next - now + 999) / 1000) : 0;
+
+		struct pollfd pfd = { master, POLLIN, 0 };
+		int ready = poll(&pfd, 1, timeout);
+		if (ready < 0 && errno != EINTR) {
+			perror("poll");
+			break;
+		}
+
+		if (ready > 0 && (pfd.revents & POLLIN)) {
+			ssize_t length = read(master, buffer, sizeof(buffer));
+			if (length > 0)
+				emulator.input(buffer, (int)length, now_us());
+		}
+
+		int length;
+		while ((length = emulator.output(buffer, sizeof(buffer), now_us())) > 0) {
+			if (write(master, buffer, length) < 0) {
+				perror("write");
+				break;
+			}
+		}
+	}
+
+	close(slave);
+	close(master);
+	return 0;
+}
@@ -0,0 +1,407 @@
+/*	Copyright 2017 DeviceDrive AS
+*
+*	Licensed under the Apache License, Version 2.0 (the "License");
+*	you may not use this file except in compliance with the License.
+*	You may obtain a copy of the License at
+*
+*	http ://www.apache.org/licenses/LICENSE-2.0
+*
+*	Unless required by applicable law or agreed to in writing, software
+*	distributed under the License is distributed on an "AS IS" BASIS,
+*	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*	See the License for the specific language governing permissions and
+*	limitations under the License.
+*
+*/
+
+/*	Many WRFs, each with its own emulated WRF01, run on a work stealing thread
+*	pool, to see what the SDK costs per WRF01 as a gateway gets more of them.
+*
+*		wrf_fleet [-t threads] [-e exchanges] [instances ...]
+*
+*	Every WRF is made with WRF::create and talks to an in process emulator with
+*	a simulated clock, so the link takes no real time and what is measured is the
+*	work of the SDK and the emulator. Each WRF runs a mix of polls (some with a
+*	cloud message waiting), telemetry sends, status requests and file uploads,
+*	one exchange at a time. A task is one exchange of one WRF. Workers take tasks
+*	from the back of their own deque and steal from the front of the others.
+*
+*	For each number of instances it prints:
+*	msgs/s			Exchanges per second of wall time.
+*	msgs/s/core		Exchanges per second of CPU time used by the process.
+*	p50, p99		Round trip from the SDK call to the callback, in microseconds.
+*	SDK B/inst		Heap the SDK holds per WRF, from wrf_memory.h.
+*
+*	and the heap per WRF by allocation site for the largest run. The exchanges
+*	are shared out over the instances, at least 10 each, default 100000.
+*	Exits with 1 if an exchange did not get its answer.
+*/
+
+#include "wrf01_emulator.h"
+#include "wrf_sdk.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <thread>
+#include <vector>
+
+#define FLEET_FILE_SIZE 2048
+#define FLEET_RECEIVE_BUFFER_SIZE 1024
+#define FLEET_QUEUE_SIZE 10
+
+static std::vector<unsigned char> file;
+
+static uint64_t now_ns()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static double cpu_seconds()
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec
+		+ (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+#pragma region Work stealing pool
+
+/*	Runs tasks, numbered from 0, on a number of threads. A task that returns true
+*	is run again later, on the same thread unless another one steals it.
+*/
+class WorkStealingPool
+{
+private:
+	struct Worker {
+		std::mutex lock;
+		std::deque<int> tasks;
+	};
+
+	std::vector<std::unique_ptr<Worker>> _workers;
+	std::atomic<int> _unfinished;
+	std::atomic<uint64_t> _steals;
+
+	bool pop(int self, int* task)
+	{
+		Worker& worker = *_workers[self];
+		std::lock_guard<std::mutex> lock(worker.lock);
+		if (worker.tasks.empty())
+			return false;
+		*task = worker.tasks.back();
+		worker.tasks.pop_back();
+		return true;
+	}
+
+	bool steal(int self, int* task)
+	{
+		for (size_t i = 1; i < _workers.size(); i++) {
+			Worker& victim = *_workers[(self + i) % _workers.size()];
+			std::lock_guard<std::mutex> lock(victim.lock);
+			if (!victim.tasks.empty()) {
+				*task = victim.tasks.front();
+				victim.tasks.pop_front();
+				_steals.fetch_add(1, std::memory_order_relaxed);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void work(int self, const std::function<bool(int)>& step)
+	{
+		while (_unfinished.load(std::memory_order_acquire) > 0) {
+			int task;
+			if (!pop(self, &task) && !steal(self, &task)) {
+				std::this_thread::yield();
+				continue;
+			}
+			if (step(task)) {
+				// To the front, so the thread goes round its tasks in turn
+				std::lock_guard<std::mutex> lock(_workers[self]->lock);
+				_workers[self]->tasks.push_front(task);
+			}
+			else
+				_unfinished.fetch_sub(1, std::memory_order_release);
+		}
+	}
+
+public:
+	WorkStealingPool(int threads) : _unfinished(0), _steals(0)
+	{
+		for (int i = 0; i < threads; i++)
+			_workers.emplace_back(new Worker());
+	}
+
+	/*	Runs @ref tasks tasks, shared out evenly to begin with, until every one
+	*	has returned false.
+	*/
+	void run(int tasks, const std::function<bool(int)>& step)
+	{
+		for (int i = 0; i < tasks; i++)
+			_workers[i % _workers.size()]->tasks.push_back(i);
+		_unfinished = tasks;
+
+		std::vector<std::thread> threads;
+		for (size_t i = 1; i < _workers.size(); i++)
+			threads.emplace_back(&WorkStealingPool::work, this, (int)i, std::cref(step));
+		work(0, step);
+		for (size_t i = 0; i < threads.size(); i++)
+			threads[i].join();
+	}
+
+	uint64_t steals()
+	{
+		return _steals.load();
+	}
+};
+
+#pragma endregion
+
+#pragma region Modules
+
+/*	One WRF and the emulator at the other end of its link. Only the thread
+*	running its task touches it.
+*/
+struct Module {
+	int number;
+	Wrf01Emulator* emulator;
+	WRF* wrf;
+	uint64_t now_us;				// Simulated clock of the link
+	uint32_t random;
+	int exchanges_left;
+	bool waiting;					// For the answer to the last exchange
+	uint64_t call_ns;
+	int errors;
+	int stalled;
+	std::vector<uint32_t> latencies_ns;
+};
+
+static uint32_t write_to_emulator(WRF* wrf, const wrf_segment* segments, int count)
+{
+	Module* module = (Module*)wrf->getUserData();
+	for (int i = 0; i < count; i++)
+		module->emulator->input(segments[i].data, segments[i].length, module->now_us);
+	return 0;
+}
+
+static int read_file(int offset, unsigned char* dst, int max_length)
+{
+	memcpy(dst, &file[offset], max_length);
+	return max_length;
+}
+
+/*	Ends the exchange on the answer it waits for. A file upload ends with
+*	FILE_SENT, SYSTEM_BUSY is followed by the real answer.
+*/
+static void on_response(WRF* wrf, wrf_result_code code, void* object)
+{
+	Module* module = (Module*)wrf->getUserData();
+	switch (code)
+	{
+	case WRF_OK:
+	case WRF_SEND_FILE:
+		return;
+	case WRF_LOCAL_ERROR:
+	case WRF_REMOTE_ERROR:
+		if (((wrf_error*)object)->code == WRF_ERROR_SYSTEM_BUSY)
+			return;
+		module->errors++;
+		break;
+	default:
+		break;
+	}
+	if (module->waiting) {
+		module->latencies_ns.push_back((uint32_t)std::min<uint64_t>(now_ns() - module->call_ns, UINT32_MAX));
+		module->waiting = false;
+	}
+}
+
+static uint32_t next_random(Module* module)
+{
+	// xorshift32
+	uint32_t x = module->random;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return module->random = x;
+}
+
+/*	Starts the next exchange: 60% polls, a third of them with a message waiting,
+*	25% telemetry, 13% status and 2% file uploads.
+*/
+static void start_exchange(Module* module)
+{
+	uint32_t kind = next_random(module) % 100;
+	module->waiting = true;
+	module->call_ns = now_ns();
+
+	if (kind < 60) {
+		if (kind < 20)
+			module->emulator->queueCloudMessage("{\"com.devicedrive.light\":{\"power\":1}}");
+		module->wrf->poll();
+	}
+	else if (kind < 85) {
+		char message[96];
+		snprintf(message, sizeof(message), "{\"com.devicedrive.sensor\":{\"id\":%d,\"temperature\":%u}}",
+			module->number, next_random(module) % 40);
+		module->wrf->send(message);
+	}
+	else if (kind < 98)
+		module->wrf->requestStatus();
+	else
+		module->wrf->sendFile((char*)"log.bin", FLEET_FILE_SIZE, read_file);
+}
+
+/*	Runs one exchange to its end, and returns true if the module has more. */
+static bool step(Module* module)
+{
+	unsigned char buffer[256];
+	start_exchange(module);
+
+	for (;;) {
+		module->wrf->handleSendQueue();
+		if (module->emulator->idle())
+			break;
+
+		uint64_t next = module->emulator->nextOutputTime();
+		if (next > module->now_us)
+			module->now_us = next;
+		int length;
+		while ((length = module->emulator->output(buffer, sizeof(buffer), module->now_us)) > 0)
+			module->wrf->registerBytes(buffer, length);
+	}
+
+	if (module->waiting) {
+		module->stalled++;
+		module->waiting = false;
+	}
+	return --module->exchanges_left > 0;
+}
+
+#pragma endregion
+
+static uint32_t percentile(std::vector<uint32_t>& values, double p)
+{
+	if (values.empty())
+		return 0;
+	size_t n = (size_t)(p * (values.size() - 1));
+	std::nth_element(values.begin(), values.begin() + n, values.end());
+	return values[n];
+}
+
+/*	Runs @ref instances WRFs for @ref exchanges exchanges in all, prints a line
+*	and returns false if an exchange got no answer.
+*/
+static bool run_fleet(int instances, int threads, long exchanges, bool print_sites)
+{
+	wrf01_emulator_config config;
+	WRF01_EMULATOR_DEFAULT_CONFIG(config);
+	int per_instance = (int)std::max<long>(exchanges / instances, 10);
+
+	wrf_memory_stats before;
+	wrf_get_memory_stats(&before);
+
+	std::vector<Module> modules(instances);
+	for (int i = 0; i < instances; i++) {
+		Module& module = modules[i];
+		module.number = i;
+		module.emulator = new Wrf01Emulator(config);
+		module.wrf = WRF::create(write_to_emulator, &module, FLEET_RECEIVE_BUFFER_SIZE, FLEET_QUEUE_SIZE);
+		module.wrf->onResponse(on_response);
+		module.now_us = 0;
+		module.random = 2463534242u + i * 7919;
+		module.exchanges_left = per_instance;
+		module.waiting = false;
+		module.errors = 0;
+		module.stalled = 0;
+		module.latencies_ns.reserve(per_instance);
+	}
+
+	wrf_memory_stats created;
+	wrf_get_memory_stats(&created);
+
+	WorkStealingPool pool(threads);
+	double cpu_start = cpu_seconds();
+	uint64_t start = now_ns();
+	pool.run(instances, [&modules](int task) { return step(&modules[task]); });
+	double wall = (now_ns() - start) / 1e9;
+	double cpu = cpu_seconds() - cpu_start;
+
+	std::vector<uint32_t> latencies;
+	latencies.reserve((size_t)instances * per_instance);
+	int errors = 0, stalled = 0;
+	for (int i = 0; i < instances; i++) {
+		latencies.insert(latencies.end(), modules[i].latencies_ns.begin(), modules[i].latencies_ns.end());
+		errors += modules[i].errors;
+		stalled += modules[i].stalled;
+	}
+	long total = (long)instances * per_instance;
+
+	printf("%9d %8ld %10.0f %12.0f %8.1f %8.1f %11.0f %7lu\n",
+		instances, total, total / wall, cpu > 0 ? total / cpu : 0.0,
+		percentile(latencies, 0.50) / 1000.0, percentile(latencies, 0.99) / 1000.0,
+		(double)(created.bytes_live - before.bytes_live) / instances, (unsigned long)pool.steals());
+	if (errors || stalled)
+		printf("          %d errors, %d exchanges without an answer\n", errors, stalled);
+
+	if (print_sites) {
+		printf("\nSDK heap per instance with %d instances\n", instances);
+		for (int i = 0; i < WRF_ALLOC_SITES; i++) {
+			size_t bytes = created.sites[i].bytes_live - before.sites[i].bytes_live;
+			if (bytes)
+				printf("    %-20s %8.0f bytes\n", wrf_alloc_site_name((wrf_alloc_site)i), (double)bytes / instances);
+		}
+		printf("    %-20s %8d bytes\n", "sizeof(WRF)", (int)sizeof(WRF));
+	}
+
+	for (int i = 0; i < instances; i++) {
+		delete modules[i].wrf;
+		delete modules[i].emulator;
+	}
+	return stalled == 0;
+}
+
+int main(int argc, char** argv)
+{
+	int threads = (int)std::thread::hardware_concurrency();
+	long exchanges = 100000;
+	std::vector<int> instances;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+			threads = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc)
+			exchanges = atol(argv[++i]);
+		else if (atoi(argv[i]) > 0)
+			instances.push_back(atoi(argv[i]));
+		else {
+			fprintf(stderr, "usage: wrf_fleet [-t threads] [-e exchanges] [instances ...]\n");
+			return 2;
+		}
+	}
+	if (threads < 1)
+		threads = 1;
+	if (instances.empty())
+		instances = { 1, 10, 100, 1000, 4000 };
+
+	for (int i = 0; i < FLEET_FILE_SIZE; i++)
+		file.push_back((unsigned char)(i * 7));
+
+	printf("%d threads\n", threads);
+	printf("%9s %8s %10s %12s %8s %8s %11s %7s\n", "instances", "msgs", "msgs/s", "msgs/s/core",
+		"p50 us", "p99 us", "SDK B/inst", "steals");
+
+	bool ok = true;
+	for (size_t i = 0; i < instances.size(); i++)
+		ok &= run_fleet(instances[i], threads, exchanges, i == instances.size() - 1);
+	return ok ? 0 : 1;
+}
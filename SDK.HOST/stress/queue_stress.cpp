@@ -0,0 +1,257 @@
+/*	Copyright 2017 DeviceDrive AS
+*
+*	Licensed under the Apache License, Version 2.0 (the "License");
+*	you may not use this file except in compliance with the License.
+*	You may obtain a copy of the License at
+*
+*	http ://www.apache.org/licenses/LICENSE-2.0
+*
+*	Unless required by applicable law or agreed to in writing, software
+*	distributed under the License is distributed on an "AS IS" BASIS,
+*	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*	See the License for the specific language governing permissions and
+*	limitations under the License.
+*
+*/
+
+/*	Several threads sending at once, with the SDK built with WRF_QUEUE_MPSC.
+*
+*		queue_stress [messages per producer]
+*
+*	queue		MpscQueue against Queue behind a mutex, the way sends were funneled
+*				before. Every producer numbers its messages and the consumer checks
+*				that each producer's messages come out whole and in order. Prints
+*				messages per second for 1 to 8 producers.
+*	wrf			Producers calling WRF::send and WRF::setVisibility while the main
+*				thread runs handleSendQueue and answers every message with OK.
+*
+*	Build with -fsanitize=thread to have the ordering checked as well.
+*	Exits with 1 if anything did not happen as expected.
+*/
+
+#include "wrf_sdk.h"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+#if !WRF_QUEUE_MPSC
+#error queue_stress needs the SDK built with WRF_QUEUE_MPSC=1
+#endif
+
+#define MAX_PRODUCERS 8
+
+static int failures = 0;
+
+static double now_s()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/*	Checks that a message is "<producer>:<number>:" followed by padding, and that
+*	it is the next one from that producer.
+*/
+static bool check_message(const char* msg, int length, uint32_t* next)
+{
+	char* end;
+	unsigned long producer = strtoul(msg, &end, 10);
+	if (*end != ':' || producer >= MAX_PRODUCERS)
+		return false;
+	unsigned long number = strtoul(end + 1, &end, 10);
+	if (*end != ':' || number != next[producer])
+		return false;
+	for (const char* c = end + 1; c < msg + length; c++)
+		if (*c != '.')
+			return false;
+	next[producer]++;
+	return true;
+}
+
+static int make_message(char* msg, int producer, uint32_t number)
+{
+	int padding = (int)(number * 13 % 40);
+	return sprintf(msg, "%d:%u:%.*s", producer, number, padding, "........................................");
+}
+
+#pragma region Queue
+
+struct MutexQueue {
+	Queue queue;
+	std::mutex mutex;
+	MutexQueue(int size, int capacity) : queue(size, capacity) {}
+
+	bool push(char* msg) {
+		std::lock_guard<std::mutex> lock(mutex);
+		return queue.push(msg);
+	}
+
+	/* The consumer copies the message out, so the lock is not held while it is used */
+	int take(char* dst) {
+		std::lock_guard<std::mutex> lock(mutex);
+		if (queue.empty())
+			return -1;
+		int length;
+		char* msg = queue.peek(&length);
+		memcpy(dst, msg, length + 1);
+		queue.pop();
+		return length;
+	}
+};
+
+struct LockFreeQueue {
+	MpscQueue queue;
+	LockFreeQueue(int size, int capacity) : queue(size, capacity) {}
+
+	bool push(char* msg) {
+		return queue.push(msg);
+	}
+
+	int take(char* dst) {
+		if (queue.empty())
+			return -1;
+		int length;
+		char* msg = queue.peek(&length);
+		memcpy(dst, msg, length + 1);
+		queue.pop();
+		return length;
+	}
+};
+
+template <typename Q>
+static double run_queue(int producers, uint32_t messages, bool* ok)
+{
+	Q queue(16, 16 * 64);
+	std::vector<std::thread> threads;
+	double start = now_s();
+	for (int p = 0; p < producers; p++)
+		threads.emplace_back([&queue, p, messages] {
+			char msg[64];
+			for (uint32_t n = 0; n < messages; n++) {
+				make_message(msg, p, n);
+				while (!queue.push(msg))
+					std::this_thread::yield();
+			}
+		});
+
+	uint32_t next[MAX_PRODUCERS] = { 0 };
+	uint64_t left = (uint64_t)producers * messages;
+	char msg[64];
+	while (left > 0) {
+		int length = queue.take(msg);
+		if (length < 0) {
+			std::this_thread::yield();
+			continue;
+		}
+		if (!check_message(msg, length, next))
+			*ok = false;
+		left--;
+	}
+	double elapsed = now_s() - start;
+	for (auto& thread : threads)
+		thread.join();
+	return producers * (double)messages / elapsed;
+}
+
+static void queue_stress(uint32_t messages)
+{
+	printf("%-10s %10s %14s %14s\n", "queue", "producers", "mutex msg/s", "mpsc msg/s");
+	for (int producers = 1; producers <= MAX_PRODUCERS; producers *= 2) {
+		bool ok = true;
+		double locked = run_queue<MutexQueue>(producers, messages, &ok);
+		double lock_free = run_queue<LockFreeQueue>(producers, messages, &ok);
+		printf("%-10s %10d %14.0f %14.0f  %s\n", "", producers, locked, lock_free, ok ? "ok" : "FAILED");
+		if (!ok)
+			failures++;
+	}
+}
+
+#pragma endregion
+
+#pragma region WRF
+
+static WRF* wrf;
+static uint32_t next_message[MAX_PRODUCERS];
+static uint32_t last_visibility[MAX_PRODUCERS];
+static uint32_t written = 0;
+static uint32_t bad_writes = 0;
+
+/*	handleSendQueue runs on the main thread only, so this needs no locking */
+static uint32_t on_write(unsigned char* data, int length)
+{
+	const char* msg = (const char*)data;
+	const char* visibility = strstr(msg, "\"" WRF_SETUP_VISIBILITY_STR "\":");
+	if (visibility) {
+		// Commands are encoded on each sender's stack, a shared buffer would mix them up
+		const char* digits = visibility + strlen(WRF_SETUP_VISIBILITY_STR) + 3;
+		unsigned long value = strtoul(*digits == '"' ? digits + 1 : digits, NULL, 10);
+		unsigned long producer = value / 1000000;
+		if (producer >= MAX_PRODUCERS || value % 1000000 <= last_visibility[producer])
+			bad_writes++;
+		else
+			last_visibility[producer] = value % 1000000;
+	}
+	else if (length < 2 || msg[length - 1] != WRF_EOT || !check_message(msg, length - 1, next_message))
+		bad_writes++;
+	written++;
+	return 0;
+}
+
+static void wrf_stress(int producers, uint32_t messages)
+{
+	wrf = WRF::createInstance(on_write, 256, 16, 16 * 128);
+	std::atomic<int> running(producers);
+	std::atomic<uint32_t> sent(0);
+	std::vector<std::thread> threads;
+	for (int p = 0; p < producers; p++)
+		threads.emplace_back([&, p] {
+			char msg[64];
+			uint32_t number = 0;
+			for (uint32_t n = 0; n < messages; n++) {
+				// WRF::send does not tell whether the message fitted, so wait for room
+				while (wrf->getQueueCount() >= 8)
+					std::this_thread::yield();
+				if (n % 8 == 7)
+					wrf->setVisibility(p * 1000000 + n + 1);
+				else {
+					make_message(msg, p, number++);
+					wrf->send(msg);
+				}
+				sent++;
+			}
+			running--;
+		});
+
+	static char ok[] = "{\"devicedrive\":{\"result\":\"OK\"}}\x04";
+	while (running.load() > 0 || !wrf->isQueueEmpty()) {
+		uint32_t before = written;
+		wrf->handleSendQueue();
+		if (written != before)
+			wrf->registerString(ok);
+		else
+			std::this_thread::yield();
+	}
+	for (auto& thread : threads)
+		thread.join();
+
+	bool ok_run = bad_writes == 0 && written == sent.load();
+	printf("%-10s %u messages from %d producers, %u written, %u bad  %s\n", "wrf",
+		sent.load(), producers, written, bad_writes, ok_run ? "ok" : "FAILED");
+	if (!ok_run)
+		failures++;
+	WRF::freeInstance();
+}
+
+#pragma endregion
+
+int main(int argc, char** argv)
+{
+	uint32_t messages = argc > 1 ? (uint32_t)atol(argv[1]) : 200000;
+
+	queue_stress(messages);
+	wrf_stress(4, messages / 10);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,264 @@
+/*	Copyright 2017 DeviceDrive AS
+*
+*	Licensed under the Apache License, Version 2.0 (the "License");
+*	you may not use this file except in compliance with the License.
+*	You may obtain a copy of the License at
+*
+*	http ://www.apache.org/licenses/LICENSE-2.0
+*
+*	Unless required by applicable law or agreed to in writing, software
+*	distributed under the License is distributed on an "AS IS" BASIS,
+*	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*	See the License for the specific language governing permissions and
+*	limitations under the License.
+*
+*/
+
+/*	Two thread stress test of the receive ring. One thread plays the UART interrupt
+*	and only pushes bytes, the other plays the main loop.
+*
+*		rx_ring_stress [bytes] [frames]
+*
+*	ring		A byte stream through a 64 byte ring, checked byte for byte.
+*	wrf			Numbered frames through WRF::registerBytesFromISR and
+*				WRF::process, with a main loop that is busy now and then. The
+*				producer waits for room, like a UART with flow control.
+*	overflow	The same without waiting, every byte must be either taken or
+*				counted in WRF::getReceiveOverflows.
+*
+*	Build with -fsanitize=thread to have the ordering checked as well.
+*	Exits with 1 if anything did not happen as expected.
+*/
+
+#include "wrf_sdk.h"
+#include <atomic>
+#include <chrono>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+
+static int failures = 0;
+
+static void report(const char* name, bool ok, const char* format, ...)
+	__attribute__((format(printf, 3, 4)));
+
+static void report(const char* name, bool ok, const char* format, ...)
+{
+	char details[128];
+	va_list args;
+	va_start(args, format);
+	vsnprintf(details, sizeof(details), format, args);
+	va_end(args);
+	printf("%-10s %-52s %s\n", name, details, ok ? "ok" : "FAILED");
+	if (!ok)
+		failures++;
+}
+
+static uint32_t next_random(uint32_t* state)
+{
+	*state = *state * 1103515245u + 12345u;
+	return *state >> 16;
+}
+
+#pragma region Ring
+
+static void ring_stress(uint32_t bytes)
+{
+	uint8_t storage[64];
+	wrf_rx_ring ring;
+	wrf_rx_ring_init(&ring, storage, sizeof(storage));
+	uint32_t refused = 0;
+
+	std::thread producer([&] {
+		uint32_t sequence = 1, choice = 7;
+		uint8_t chunk[16];
+		for (uint32_t sent = 0; sent < bytes; ) {
+			uint32_t length = next_random(&choice) % sizeof(chunk) + 1;
+			if (length > bytes - sent)
+				length = bytes - sent;
+			uint32_t state = sequence;
+			for (uint32_t i = 0; i < length; i++)
+				chunk[i] = (uint8_t)next_random(&state);
+
+			uint32_t written = 0;
+			while (written < length) {
+				uint32_t count = length == 1
+					? wrf_rx_ring_push(&ring, chunk[0])
+					: (uint32_t)wrf_rx_ring_write(&ring, chunk + written, length - written);
+				refused += length - written - count;
+				written += count;
+				if (written < length)
+					std::this_thread::yield();
+			}
+			sequence = state;
+			sent += length;
+		}
+	});
+
+	uint32_t sequence = 1, received = 0, mismatches = 0;
+	while (received < bytes) {
+		const uint8_t* data;
+		size_t length = wrf_rx_ring_peek(&ring, &data);
+		if (length == 0) {
+			std::this_thread::yield();
+			continue;
+		}
+		for (size_t i = 0; i < length; i++)
+			if (data[i] != (uint8_t)next_random(&sequence))
+				mismatches++;
+		wrf_rx_ring_consume(&ring, length);
+		received += length;
+	}
+	producer.join();
+
+	report("ring", mismatches == 0 && wrf_rx_ring_overflows(&ring) == refused,
+		"%u bytes, %u out of order, %u refused", received, mismatches, refused);
+}
+
+#pragma endregion
+
+#pragma region WRF
+
+static uint32_t frames_expected = 0;
+static uint32_t frames_received = 0;
+static uint32_t frames_out_of_order = 0;
+static uint32_t frame_errors = 0;
+
+static uint32_t discard_writes(unsigned char* data, int length)
+{
+	return 0;
+}
+
+static void on_message(char* msg)
+{
+	const char* seq = strstr(msg, "\"seq\":");
+	uint32_t number = seq ? (uint32_t)strtoul(seq + 6, NULL, 10) : 0;
+	if (number < frames_expected)
+		frames_out_of_order++;
+	frames_expected = number + 1;
+	frames_received++;
+}
+
+static void on_error(wrf_error* error)
+{
+	frame_errors++;
+}
+
+static std::string make_frame(uint32_t number)
+{
+	char frame[160];
+	int padding = (int)(number * 37 % 64);
+	snprintf(frame, sizeof(frame), "{\"seq\":%u,\"pad\":\"%.*s\"}\x04", number, padding,
+		"................................................................");
+	return frame;
+}
+
+/*	Pushes the frames in random sized pieces. With wait set, a piece is retried
+*	until it fits, otherwise the rest of it is dropped. Returns the bytes offered.
+*/
+static uint64_t push_frames(WRF* wrf, uint32_t frames, bool wait, uint64_t* accepted)
+{
+	uint64_t offered = 0;
+	uint32_t choice = 11;
+	for (uint32_t n = 0; n < frames; n++) {
+		std::string frame = make_frame(n);
+		const uint8_t* data = (const uint8_t*)frame.data();
+		int left = (int)frame.size();
+		while (left > 0) {
+			int length = (int)(next_random(&choice) % 8) + 1;
+			if (length > left)
+				length = left;
+			int count = length == 1 ? wrf->registerCharFromISR(*data) : wrf->registerBytesFromISR(data, length);
+			*accepted += count;
+			if (wait && count < length) {
+				offered += count;
+				data += count;
+				left -= count;
+				std::this_thread::yield();
+				continue;
+			}
+			offered += length;
+			data += length;
+			left -= length;
+		}
+		// Gives the main loop a chance between frames on a single core host
+		if (!wait)
+			std::this_thread::yield();
+	}
+	return offered;
+}
+
+static void run_main_loop(WRF* wrf, std::atomic<bool>& done)
+{
+	uint32_t iteration = 0;
+	while (!done.load()) {
+		wrf->process();
+		// Now and then the application is busy for a while
+		if (++iteration % 4096 == 0)
+			std::this_thread::sleep_for(std::chrono::milliseconds(2));
+		else
+			std::this_thread::yield();
+	}
+	wrf->process();
+	wrf->process();
+}
+
+static void wrf_stress(uint32_t frames)
+{
+	WRF* wrf = WRF::createInstance(discard_writes, 256, 4);
+	wrf->onMessageReceived(on_message);
+	wrf->onError(on_error);
+	wrf->enableReceiveRing(1024);
+
+	std::atomic<bool> done(false);
+	uint64_t accepted = 0;
+	std::thread producer([&] {
+		push_frames(wrf, frames, true, &accepted);
+		done.store(true);
+	});
+	run_main_loop(wrf, done);
+	producer.join();
+
+	report("wrf", frames_received == frames && frames_out_of_order == 0 && frame_errors == 0,
+		"%u of %u frames, %u out of order, %u errors", frames_received, frames, frames_out_of_order, frame_errors);
+	WRF::freeInstance();
+}
+
+static void overflow_stress(uint32_t frames)
+{
+	frames_expected = frames_received = frames_out_of_order = frame_errors = 0;
+	WRF* wrf = WRF::createInstance(discard_writes, 256, 4);
+	wrf->onMessageReceived(on_message);
+	wrf->onError(on_error);
+	wrf->enableReceiveRing(256);
+
+	std::atomic<bool> done(false);
+	uint64_t accepted = 0, offered = 0;
+	std::thread producer([&] {
+		offered = push_frames(wrf, frames, false, &accepted);
+		done.store(true);
+	});
+	run_main_loop(wrf, done);
+	producer.join();
+
+	uint32_t overflows = wrf->getReceiveOverflows();
+	report("overflow", accepted + overflows == offered,
+		"%u frames parsed, %u bytes dropped of %llu", frames_received, overflows, (unsigned long long)offered);
+	WRF::freeInstance();
+}
+
+#pragma endregion
+
+int main(int argc, char** argv)
+{
+	uint32_t bytes = argc > 1 ? (uint32_t)atol(argv[1]) : 4000000;
+	uint32_t frames = argc > 2 ? (uint32_t)atol(argv[2]) : 50000;
+
+	ring_stress(bytes);
+	wrf_stress(frames);
+	overflow_stress(frames);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,310 @@
+/*	Copyright 2017 DeviceDrive AS
+*
+*	Licensed under the Apache License, Version 2.0 (the "License");
+*	you may not use this file except in compliance with the License.
+*	You may obtain a copy of the License at
+*
+*	http ://www.apache.org/licenses/LICENSE-2.0
+*
+*	Unless required by applicable law or agreed to in writing, software
+*	distributed under the License is distributed on an "AS IS" BASIS,
+*	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*	See the License for the specific language governing permissions and
+*	limitations under the License.
+*
+*/
+
+/*	Turns a dump from WRF::dumpTrace into the time every message spent in each
+*	part of its round trip, and a histogram per part.
+*
+*		wrf_trace_decode [-e] [-u unit] [dump file]
+*
+*	-e lists the raw events too. -u names the unit of the clock the trace was
+*	taken with, "us" by default. Reads standard input without a file.
+*
+*	A message is followed from ENQUEUE through TX_START to the CALLBACK of its
+*	response. Messages are sent in the order they are queued, and the response
+*	that arrives while a message is being sent belongs to it; SYSTEM_BUSY answers
+*	are counted and the wait goes on until the real response.
+*/
+
+#include "wrf_trace.h"
+#include "wrf.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <deque>
+#include <string>
+#include <vector>
+
+enum phase {
+	PHASE_QUEUE,		// ENQUEUE to TX_START
+	PHASE_WRF01,		// TX_START to the first byte of the response, link and WRF01
+	PHASE_RECEIVE,		// First byte to EOT
+	PHASE_PARSE,		// EOT to parse done
+	PHASE_CALLBACK,		// Parse done to the callback returning
+	PHASE_TOTAL,		// ENQUEUE to the callback returning
+	PHASE_FILE_ACK,		// File packet written to ACK or NAK
+	PHASES
+};
+
+static const char* const phase_names[PHASES] = {
+	"queue", "link+WRF01", "receive", "parse", "callback", "total", "file ack"
+};
+
+#define HISTOGRAM_BUCKETS 32
+
+struct histogram {
+	uint32_t buckets[HISTOGRAM_BUCKETS];	// Bucket n counts times below 2^n
+	uint32_t count;
+	uint64_t sum;
+	uint32_t max;
+};
+
+struct message {
+	bool queued;
+	uint32_t enqueue, tx, rx_first, rx_eot, parsed, done;
+	int length;
+	int busy;
+	int code;
+};
+
+static histogram histograms[PHASES];
+static const char* unit = "us";
+
+static void add_time(phase p, uint32_t from, uint32_t to)
+{
+	uint32_t time = to - from;
+	histogram* h = &histograms[p];
+	int bucket = 0;
+	while (bucket < HISTOGRAM_BUCKETS - 1 && time >= (1u << bucket))
+		bucket++;
+	h->buckets[bucket]++;
+	h->count++;
+	h->sum += time;
+	if (time > h->max)
+		h->max = time;
+}
+
+static const char* result_name(int code)
+{
+	switch (code) {
+	case WRF_OK: return "OK";
+	case WRF_EMPTY: return "EMPTY";
+	case WRF_MESSAGE: return "MESSAGE";
+	case WRF_SENT: return "SENT";
+	case WRF_LOCAL_ERROR: return "LOCAL_ERROR";
+	case WRF_REMOTE_ERROR: return "REMOTE_ERROR";
+	case WRF_CONFIG: return "CONFIG";
+	case WRF_STATUS: return "STATUS";
+	case WRF_UPGRADE_PENDING: return "UPGRADE_PENDING";
+	case WRF_UPGRADE_PACKAGE: return "UPGRADE_PACKAGE";
+	case WRF_SEND_FILE: return "SEND_FILE";
+	case WRF_FILE_SENT: return "FILE_SENT";
+	case WRF_FILE_CANCEL: return "FILE_CANCEL";
+	case WRF_TIME: return "TIME";
+	default: return "?";
+	}
+}
+
+static void print_message(int number, const message& m)
+{
+	char queue[16] = "-";
+	char total[16] = "-";
+	if (m.queued) {
+		snprintf(queue, sizeof(queue), "%u", m.tx - m.enqueue);
+		snprintf(total, sizeof(total), "%u", m.done - m.enqueue);
+	}
+	printf("%5d %10u %5d %8s %10u %8u %8u %8u %10s %4d  %s\n", number, m.tx, m.length, queue,
+		m.rx_first - m.tx, m.rx_eot - m.rx_first, m.parsed - m.rx_eot, m.done - m.parsed,
+		total, m.busy, result_name(m.code));
+}
+
+static void finish_message(int number, const message& m)
+{
+	print_message(number, m);
+	if (m.queued) {
+		add_time(PHASE_QUEUE, m.enqueue, m.tx);
+		add_time(PHASE_TOTAL, m.enqueue, m.done);
+	}
+	add_time(PHASE_WRF01, m.tx, m.rx_first);
+	add_time(PHASE_RECEIVE, m.rx_first, m.rx_eot);
+	add_time(PHASE_PARSE, m.rx_eot, m.parsed);
+	add_time(PHASE_CALLBACK, m.parsed, m.done);
+}
+
+static void print_histograms()
+{
+	for (int p = 0; p < PHASES; p++) {
+		const histogram& h = histograms[p];
+		if (!h.count)
+			continue;
+		printf("\n%s: %u samples, mean %.1f %s, max %u %s\n", phase_names[p], h.count,
+			(double)h.sum / h.count, unit, h.max, unit);
+
+		uint32_t largest = 0;
+		for (int b = 0; b < HISTOGRAM_BUCKETS; b++)
+			if (h.buckets[b] > largest)
+				largest = h.buckets[b];
+		for (int b = 0; b < HISTOGRAM_BUCKETS; b++) {
+			if (!h.buckets[b])
+				continue;
+			char range[32];
+			if (b == 0)
+				snprintf(range, sizeof(range), "0");
+			else
+				snprintf(range, sizeof(range), "%u-%u", 1u << (b - 1), (1u << b) - 1);
+			printf("  %21s %s %6u %s\n", range, unit, h.buckets[b],
+				std::string((h.buckets[b] * 40 + largest - 1) / largest, '#').c_str());
+		}
+	}
+}
+
+static bool read_dump(FILE* file, std::vector<wrf_trace_event>& events, uint32_t* dropped)
+{
+	unsigned char buffer[WRF_TRACE_HEADER_SIZE];
+	if (fread(buffer, 1, WRF_TRACE_HEADER_SIZE, file) != WRF_TRACE_HEADER_SIZE)
+		return false;
+	int count = wrf_trace_decode_header(buffer, dropped);
+	if (count < 0)
+		return false;
+
+	for (int i = 0; i < count; i++) {
+		if (fread(buffer, 1, WRF_TRACE_EVENT_SIZE, file) != WRF_TRACE_EVENT_SIZE)
+			return false;
+		wrf_trace_event event;
+		wrf_trace_decode_event(buffer, &event);
+		events.push_back(event);
+	}
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	bool list_events = false;
+	int opt;
+	while ((opt = getopt(argc, argv, "eu:")) != -1) {
+		switch (opt) {
+		case 'e': list_events = true; break;
+		case 'u': unit = optarg; break;
+		default:
+			fprintf(stderr, "usage: %s [-e] [-u unit] [dump file]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	FILE* file = optind < argc ? fopen(argv[optind], "rb") : stdin;
+	if (!file) {
+		perror(argv[optind]);
+		return 1;
+	}
+	std::vector<wrf_trace_event> events;
+	uint32_t dropped = 0;
+	if (!read_dump(file, events, &dropped)) {
+		fprintf(stderr, "not a complete trace dump\n");
+		return 1;
+	}
+	printf("%d events, %u dropped before the first, times in %s\n", (int)events.size(), dropped, unit);
+
+	if (list_events) {
+		for (size_t i = 0; i < events.size(); i++)
+			printf("%10u %-12s %u\n", events[i].time, wrf_trace_event_name(events[i].type), events[i].arg);
+		printf("\n");
+	}
+
+	printf("%5s %10s %5s %8s %10s %8s %8s %8s %10s %4s  %s\n", "msg", "tx", "bytes", "queue",
+		"link+WRF01", "receive", "parse", "callback", "total", "busy", "result");
+
+	std::deque<uint32_t> queued;
+	message current;
+	bool sending = false;		// current is waiting for its response
+	bool receiving = false;		// a response to current is on its way in
+	bool busy = false;			// that response is SYSTEM_BUSY
+	int number = 0;
+	int unsolicited = 0;
+	uint32_t file_packet_time = 0;
+	bool file_packet_pending = false;
+
+	for (size_t i = 0; i < events.size(); i++) {
+		const wrf_trace_event& e = events[i];
+		switch (e.type) {
+		case WRF_TRACE_ENQUEUE:
+			queued.push_back(e.time);
+			break;
+		case WRF_TRACE_TX_START:
+			memset(&current, 0, sizeof(current));
+			current.tx = e.time;
+			current.length = e.arg;
+			// A dump that starts in the middle has sends without their enqueue
+			if (!queued.empty()) {
+				current.queued = true;
+				current.enqueue = queued.front();
+				queued.pop_front();
+			}
+			sending = true;
+			receiving = false;
+			break;
+		case WRF_TRACE_RX_FIRST:
+			if (sending) {
+				current.rx_first = e.time;
+				receiving = true;
+				busy = false;
+			}
+			break;
+		case WRF_TRACE_RX_EOT:
+			if (receiving)
+				current.rx_eot = e.time;
+			break;
+		case WRF_TRACE_PARSE_DONE:
+			if (receiving) {
+				current.parsed = e.time;
+				current.code = e.arg;
+			}
+			break;
+		case WRF_TRACE_SYSTEM_BUSY:
+			if (receiving) {
+				current.busy++;
+				busy = true;
+			}
+			break;
+		case WRF_TRACE_CALLBACK:
+			if (!receiving) {
+				unsolicited++;
+				break;
+			}
+			receiving = false;
+			// After SYSTEM_BUSY the message waits on for the real response
+			if (busy)
+				break;
+			current.done = e.time;
+			finish_message(++number, current);
+			sending = false;
+			break;
+		case WRF_TRACE_POWER_UP:
+			sending = receiving = false;
+			queued.clear();
+			break;
+		case WRF_TRACE_FILE_PACKET:
+			file_packet_time = e.time;
+			file_packet_pending = true;
+			break;
+		case WRF_TRACE_FILE_ACK:
+		case WRF_TRACE_FILE_NAK:
+			if (file_packet_pending)
+				add_time(PHASE_FILE_ACK, file_packet_time, e.time);
+			file_packet_pending = false;
+			break;
+		case WRF_TRACE_FILE_CAN:
+			file_packet_pending = false;
+			break;
+		}
+	}
+
+	if (unsolicited)
+		printf("%d responses without a message sent\n", unsolicited);
+	if (!queued.empty())
+		printf("%d messages still queued\n", (int)queued.size());
+	print_histograms();
+	return 0;
+}
@@ -22,7 +22,7 @@
 #include "app_timer.h"
 #include "app_uart.h"
 #include "wrf_sdk.h"
-#include "json.h"
+#include "json_tape.h"
 
 //TODO: Please get your product key at https://devicedrive.com/subscription
 #define PRODUCT_KEY "<Your product key here>"
@@ -46,8 +46,9 @@
 #define APP_GPIOTE_MAX_USERS        1		/**< Maximum number of users of the GPIOTE handler. */
 #define APP_NUM_BUTTONS				1		/**< Number of buttons to registrate in this example */
 #define UART_TX_BUF_SIZE			1024    /**< UART TX buffer size. */
-#define UART_RX_BUF_SIZE			1024    /**< UART RX buffer size. */
+#define UART_RX_BUF_SIZE			32		/**< UART RX buffer size, it is emptied into the WRF receive ring by the UART interrupt. */
 #define WRF_RECEIVE_BUFFER_SIZE		1024	/**< Size of buffer the WRF SDK is allowed to allocate */
+#define WRF_RECEIVE_RING_SIZE		1024	/**< Bytes received, but not yet parsed by @ref WRF::process. Must be a power of 2 */
 #define WRF_SEND_QUEUE_SIZE			10		/**< Size of send queue */
 #define POLL_DELAY_MS				3000	/**< Poll intervall in milliseconds */
 
@@ -73,7 +74,15 @@ static void button_handler(uint8_t pin_no, uint8_t button_action);	/**< Forward
 
 void uart_error_handle(app_uart_evt_t * p_event)
 {
-	if (p_event->evt_type == APP_UART_COMMUNICATION_ERROR)
+	if (p_event->evt_type == APP_UART_DATA_READY)
+	{
+		// We are in interrupt context, so the bytes are only handed over here.
+		// They are parsed in the main loop by wrf->process().
+		uint8_t byte;
+		while (app_uart_get(&byte) == NRF_SUCCESS)
+			wrf->registerCharFromISR(byte);
+	}
+	else if (p_event->evt_type == APP_UART_COMMUNICATION_ERROR)
 	{
 		// TODO: Handle error
 		APP_ERROR_HANDLER(p_event->data.error_communication);
@@ -184,30 +193,18 @@ void set_led(bool on)
 /** @brief	Function for handleing messages from the cloud */ 
 void handle_message(char* msg)
 {
-	json_char* json;
-	json_value* value;
-
 	// Remowing the EOT char from the JSON
 	int len = strlen(msg);    
 	if (msg[len - 1] == WRF_EOT)
 		len--;
 	
-	json = (json_char*)msg;
-	value = json_parse(json, len);
+	// Check if message conntains a value for our power, as a number or a string.
 	uint32_t new_power = power;
+	json_slice value = json_find(msg, len, "com.devicedrive.light", "power");
+	int64_t number;
+	if (json_slice_int(&value, &number))
+		new_power = (uint32_t)number;
 
-	// Check if message conntains a value for our power.
-	if (value && value->type == json_object) {
-		if (strcmp(value->u.object.values[0].name, "com.devicedrive.light") == 0) {
-			value = value->u.object.values[0].value;
-			int length = value->u.object.length;
-			for (int x = 0; x < length; x++) {
-				if (strcmp(value->u.object.values[x].name, "power") == 0)
-					new_power = atoi(value->u.object.values[x].value->u.string.ptr);
-			}
-		}
-	}
-	
 	// Now we set the LED to the new value
 	set_led(new_power);
 }
@@ -290,6 +287,7 @@ void init_wrf()
 	
 	// First we need to get our WRF instance
 	wrf = WRF::createInstance(uart_write_string, WRF_RECEIVE_BUFFER_SIZE, WRF_SEND_QUEUE_SIZE);
+	wrf->enableReceiveRing(WRF_RECEIVE_RING_SIZE);
 	
 	// Then we set up our wanted configurations
 	DEFAULT_WRF_CONFIG(config);
@@ -323,8 +321,9 @@ int main(void)
 	init_leds();
 	init_clock();
 	init_buttons();
-	init_uart();
+	// The UART interrupt hands bytes to wrf, so wrf must be there first.
 	init_wrf();
+	init_uart();
 
 	// When we start we want to tell the WRF01 how to behave!
 	wrf->send_config(config);
@@ -334,16 +333,8 @@ int main(void)
 	
 	while (true)
 	{
-		// We read our uart and asks wrf to handle it.
-		char byte = '\x0';
-		int res = app_uart_get((uint8_t*)&byte);
-		if (res == NRF_SUCCESS)
-		{
-			wrf->registerChar(byte);
-		}
-		
-		// We need to give the WRF SDK the possibility to send messages to the WRF. 
-		wrf->handleSendQueue();
+		// We let wrf parse what the UART interrupt has received and send the next message to the WRF.
+		wrf->process();
 		__SEV();
 		__WFE();
 		__WFE();
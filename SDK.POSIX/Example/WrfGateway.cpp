@@ -0,0 +1,157 @@
+/*	Copyright 2017 DeviceDrive AS
+*
+*	Licensed under the Apache License, Version 2.0 (the "License");
+*	you may not use this file except in compliance with the License.
+*	You may obtain a copy of the License at
+*
+*	http ://www.apache.org/licenses/LICENSE-2.0
+*
+*	Unless required by applicable law or agreed to in writing, software
+*	distributed under the License is distributed on an "AS IS" BASIS,
+*	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*	See the License for the specific language governing permissions and
+*	limitations under the License.
+*
+*/
+
+/*	Connects a WRF01 on a Linux serial port to the cloud, prints every cloud
+*	message and sends every line typed on stdin as a message.
+*
+*		WrfGateway <device> [baud]
+*
+*	The port and stdin are served from one epoll set, so nothing blocks and no
+*	thread is needed.
+*/
+
+#include "wrf_posix.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#define PRODUCT_KEY				"YOUR PRODUCT KEY"	/**< Product key from the DeviceDrive portal */
+#define GATEWAY_VERSION			"1.0.POSIX"
+#define POLL_INTERVAL_MS		3000				/**< Poll intervall in milliseconds */
+
+WRFPosix* wrf;										/**< Our wrf instance, see @ref init_wrf */
+wrf_config config;									/**< Our Wrf config, see @ref init_wrf */
+
+#pragma region WRF
+
+void onWrfStart()
+{
+	wrf->send_config(config);
+}
+
+void onWrfError(wrf_error* error)
+{
+	fprintf(stderr, "error %s\n", error->msg);
+}
+
+void onWrfConnected(wrf_device_state* state)
+{
+	printf("connected %s, rssi %d\n", state->mac, state->rssi);
+	// We start asking if there is anything for us
+	wrf->startPoll(POLL_INTERVAL_MS);
+}
+
+void onWrfNotConnected()
+{
+	// If we lose the connection we stop polling and make the WRF01 visible for Linkup
+	wrf->stopPoll();
+	wrf->setVisibility(-1);
+}
+
+void onMessageReceived(char* msg)
+{
+	printf("%.*s\n", (int)strcspn(msg, "\x04"), msg);
+	fflush(stdout);
+}
+
+void init_wrf(const char* device, int baud)
+{
+	wrf = WRFPosix::open(device, baud);
+	if (!wrf) {
+		perror(device);
+		exit(1);
+	}
+
+	DEFAULT_WRF_CONFIG(config);
+	config.debug_mode = WRF_MODE_ALL;
+	config.silent_connect = false;
+	config.product_key = (char*)PRODUCT_KEY;
+	config.version = (char*)GATEWAY_VERSION;
+
+	wrf->onError(onWrfError);
+	wrf->onPowerUp(onWrfStart);
+	wrf->onConnected(onWrfConnected);
+	wrf->onNotConnected(onWrfNotConnected);
+	wrf->onMessageReceived(onMessageReceived);
+}
+
+#pragma endregion
+
+/*	Sends each complete line on stdin. Returns false at the end of stdin. */
+static bool read_stdin()
+{
+	static char line[WRF_MESSAGE_MAX_SIZE];
+	static size_t length = 0;
+
+	ssize_t n = read(STDIN_FILENO, line + length, sizeof(line) - 1 - length);
+	if (n <= 0)
+		return false;
+	length += n;
+
+	char* start = line;
+	char* end;
+	while ((end = (char*)memchr(start, '\n', line + length - start)) != NULL) {
+		*end = 0x0;
+		if (end > start)
+			wrf->send(start);
+		start = end + 1;
+	}
+	length -= start - line;
+	memmove(line, start, length);
+	if (length == sizeof(line) - 1)
+		length = 0;		// A line longer than a message is dropped
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <device> [baud]\n", argv[0]);
+		return 1;
+	}
+	init_wrf(argv[1], argc > 2 ? atoi(argv[2]) : 115200);
+
+	// The WRF's epoll set is readable when the port needs attention
+	int epoll_fd = epoll_create1(0);
+	struct epoll_event event = {};
+	event.events = EPOLLIN;
+	event.data.fd = STDIN_FILENO;
+	epoll_ctl(epoll_fd, EPOLL_CTL_ADD, STDIN_FILENO, &event);
+	event.data.fd = wrf->epollFd();
+	epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wrf->epollFd(), &event);
+
+	// When we start we tell the WRF01 how to behave!
+	wrf->send_config(config);
+
+	bool has_stdin = true;
+	while (true) {
+		// The poll timer is in the WRF, so it is asked how long we may wait
+		int ready = epoll_wait(epoll_fd, &event, 1, wrf->nextTimeout());
+		if (ready > 0 && event.data.fd == STDIN_FILENO && !read_stdin() && has_stdin) {
+			epoll_ctl(epoll_fd, EPOLL_CTL_DEL, STDIN_FILENO, NULL);
+			has_stdin = false;
+		}
+		if (wrf->runOnce(0) < 0) {
+			perror("wrf");
+			break;
+		}
+	}
+
+	delete wrf;
+	return 1;
+}
@@ -0,0 +1,334 @@
+/*	Copyright 2017 DeviceDrive AS
+*
+*	Licensed under the Apache License, Version 2.0 (the "License");
+*	you may not use this file except in compliance with the License.
+*	You may obtain a copy of the License at
+*
+*	http ://www.apache.org/licenses/LICENSE-2.0
+*
+*	Unless required by applicable law or agreed to in writing, software
+*	distributed under the License is distributed on an "AS IS" BASIS,
+*	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*	See the License for the specific language governing permissions and
+*	limitations under the License.
+*
+*/
+
+#include "wrf_posix.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/uio.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#define WRF_POSIX_READ_SIZE 4096
+#define WRF_POSIX_MAX_SEGMENTS 8
+
+static uint64_t now_ms()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static speed_t speed_for(int baud)
+{
+	switch (baud)
+	{
+	case 9600: return B9600;
+	case 19200: return B19200;
+	case 38400: return B38400;
+	case 57600: return B57600;
+	case 115200: return B115200;
+	case 230400: return B230400;
+	case 460800: return B460800;
+	case 921600: return B921600;
+	default: return B0;
+	}
+}
+
+#pragma region Open and close
+
+WRFPosix::WRFPosix(int receive_buffer_size, int queue_size) :
+WRF() {
+	WRF::init_instance(NULL, receive_buffer_size, queue_size);
+	setWriter(write_serial);
+}
+
+WRFPosix::~WRFPosix()
+{
+	if (_epoll_fd >= 0)
+		close(_epoll_fd);
+	if (_fd >= 0)
+		close(_fd);
+}
+
+WRFPosix* WRFPosix::open(const char* device, int baud, int receive_buffer_size, int queue_size)
+{
+	WRFPosix* wrf = new WRFPosix(receive_buffer_size, queue_size);
+	if (!wrf->openPort(device, baud)) {
+		int error = errno;
+		delete wrf;
+		errno = error;
+		return NULL;
+	}
+	return wrf;
+}
+
+bool WRFPosix::openPort(const char* device, int baud)
+{
+	speed_t speed = speed_for(baud);
+	if (speed == B0) {
+		errno = EINVAL;
+		return false;
+	}
+
+	_fd = ::open(device, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+	if (_fd < 0)
+		return false;
+
+	// Raw 8N1 without flow control, so the protocol bytes are passed as they are
+	struct termios tio;
+	if (tcgetattr(_fd, &tio) < 0)
+		return false;
+	cfmakeraw(&tio);
+	tio.c_cflag |= CLOCAL | CREAD;
+	tio.c_cflag &= ~(CSTOPB | CRTSCTS);
+	tio.c_cc[VMIN] = 0;
+	tio.c_cc[VTIME] = 0;
+	cfsetispeed(&tio, speed);
+	cfsetospeed(&tio, speed);
+	if (tcsetattr(_fd, TCSANOW, &tio) < 0)
+		return false;
+	tcflush(_fd, TCIOFLUSH);
+
+	_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (_epoll_fd < 0)
+		return false;
+	struct epoll_event event = {};
+	event.events = EPOLLIN;
+	event.data.fd = _fd;
+	return epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, _fd, &event) == 0;
+}
+
+#pragma endregion
+
+#pragma region Handle Uart
+
+uint32_t WRFPosix::write_serial(WRF* wrf, const wrf_segment* segments, int count)
+{
+	((WRFPosix*)wrf)->write(segments, count);
+	return 0;
+}
+
+/*	Writes what the tty takes now and keeps the rest. Behind pending output
+*	everything is kept, so the bytes stay in order.
+*/
+void WRFPosix::write(const wrf_segment* segments, int count)
+{
+	size_t written = 0;
+	if (_tx_pending.empty() && _fd >= 0) {
+		struct iovec iov[WRF_POSIX_MAX_SEGMENTS];
+		int n = count < WRF_POSIX_MAX_SEGMENTS ? count : WRF_POSIX_MAX_SEGMENTS;
+		for (int i = 0; i < n; i++) {
+			iov[i].iov_base = (void*)segments[i].data;
+			iov[i].iov_len = segments[i].length;
+		}
+		ssize_t result;
+		do {
+			result = writev(_fd, iov, n);
+		} while (result < 0 && errno == EINTR);
+		if (result > 0) {
+			written = (size_t)result;
+			_stats.bytes_written += written;
+		}
+	}
+
+	size_t skip = written;
+	for (int i = 0; i < count; i++) {
+		size_t length = segments[i].length;
+		if (skip >= length) {
+			skip -= length;
+			continue;
+		}
+		_tx_pending.insert(_tx_pending.end(), segments[i].data + skip, segments[i].data + length);
+		skip = 0;
+	}
+
+	if (!_tx_pending.empty()) {
+		if (written > 0)
+			_stats.partial_writes++;
+		watchWrite(true);
+	}
+}
+
+/*	Writes pending output. Returns false if the port failed. */
+bool WRFPosix::flush()
+{
+	while (_tx_offset < _tx_pending.size()) {
+		ssize_t result = ::write(_fd, &_tx_pending[_tx_offset], _tx_pending.size() - _tx_offset);
+		if (result < 0) {
+			if (errno == EINTR)
+				continue;
+			return errno == EAGAIN || errno == EWOULDBLOCK;
+		}
+		_tx_offset += result;
+		_stats.bytes_written += result;
+	}
+
+	_tx_pending.clear();
+	_tx_offset = 0;
+	watchWrite(false);
+	return true;
+}
+
+/*	Reads until the tty is empty. Returns false if the port failed or was closed. */
+bool WRFPosix::readAll()
+{
+	uint8_t buffer[WRF_POSIX_READ_SIZE];
+	for (;;) {
+		ssize_t length = read(_fd, buffer, sizeof(buffer));
+		if (length > 0) {
+			_stats.bytes_read += length;
+			_stats.reads++;
+			registerBytes(buffer, length);
+			continue;
+		}
+		// With VMIN and VTIME at 0 a tty returns 0 when it is empty, a hang up
+		// comes as EPOLLHUP
+		if (length == 0)
+			return true;
+		if (errno == EINTR)
+			continue;
+		return errno == EAGAIN || errno == EWOULDBLOCK;
+	}
+}
+
+void WRFPosix::watchWrite(bool want_write)
+{
+	if (want_write == _want_write || _epoll_fd < 0)
+		return;
+
+	struct epoll_event event = {};
+	event.events = EPOLLIN | (want_write ? EPOLLOUT : 0);
+	event.data.fd = _fd;
+	if (epoll_ctl(_epoll_fd, EPOLL_CTL_MOD, _fd, &event) == 0)
+		_want_write = want_write;
+}
+
+#pragma endregion
+
+#pragma region Poll
+
+bool WRFPosix::preHandleResponse(wrf_result_code code, void* object)
+{
+	switch (code)
+	{
+	case WRF_EMPTY:
+	case WRF_MESSAGE:
+		_awaiting_poll = false;
+		break;
+	case WRF_LOCAL_ERROR:
+	case WRF_REMOTE_ERROR:
+		// Neither answers the poll
+		if (((wrf_error*)object)->code != WRF_ERROR_SYSTEM_BUSY && ((wrf_error*)object)->code != LIB_ERROR_COMMAND_TOO_LONG)
+			_awaiting_poll = false;
+		break;
+	default:
+		break;
+	}
+	return WRF::preHandleResponse(code, object);
+}
+
+void WRFPosix::startPoll(int interval_ms)
+{
+	_is_polling = true;
+	_awaiting_poll = false;
+	_poll_interval = interval_ms;
+	_last_poll = now_ms();
+}
+
+void WRFPosix::stopPoll()
+{
+	_is_polling = false;
+}
+
+/*	Milliseconds until the poll timer needs attention, -1 if it does not. */
+int WRFPosix::timeUntilPoll(uint64_t now)
+{
+	if (!_is_polling)
+		return -1;
+	// An unanswered poll is given up and sent again after three intervals
+	uint64_t due = _last_poll + (uint64_t)_poll_interval * (_awaiting_poll ? 3 : 1);
+	return due > now ? (int)(due - now) : 0;
+}
+
+void WRFPosix::handlePoll(uint64_t now)
+{
+	if (timeUntilPoll(now) != 0)
+		return;
+
+	poll();
+	_stats.polls++;
+	_awaiting_poll = true;
+	_last_poll = now;
+}
+
+#pragma endregion
+
+int WRFPosix::runOnce(int timeout_ms)
+{
+	int until_poll = timeUntilPoll(now_ms());
+	if (until_poll >= 0 && (timeout_ms < 0 || until_poll < timeout_ms))
+		timeout_ms = until_poll;
+
+	struct epoll_event event;
+	int ready = epoll_wait(_epoll_fd, &event, 1, timeout_ms);
+	if (ready < 0) {
+		if (errno != EINTR)
+			return -1;
+		ready = 0;
+	}
+
+	if (ready > 0) {
+		if ((event.events & EPOLLOUT) && !flush())
+			return -1;
+		if ((event.events & EPOLLIN) && !readAll())
+			return -1;
+		if ((event.events & (EPOLLERR | EPOLLHUP)) && !(event.events & EPOLLIN)) {
+			errno = EIO;
+			return -1;
+		}
+	}
+
+	handlePoll(now_ms());
+	handleSendQueue();
+	return ready;
+}
+
+int WRFPosix::nextTimeout()
+{
+	return timeUntilPoll(now_ms());
+}
+
+size_t WRFPosix::pendingOutput()
+{
+	return _tx_pending.size() - _tx_offset;
+}
+
+int WRFPosix::fd()
+{
+	return _fd;
+}
+
+int WRFPosix::epollFd()
+{
+	return _epoll_fd;
+}
+
+const wrf_posix_stats& WRFPosix::stats()
+{
+	return _stats;
+}
@@ -0,0 +1,118 @@
+/*	Copyright 2017 DeviceDrive AS
+*
+*	Licensed under the Apache License, Version 2.0 (the "License");
+*	you may not use this file except in compliance with the License.
+*	You may obtain a copy of the License at
+*
+*	http ://www.apache.org/licenses/LICENSE-2.0
+*
+*	Unless required by applicable law or agreed to in writing, software
+*	distributed under the License is distributed on an "AS IS" BASIS,
+*	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*	See the License for the specific language governing permissions and
+*	limitations under the License.
+*
+*/
+
+/**@file
+*
+*	@brief		WRF01 on a Linux serial port
+*	@details	WRFPosix opens a tty (or pty) in raw mode and drives the WRF from
+*				an epoll loop: @ref WRFPosix::runOnce waits for received bytes, room
+*				to write or the next timer, handles what happened and returns.
+*				Nothing blocks, so one thread can serve several ports beside other work,
+*				and @ref WRFPosix::epollFd can be added to an epoll set of the
+*				application.
+*
+*				Writes are non-blocking. What the tty does not take at once is kept
+*				and written when the port is writable again, so a message is never
+*				cut.
+*/
+
+#pragma once
+
+#include "wrf_sdk.h"
+#include <stdint.h>
+#include <vector>
+
+#define DEFAULT_WRF_POSIX_RECEIVE_BUFFER_SIZE 1024
+#define DEFAULT_WRF_POSIX_QUEUE_SIZE 10
+
+/*	@brief	What the port has done since it was opened. */
+typedef struct {
+	uint64_t bytes_read;
+	uint64_t bytes_written;
+	uint32_t reads;					// read calls that returned data
+	uint32_t partial_writes;		// Writes the tty did not take all of
+	uint32_t polls;					// Polls sent by the poll timer
+}wrf_posix_stats;
+
+class WRFPosix : public WRF {
+private:
+	int _fd = -1;
+	int _epoll_fd = -1;
+	bool _want_write = false;		// EPOLLOUT is set, there is pending output
+
+	std::vector<unsigned char> _tx_pending;
+	size_t _tx_offset = 0;
+
+	bool _is_polling = false;
+	bool _awaiting_poll = false;
+	uint64_t _last_poll = 0;
+	int _poll_interval = 10000;
+
+	wrf_posix_stats _stats = {};
+
+	WRFPosix(int receive_buffer_size, int queue_size);
+
+	static uint32_t write_serial(WRF* wrf, const wrf_segment* segments, int count);
+
+	bool openPort(const char* device, int baud);
+	void write(const wrf_segment* segments, int count);
+	bool flush();
+	bool readAll();
+	void watchWrite(bool want_write);
+	int timeUntilPoll(uint64_t now);
+	void handlePoll(uint64_t now);
+
+protected:
+	bool preHandleResponse(wrf_result_code code, void* object);
+
+public:
+	~WRFPosix();
+
+	/*	@brief	Opens @ref device at @ref baud. Each port gets its own WRFPosix, free
+	*			it with delete.
+	*
+	*	@retval	NULL if the port could not be opened or the baud rate is not
+	*			supported, errno tells why.
+	*/
+	static WRFPosix* open(const char* device, int baud = 115200,
+		int receive_buffer_size = DEFAULT_WRF_POSIX_RECEIVE_BUFFER_SIZE,
+		int queue_size = DEFAULT_WRF_POSIX_QUEUE_SIZE);
+
+	/*	@brief	Waits up to @ref timeout_ms for the port or the poll timer, handles
+	*			it and sends the next queued message. -1 waits until something
+	*			happens, 0 does not wait.
+	*
+	*	@retval	Number of port events handled, or -1 if the port failed or was
+	*			closed, errno tells why.
+	*/
+	int runOnce(int timeout_ms);
+
+	/*	@brief	Milliseconds until @ref runOnce is due for a timer, -1 for none. For
+	*			waiting on @ref epollFd in a loop of the application.
+	*/
+	int nextTimeout();
+
+	/*	@brief	Polls the WRF01 for cloud messages every @ref interval_ms. */
+	void startPoll(int interval_ms);
+	void stopPoll();
+
+	/*	@brief	Bytes written to the WRF that the tty has not taken yet. */
+	size_t pendingOutput();
+
+	int fd();
+	int epollFd();
+	const wrf_posix_stats& stats();
+};
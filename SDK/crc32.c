@@ -1,21 +1,13 @@
 #include "crc32.h"
+#include "crc32_table.h"
 #include <stdlib.h> // malloc & free
 
 unsigned int * createCrcTable(void)
 {
-	unsigned int* crc_table;
-	unsigned int c;
-	unsigned int i, j;
-	crc_table = (unsigned int*)malloc(256 * 4);
-	for (i = 0; i < 256; i++) {
-		c = (unsigned int)i;
-		for (j = 0; j < 8; j++) {
-			if (c & 1)
-				c = 0xedb88320L ^ (c >> 1);
-			else
-				c = c >> 1;
-		}
-		crc_table[i] = c;
+	unsigned int* crc_table = (unsigned int*)malloc(256 * sizeof(unsigned int));
+	if (crc_table) {
+		for (int i = 0; i < 256; i++)
+			crc_table[i] = crc32_table[0][i];
 	}
 	return crc_table;
 }
@@ -29,12 +21,81 @@ unsigned int crc32(unsigned int crc, unsigned int* crc_table, unsigned char *buf
 	return crc;
 }
 
-/* Replace this function with your implementation */
-unsigned int calcCrc(unsigned char* buffer, int size)
+#pragma region Slice kernels
+
+uint32_t crc32_update_slice1(uint32_t crc, const void* buffer, size_t size)
+{
+	const uint8_t* p = (const uint8_t*)buffer;
+	while (size--)
+		crc = crc32_table[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+	return crc;
+}
+
+#if CRC32_SLICES >= 4
+/*	Little endian load that does not care about alignment or byte order of the host. */
+static uint32_t load32(const uint8_t* p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+uint32_t crc32_update_slice4(uint32_t crc, const void* buffer, size_t size)
+{
+	const uint8_t* p = (const uint8_t*)buffer;
+	for (; size >= 4; size -= 4, p += 4) {
+		crc ^= load32(p);
+		crc = crc32_table[3][crc & 0xFF] ^
+			crc32_table[2][(crc >> 8) & 0xFF] ^
+			crc32_table[1][(crc >> 16) & 0xFF] ^
+			crc32_table[0][crc >> 24];
+	}
+	return crc32_update_slice1(crc, p, size);
+}
+#endif
+
+#if CRC32_SLICES >= 8
+uint32_t crc32_update_slice8(uint32_t crc, const void* buffer, size_t size)
+{
+	const uint8_t* p = (const uint8_t*)buffer;
+	for (; size >= 8; size -= 8, p += 8) {
+		uint32_t low = load32(p) ^ crc;
+		uint32_t high = load32(p + 4);
+		crc = crc32_table[7][low & 0xFF] ^
+			crc32_table[6][(low >> 8) & 0xFF] ^
+			crc32_table[5][(low >> 16) & 0xFF] ^
+			crc32_table[4][low >> 24] ^
+			crc32_table[3][high & 0xFF] ^
+			crc32_table[2][(high >> 8) & 0xFF] ^
+			crc32_table[1][(high >> 16) & 0xFF] ^
+			crc32_table[0][high >> 24];
+	}
+	return crc32_update_slice1(crc, p, size);
+}
+#endif
+
+#pragma endregion
+
+uint32_t crc32_init(void)
+{
+	return 0xFFFFFFFF;
+}
+
+uint32_t crc32_update(uint32_t crc, const void* buffer, size_t size)
+{
+#if CRC32_SLICES == 8
+	return crc32_update_slice8(crc, buffer, size);
+#elif CRC32_SLICES == 4
+	return crc32_update_slice4(crc, buffer, size);
+#else
+	return crc32_update_slice1(crc, buffer, size);
+#endif
+}
+
+uint32_t crc32_final(uint32_t crc)
 {
-	unsigned int *crc_table = createCrcTable();
-	unsigned int crc = 0xffffffff;
-	crc = crc32(crc, crc_table, buffer, size);
-	free(crc_table);
 	return ~crc;
-}
\ No newline at end of file
+}
+
+unsigned int calcCrc(unsigned char* buffer, int size)
+{
+	return crc32_final(crc32_update(crc32_init(), buffer, size));
+}
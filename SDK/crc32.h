@@ -1,8 +1,56 @@
 #ifndef _CRC32_H
 #define _CRC32_H
 
+#include <stdint.h>
+#include <stddef.h>
+
+/*	@brief	Bytes handled per table lookup round: 1, 4 or 8.
+*
+*	@note	Each step up costs flash for more tables (1 KB per slice) and makes
+*			checksumming faster. The tables are generated by tools/crc32_table.py.
+*/
+#ifndef CRC32_SLICES
+#define CRC32_SLICES 4
+#endif
+
+#if CRC32_SLICES != 1 && CRC32_SLICES != 4 && CRC32_SLICES != 8
+#error "CRC32_SLICES must be 1, 4 or 8"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*	@brief		Functions for calculating a CRC32 in parts.
+*
+*	@details	crc = crc32_init();
+*				crc = crc32_update(crc, part, length); // For each part
+*				checksum = crc32_final(crc);
+*/
+uint32_t crc32_init(void);
+uint32_t crc32_update(uint32_t crc, const void* buffer, size_t size);
+uint32_t crc32_final(uint32_t crc);
+
+/*	@brief	Update functions of each slice variant, for comparing them.
+*			Variants with more slices than CRC32_SLICES are not available.
+*/
+uint32_t crc32_update_slice1(uint32_t crc, const void* buffer, size_t size);
+#if CRC32_SLICES >= 4
+uint32_t crc32_update_slice4(uint32_t crc, const void* buffer, size_t size);
+#endif
+#if CRC32_SLICES >= 8
+uint32_t crc32_update_slice8(uint32_t crc, const void* buffer, size_t size);
+#endif
+
+/*	@brief	Calculates the CRC32 of a buffer in one go. */
 unsigned int calcCrc(unsigned char* buffer, int size);
+
+/*	@note	Kept for existing users. The table is allocated and must be freed. */
 unsigned int* createCrcTable(void);
 unsigned int crc32(unsigned int crc, unsigned int* crc_table, unsigned char* buffer, unsigned int size);
 
-#endif
\ No newline at end of file
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -28,6 +28,7 @@
  */
 
 #include "json.h"
+#include "wrf_memory.h"
 
 #ifdef _MSC_VER
    #ifndef _CRT_SECURE_NO_WARNINGS
@@ -40,7 +41,6 @@ const struct _json_value json_value_none;
 #include <stdio.h>
 #include <string.h>
 #include <ctype.h>
-#include <math.h>
 
 typedef unsigned int json_uchar;
 
@@ -60,6 +60,25 @@ static unsigned char hex_value (json_char c)
    }
 }
 
+/* When parsing in place, values and the value lists of arrays and objects are
+ * taken from a chain of blocks. The root is the first value in the first block,
+ * so json_value_free_inplace finds the chain from it.
+ */
+typedef struct _json_block
+{
+   struct _json_block * next;
+   size_t used, size;
+
+} json_block;
+
+#define json_align(size)  (((size) + 7) & ~ (size_t) 7)
+#define json_block_header  json_align (sizeof (json_block))
+
+/* Children of the open arrays and objects are kept here until they are closed,
+ * and this many fit before the stack is moved to the heap.
+ */
+#define json_inplace_stack 16
+
 typedef struct
 {
    unsigned long used_memory;
@@ -73,16 +92,26 @@ typedef struct
    const json_char * ptr;
    unsigned int cur_line, cur_col;
 
+   int in_place;
+   json_block * first_block, * block;
+
+   json_object_entry * stack;
+   unsigned int stack_length, stack_size;
+   int stack_allocated;
+
+   json_char * name;  /* of the object member parsed next */
+   unsigned int name_length;
+
 } json_state;
 
 static void * default_alloc (size_t size, int zero, void * user_data)
 {
-   return zero ? calloc (1, size) : malloc (size);
+   return zero ? wrf_calloc (size, WRF_ALLOC_JSON) : wrf_malloc (size, WRF_ALLOC_JSON);
 }
 
 static void default_free (void * ptr, void * user_data)
 {
-   free (ptr);
+   wrf_free (ptr);
 }
 
 static void * json_alloc (json_state * state, unsigned long size, int zero)
@@ -99,6 +128,159 @@ static void * json_alloc (json_state * state, unsigned long size, int zero)
    return state->settings.mem_alloc (size, zero, state->settings.user_data);
 }
 
+static void * block_alloc (json_state * state, size_t size)
+{
+   json_block * block = state->block;
+
+   size = json_align (size);
+
+   if (!block || block->size - block->used < size)
+   {
+      size_t block_size = size > json_inplace_block_size ? size : json_inplace_block_size;
+
+      if (! (block = (json_block *) json_alloc (state, json_block_header + block_size, 0)))
+         return 0;
+
+      block->used = 0;
+      block->size = block_size;
+
+      if (state->first_block)
+      {
+         block->next = state->first_block->next;
+         state->first_block->next = block;
+      }
+      else
+      {
+         block->next = 0;
+         state->first_block = block;
+      }
+
+      state->block = block;
+   }
+
+   block->used += size;
+
+   return ((char *) block) + json_block_header + block->used - size;
+}
+
+static void free_blocks (json_settings * settings, json_block * block)
+{
+   while (block)
+   {
+      json_block * next = block->next;
+      settings->mem_free (block, settings->user_data);
+      block = next;
+   }
+}
+
+static int push_child (json_state * state, json_value * value)
+{
+   json_object_entry * entry;
+
+   if (state->stack_length == state->stack_size)
+   {
+      json_object_entry * stack = (json_object_entry *) json_alloc
+         (state, state->stack_size * 2 * sizeof (json_object_entry), 0);
+
+      if (!stack)
+         return 0;
+
+      memcpy (stack, state->stack, state->stack_length * sizeof (json_object_entry));
+
+      if (state->stack_allocated)
+         state->settings.mem_free (state->stack, state->settings.user_data);
+
+      state->stack = stack;
+      state->stack_size *= 2;
+      state->stack_allocated = 1;
+   }
+
+   entry = state->stack + state->stack_length ++;
+
+   entry->name = state->name;
+   entry->name_length = state->name_length;
+   entry->value = value;
+
+   return 1;
+}
+
+/* Moves the children of a closed array or object from the stack to a list of
+ * the right length.
+ */
+static int end_container (json_state * state, json_value * value)
+{
+   unsigned int length = value->u.array.length, i;
+   json_object_entry * children = state->stack + state->stack_length - length;
+
+   if (length == 0)
+      return 1;
+
+   if (value->type == json_array)
+   {
+      json_value ** values = (json_value **) block_alloc
+         (state, length * sizeof (json_value *));
+
+      if (!values)
+         return 0;
+
+      for (i = 0; i < length; ++ i)
+         values [i] = children [i].value;
+
+      value->u.array.values = values;
+   }
+   else
+   {
+      json_object_entry * values = (json_object_entry *) block_alloc
+         (state, length * sizeof (json_object_entry));
+
+      if (!values)
+         return 0;
+
+      memcpy (values, children, length * sizeof (json_object_entry));
+
+      value->u.object.values = values;
+   }
+
+   state->stack_length -= length;
+
+   return 1;
+}
+
+static int new_inplace_value (json_state * state,
+                              json_value ** top, json_value ** root,
+                              json_type type)
+{
+   size_t size = sizeof (json_value) + state->settings.value_extra;
+   json_value * value;
+
+   if (! (value = (json_value *) block_alloc (state, size)))
+      return 0;
+
+   memset (value, 0, size);
+
+   if (!*root)
+      *root = value;
+
+   value->type = type;
+   value->parent = *top;
+
+   #ifdef JSON_TRACK_SOURCE
+      value->line = state->cur_line;
+      value->col = state->cur_col;
+   #endif
+
+   /* Unescaped over the source, behind the closing quote */
+   if (type == json_string)
+      value->u.string.ptr = (json_char *) state->ptr + 1;
+
+   if (value->parent && !push_child (state, value))
+      return 0;
+
+   *top = value;
+
+   return 1;
+}
+
 static int new_value (json_state * state,
                       json_value ** top, json_value ** root, json_value ** alloc,
                       json_type type)
@@ -106,6 +288,9 @@ static int new_value (json_state * state,
    json_value * value;
    int values_size;
 
+   if (state->in_place)
+      return new_inplace_value (state, top, root, type);
+
    if (!state->first_pass)
    {
       value = *top = *alloc;
@@ -124,6 +309,7 @@ static int new_value (json_state * state,
             if (! (value->u.array.values = (json_value **) json_alloc
                (state, value->u.array.length * sizeof (json_value *), 0)) )
             {
+               value->u.array.length = 0;  /* nothing to free */
                return 0;
             }
 
@@ -140,6 +326,7 @@ static int new_value (json_state * state,
             if (! (value->u.object.values = (json_object_entry *) json_alloc
                   (state, values_size + ((unsigned long) value->u.object.values), 0)) )
             {
+               value->u.object.length = 0;  /* nothing to free */
                return 0;
             }
 
@@ -216,20 +403,121 @@ static const long
    flag_num_e_got_sign   = 1 << 11,
    flag_num_e_negative   = 1 << 12,
    flag_line_comment     = 1 << 13,
-   flag_block_comment    = 1 << 14;
+   flag_block_comment    = 1 << 14,
+   flag_num_fraction     = 1L << 15,
+   flag_num_dropped      = 1L << 16;
 
-json_value * json_parse_ex (json_settings * settings,
-                            const json_char * json,
-                            size_t length,
-                            char * error_buf)
+#define json_int_max \
+   ((json_int_t) (~ 0ULL >> ((sizeof (unsigned long long) - sizeof (json_int_t)) * 8 + 1)))
+
+/* Exponents beyond this give zero or infinity anyway */
+#define json_exponent_max 100000
+
+#ifndef JSON_NO_DOUBLE
+
+/* value * 10^exponent by powers of ten, so libm is not needed */
+static double scale_double (double value, long exponent)
+{
+   static const double powers [] =
+      { 1e1, 1e2, 1e4, 1e8, 1e16, 1e32, 1e64, 1e128, 1e256 };
+
+   unsigned long e = exponent < 0 ? - exponent : exponent;
+   double scale = 1;
+   int i;
+
+   /* Below this even the largest mantissa is less than half the smallest
+    * double. Above it 10^-exponent would still be zero or infinite, so the
+    * last 10^300 is divided on its own.
+    */
+   if (exponent < -343)
+      return 0;
+
+   if (exponent < -300)
+      return scale_double (value, exponent + 300) / 1e300;
+
+   for (i = 0; e && i < (int) (sizeof (powers) / sizeof (powers [0])); ++ i, e >>= 1)
+   {
+      if (e & 1)
+         scale *= powers [i];
+   }
+
+   if (e)
+      return exponent < 0 || value == 0 ? 0 : value * 1e256 * 1e256;
+
+   return exponent < 0 ? value / scale : value * scale;
+}
+
+#endif
+
+/* Gives a number its value once all of it is read. The digits are in
+ * value->u.integer, and exponent says where the decimal point goes.
+ * Returns 0 if the number does not fit.
+ */
+static int end_number (json_value * value, long flags, long exponent)
+{
+   json_int_t mantissa = value->u.integer;
+   int negative = (flags & flag_num_negative) != 0;
+
+   if (! (flags & (flag_num_fraction | flag_num_e)) && exponent == 0)
+   {
+      value->u.integer = negative ? - mantissa : mantissa;
+      return 1;
+   }
+
+   #ifdef JSON_NO_DOUBLE
+   {
+      json_int_t scale;
+
+      for (scale = JSON_FIXED_SCALE; scale > 1; scale /= 10)
+         ++ exponent;
+
+      /* The first dropped fraction digit is what made the mantissa too
+       * large, so the value does not fit if that digit is still needed.
+       */
+      if (exponent > 0 && (flags & flag_num_dropped))
+         return 0;
+
+      for (; exponent > 0 && mantissa; -- exponent)
+      {
+         if (mantissa > json_int_max / 10)
+            return 0;
+
+         mantissa *= 10;
+      }
+
+      for (; exponent < 0 && mantissa; ++ exponent)
+         mantissa /= 10;
+
+      value->type = json_fixed;
+      value->u.integer = negative ? - mantissa : mantissa;
+   }
+   #else
+
+      value->type = json_double;
+      value->u.dbl = scale_double ((double) mantissa, exponent);
+
+      if (negative)
+         value->u.dbl = - value->u.dbl;
+
+   #endif
+
+   return 1;
+}
+
+static json_value * parse (json_settings * settings,
+                           const json_char * json,
+                           size_t length,
+                           char * error_buf,
+                           int in_place)
 {
    json_char error [json_error_max];
+   json_object_entry stack [json_inplace_stack];
    const json_char * end;
    json_value * top, * root, * alloc = 0;
    json_state state = { 0 };
    long flags;
    long num_digits = 0, num_e = 0;
-   json_int_t num_fraction = 0;
+   long num_fraction_digits = 0, num_shift = 0;
 
    /* Skip UTF-8 BOM
     */
@@ -258,7 +546,12 @@ json_value * json_parse_ex (json_settings * settings,
    state.uint_max -= 8; /* limit of how much can be added before next check */
    state.ulong_max -= 8;
 
-   for (state.first_pass = 1; state.first_pass >= 0; -- state.first_pass)
+   /* In place there is nothing to size, so one pass is enough */
+   state.in_place = in_place;
+   state.stack = stack;
+   state.stack_size = json_inplace_stack;
+
+   for (state.first_pass = !in_place; state.first_pass >= 0; -- state.first_pass)
    {
       json_uchar uchar;
       unsigned char uc_b1, uc_b2, uc_b3, uc_b4;
@@ -404,7 +697,9 @@ json_value * json_parse_ex (json_settings * settings,
 
                   case json_object:
 
-                     if (state.first_pass)
+                     if (state.in_place)
+                        state.name_length = string_length;
+                     else if (state.first_pass)
                         (*(json_char **) &top->u.object.values) += string_length + 1;
                      else
                      {  
@@ -643,7 +938,7 @@ json_value * json_parse_ex (json_settings * settings,
                            if (!new_value (&state, &top, &root, &alloc, json_integer))
                               goto e_alloc_failure;
 
-                           if (!state.first_pass)
+                           if (!state.first_pass && !state.in_place)
                            {
                               while (isdigit (b) || b == '+' || b == '-'
                                         || b == 'e' || b == 'E' || b == '.')
@@ -663,10 +958,12 @@ json_value * json_parse_ex (json_settings * settings,
 
                            flags &= ~ (flag_num_negative | flag_num_e |
                                         flag_num_e_got_sign | flag_num_e_negative |
-                                           flag_num_zero);
+                                           flag_num_zero | flag_num_fraction |
+                                              flag_num_dropped);
 
                            num_digits = 0;
-                           num_fraction = 0;
+                           num_fraction_digits = 0;
+                           num_shift = 0;
                            num_e = 0;
 
                            if (b != '-')
@@ -705,7 +1002,11 @@ json_value * json_parse_ex (json_settings * settings,
 
                      flags |= flag_string;
 
-                     string = (json_char *) top->_reserved.object_mem;
+                     if (state.in_place)
+                        string = state.name = (json_char *) state.ptr + 1;
+                     else
+                        string = (json_char *) top->_reserved.object_mem;
+
                      string_length = 0;
 
                      break;
@@ -731,36 +1032,47 @@ json_value * json_parse_ex (json_settings * settings,
                break;
 
             case json_integer:
-            case json_double:
 
                if (isdigit (b))
                {
                   ++ num_digits;
 
-                  if (top->type == json_integer || flags & flag_num_e)
+                  if (flags & flag_num_e)
                   {
-                     if (! (flags & flag_num_e))
-                     {
-                        if (flags & flag_num_zero)
-                        {  sprintf (error, "%d:%d: Unexpected `0` before `%c`", line_and_col, b);
-                           goto e_failed;
-                        }
+                     flags |= flag_num_e_got_sign;
 
-                        if (num_digits == 1 && b == '0')
-                           flags |= flag_num_zero;
-                     }
-                     else
-                     {
-                        flags |= flag_num_e_got_sign;
+                     if (num_e < json_exponent_max)
                         num_e = (num_e * 10) + (b - '0');
-                        continue;
+
+                     continue;
+                  }
+
+                  if (! (flags & flag_num_fraction))
+                  {
+                     if (flags & flag_num_zero)
+                     {  sprintf (error, "%d:%d: Unexpected `0` before `%c`", line_and_col, b);
+                        goto e_failed;
                      }
 
+                     if (num_digits == 1 && b == '0')
+                        flags |= flag_num_zero;
+                  }
+
+                  /* All digits go to one integer. Digits that do not fit are
+                   * dropped, before the point they move it instead.
+                   */
+                  if (top->u.integer <= (json_int_max - (b - '0')) / 10)
+                  {
                      top->u.integer = (top->u.integer * 10) + (b - '0');
-                     continue;
+
+                     if (flags & flag_num_fraction)
+                        ++ num_fraction_digits;
                   }
+                  else if (! (flags & flag_num_fraction))
+                     ++ num_shift;
+                  else
+                     flags |= flag_num_dropped;
 
-                  num_fraction = (num_fraction * 10) + (b - '0');
                   continue;
                }
 
@@ -776,15 +1088,14 @@ json_value * json_parse_ex (json_settings * settings,
                      continue;
                   }
                }
-               else if (b == '.' && top->type == json_integer)
+               else if (b == '.' && ! (flags & (flag_num_fraction | flag_num_e)))
                {
                   if (!num_digits)
                   {  sprintf (error, "%d:%d: Expected digit before `.`", line_and_col);
                      goto e_failed;
                   }
 
-                  top->type = json_double;
-                  top->u.dbl = (double) top->u.integer;
+                  flags |= flag_num_fraction;
 
                   num_digits = 0;
                   continue;
@@ -792,26 +1103,15 @@ json_value * json_parse_ex (json_settings * settings,
 
                if (! (flags & flag_num_e))
                {
-                  if (top->type == json_double)
-                  {
-                     if (!num_digits)
-                     {  sprintf (error, "%d:%d: Expected digit after `.`", line_and_col);
-                        goto e_failed;
-                     }
-
-                     top->u.dbl += ((double) num_fraction) / (pow (10.0, (double) num_digits));
+                  if ((flags & flag_num_fraction) && !num_digits)
+                  {  sprintf (error, "%d:%d: Expected digit after `.`", line_and_col);
+                     goto e_failed;
                   }
 
                   if (b == 'e' || b == 'E')
                   {
                      flags |= flag_num_e;
 
-                     if (top->type == json_integer)
-                     {
-                        top->type = json_double;
-                        top->u.dbl = (double) top->u.integer;
-                     }
-
                      num_digits = 0;
                      flags &= ~ flag_num_zero;
 
@@ -824,17 +1124,12 @@ json_value * json_parse_ex (json_settings * settings,
                   {  sprintf (error, "%d:%d: Expected digit after `e`", line_and_col);
                      goto e_failed;
                   }
-
-                  top->u.dbl *= pow (10.0, (double)
-                      (flags & flag_num_e_negative ? - num_e : num_e));
                }
 
-               if (flags & flag_num_negative)
-               {
-                  if (top->type == json_integer)
-                     top->u.integer = - top->u.integer;
-                  else
-                     top->u.dbl = - top->u.dbl;
+               if (!end_number (top, flags, (flags & flag_num_e_negative ? - num_e : num_e)
+                                    + num_shift - num_fraction_digits))
+               {  sprintf (error, "%d:%d: Number too large", line_and_col);
+                  goto e_failed;
                }
 
                flags |= flag_next | flag_reproc;
@@ -855,6 +1150,12 @@ json_value * json_parse_ex (json_settings * settings,
          {
             flags = (flags & ~ flag_next) | flag_need_comma;
 
+            if (state.in_place && (top->type == json_object || top->type == json_array)
+                  && !end_container (&state, top))
+            {
+               goto e_alloc_failure;
+            }
+
             if (!top->parent)
             {
                /* root value done */
@@ -866,7 +1167,7 @@ json_value * json_parse_ex (json_settings * settings,
             if (top->parent->type == json_array)
                flags |= flag_seek_value;
                
-            if (!state.first_pass)
+            if (!state.first_pass && !state.in_place)
             {
                json_value * parent = top->parent;
 
@@ -903,6 +1204,9 @@ json_value * json_parse_ex (json_settings * settings,
       alloc = root;
    }
 
+   if (state.stack_allocated)
+      state.settings.mem_free (state.stack, state.settings.user_data);
+
    return root;
 
 e_unknown_value:
@@ -930,6 +1234,15 @@ e_failed:
          strcpy (error_buf, "Unknown error");
    }
 
+   if (state.in_place)
+   {
+      if (state.stack_allocated)
+         state.settings.mem_free (state.stack, state.settings.user_data);
+
+      free_blocks (&state.settings, state.first_block);
+      return 0;
+   }
+
    if (state.first_pass)
       alloc = root;
 
@@ -946,12 +1259,34 @@ e_failed:
    return 0;
 }
 
+json_value * json_parse_ex (json_settings * settings,
+                            const json_char * json,
+                            size_t length,
+                            char * error_buf)
+{
+   return parse (settings, json, length, error_buf, 0);
+}
+
 json_value * json_parse (const json_char * json, size_t length)
 {
    json_settings settings = { 0 };
    return json_parse_ex (&settings, json, length, 0);
 }
 
+json_value * json_parse_inplace_ex (json_settings * settings,
+                                    json_char * json,
+                                    size_t length,
+                                    char * error_buf)
+{
+   return parse (settings, json, length, error_buf, 1);
+}
+
+json_value * json_parse_inplace (json_char * json, size_t length)
+{
+   json_settings settings = { 0 };
+   return json_parse_inplace_ex (&settings, json, length, 0);
+}
+
 void json_value_free_ex (json_settings * settings, json_value * value)
 {
    json_value * cur_value;
@@ -1009,3 +1344,17 @@ void json_value_free (json_value * value)
    json_value_free_ex (&settings, value);
 }
 
+void json_value_free_inplace_ex (json_settings * settings, json_value * value)
+{
+   if (!value)
+      return;
+
+   free_blocks (settings, (json_block *) (((char *) value) - json_block_header));
+}
+
+void json_value_free_inplace (json_value * value)
+{
+   json_settings settings = { 0 };
+   settings.mem_free = default_free;
+   json_value_free_inplace_ex (&settings, value);
+}
@@ -44,6 +44,24 @@
    #endif
 #endif
 
+/* Numbers with a fraction or an exponent are json_double: exact for up to 15
+ * digits and exponents up to 22, within a few ulp of strtod beyond, infinite or
+ * zero outside the range of a double. With JSON_NO_DOUBLE
+ * defined json.c does no floating point at all, for targets without an FPU:
+ * such numbers are json_fixed instead, an integer count of 1 / JSON_FIXED_SCALE,
+ * and become a double only if the application converts them. Integers that do
+ * not fit in json_int_t are a parse error then.
+ */
+#ifdef JSON_NO_DOUBLE
+   #ifndef JSON_FIXED_SCALE
+      #define JSON_FIXED_SCALE 1000  /* a power of ten */
+   #endif
+#endif
+
+#ifndef json_inplace_block_size
+   #define json_inplace_block_size 256  /* bytes of values per allocation in place */
+#endif
+
 #include <stdlib.h>
 
 #ifdef __cplusplus
@@ -83,7 +101,8 @@ typedef enum
    json_double,
    json_string,
    json_boolean,
-   json_null
+   json_null,
+   json_fixed
 
 } json_type;
 
@@ -107,8 +126,11 @@ typedef struct _json_value
    union
    {
       int boolean;
-      json_int_t integer;
-      double dbl;
+      json_int_t integer;  /* also json_fixed */
+
+      #ifndef JSON_NO_DOUBLE
+         double dbl;
+      #endif
 
       struct
       {
@@ -220,8 +242,13 @@ typedef struct _json_value
                case json_integer:
                   return u.integer;
 
-               case json_double:
-                  return (json_int_t) u.dbl;
+               #ifdef JSON_NO_DOUBLE
+                  case json_fixed:
+                     return u.integer / JSON_FIXED_SCALE;
+               #else
+                  case json_double:
+                     return (json_int_t) u.dbl;
+               #endif
 
                default:
                   return 0;
@@ -243,8 +270,13 @@ typedef struct _json_value
                case json_integer:
                   return (double) u.integer;
 
-               case json_double:
-                  return u.dbl;
+               #ifdef JSON_NO_DOUBLE
+                  case json_fixed:
+                     return (double) u.integer / JSON_FIXED_SCALE;
+               #else
+                  case json_double:
+                     return u.dbl;
+               #endif
 
                default:
                   return 0;
@@ -274,6 +306,25 @@ void json_value_free_ex (json_settings * settings,
                          json_value *);
 
 
+/* Parses json in place: strings and object names are unescaped and null
+ * terminated inside json, and the values point into it, so json is changed and
+ * must live as long as the result. Only the values are allocated, a few of them
+ * at a time, in one pass. Free the root with json_value_free_inplace.
+ */
+json_value * json_parse_inplace (json_char * json,
+                                 size_t length);
+
+json_value * json_parse_inplace_ex (json_settings * settings,
+                                    json_char * json,
+                                    size_t length,
+                                    char * error);
+
+void json_value_free_inplace (json_value *);
+
+void json_value_free_inplace_ex (json_settings * settings,
+                                 json_value *);
+
+
 #ifdef __cplusplus
    } /* extern "C" */
 #endif
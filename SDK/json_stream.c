@@ -0,0 +1,433 @@
+/*	Copyright 2017 DeviceDrive AS
+*
+*	Licensed under the Apache License, Version 2.0 (the "License");
+*	you may not use this file except in compliance with the License.
+*	You may obtain a copy of the License at
+*
+*	http ://www.apache.org/licenses/LICENSE-2.0
+*
+*	Unless required by applicable law or agreed to in writing, software
+*	distributed under the License is distributed on an "AS IS" BASIS,
+*	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*	See the License for the specific language governing permissions and
+*	limitations under the License.
+*
+*/
+
+#include "json_stream.h"
+#include <stddef.h>
+
+enum {
+	ST_VALUE,			// Expecting a value
+	ST_FIRST_VALUE,		// After '[', expecting a value or ']'
+	ST_FIRST_KEY,		// After '{', expecting a key or '}'
+	ST_KEY,				// After ',' in an object, expecting a key
+	ST_COLON,			// After a key
+	ST_NEXT,			// After a value, expecting ',' or the end of the container
+	ST_STRING,
+	ST_ESCAPE,
+	ST_UNICODE,
+	ST_NUMBER_MINUS,	// After '-', expecting a digit
+	ST_NUMBER_ZERO,		// After a leading 0, expecting '.', an exponent or the end
+	ST_NUMBER,			// In the integer part
+	ST_NUMBER_POINT,	// After '.', expecting a digit
+	ST_NUMBER_FRACTION,
+	ST_NUMBER_E,		// After 'e', expecting a sign or a digit
+	ST_NUMBER_E_SIGN,	// After the sign of the exponent, expecting a digit
+	ST_NUMBER_EXPONENT,
+	ST_LITERAL,
+	ST_DONE,
+	ST_ERROR,
+};
+
+#pragma region Helpers
+
+static bool is_whitespace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static bool fail(json_stream* stream)
+{
+	stream->state = ST_ERROR;
+	return false;
+}
+
+static bool in_number(const json_stream* stream)
+{
+	return stream->state >= ST_NUMBER_MINUS && stream->state <= ST_NUMBER_EXPONENT;
+}
+
+/*	True where a number may end: after a digit of the integer part, the fraction
+*	or the exponent.
+*/
+static bool number_complete(const json_stream* stream)
+{
+	return stream->state == ST_NUMBER_ZERO || stream->state == ST_NUMBER
+		|| stream->state == ST_NUMBER_FRACTION || stream->state == ST_NUMBER_EXPONENT;
+}
+
+/*	The number state after @ref c, or ST_ERROR if @ref c does not continue the
+*	number, following the grammar of JSON numbers.
+*/
+static uint8_t number_next(uint8_t state, char c)
+{
+	bool digit = c >= '0' && c <= '9';
+	bool e = c == 'e' || c == 'E';
+
+	switch (state)
+	{
+	case ST_NUMBER_MINUS:
+		return c == '0' ? ST_NUMBER_ZERO : digit ? ST_NUMBER : ST_ERROR;
+	case ST_NUMBER:
+		if (digit)
+			return ST_NUMBER;
+		// Fall through
+	case ST_NUMBER_ZERO:
+		return c == '.' ? ST_NUMBER_POINT : e ? ST_NUMBER_E : ST_ERROR;
+	case ST_NUMBER_POINT:
+		return digit ? ST_NUMBER_FRACTION : ST_ERROR;
+	case ST_NUMBER_FRACTION:
+		return digit ? ST_NUMBER_FRACTION : e ? ST_NUMBER_E : ST_ERROR;
+	case ST_NUMBER_E:
+		if (c == '+' || c == '-')
+			return ST_NUMBER_E_SIGN;
+		// Fall through
+	default:
+		return digit ? ST_NUMBER_EXPONENT : ST_ERROR;
+	}
+}
+
+static void emit(json_stream* stream, json_token_type type, bool with_text)
+{
+	if (!stream->handler)
+		return;
+
+	json_token token;
+	token.type = type;
+	token.depth = stream->depth;
+	token.index = stream->index[stream->depth];
+	token.text = with_text ? stream->text : NULL;
+	token.length = with_text ? stream->text_length : 0;
+	token.truncated = with_text ? stream->truncated : false;
+	stream->handler(&token, stream->user_data);
+}
+
+static void text_start(json_stream* stream)
+{
+	stream->text_length = 0;
+	stream->truncated = false;
+	stream->text[0] = 0x0;
+}
+
+static void text_add(json_stream* stream, char c)
+{
+	if (stream->text_length == JSON_STREAM_TOKEN_SIZE - 1 && stream->split_strings
+			&& !stream->is_key && !in_number(stream)) {
+		emit(stream, JSON_TOKEN_STRING_PART, true);
+		text_start(stream);
+	}
+
+	if (stream->text_length < JSON_STREAM_TOKEN_SIZE - 1) {
+		stream->text[stream->text_length++] = c;
+		stream->text[stream->text_length] = 0x0;
+	}
+	else
+		stream->truncated = true;
+}
+
+static void text_add_utf8(json_stream* stream, uint32_t cp)
+{
+	if (cp <= 0x7F)
+		text_add(stream, (char)cp);
+	else if (cp <= 0x7FF) {
+		text_add(stream, (char)(0xC0 | (cp >> 6)));
+		text_add(stream, (char)(0x80 | (cp & 0x3F)));
+	}
+	else if (cp <= 0xFFFF) {
+		text_add(stream, (char)(0xE0 | (cp >> 12)));
+		text_add(stream, (char)(0x80 | ((cp >> 6) & 0x3F)));
+		text_add(stream, (char)(0x80 | (cp & 0x3F)));
+	}
+	else {
+		text_add(stream, (char)(0xF0 | (cp >> 18)));
+		text_add(stream, (char)(0x80 | ((cp >> 12) & 0x3F)));
+		text_add(stream, (char)(0x80 | ((cp >> 6) & 0x3F)));
+		text_add(stream, (char)(0x80 | (cp & 0x3F)));
+	}
+}
+
+static int hex_digit(char c)
+{
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+
+static void value_done(json_stream* stream)
+{
+	if (stream->depth == 0) {
+		stream->state = ST_DONE;
+		return;
+	}
+	stream->index[stream->depth]++;
+	stream->state = ST_NEXT;
+}
+
+static bool begin_container(json_stream* stream, bool is_object)
+{
+	if (stream->depth >= JSON_STREAM_MAX_DEPTH)
+		return fail(stream);
+
+	emit(stream, is_object ? JSON_TOKEN_OBJECT_BEGIN : JSON_TOKEN_ARRAY_BEGIN, false);
+	stream->depth++;
+	stream->index[stream->depth] = 0;
+	if (is_object)
+		stream->objects |= (1UL << stream->depth);
+	else
+		stream->objects &= ~(1UL << stream->depth);
+	stream->state = is_object ? ST_FIRST_KEY : ST_FIRST_VALUE;
+	return true;
+}
+
+static bool end_container(json_stream* stream, bool is_object)
+{
+	bool top_is_object = (stream->objects & (1UL << stream->depth)) != 0;
+	if (stream->depth == 0 || top_is_object != is_object)
+		return fail(stream);
+
+	stream->depth--;
+	emit(stream, is_object ? JSON_TOKEN_OBJECT_END : JSON_TOKEN_ARRAY_END, false);
+	value_done(stream);
+	return true;
+}
+
+static bool begin_value(json_stream* stream, char c)
+{
+	switch (c)
+	{
+	case '{':
+		return begin_container(stream, true);
+	case '[':
+		return begin_container(stream, false);
+	case '"':
+		stream->is_key = false;
+		stream->unicode_high = 0;
+		text_start(stream);
+		stream->state = ST_STRING;
+		return true;
+	case 't':
+		stream->literal = "true";
+		break;
+	case 'f':
+		stream->literal = "false";
+		break;
+	case 'n':
+		stream->literal = "null";
+		break;
+	default:
+		if (c == '-' || (c >= '0' && c <= '9')) {
+			stream->state = c == '-' ? ST_NUMBER_MINUS : c == '0' ? ST_NUMBER_ZERO : ST_NUMBER;
+			text_start(stream);
+			text_add(stream, c);
+			return true;
+		}
+		return fail(stream);
+	}
+	stream->literal_pos = 1;
+	stream->state = ST_LITERAL;
+	return true;
+}
+
+#pragma endregion
+
+void json_stream_init(json_stream* stream, json_token_handler handler, void* user_data)
+{
+	stream->handler = handler;
+	stream->user_data = user_data;
+	stream->split_strings = false;
+	json_stream_reset(stream);
+}
+
+void json_stream_split_strings(json_stream* stream, bool split)
+{
+	stream->split_strings = split;
+}
+
+void json_stream_reset(json_stream* stream)
+{
+	stream->state = ST_VALUE;
+	stream->depth = 0;
+	stream->objects = 0;
+	stream->index[0] = 0;
+	text_start(stream);
+}
+
+bool json_stream_feed(json_stream* stream, char c)
+{
+	switch (stream->state)
+	{
+	case ST_STRING:
+		if (c == '"') {
+			if (stream->is_key) {
+				emit(stream, JSON_TOKEN_KEY, true);
+				stream->state = ST_COLON;
+			}
+			else {
+				emit(stream, JSON_TOKEN_STRING, true);
+				value_done(stream);
+			}
+		}
+		else if (c == '\\')
+			stream->state = ST_ESCAPE;
+		else if ((unsigned char)c < 0x20)
+			return fail(stream);
+		else
+			text_add(stream, c);
+		return true;
+
+	case ST_ESCAPE:
+		stream->state = ST_STRING;
+		switch (c)
+		{
+		case 'b': text_add(stream, '\b'); break;
+		case 'f': text_add(stream, '\f'); break;
+		case 'n': text_add(stream, '\n'); break;
+		case 'r': text_add(stream, '\r'); break;
+		case 't': text_add(stream, '\t'); break;
+		case '"': case '\\': case '/': text_add(stream, c); break;
+		case 'u':
+			stream->unicode = 0;
+			stream->unicode_digits = 0;
+			stream->state = ST_UNICODE;
+			break;
+		default:
+			return fail(stream);
+		}
+		return true;
+
+	case ST_UNICODE:
+	{
+		int digit = hex_digit(c);
+		if (digit < 0)
+			return fail(stream);
+		stream->unicode = (stream->unicode << 4) | (uint32_t)digit;
+		if (++stream->unicode_digits < 4)
+			return true;
+
+		uint32_t cp = stream->unicode;
+		stream->state = ST_STRING;
+		if (cp >= 0xD800 && cp <= 0xDBFF) {
+			stream->unicode_high = cp;
+			return true;
+		}
+		if (cp >= 0xDC00 && cp <= 0xDFFF) {
+			if (!stream->unicode_high)
+				return true;
+			cp = 0x10000 + ((stream->unicode_high - 0xD800) << 10) + (cp - 0xDC00);
+		}
+		stream->unicode_high = 0;
+		text_add_utf8(stream, cp);
+		return true;
+	}
+
+	case ST_NUMBER_MINUS:
+	case ST_NUMBER_ZERO:
+	case ST_NUMBER:
+	case ST_NUMBER_POINT:
+	case ST_NUMBER_FRACTION:
+	case ST_NUMBER_E:
+	case ST_NUMBER_E_SIGN:
+	case ST_NUMBER_EXPONENT:
+	{
+		uint8_t next = number_next(stream->state, c);
+		if (next != ST_ERROR) {
+			stream->state = next;
+			text_add(stream, c);
+			return true;
+		}
+		// Anything else ends the number, which must not end in '-', '.' or 'e'
+		if (!number_complete(stream))
+			return fail(stream);
+		emit(stream, JSON_TOKEN_NUMBER, true);
+		value_done(stream);
+		return json_stream_feed(stream, c);
+	}
+
+	case ST_LITERAL:
+		if (c != stream->literal[stream->literal_pos])
+			return fail(stream);
+		if (stream->literal[++stream->literal_pos] == 0x0) {
+			json_token_type type = stream->literal[0] == 't' ? JSON_TOKEN_TRUE
+				: stream->literal[0] == 'f' ? JSON_TOKEN_FALSE : JSON_TOKEN_NULL;
+			emit(stream, type, false);
+			value_done(stream);
+		}
+		return true;
+
+	case ST_ERROR:
+		return false;
+
+	default:
+		break;
+	}
+
+	if (is_whitespace(c))
+		return true;
+
+	switch (stream->state)
+	{
+	case ST_FIRST_VALUE:
+		if (c == ']')
+			return end_container(stream, false);
+		return begin_value(stream, c);
+
+	case ST_VALUE:
+		return begin_value(stream, c);
+
+	case ST_FIRST_KEY:
+		if (c == '}')
+			return end_container(stream, true);
+		// Fall through
+	case ST_KEY:
+		if (c != '"')
+			return fail(stream);
+		stream->is_key = true;
+		stream->unicode_high = 0;
+		text_start(stream);
+		stream->state = ST_STRING;
+		return true;
+
+	case ST_COLON:
+		if (c != ':')
+			return fail(stream);
+		stream->state = ST_VALUE;
+		return true;
+
+	case ST_NEXT:
+		if (c == ',') {
+			bool in_object = (stream->objects & (1UL << stream->depth)) != 0;
+			stream->state = in_object ? ST_KEY : ST_VALUE;
+			return true;
+		}
+		if (c == '}')
+			return end_container(stream, true);
+		if (c == ']')
+			return end_container(stream, false);
+		return fail(stream);
+
+	default:
+		// ST_DONE: only whitespace may follow the root value
+		return fail(stream);
+	}
+}
+
+bool json_stream_finish(json_stream* stream)
+{
+	if (number_complete(stream) && stream->depth == 0) {
+		emit(stream, JSON_TOKEN_NUMBER, true);
+		stream->state = ST_DONE;
+	}
+	return stream->state == ST_DONE;
+}
@@ -0,0 +1,152 @@
+/*	Copyright 2017 DeviceDrive AS
+*
+*	Licensed under the Apache License, Version 2.0 (the "License");
+*	you may not use this file except in compliance with the License.
+*	You may obtain a copy of the License at
+*
+*	http ://www.apache.org/licenses/LICENSE-2.0
+*
+*	Unless required by applicable law or agreed to in writing, software
+*	distributed under the License is distributed on an "AS IS" BASIS,
+*	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*	See the License for the specific language governing permissions and
+*	limitations under the License.
+*
+*/
+
+/**@file
+*
+*	@brief		Incremental JSON tokenizer
+*	@details	The tokenizer is fed one character at a time and reports each complete
+*				token to a handler. It does a bounded amount of work per character,
+*				never allocates and keeps all its state in @ref json_stream, so it can
+*				run while a frame is received from the WRF01.
+*/
+
+#ifndef JSON_STREAM_H__
+#define JSON_STREAM_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef JSON_STREAM_MAX_DEPTH
+#define JSON_STREAM_MAX_DEPTH 16
+#endif
+
+#if JSON_STREAM_MAX_DEPTH > 31
+#error "JSON_STREAM_MAX_DEPTH must be less than 32"
+#endif
+
+#ifndef JSON_STREAM_TOKEN_SIZE
+#define JSON_STREAM_TOKEN_SIZE 32
+#endif
+
+/*	@brief	Token types reported by the tokenizer.
+*/
+typedef enum {
+	JSON_TOKEN_OBJECT_BEGIN,
+	JSON_TOKEN_OBJECT_END,
+	JSON_TOKEN_ARRAY_BEGIN,
+	JSON_TOKEN_ARRAY_END,
+	JSON_TOKEN_KEY,
+	JSON_TOKEN_STRING,
+	JSON_TOKEN_NUMBER,
+	JSON_TOKEN_TRUE,
+	JSON_TOKEN_FALSE,
+	JSON_TOKEN_NULL,
+	JSON_TOKEN_STRING_PART,		// A full buffer of a long string, see @ref json_stream_split_strings
+}json_token_type;
+
+/*	@brief	A complete token.
+*
+*	@note	@ref depth is the number of containers the token is inside, so the root value
+*			has depth 0 and the keys of the root object have depth 1. Begin and end tokens
+*			have the depth of the container itself. @ref index is the position of the
+*			token in its container; a key and its value share the same index.
+*
+*			@ref text is only valid during the handler call. It holds the unescaped, zero
+*			terminated content of keys and strings, and the characters of numbers. If the
+*			content is longer than JSON_STREAM_TOKEN_SIZE - 1 it is cut and
+*			@ref truncated is set.
+*/
+typedef struct {
+	json_token_type type;
+	int depth;
+	int index;
+	const char* text;
+	int length;
+	bool truncated;
+}json_token;
+
+/*	@brief	Function signature for receiving tokens.
+*/
+typedef void(*json_token_handler)(const json_token* token, void* user_data);
+
+/*	@brief	Tokenizer state. Treat as opaque.
+*/
+typedef struct {
+	uint8_t state;
+	uint8_t return_state;
+	uint8_t depth;
+	uint8_t literal_pos;
+	uint8_t unicode_digits;
+	bool is_key;
+	bool truncated;
+	bool split_strings;
+	const char* literal;
+	uint32_t unicode;
+	uint32_t unicode_high;
+	uint32_t objects;
+	uint16_t index[JSON_STREAM_MAX_DEPTH + 1];
+	int text_length;
+	char text[JSON_STREAM_TOKEN_SIZE];
+	json_token_handler handler;
+	void* user_data;
+}json_stream;
+
+/*	@brief		Function for initializing a tokenizer.
+*
+*	@param[in]	stream		Tokenizer to initialize.
+*	@param[in]	handler		Function receiving tokens, may be NULL.
+*	@param[in]	user_data	Passed to @ref handler.
+*/
+void json_stream_init(json_stream* stream, json_token_handler handler, void* user_data);
+
+/*	@brief		Function for making the tokenizer ready for a new document.
+*/
+void json_stream_reset(json_stream* stream);
+
+/*	@brief		Function for receiving long strings in parts.
+*
+*	@details	When on, a string value that does not fit the token buffer is reported
+*				as JSON_TOKEN_STRING_PART tokens of JSON_STREAM_TOKEN_SIZE - 1 bytes each,
+*				followed by a JSON_TOKEN_STRING with the rest. Keys are still truncated.
+*				A part may end in the middle of a UTF-8 sequence.
+*/
+void json_stream_split_strings(json_stream* stream, bool split);
+
+/*	@brief		Function for feeding one character to the tokenizer.
+*
+*	@retval		false	if the document is invalid. Further characters are ignored until reset.
+*	@retval		true	otherwise.
+*/
+bool json_stream_feed(json_stream* stream, char c);
+
+/*	@brief		Function for finishing the document.
+*
+*	@details	Completes a number at the end of the document.
+*
+*	@retval		true	if one complete and valid JSON value was fed.
+*	@retval		false	if the document is invalid or incomplete.
+*/
+bool json_stream_finish(json_stream* stream);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,734 @@
+/*	Copyright 2017 DeviceDrive AS
+*
+*	Licensed under the Apache License, Version 2.0 (the "License");
+*	you may not use this file except in compliance with the License.
+*	You may obtain a copy of the License at
+*
+*	http ://www.apache.org/licenses/LICENSE-2.0
+*
+*	Unless required by applicable law or agreed to in writing, software
+*	distributed under the License is distributed on an "AS IS" BASIS,
+*	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*	See the License for the specific language governing permissions and
+*	limitations under the License.
+*
+*/
+
+#include "json_tape.h"
+#include <stdarg.h>
+#include <string.h>
+
+/*	An entry is the type in the top 4 bits and an index or offset below. */
+#define TYPE_SHIFT 28
+#define PAYLOAD_MASK 0x0FFFFFFF
+
+#define ENTRY(TYPE, PAYLOAD) (((uint32_t)(TYPE) << TYPE_SHIFT) | (uint32_t)(PAYLOAD))
+#define ENTRY_TYPE(ENTRY) ((json_tape_type)((ENTRY) >> TYPE_SHIFT))
+#define ENTRY_PAYLOAD(ENTRY) ((ENTRY) & PAYLOAD_MASK)
+
+enum {
+	EXPECT_VALUE,
+	EXPECT_FIRST_VALUE,		// After '[', a value or ']'
+	EXPECT_FIRST_KEY,		// After '{', a key or '}'
+	EXPECT_KEY,
+	EXPECT_COLON,
+	EXPECT_NEXT,			// After a value, ',' or the end of the container
+};
+
+#pragma region Scanning
+
+static bool is_whitespace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static bool is_digit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+static int hex_value(char c)
+{
+	if (is_digit(c))
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+/*	Returns the position after the closing quote of the string starting at @ref i,
+*	or 0 if it is not valid.
+*/
+static size_t skip_string(const char* json, size_t length, size_t i)
+{
+	for (i++; i < length; i++) {
+		unsigned char c = (unsigned char)json[i];
+		if (c == '"')
+			return i + 1;
+		if (c < 0x20)
+			return 0;
+		if (c != '\\')
+			continue;
+
+		if (++i == length)
+			return 0;
+		switch (json[i])
+		{
+		case '"': case '\\': case '/': case 'b': case 'f': case 'n': case 'r': case 't':
+			break;
+		case 'u':
+			if (length - i < 5 || hex_value(json[i + 1]) < 0 || hex_value(json[i + 2]) < 0
+					|| hex_value(json[i + 3]) < 0 || hex_value(json[i + 4]) < 0)
+				return 0;
+			i += 4;
+			break;
+		default:
+			return 0;
+		}
+	}
+	return 0;
+}
+
+/*	Returns the position after the number starting at @ref i, or 0 if it is not valid. */
+static size_t skip_number(const char* json, size_t length, size_t i)
+{
+	if (i < length && json[i] == '-')
+		i++;
+	if (i == length || !is_digit(json[i]))
+		return 0;
+	if (json[i] == '0')
+		i++;
+	else
+		while (i < length && is_digit(json[i]))
+			i++;
+
+	if (i < length && json[i] == '.') {
+		if (++i == length || !is_digit(json[i]))
+			return 0;
+		while (i < length && is_digit(json[i]))
+			i++;
+	}
+
+	if (i < length && (json[i] == 'e' || json[i] == 'E')) {
+		if (++i < length && (json[i] == '+' || json[i] == '-'))
+			i++;
+		if (i == length || !is_digit(json[i]))
+			return 0;
+		while (i < length && is_digit(json[i]))
+			i++;
+	}
+	return i;
+}
+
+/*	Returns the position after the literal @ref word at @ref i, or 0 if it is not there. */
+static size_t skip_literal(const char* json, size_t length, size_t i, const char* word)
+{
+	size_t word_length = strlen(word);
+	if (length - i < word_length || memcmp(json + i, word, word_length) != 0)
+		return 0;
+	return i + word_length;
+}
+
+/*	Returns the position after the array or object starting at @ref i, or 0 if it
+*	does not end. Only strings and brackets are looked at, the rest is not checked.
+*/
+static size_t skip_container(const char* json, size_t length, size_t i)
+{
+	int depth = 0;
+	while (i < length) {
+		switch (json[i])
+		{
+		case '"':
+			if ((i = skip_string(json, length, i)) == 0)
+				return 0;
+			continue;
+		case '{':
+		case '[':
+			depth++;
+			break;
+		case '}':
+		case ']':
+			if (--depth == 0)
+				return i + 1;
+			break;
+		default:
+			break;
+		}
+		i++;
+	}
+	return 0;
+}
+
+static size_t skip_whitespace(const char* json, size_t length, size_t i)
+{
+	while (i < length && is_whitespace(json[i]))
+		i++;
+	return i;
+}
+
+/*	Decodes the character of a string at *@ref i to UTF-8 and moves past it.
+*	Returns the number of bytes, 0 at the closing quote.
+*/
+static int decode_char(const char* json, size_t* i, char* utf8)
+{
+	char c = json[*i];
+	if (c == '"')
+		return 0;
+
+	(*i)++;
+	if (c != '\\') {
+		utf8[0] = c;
+		return 1;
+	}
+
+	c = json[(*i)++];
+	switch (c)
+	{
+	case 'b': utf8[0] = '\b'; return 1;
+	case 'f': utf8[0] = '\f'; return 1;
+	case 'n': utf8[0] = '\n'; return 1;
+	case 'r': utf8[0] = '\r'; return 1;
+	case 't': utf8[0] = '\t'; return 1;
+	case 'u': break;
+	default: utf8[0] = c; return 1;
+	}
+
+	// Checked by skip_string, a surrogate pair without its second half is kept as it is
+	uint32_t code = 0;
+	for (int n = 0; n < 4; n++)
+		code = (code << 4) | hex_value(json[(*i)++]);
+	if ((code & 0xFC00) == 0xD800 && json[*i] == '\\' && json[*i + 1] == 'u') {
+		uint32_t low = 0;
+		for (int n = 2; n < 6; n++)
+			low = (low << 4) | hex_value(json[*i + n]);
+		if ((low & 0xFC00) == 0xDC00) {
+			code = 0x10000 + ((code & 0x3FF) << 10) + (low & 0x3FF);
+			*i += 6;
+		}
+	}
+
+	if (code < 0x80) {
+		utf8[0] = (char)code;
+		return 1;
+	}
+	if (code < 0x800) {
+		utf8[0] = (char)(0xC0 | (code >> 6));
+		utf8[1] = (char)(0x80 | (code & 0x3F));
+		return 2;
+	}
+	if (code < 0x10000) {
+		utf8[0] = (char)(0xE0 | (code >> 12));
+		utf8[1] = (char)(0x80 | ((code >> 6) & 0x3F));
+		utf8[2] = (char)(0x80 | (code & 0x3F));
+		return 3;
+	}
+	utf8[0] = (char)(0xF0 | (code >> 18));
+	utf8[1] = (char)(0x80 | ((code >> 12) & 0x3F));
+	utf8[2] = (char)(0x80 | ((code >> 6) & 0x3F));
+	utf8[3] = (char)(0x80 | (code & 0x3F));
+	return 4;
+}
+
+/*	These take the text of a checked string, which ends at its closing quote. */
+static size_t text_copy(const char* text, char* dst, size_t size)
+{
+	size_t i = 0;
+	size_t length = 0;
+	char utf8[4];
+	int n;
+	while ((n = decode_char(text, &i, utf8)) > 0) {
+		for (int j = 0; j < n; j++, length++)
+			if (length + 1 < size)
+				dst[length] = utf8[j];
+	}
+
+	if (size)
+		dst[length < size ? length : size - 1] = 0x0;
+	return length;
+}
+
+static bool text_equals(const char* text, const char* other)
+{
+	size_t i = 0;
+	char utf8[4];
+	int n;
+	while ((n = decode_char(text, &i, utf8)) > 0) {
+		for (int j = 0; j < n; j++, other++)
+			if (*other != utf8[j])
+				return false;
+	}
+	return *other == 0x0;
+}
+
+static bool text_int(const char* text, size_t length, int64_t* result)
+{
+	bool negative = length > 0 && text[0] == '-';
+	size_t i = negative ? 1 : 0;
+	uint64_t number = 0;
+	if (i == length)
+		return false;
+
+	for (; i < length; i++) {
+		if (!is_digit(text[i]))
+			return false;
+		unsigned digit = text[i] - '0';
+		if (number > (UINT64_C(0x8000000000000000) - digit) / 10)
+			return false;
+		number = number * 10 + digit;
+	}
+	if (!negative && number > INT64_MAX)
+		return false;
+
+	*result = negative ? (int64_t)(0 - number) : (int64_t)number;
+	return true;
+}
+
+#pragma endregion
+
+#pragma region Parsing
+
+static bool fail(json_tape* tape)
+{
+	tape->count = 0;
+	return false;
+}
+
+/*	The document may be valid, but does not fit. The rest of it is not checked. */
+static bool fail_too_large(json_tape* tape)
+{
+	tape->too_large = true;
+	return fail(tape);
+}
+
+bool json_tape_parse(json_tape* tape, const char* json, size_t length, uint32_t* entries, uint32_t size)
+{
+	uint32_t open[JSON_TAPE_MAX_DEPTH];
+	int depth = 0;
+	int expect = EXPECT_VALUE;
+	size_t i = 0;
+
+	tape->json = json;
+	tape->length = length;
+	tape->entries = entries;
+	tape->count = 0;
+	tape->too_large = false;
+	if (length > PAYLOAD_MASK)
+		return fail_too_large(tape);
+	if (size > PAYLOAD_MASK)
+		return false;
+
+	for (;;) {
+		i = skip_whitespace(json, length, i);
+		if (i == length)
+			break;
+
+		char c = json[i];
+		size_t end;
+
+		switch (expect)
+		{
+		case EXPECT_COLON:
+			if (c != ':')
+				return fail(tape);
+			i++;
+			expect = EXPECT_VALUE;
+			continue;
+
+		case EXPECT_FIRST_KEY:
+		case EXPECT_KEY:
+			if (c == '}' && expect == EXPECT_FIRST_KEY)
+				break;
+			if (c != '"' || (end = skip_string(json, length, i)) == 0 || tape->count == size)
+				return fail(tape);
+			entries[tape->count++] = ENTRY(JSON_TAPE_KEY, i + 1);
+			i = end;
+			expect = EXPECT_COLON;
+			continue;
+
+		case EXPECT_NEXT:
+			if (depth == 0)
+				return fail(tape);	// Something after the root value
+			if (c == ',') {
+				i++;
+				expect = ENTRY_TYPE(entries[open[depth - 1]]) == JSON_TAPE_OBJECT ? EXPECT_KEY : EXPECT_VALUE;
+				continue;
+			}
+			break;
+
+		default:
+			if (c == ']' && expect == EXPECT_FIRST_VALUE)
+				break;
+			if (tape->count == size)
+				return fail_too_large(tape);
+
+			if (c == '{' || c == '[') {
+				if (depth == JSON_TAPE_MAX_DEPTH)
+					return fail_too_large(tape);
+				open[depth++] = tape->count;
+				entries[tape->count++] = ENTRY(c == '{' ? JSON_TAPE_OBJECT : JSON_TAPE_ARRAY, 0);
+				i++;
+				expect = c == '{' ? EXPECT_FIRST_KEY : EXPECT_FIRST_VALUE;
+				continue;
+			}
+
+			json_tape_type type;
+			switch (c)
+			{
+			case '"':
+				type = JSON_TAPE_STRING;
+				end = skip_string(json, length, i);
+				break;
+			case 't':
+				type = JSON_TAPE_TRUE;
+				end = skip_literal(json, length, i, "true");
+				break;
+			case 'f':
+				type = JSON_TAPE_FALSE;
+				end = skip_literal(json, length, i, "false");
+				break;
+			case 'n':
+				type = JSON_TAPE_NULL;
+				end = skip_literal(json, length, i, "null");
+				break;
+			default:
+				type = JSON_TAPE_NUMBER;
+				end = skip_number(json, length, i);
+				break;
+			}
+			if (end == 0)
+				return fail(tape);
+			entries[tape->count++] = ENTRY(type, type == JSON_TAPE_STRING ? i + 1 : i);
+			i = end;
+			expect = EXPECT_NEXT;
+			continue;
+		}
+
+		// The end of the innermost container
+		uint32_t container = open[depth - 1];
+		if (c != (ENTRY_TYPE(entries[container]) == JSON_TAPE_OBJECT ? '}' : ']'))
+			return fail(tape);
+		entries[container] |= tape->count;
+		depth--;
+		i++;
+		expect = EXPECT_NEXT;
+	}
+
+	if (depth != 0 || expect != EXPECT_NEXT)
+		return fail(tape);
+	return true;
+}
+
+#pragma endregion
+
+#pragma region Navigation
+
+json_tape_type json_tape_type_of(const json_tape* tape, uint32_t value)
+{
+	if (value >= tape->count)
+		return JSON_TAPE_NONE;
+	return ENTRY_TYPE(tape->entries[value]);
+}
+
+/*	The index after @ref value and everything in it. */
+static uint32_t skip_value(const json_tape* tape, uint32_t value)
+{
+	json_tape_type type = ENTRY_TYPE(tape->entries[value]);
+	if (type == JSON_TAPE_OBJECT || type == JSON_TAPE_ARRAY)
+		return ENTRY_PAYLOAD(tape->entries[value]);
+	return value + 1;
+}
+
+/*	The value at @ref index in @ref container, after the key in an object. */
+static uint32_t child_at(const json_tape* tape, uint32_t container, uint32_t index)
+{
+	if (index >= ENTRY_PAYLOAD(tape->entries[container]))
+		return JSON_TAPE_END;
+	if (ENTRY_TYPE(tape->entries[index]) == JSON_TAPE_KEY)
+		index++;
+	return index;
+}
+
+uint32_t json_tape_first(const json_tape* tape, uint32_t container)
+{
+	json_tape_type type = json_tape_type_of(tape, container);
+	if (type != JSON_TAPE_OBJECT && type != JSON_TAPE_ARRAY)
+		return JSON_TAPE_END;
+	return child_at(tape, container, container + 1);
+}
+
+uint32_t json_tape_next(const json_tape* tape, uint32_t container, uint32_t value)
+{
+	if (value >= tape->count || container >= tape->count)
+		return JSON_TAPE_END;
+	return child_at(tape, container, skip_value(tape, value));
+}
+
+uint32_t json_tape_length(const json_tape* tape, uint32_t container)
+{
+	uint32_t length = 0;
+	for (uint32_t v = json_tape_first(tape, container); v != JSON_TAPE_END; v = json_tape_next(tape, container, v))
+		length++;
+	return length;
+}
+
+uint32_t json_tape_get(const json_tape* tape, uint32_t object, const char* key)
+{
+	if (json_tape_type_of(tape, object) != JSON_TAPE_OBJECT)
+		return JSON_TAPE_END;
+
+	for (uint32_t v = json_tape_first(tape, object); v != JSON_TAPE_END; v = json_tape_next(tape, object, v))
+		if (json_tape_equals(tape, v - 1, key))
+			return v;
+	return JSON_TAPE_END;
+}
+
+uint32_t json_tape_at(const json_tape* tape, uint32_t array, uint32_t index)
+{
+	if (json_tape_type_of(tape, array) != JSON_TAPE_ARRAY)
+		return JSON_TAPE_END;
+
+	uint32_t v = json_tape_first(tape, array);
+	while (index-- > 0 && v != JSON_TAPE_END)
+		v = json_tape_next(tape, array, v);
+	return v;
+}
+
+#pragma endregion
+
+#pragma region Values
+
+const char* json_tape_raw(const json_tape* tape, uint32_t value, size_t* length)
+{
+	json_tape_type type = json_tape_type_of(tape, value);
+	size_t start, end;
+	if (type == JSON_TAPE_NONE || type == JSON_TAPE_OBJECT || type == JSON_TAPE_ARRAY)
+		return NULL;
+
+	start = ENTRY_PAYLOAD(tape->entries[value]);
+	switch (type)
+	{
+	case JSON_TAPE_KEY:
+	case JSON_TAPE_STRING:
+		end = skip_string(tape->json, tape->length, start - 1) - 1;
+		break;
+	case JSON_TAPE_NUMBER:
+		end = skip_number(tape->json, tape->length, start);
+		break;
+	case JSON_TAPE_FALSE:
+		end = start + 5;
+		break;
+	default:
+		end = start + 4;
+		break;
+	}
+
+	if (length)
+		*length = end - start;
+	return tape->json + start;
+}
+
+const char* json_tape_key(const json_tape* tape, uint32_t value, size_t* length)
+{
+	if (value == 0 || json_tape_type_of(tape, value - 1) != JSON_TAPE_KEY)
+		return NULL;
+	return json_tape_raw(tape, value - 1, length);
+}
+
+static bool is_text(const json_tape* tape, uint32_t value)
+{
+	json_tape_type type = json_tape_type_of(tape, value);
+	return type == JSON_TAPE_STRING || type == JSON_TAPE_KEY;
+}
+
+size_t json_tape_string(const json_tape* tape, uint32_t value, char* dst, size_t size)
+{
+	if (!is_text(tape, value)) {
+		if (size)
+			dst[0] = 0x0;
+		return 0;
+	}
+	return text_copy(tape->json + ENTRY_PAYLOAD(tape->entries[value]), dst, size);
+}
+
+bool json_tape_equals(const json_tape* tape, uint32_t value, const char* text)
+{
+	if (!is_text(tape, value))
+		return false;
+	return text_equals(tape->json + ENTRY_PAYLOAD(tape->entries[value]), text);
+}
+
+bool json_tape_int(const json_tape* tape, uint32_t value, int64_t* result)
+{
+	json_tape_type type = json_tape_type_of(tape, value);
+	if (type != JSON_TAPE_NUMBER && type != JSON_TAPE_STRING)
+		return false;
+
+	size_t length;
+	const char* text = json_tape_raw(tape, value, &length);
+	return text_int(text, length, result);
+}
+
+bool json_tape_bool(const json_tape* tape, uint32_t value)
+{
+	return json_tape_type_of(tape, value) == JSON_TAPE_TRUE;
+}
+
+#pragma endregion
+
+#pragma region Queries
+
+/*	The value starting at @ref i as a slice. */
+static json_slice slice_at(const char* json, size_t length, size_t i)
+{
+	json_slice slice = { JSON_TAPE_NONE, NULL, 0 };
+	json_tape_type type;
+	size_t start = i;
+	size_t end;
+	if (i == length)
+		return slice;
+
+	switch (json[i])
+	{
+	case '{':
+	case '[':
+		type = json[i] == '{' ? JSON_TAPE_OBJECT : JSON_TAPE_ARRAY;
+		end = skip_container(json, length, i);
+		break;
+	case '"':
+		type = JSON_TAPE_STRING;
+		end = skip_string(json, length, i);
+		start = i + 1;
+		break;
+	case 't':
+		type = JSON_TAPE_TRUE;
+		end = skip_literal(json, length, i, "true");
+		break;
+	case 'f':
+		type = JSON_TAPE_FALSE;
+		end = skip_literal(json, length, i, "false");
+		break;
+	case 'n':
+		type = JSON_TAPE_NULL;
+		end = skip_literal(json, length, i, "null");
+		break;
+	default:
+		type = JSON_TAPE_NUMBER;
+		end = skip_number(json, length, i);
+		break;
+	}
+	if (end == 0)
+		return slice;
+
+	slice.type = type;
+	slice.text = json + start;
+	slice.length = (type == JSON_TAPE_STRING ? end - 1 : end) - start;
+	return slice;
+}
+
+json_slice json_find_path(const char* json, size_t length, const char* const* keys, int count)
+{
+	json_slice none = { JSON_TAPE_NONE, NULL, 0 };
+	size_t i = skip_whitespace(json, length, 0);
+
+	for (int k = 0; k < count; k++) {
+		if (i == length || json[i] != '{')
+			return none;
+		i = skip_whitespace(json, length, i + 1);
+
+		for (;;) {
+			if (i == length || json[i] != '"')
+				return none;	// Also at '}', the key is not there
+			size_t key_end = skip_string(json, length, i);
+			if (key_end == 0)
+				return none;
+			bool match = text_equals(json + i + 1, keys[k]);
+
+			i = skip_whitespace(json, length, key_end);
+			if (i == length || json[i] != ':')
+				return none;
+			i = skip_whitespace(json, length, i + 1);
+			if (match)
+				break;
+
+			// Another member, its value is passed over
+			if (i < length && (json[i] == '{' || json[i] == '['))
+				i = skip_container(json, length, i);
+			else if (i < length && json[i] == '"')
+				i = skip_string(json, length, i);
+			else
+				while (i < length && json[i] != ',' && json[i] != '}' && !is_whitespace(json[i]))
+					i++;
+			if (i == 0)
+				return none;
+
+			i = skip_whitespace(json, length, i);
+			if (i == length || json[i] != ',')
+				return none;
+			i = skip_whitespace(json, length, i + 1);
+		}
+	}
+	return slice_at(json, length, i);
+}
+
+json_slice json_find_keys(const char* json, size_t length, ...)
+{
+	const char* keys[JSON_TAPE_MAX_DEPTH];
+	int count = 0;
+	const char* key;
+	va_list args;
+
+	va_start(args, length);
+	while ((key = va_arg(args, const char*)) != NULL) {
+		if (count == JSON_TAPE_MAX_DEPTH) {
+			va_end(args);
+			json_slice none = { JSON_TAPE_NONE, NULL, 0 };
+			return none;
+		}
+		keys[count++] = key;
+	}
+	va_end(args);
+	return json_find_path(json, length, keys, count);
+}
+
+json_slice json_tape_slice(const json_tape* tape, uint32_t value)
+{
+	json_slice slice = { JSON_TAPE_NONE, NULL, 0 };
+	json_tape_type type = json_tape_type_of(tape, value);
+	if (type == JSON_TAPE_NONE || type == JSON_TAPE_OBJECT || type == JSON_TAPE_ARRAY)
+		return slice;
+
+	slice.type = type;
+	slice.text = json_tape_raw(tape, value, &slice.length);
+	return slice;
+}
+
+size_t json_slice_string(const json_slice* slice, char* dst, size_t size)
+{
+	if (slice->type != JSON_TAPE_STRING) {
+		if (size)
+			dst[0] = 0x0;
+		return 0;
+	}
+	return text_copy(slice->text, dst, size);
+}
+
+bool json_slice_equals(const json_slice* slice, const char* text)
+{
+	return slice->type == JSON_TAPE_STRING && text_equals(slice->text, text);
+}
+
+bool json_slice_int(const json_slice* slice, int64_t* result)
+{
+	if (slice->type != JSON_TAPE_NUMBER && slice->type != JSON_TAPE_STRING)
+		return false;
+	return text_int(slice->text, slice->length, result);
+}
+
+bool json_slice_bool(const json_slice* slice)
+{
+	return slice->type == JSON_TAPE_TRUE;
+}
+
+#pragma endregion
@@ -0,0 +1,292 @@
+/*	Copyright 2017 DeviceDrive AS
+*
+*	Licensed under the Apache License, Version 2.0 (the "License");
+*	you may not use this file except in compliance with the License.
+*	You may obtain a copy of the License at
+*
+*	http ://www.apache.org/licenses/LICENSE-2.0
+*
+*	Unless required by applicable law or agreed to in writing, software
+*	distributed under the License is distributed on an "AS IS" BASIS,
+*	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*	See the License for the specific language governing permissions and
+*	limitations under the License.
+*
+*/
+
+/**@file
+*
+*	@brief		Compact JSON document on a tape, and queries on JSON text
+*	@details	A validated document is stored as a flat array of 32 bit entries, one
+*				per value and one per object key, in document order. An array or
+*				object entry holds the index of the entry after its last child, so a
+*				subtree is skipped in one step. Every other entry holds the offset of
+*				its text in the source, which is never copied, so the source has to
+*				live as long as the tape. The entries are given by the caller and
+*				nothing is allocated.
+*
+*				{"com.devicedrive.light":{"power":1}} takes 5 entries, 20 bytes,
+*				where json_parse makes 5 heap blocks of several hundred bytes together.
+*
+*				When only a property or two is wanted, @ref json_find goes straight
+*				to it in the text, without a tape. Members on the way that do not
+*				match are passed over by matching brackets.
+*/
+
+#ifndef JSON_TAPE_H__
+#define JSON_TAPE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef JSON_TAPE_MAX_DEPTH
+#define JSON_TAPE_MAX_DEPTH 16
+#endif
+
+/*	@brief	Index of a missing value, given by lookups that find nothing.
+*/
+#define JSON_TAPE_END 0xFFFFFFFF
+
+/*	@brief	Value types. JSON_TAPE_NONE is the type of @ref JSON_TAPE_END.
+*/
+typedef enum {
+	JSON_TAPE_NONE,
+	JSON_TAPE_OBJECT,
+	JSON_TAPE_ARRAY,
+	JSON_TAPE_KEY,				// Only seen when walking the entries directly
+	JSON_TAPE_STRING,
+	JSON_TAPE_NUMBER,
+	JSON_TAPE_TRUE,
+	JSON_TAPE_FALSE,
+	JSON_TAPE_NULL,
+}json_tape_type;
+
+/*	@brief	A value in JSON text. Strings are without the quotes and with escapes as
+*			they are, arrays and objects include their brackets.
+*/
+typedef struct {
+	json_tape_type type;
+	const char* text;
+	size_t length;
+}json_slice;
+
+/*	@brief	A parsed document. The root value has index 0.
+*/
+typedef struct {
+	const char* json;
+	size_t length;
+	uint32_t* entries;
+	uint32_t count;
+	bool too_large;			// Set when parsing failed for lack of entries or depth
+}json_tape;
+
+/*	@brief		Function for parsing a document onto a tape.
+*
+*	@details	A document never needs more entries than it has characters, and a
+*				typical cloud message needs about one per 7 characters.
+*
+*	@param[out]	tape		Tape to fill.
+*	@param[in]	json		Source, which the tape points into. It is not changed.
+*	@param[in]	length		Length of @ref json, less than 2^28.
+*	@param[in]	entries		Storage for the entries.
+*	@param[in]	size		Number of entries in @ref entries.
+*
+*	@retval		true	if @ref json is one valid JSON value and the entries were enough.
+*	@retval		false	otherwise, and the tape is empty. too_large is set if the entries,
+*						JSON_TAPE_MAX_DEPTH or the length ran out, and then the rest of
+*						@ref json was not checked.
+*/
+bool json_tape_parse(json_tape* tape, const char* json, size_t length, uint32_t* entries, uint32_t size);
+
+/*	@brief		Function for getting the type of a value.
+*/
+json_tape_type json_tape_type_of(const json_tape* tape, uint32_t value);
+
+/*	@brief		Function for getting the number of members or elements of a container.
+*/
+uint32_t json_tape_length(const json_tape* tape, uint32_t container);
+
+/*	@brief		Function for walking the children of a container.
+*
+*	@details	For an object these are the member values, see @ref json_tape_key.
+*
+*				for (uint32_t v = json_tape_first(tape, c); v != JSON_TAPE_END; v = json_tape_next(tape, c, v))
+*
+*	@return		The first child, or JSON_TAPE_END if there is none.
+*/
+uint32_t json_tape_first(const json_tape* tape, uint32_t container);
+
+/*	@brief		Function for getting the child after @ref value in @ref container.
+*
+*	@return		The next child, or JSON_TAPE_END after the last one.
+*/
+uint32_t json_tape_next(const json_tape* tape, uint32_t container, uint32_t value);
+
+/*	@brief		Function for looking up the member of an object with the given key.
+*
+*	@return		The member value, or JSON_TAPE_END if there is no such key.
+*/
+uint32_t json_tape_get(const json_tape* tape, uint32_t object, const char* key);
+
+/*	@brief		Function for getting an element of an array.
+*
+*	@return		The element, or JSON_TAPE_END if @ref index is out of range.
+*/
+uint32_t json_tape_at(const json_tape* tape, uint32_t array, uint32_t index);
+
+/*	@brief		Function for getting the source text of a string, number or literal.
+*
+*	@details	Strings are given without the quotes and with escapes as they are.
+*
+*	@return		The text, which is not zero terminated, or NULL for other values.
+*/
+const char* json_tape_raw(const json_tape* tape, uint32_t value, size_t* length);
+
+/*	@brief		Function for getting the key of an object member value.
+*
+*	@return		The key as it is in the source, like @ref json_tape_raw, or NULL if
+*				@ref value is not an object member.
+*/
+const char* json_tape_key(const json_tape* tape, uint32_t value, size_t* length);
+
+/*	@brief		Function for copying a string with the escapes decoded.
+*
+*	@details	@ref dst is always zero terminated when @ref size is not 0.
+*
+*	@return		The length of the whole string, so a result of @ref size or more
+*				means it was cut. 0 if @ref value is not a string.
+*/
+size_t json_tape_string(const json_tape* tape, uint32_t value, char* dst, size_t size);
+
+/*	@brief		Function for comparing a string or key with a zero terminated string.
+*/
+bool json_tape_equals(const json_tape* tape, uint32_t value, const char* text);
+
+/*	@brief		Function for reading an integer from a number or a string of digits.
+*
+*	@retval		false	if the value is not an integer or does not fit in 64 bits.
+*/
+bool json_tape_int(const json_tape* tape, uint32_t value, int64_t* result);
+
+/*	@brief		Function for reading true or false.
+*
+*	@retval		false	if the value is not true.
+*/
+bool json_tape_bool(const json_tape* tape, uint32_t value);
+
+/*	@brief		Function for getting a string, number or literal as a slice.
+*
+*	@return		The slice, of type JSON_TAPE_NONE for other values.
+*/
+json_slice json_tape_slice(const json_tape* tape, uint32_t value);
+
+/*	@brief		Macro for finding a value by the keys of the objects leading to it.
+*
+*	@details	json_find(msg, length, "com.devicedrive.light", "power") gives the
+*				value of power in {"com.devicedrive.light":{"power":1}}. The text is
+*				scanned once and nothing is allocated. Only the path to the value and
+*				the value itself are checked, so text that is not valid JSON elsewhere
+*				may still give a result.
+*
+*	@return		The value, or a slice of type JSON_TAPE_NONE if it is not there.
+*/
+#define json_find(JSON, LENGTH, ...) json_find_keys((JSON), (LENGTH), __VA_ARGS__, (const char*)NULL)
+
+/*	@brief		Function behind @ref json_find, the keys end with NULL.
+*/
+json_slice json_find_keys(const char* json, size_t length, ...);
+
+/*	@brief		Function for finding a value by an array of @ref count keys.
+*/
+json_slice json_find_path(const char* json, size_t length, const char* const* keys, int count);
+
+/*	@brief		Functions for reading a slice, as the json_tape_ ones for a value.
+*/
+size_t json_slice_string(const json_slice* slice, char* dst, size_t size);
+bool json_slice_equals(const json_slice* slice, const char* text);
+bool json_slice_int(const json_slice* slice, int64_t* result);
+bool json_slice_bool(const json_slice* slice);
+
+#ifdef __cplusplus
+}
+
+/*	@brief	A value on a tape, with the same lookups as json_value. A missing key or
+*			index gives a value of type JSON_TAPE_NONE, so lookups can be chained:
+*
+*			int power = JsonTapeValue(&tape)["com.devicedrive.light"]["power"].asInt();
+*
+*			There are no conversion operators, as with both an integer and a bool one
+*			int power = ... would go through the bool.
+*/
+class JsonTapeValue
+{
+private:
+	const json_tape* _tape;
+	uint32_t _index;
+
+public:
+	JsonTapeValue(const json_tape* tape, uint32_t index = 0) :
+		_tape(tape), _index(index)
+	{
+	}
+
+	JsonTapeValue operator[](const char* key) const
+	{
+		return JsonTapeValue(_tape, json_tape_get(_tape, _index, key));
+	}
+
+	JsonTapeValue operator[](int index) const
+	{
+		return JsonTapeValue(_tape, index < 0 ? JSON_TAPE_END : json_tape_at(_tape, _index, (uint32_t)index));
+	}
+
+	json_tape_type type() const
+	{
+		return json_tape_type_of(_tape, _index);
+	}
+
+	uint32_t index() const
+	{
+		return _index;
+	}
+
+	uint32_t length() const
+	{
+		return json_tape_length(_tape, _index);
+	}
+
+	bool equals(const char* text) const
+	{
+		return json_tape_equals(_tape, _index, text);
+	}
+
+	size_t copyTo(char* dst, size_t size) const
+	{
+		return json_tape_string(_tape, _index, dst, size);
+	}
+
+	/*	@brief	The integer in a number or a string of digits, 0 for anything else.
+	*/
+	int64_t asInt() const
+	{
+		int64_t result = 0;
+		json_tape_int(_tape, _index, &result);
+		return result;
+	}
+
+	/*	@brief	True only for true.
+	*/
+	bool asBool() const
+	{
+		return json_tape_bool(_tape, _index);
+	}
+};
+
+#endif
+
+#endif
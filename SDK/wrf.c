@@ -15,50 +15,85 @@
 */
 
 #include  "wrf.h"
-#include "json.h"
+#include "wrf_keywords.h"
+#include "wrf_schema.h"
 #include  <string.h>
 #include <stdio.h>
 
-#define WRF_MESSAGE_MAX_SIZE 1024
-
+/*	The wrf_ functions keep what they are set up with here, and are run through a
+*	built in context that calls these.
+*/
 static wrf_write_string _write_string = NULL;
+static wrf_write_segments _write_segments = NULL;
 static wrf_callback on_response_cb = NULL;
+#if WRF_COMMAND_BUFFER_STATIC
+static char _command_buffer[WRF_MESSAGE_MAX_SIZE];
+#endif
 
-void wrf_init(wrf_write_string write_string)
+static uint32_t default_write_string(wrf_ctx* ctx, unsigned char* buffer, int buflen)
 {
-	_write_string = write_string;
+	return _write_string(buffer, buflen);
 }
 
-void wrf_send_message(char* msg)
+static uint32_t default_write_segments(wrf_ctx* ctx, const wrf_segment* segments, int count)
 {
-	int length = strlen(msg);
-	unsigned char* buffer = malloc(length + 2);
-	memcpy(buffer, msg, length);
-	buffer[length + 0] = (char)WRF_EOT;
-	buffer[length + 1] = 0x0; //Zero terminate
+	if (_write_segments)
+		return _write_segments(segments, count);
+	for (int i = 0; i < count; i++)
+		_write_string((unsigned char*)segments[i].data, segments[i].length);
+	return 0;
+}
 
-	_write_string(buffer, strlen(buffer));
-	free(buffer);
+static void default_on_response(wrf_ctx* ctx, wrf_result_code code, void* object)
+{
+	if (on_response_cb)
+		on_response_cb(code, object);
 }
 
-void wrf_receive_message()
+static wrf_ctx _builtin_ctx = { default_write_string, default_write_segments, default_on_response, NULL };
+static wrf_ctx* _default_ctx = &_builtin_ctx;
+
+#pragma region Contexts
+
+void wrf_ctx_init(wrf_ctx* ctx, wrf_ctx_write_string write_uart, void* user_data)
 {
-	_write_string(WRF_EOT_STR, 1);
+	ctx->write_string = write_uart;
+	ctx->write_segments = NULL;
+	ctx->on_response = NULL;
+	ctx->user_data = user_data;
+	ctx->message_length = 0;
 }
 
-void wrf_send_without_receive(char* msg)
+void wrf_ctx_init_segments(wrf_ctx* ctx, wrf_ctx_write_segments write_segments)
 {
-	int length = strlen(msg);
-	unsigned char* buffer = malloc(length + 3);
-	memcpy(buffer, msg, length);
-	buffer[length + 0] = (char)ETX_CHAR;
-	buffer[length + 1] = (char)WRF_EOT;
-	buffer[length + 2] = 0x0; //Zero terminate
-	_write_string(buffer, strlen((const char*)buffer));
-	free(buffer);
+	ctx->write_segments = write_segments;
+}
+
+void wrf_ctx_on_response(wrf_ctx* ctx, wrf_ctx_callback callback)
+{
+	ctx->on_response = callback;
+}
+
+wrf_ctx* wrf_default_ctx()
+{
+	return _default_ctx;
+}
+
+void wrf_set_default_ctx(wrf_ctx* ctx)
+{
+	_default_ctx = ctx ? ctx : &_builtin_ctx;
+}
+
+void wrf_init(wrf_write_string write_string)
+{
+	_write_string = write_string;
+	_default_ctx = &_builtin_ctx;
 }
 
-#pragma region Callbacks
+void wrf_init_segments(wrf_write_segments write_segments)
+{
+	_write_segments = write_segments;
+}
 
 void wrf_on_response(wrf_callback callback)
 {
@@ -67,35 +102,90 @@ void wrf_on_response(wrf_callback callback)
 
 #pragma endregion
 
+static void write_segments(wrf_ctx* ctx, const wrf_segment* segments, int count)
+{
+	if (ctx->write_segments) {
+		ctx->write_segments(ctx, segments, count);
+		return;
+	}
+	for (int i = 0; i < count; i++)
+		ctx->write_string(ctx, (unsigned char*)segments[i].data, segments[i].length);
+}
+
+void wrf_ctx_send_message(wrf_ctx* ctx, char* msg)
+{
+	static const unsigned char eot[] = { WRF_EOT };
+	wrf_segment segments[2] = {
+		{ (const unsigned char*)msg, (int)strlen(msg) },
+		{ eot, sizeof(eot) }
+	};
+	write_segments(ctx, segments, 2);
+}
+
+void wrf_ctx_receive_message(wrf_ctx* ctx)
+{
+	ctx->write_string(ctx, WRF_EOT_STR, 1);
+}
+
+void wrf_ctx_send_without_receive(wrf_ctx* ctx, char* msg)
+{
+	static const unsigned char etx_eot[] = { ETX_CHAR, WRF_EOT };
+	wrf_segment segments[2] = {
+		{ (const unsigned char*)msg, (int)strlen(msg) },
+		{ etx_eot, sizeof(etx_eot) }
+	};
+	write_segments(ctx, segments, 2);
+}
+
 #pragma region Send Commands
 
-void wrf_send_command(wrf_command cmd, wrf_param* params, int size)
+static void send_response(wrf_ctx* ctx, wrf_result_code code, void* object);
+
+/*	The WRF01 queue takes whole frames only, so a command that does not fit
+*	the buffer can not be streamed and is reported instead.
+*/
+static void send_encoded(wrf_ctx* ctx, wrf_encoder* enc)
 {
-	char *msg = (char*)malloc(WRF_MESSAGE_MAX_SIZE);
-	strcpy(msg, WRF_JSON_START);
-	JSON_PAIR_STR(WRF_COMMAND_STR, get_cmd_str(cmd), msg);
+	int length = wrf_encoder_end(enc);
+	if (length < 0) {
+		wrf_error error = { LIB_ERROR_COMMAND_TOO_LONG, (char*)LIB_ERROR_COMMAND_TOO_LONG_STR };
+		send_response(ctx, WRF_LOCAL_ERROR, &error);
+		return;
+	}
+	ctx->write_string(ctx, (unsigned char*)enc->buffer, length);
+}
+
+void wrf_ctx_send_command(wrf_ctx* ctx, wrf_command cmd, wrf_param* params, int size)
+{
+#if !WRF_COMMAND_BUFFER_STATIC
+	char _command_buffer[WRF_MESSAGE_MAX_SIZE];	// Commands may be sent from several threads at once
+#endif
+	wrf_encoder enc;
+	wrf_encoder_init(&enc, _command_buffer, WRF_MESSAGE_MAX_SIZE);
+	wrf_encoder_begin(&enc, cmd);
 
 	if (params)
-		for(int i = 0; i< size; i++)
-			add_cmd_param(*(params+i), msg);	
-	
-	strcat(msg, WRF_JSON_END);
-	wrf_send_message(msg);
-	free(msg);
+		for (int i = 0; i < size; i++)
+			wrf_encoder_add_param(&enc, params + i);
+
+	send_encoded(ctx, &enc);
 }
 
-void wrf_send_introspect(char* introspect) 
+void wrf_ctx_send_introspect(wrf_ctx* ctx, char* introspect) 
 {
-	char msg[WRF_MESSAGE_MAX_SIZE] = WRF_JSON_START;
-	JSON_PAIR_STR(WRF_COMMAND_STR, WRF_COMMAND_INTROSPECT_STR, msg);
-	strcat(msg, ", ");
-	strcat(msg, introspect);
-	strcat(msg, WRF_JSON_END);
+#if !WRF_COMMAND_BUFFER_STATIC
+	char _command_buffer[WRF_MESSAGE_MAX_SIZE];	// Commands may be sent from several threads at once
+#endif
+	wrf_encoder enc;
+	wrf_encoder_init(&enc, _command_buffer, WRF_MESSAGE_MAX_SIZE);
+	wrf_encoder_begin(&enc, WRF_COMMAND_INTROSPECT);
+	wrf_encoder_add_raw(&enc, ", ");
+	wrf_encoder_add_raw(&enc, introspect);
 
-	wrf_send_message(msg);
+	send_encoded(ctx, &enc);
 }
 
-void wrf_send_config(wrf_config *config)
+void wrf_ctx_send_config(wrf_ctx* ctx, wrf_config *config)
 {
 	char f_buffer[10];
 	wrf_param params[WRF_DEFAULT_CONFIG_SIZE];
@@ -154,27 +244,27 @@ void wrf_send_config(wrf_config *config)
 		size++;
 	}
 
-	wrf_send_command(WRF_COMMAND_SETUP, params, size);
+	wrf_ctx_send_command(ctx, WRF_COMMAND_SETUP, params, size);
 }
 
 
-void wrf_set_visible(int seconds) 
+void wrf_ctx_set_visible(wrf_ctx* ctx, int seconds) 
 {
 	char seconds_str[WRF_PARAM_SIZE];
 	sprintf(seconds_str, "%d", seconds);
 	wrf_param param = {WRF_SETUP_VISIBILITY_STR, seconds_str};
-	wrf_send_command(WRF_COMMAND_SETUP, &param, 1);
+	wrf_ctx_send_command(ctx, WRF_COMMAND_SETUP, &param, 1);
 }
 
-void wrf_smart_linkup(int seconds)
+void wrf_ctx_smart_linkup(wrf_ctx* ctx, int seconds)
 {
 	char seconds_str[WRF_PARAM_SIZE];
 	sprintf(seconds_str, "%d", seconds);
 	wrf_param param = { WRF_TIMEOUT_STR, seconds_str };
-	wrf_send_command(WRF_COMMAND_SMARTLINKUP, &param, 1);
+	wrf_ctx_send_command(ctx, WRF_COMMAND_SMARTLINKUP, &param, 1);
 }
 
-void wrf_connect(bool silent) 
+void wrf_ctx_connect(wrf_ctx* ctx, bool silent) 
 {
 	char silent_str[WRF_PARAM_SIZE];
 	sprintf(silent_str, "%d", silent);
@@ -182,27 +272,27 @@ void wrf_connect(bool silent)
 		{WRF_SETUP_SILENT_CONNECT_STR, silent_str}
 	};
 	
-	wrf_send_command(WRF_COMMAND_SETUP, params, 1);
+	wrf_ctx_send_command(ctx, WRF_COMMAND_SETUP, params, 1);
 }
 
-void wrf_reboot() 
+void wrf_ctx_reboot(wrf_ctx* ctx) 
 {
-	wrf_send_command(WRF_COMMAND_REBOOT, NULL, 0);
+	wrf_ctx_send_command(ctx, WRF_COMMAND_REBOOT, NULL, 0);
 }
 
-void wrf_deep_sleep(int duration) 
+void wrf_ctx_deep_sleep(wrf_ctx* ctx, int duration) 
 {
 	char duration_str[WRF_PARAM_SIZE];
 	sprintf(duration_str, "%d", duration);
 	wrf_param param = {WRF_SECONDS_STR, duration_str};
-	wrf_send_command(WRF_COMMAND_DEEP_SLEEP, &param, 1);
+	wrf_ctx_send_command(ctx, WRF_COMMAND_DEEP_SLEEP, &param, 1);
 }
 
-void wrf_check_upgrade() {
-	wrf_send_command(WRF_COMMAND_CHECK_UPGRADE, NULL, 0);
+void wrf_ctx_check_upgrade(wrf_ctx* ctx) {
+	wrf_ctx_send_command(ctx, WRF_COMMAND_CHECK_UPGRADE, NULL, 0);
 }
 
-void wrf_get_upgrade(ota_params *upgrade_params) {
+void wrf_ctx_get_upgrade(wrf_ctx* ctx, ota_params *upgrade_params) {
 	wrf_param params[DEFAULT_OTA_PARAM_SIZE];
 	int size = 0;
 	if (upgrade_params->module >= 0) {
@@ -233,10 +323,10 @@ void wrf_get_upgrade(ota_params *upgrade_params) {
 		size++;
 	}
 
-	wrf_send_command(WRF_COMMAND_GET_UPGRADE, params, size);
+	wrf_ctx_send_command(ctx, WRF_COMMAND_GET_UPGRADE, params, size);
 }
 
-void wrf_init_send_file(char* file_name, int size) {
+void wrf_ctx_init_send_file(wrf_ctx* ctx, char* file_name, int size) {
 	char size_str[WRF_PARAM_SIZE];
 	sprintf(size_str, "%d", size);
 
@@ -247,291 +337,338 @@ void wrf_init_send_file(char* file_name, int size) {
 	params[1].name = WRF_SEND_FILE_FILE_NAME_STR;
 	params[1].str_value = file_name;
 
-	wrf_send_command(WRF_COMMAND_SEND_FILE, params, 2);
+	wrf_ctx_send_command(ctx, WRF_COMMAND_SEND_FILE, params, 2);
 }
 
-void wrf_clear() 
+void wrf_ctx_clear(wrf_ctx* ctx) 
 {
-	wrf_send_command(WRF_COMMAND_CLEAR, NULL, 0);
+	wrf_ctx_send_command(ctx, WRF_COMMAND_CLEAR, NULL, 0);
 }
 
-void wrf_factory_reset()
+void wrf_ctx_factory_reset(wrf_ctx* ctx)
 {
-	wrf_send_command(WRF_COMMAND_FACTORY_RESET, NULL, 0);
+	wrf_ctx_send_command(ctx, WRF_COMMAND_FACTORY_RESET, NULL, 0);
 }
 
-void wrf_ask_status() 
+void wrf_ctx_ask_status(wrf_ctx* ctx) 
 {
-	wrf_send_command(WRF_COMMAND_STATUS, NULL, 0);
+	wrf_ctx_send_command(ctx, WRF_COMMAND_STATUS, NULL, 0);
 }
 
-void wrf_get_time()
+void wrf_ctx_get_time(wrf_ctx* ctx)
 {
-	wrf_send_command(WRF_COMMAND_GET_TIME,NULL,0);
+	wrf_ctx_send_command(ctx, WRF_COMMAND_GET_TIME,NULL,0);
 }
 
 #pragma endregion
 
 #pragma region Response Handelers
 
-static void send_response(wrf_result_code code, void* object) 
+static void send_response(wrf_ctx* ctx, wrf_result_code code, void* object) 
 {
-	if (on_response_cb)
-		on_response_cb(code, object);
+	if (ctx->on_response)
+		ctx->on_response(ctx, code, object);
 }
 
-static void handle_result(json_value* value)
+static void handle_result(wrf_ctx* ctx, const char* value)
 {
-	if (CHECK_STR(WRF_RESULT_OK_STR, value))
-		send_response(WRF_OK, NULL);
-	else if (CHECK_STR(WRF_RESULT_SENT_STR, value))
-		send_response(WRF_SENT, NULL);
-	else if (CHECK_STR(WRF_RESULT_EMPTY_STR, value))
-		send_response(WRF_EMPTY, NULL);
-	else if (CHECK_STR(WRF_RESULT_FILE_SENT_STR, value))
-		send_response(WRF_FILE_SENT, NULL);
-	else if (CHECK_STR(WRF_RESULT_FILE_CANCEL_STR, value))
-		send_response(WRF_FILE_CANCEL, NULL);
+	const wrf_keyword_entry* result = wrf_keyword_find(value, WRF_KEYWORD_RESULT);
+	if (result)
+		send_response(ctx, (wrf_result_code)result->value, NULL);
 	else {
 		wrf_error error = { LIB_ERROR_RESULT_UNKNOWN, WRF_ERROR_UNKNOWN_STR };
-		send_response(WRF_LOCAL_ERROR, &error);
+		send_response(ctx, WRF_LOCAL_ERROR, &error);
 	}
 }
 
-static void handle_local_error(json_value* value)
+static void handle_error(wrf_ctx* ctx, wrf_result_code code, wrf_keyword_class keyword_class, const char* value)
 {
 	wrf_error error;
-	if CHECK_STR(WRF_ERROR_SYSTEM_BUSY_STR, value)
-		INIT_ERROR(WRF_ERROR_SYSTEM_BUSY, WRF_ERROR_SYSTEM_BUSY_STR)
-
-	else if CHECK_STR(WRF_ERROR_SEND_REQUEST_FAILED_STR, value)
-		INIT_ERROR(WRF_ERROR_SEND_REQUEST_FAILED, WRF_ERROR_SEND_REQUEST_FAILED_STR)
-
-	else if CHECK_STR(WRF_ERROR_REVEICE_REQUEST_FAILED_STR, value)
-		INIT_ERROR(WRF_ERROR_REVEICE_REQUEST_FAILED, WRF_ERROR_REVEICE_REQUEST_FAILED_STR)
+	const wrf_keyword_entry* entry = wrf_keyword_find(value, keyword_class);
+	if (entry)
+		INIT_ERROR((wrf_error_code)entry->value, (char*)entry->str)
+	else 
+		INIT_ERROR(LIB_ERROR_RESULT_UNKNOWN, WRF_ERROR_UNKNOWN_STR)
 
-	else if CHECK_STR(WRF_ERROR_MASTER_REQUEST_FAILED_STR, value)
-		INIT_ERROR(WRF_ERROR_MASTER_REQUEST_FAILED, WRF_ERROR_MASTER_REQUEST_FAILED_STR)
+	send_response(ctx, code, &error);
+}
 
-	else if CHECK_STR(WRF_ERROR_NOT_ONLINE_STR, value)
-		INIT_ERROR(WRF_ERROR_NOT_ONLINE, WRF_ERROR_NOT_ONLINE_STR)
+/*	Sends the struct the decoder filled in, or the error of its schema. */
+static void handle_decoded(wrf_ctx* ctx, const wrf_decoder* decoder)
+{
+	const wrf_schema* schema = decoder->schema;
+	if (!schema) {
+		wrf_error error = { LIB_ERROR_UNKNOWN_OBJECT, LIB_ERROR_UNKNOWN_OBJECT_STR };
+		send_response(ctx, WRF_LOCAL_ERROR, &error);
+	}
+	else if (wrf_decoder_done(decoder))
+		send_response(ctx, schema->result, (void*)&decoder->out);
+	else {
+		wrf_error error;
+		INIT_ERROR(schema->error, (char*)schema->error_str)
+		send_response(ctx, WRF_LOCAL_ERROR, &error);
+	}
+}
 
-	else if CHECK_STR(WRF_ERROR_REMOTE_ERROR_STR, value)
-		INIT_ERROR(WRF_ERROR_REMOTE_ERROR, WRF_ERROR_REMOTE_ERROR_STR)
+static const wrf_schema* schema_for(wrf_frame_kind kind)
+{
+	switch (kind)
+	{
+	case WRF_FRAME_STATUS:
+		return &wrf_status_schema;
+	case WRF_FRAME_TIME:
+		return &wrf_time_schema;
+	case WRF_FRAME_UPGRADE:
+		return &wrf_module_list_schema;
+	case WRF_FRAME_CONFIG:
+		return &wrf_device_state_schema;
+	default:
+		return NULL;
+	}
+}
 
-	else if CHECK_STR(WRF_ERROR_RX_OVERFLOW_STR, value)
-		INIT_ERROR(WRF_ERROR_RX_OVERFLOW, WRF_ERROR_RX_OVERFLOW_STR)
+/*	Follows the tokens of the first member of the root object, which is all the
+*	library needs to know what kind of response it is.
+*/
+static void frame_classify(wrf_frame* frame, const json_token* token)
+{
+	if (token->depth == 1 && token->type == JSON_TOKEN_KEY) {
+		frame->root_member = token->index;
+		if (token->index != 0)
+			return;
+
+		const wrf_keyword_entry* root = wrf_keyword_find(token->text, WRF_KEYWORD_ROOT);
+		if (root) {
+			frame->kind = (wrf_frame_kind)root->value;
+			wrf_decoder_start(&frame->decoder, schema_for(frame->kind));
+		}
+		return;
+	}
 
-	else if CHECK_STR(WRF_ERROR_SET_AP_MODE_FAILED_STR, value)
-		INIT_ERROR(WRF_ERROR_SET_AP_MODE_FAILED, WRF_ERROR_SET_AP_MODE_FAILED_STR)
+	if (frame->root_member != 0 || frame->kind == WRF_FRAME_MESSAGE || frame->kind == WRF_FRAME_CONFIG)
+		return;
 
-	else if CHECK_STR(WRF_ERROR_UPGRADE_STR, value)
-		INIT_ERROR(WRF_ERROR_UPGRADE, WRF_ERROR_UPGRADE_STR)
+	// The response object must hold an object
+	if (token->depth == 1 && token->type != JSON_TOKEN_OBJECT_BEGIN && token->type != JSON_TOKEN_OBJECT_END) {
+		frame->kind = frame->kind == WRF_FRAME_REMOTE_UNKNOWN ? WRF_FRAME_REMOTE_UNKNOWN : WRF_FRAME_LOCAL_UNKNOWN;
+		return;
+	}
 
-	else if CHECK_STR(WRF_ERROR_COMMAND_FAILED_STR, value)
-		INIT_ERROR(WRF_ERROR_COMMAND_FAILED, WRF_ERROR_COMMAND_FAILED_STR)
+	if (token->depth != 2 || token->index != 0)
+		return;
 
-	else if CHECK_STR(WRF_ERROR_SMARTLINKUP_FAILED_STR, value)
-		INIT_ERROR(WRF_ERROR_SMARTLINKUP_FAILED, WRF_ERROR_SMARTLINKUP_FAILED_STR)
+	if (token->type == JSON_TOKEN_KEY) {
+		wrf_keyword_class keyword_class = frame->kind == WRF_FRAME_LOCAL_UNKNOWN 
+			? WRF_KEYWORD_LOCAL_OBJECT : WRF_KEYWORD_REMOTE_OBJECT;
+		const wrf_keyword_entry* object = wrf_keyword_find(token->text, keyword_class);
+		if (object) {
+			frame->kind = (wrf_frame_kind)object->value;
+			wrf_decoder_start(&frame->decoder, schema_for(frame->kind));
+		}
+		return;
+	}
 
-	else if CHECK_STR(WRF_ERROR_NO_TIME_STR, value)
-		INIT_ERROR(WRF_ERROR_NO_TIME, WRF_ERROR_NO_TIME_STR)
+	// An upgrade response is a list of modules or, as an object, a packet
+	if (frame->kind == WRF_FRAME_UPGRADE && token->type == JSON_TOKEN_OBJECT_BEGIN)
+		wrf_decoder_start(&frame->decoder, &wrf_ota_packet_schema);
+
+	bool wants_value = frame->kind == WRF_FRAME_RESULT 
+		|| frame->kind == WRF_FRAME_LOCAL_ERROR 
+		|| frame->kind == WRF_FRAME_REMOTE_ERROR
+		|| frame->kind == WRF_FRAME_SEND_FILE;
+	bool is_value = token->type == JSON_TOKEN_STRING
+		|| (token->type == JSON_TOKEN_NUMBER && frame->kind == WRF_FRAME_SEND_FILE);
+	// Long strings arrive in parts, none of which is a known value
+	if (token->type == JSON_TOKEN_STRING_PART)
+		frame->value_truncated = true;
+	else if (wants_value && is_value && !token->truncated && !frame->value_truncated)
+		memcpy(frame->value, token->text, token->length + 1);
+}
+
+/*	Works out the kind of response from the first member of the root object, and
+*	hands every token to the decoder of that kind.
+*/
+static void frame_on_token(const json_token* token, void* user_data)
+{
+	wrf_frame* frame = (wrf_frame*)user_data;
+	frame_classify(frame, token);
+	if (frame->decoder.schema)
+		wrf_decoder_feed(&frame->decoder, token);
+}
 
-	else INIT_ERROR(LIB_ERROR_RESULT_UNKNOWN, WRF_ERROR_UNKNOWN_STR)
+void wrf_frame_reset(wrf_frame* frame)
+{
+	json_stream_init(&frame->stream, frame_on_token, frame);
+	json_stream_split_strings(&frame->stream, true);
+	wrf_decoder_start(&frame->decoder, NULL);
+	frame->kind = WRF_FRAME_MESSAGE;
+	frame->root_member = 0;
+	frame->value[0] = 0x0;
+	frame->value_truncated = false;
+}
 
-	send_response(WRF_LOCAL_ERROR, &error);
+void wrf_frame_feed(wrf_frame* frame, char c)
+{
+	json_stream_feed(&frame->stream, c);
 }
 
-static void handle_status(json_value* _value) {
-	
-	if (_value->u.object.length != 6) {
-		wrf_error error = { LIB_ERROR_PARSE_STATUS, LIB_ERROR_PARSE_STATUS_STR };
-		send_response(WRF_LOCAL_ERROR, &error);
+void wrf_ctx_handle_frame(wrf_ctx* ctx, wrf_frame* frame, char* msg, size_t length)
+{
+	wrf_frame_kind kind = json_stream_finish(&frame->stream) ? frame->kind : WRF_FRAME_MESSAGE;
+	ctx->message_length = length;
+
+	switch (kind)
+	{
+	case WRF_FRAME_MESSAGE:
+		send_response(ctx, WRF_MESSAGE, msg);
+		break;
+	case WRF_FRAME_RESULT:
+		handle_result(ctx, frame->value);
+		break;
+	case WRF_FRAME_LOCAL_ERROR:
+		handle_error(ctx, WRF_LOCAL_ERROR, WRF_KEYWORD_LOCAL_ERROR, frame->value);
+		break;
+	case WRF_FRAME_LOCAL_UNKNOWN:
+	{
+		wrf_error error = { LIB_ERROR_UNKNOWN_OBJECT, LIB_ERROR_UNKNOWN_OBJECT_STR };
+		send_response(ctx, WRF_LOCAL_ERROR, &error);
+		break;
 	}
-	else {
-		wrf_status status;
-		status.connection_status = get_status((_value->u.object.values[0].value->u.string.ptr));
-		memcpy(status.ip_addr, _value->u.object.values[1].value->u.string.ptr, _value->u.object.values[1].value->u.string.length);
-		status.ip_addr[_value->u.object.values[1].value->u.string.length] = '\x0'; // Null terminate string
-		status.visibility_status = strcmp(_value->u.object.values[2].value->u.string.ptr, "ON") == 0 ? true : false;
-		status.last_error_code = get_error_code((_value->u.object.values[3].value->u.string.ptr));
-		memcpy(status.last_error_msg, _value->u.object.values[4].value->u.string.ptr, (size_t)_value->u.object.values[4].value->u.string.length);
-		status.last_error_msg[_value->u.object.values[4].value->u.string.length] = '\x0'; // Null terminate string
-		status.successful_transfer_count = atoi(_value->u.object.values[5].value->u.string.ptr);
-
-		send_response(WRF_STATUS, &status);
+	case WRF_FRAME_REMOTE_ERROR:
+		handle_error(ctx, WRF_REMOTE_ERROR, WRF_KEYWORD_REMOTE_ERROR, frame->value);
+		break;
+	case WRF_FRAME_REMOTE_UNKNOWN:
+	{
+		wrf_error error;
+		INIT_ERROR(LIB_ERROR_RESULT_UNKNOWN, WRF_ERROR_UNKNOWN_STR)
+		send_response(ctx, WRF_REMOTE_ERROR, &error);
+		break;
 	}
+	case WRF_FRAME_SEND_FILE:
+		send_response(ctx, WRF_SEND_FILE, frame->value);
+		break;
+	default:
+		handle_decoded(ctx, &frame->decoder);
+		break;
+	}
+
+	wrf_frame_reset(frame);
 }
 
-static void handle_remote_error(json_value* value) 
-{
-	wrf_error error;
+void wrf_ctx_handle_response(wrf_ctx* ctx, char* msg) {
+	wrf_frame frame;
+	wrf_frame_reset(&frame);
 
-	if CHECK_STR(WRF_ERROR_UNDEFINED_ERROR_STR, value)
-		INIT_ERROR(WRF_ERROR_UNDEFINED_ERROR, WRF_ERROR_UNDEFINED_ERROR_STR)
+	char* c;
+	for (c = msg; *c && *c != WRF_EOT; c++)
+		wrf_frame_feed(&frame, *c);
 
-	else if CHECK_STR(WRF_ERROR_INVALID_JSON_STR, value)
-		INIT_ERROR(WRF_ERROR_INVALID_JSON, WRF_ERROR_INVALID_JSON_STR)
+	wrf_ctx_handle_frame(ctx, &frame, msg, (size_t)(c - msg));
+}
+#pragma endregion
 
-	else if CHECK_STR(WRF_ERROR_INVALID_INTROSPECT_STR, value)
-		INIT_ERROR(WRF_ERROR_INVALID_INTROSPECT, WRF_ERROR_INVALID_INTROSPECT_STR)
+#pragma region Default Context
 
-	else if CHECK_STR(WRF_ERROR_INVALID_HEADER_STR, value)
-		INIT_ERROR(WRF_ERROR_INVALID_HEADER, WRF_ERROR_INVALID_HEADER_STR)
+void wrf_send_message(char* msg)
+{
+	wrf_ctx_send_message(_default_ctx, msg);
+}
 
-	else if CHECK_STR(WRF_ERROR_FORWARDING_ERROR_STR, value)
-		INIT_ERROR(WRF_ERROR_FORWARDING_ERROR, WRF_ERROR_FORWARDING_ERROR_STR)
+void wrf_send_command(wrf_command cmd, wrf_param* params, int size)
+{
+	wrf_ctx_send_command(_default_ctx, cmd, params, size);
+}
 
-	else if CHECK_STR(WRF_ERROR_MISSING_HEADER_STR, value)
-		INIT_ERROR(WRF_ERROR_MISSING_HEADER, WRF_ERROR_MISSING_HEADER_STR)
+void wrf_receive_message()
+{
+	wrf_ctx_receive_message(_default_ctx);
+}
 
-	else if CHECK_STR(WRF_ERROR_INVALID_TOKEN_STR, value)
-		INIT_ERROR(WRF_ERROR_INVALID_TOKEN, WRF_ERROR_INVALID_TOKEN_STR)
+void wrf_send_without_receive(char* msg)
+{
+	wrf_ctx_send_without_receive(_default_ctx, msg);
+}
 
-	else if CHECK_STR(WRF_ERROR_INVALID_APP_STR, value)
-		INIT_ERROR(WRF_ERROR_INVALID_APP, WRF_ERROR_INVALID_APP_STR)
+void wrf_send_config(wrf_config *config)
+{
+	wrf_ctx_send_config(_default_ctx, config);
+}
 
-	else INIT_ERROR(LIB_ERROR_RESULT_UNKNOWN, WRF_ERROR_UNKNOWN_STR)
+void wrf_send_introspect(char* introspect)
+{
+	wrf_ctx_send_introspect(_default_ctx, introspect);
+}
 
-	send_response(WRF_REMOTE_ERROR, &error);
+void wrf_set_visible(int seconds)
+{
+	wrf_ctx_set_visible(_default_ctx, seconds);
 }
 
-static void handle_configuartion(json_value* value) 
+void wrf_smart_linkup(int seconds)
 {
-	wrf_device_state state;
-	memcpy(state.mac, value->u.object.values[0].value->u.string.ptr, value->u.object.values[0].value->u.string.length);
-	state.mac[value->u.object.values[0].value->u.string.length] = '\x0'; // Nullterminate string!
-	json_value* device_state = value->parent->u.object.values[1].value;
-	state.rssi = atoi(device_state->u.object.values[0].value->u.string.ptr);
-	
-	send_response(WRF_CONFIG, &state);
+	wrf_ctx_smart_linkup(_default_ctx, seconds);
 }
 
-static void handle_upgrade(json_value* value) 
+void wrf_connect(bool silent)
 {
-	if (value->type == json_array) 
-	{
-		wrf_module_list list;
-		list.size = value->u.array.length;
-		for (int i = 0; i < list.size; i++)
-			list.modules[i] = get_ota_module(value->u.array.values[i]->u.string.ptr);
-		
-		send_response(WRF_UPGRADE_PENDING, &list);
-	}
-	else if (value->type == json_object && value->u.object.length >0 && strcmp(WRF_SIZE_STR,value->u.object.values[0].name)==0)
-	{
-		ota_packet packet; 
-		packet.size = value->u.object.values[0].value->u.integer;
-		packet.crc = value->u.object.values[1].value->u.integer;
+	wrf_ctx_connect(_default_ctx, silent);
+}
 
-		send_response(WRF_UPGRADE_PACKAGE, &packet);
-	}
-	else
-	{
-		wrf_error error;
-		INIT_ERROR(LIB_ERROR_PARSE_UPGRADE, LIB_ERROR_PARSE_UPGRADE_STR)
-		send_response(WRF_LOCAL_ERROR, &error);
-	}
+void wrf_reboot()
+{
+	wrf_ctx_reboot(_default_ctx);
 }
 
-static void handle_send_file(json_value* value) {
-	char size_str[WRF_PARAM_SIZE];
-	memcpy(size_str, value->u.string.ptr, value->u.string.length);
-	send_response(WRF_SEND_FILE, size_str);
+void wrf_deep_sleep(int duration)
+{
+	wrf_ctx_deep_sleep(_default_ctx, duration);
 }
 
-void handle_time(json_value* value)
+void wrf_check_upgrade()
 {
-	if (value->type == json_array) 
-	{
-		wrf_time time; 
-		time.timestamp = value->u.array.values[0]->u.integer;
-		time.week_day = value->u.array.values[1]->u.integer;
-		time.day = value->u.array.values[2]->u.integer;
-		time.month = value->u.array.values[3]->u.integer;
-		time.year = value->u.array.values[4]->u.integer;
-		time.hour = value->u.array.values[5]->u.integer;
-		time.minute = value->u.array.values[6]->u.integer;
-		time.second = value->u.array.values[7]->u.integer;
-		time.timezone = value->u.array.values[8]->u.integer;
-		time.dst = value->u.array.values[9]->u.integer;
-
-		send_response(WRF_TIME, &time);
-		return;
-	}
+	wrf_ctx_check_upgrade(_default_ctx);
+}
 
-	// TODO Make correc error
-	wrf_error error;
-	INIT_ERROR(LIB_ERROR_PARSE_TIME, LIB_ERROR_PARSE_TIME_STR)
-	send_response(WRF_LOCAL_ERROR, &error);
-}
-
-static void process_local_response(json_value* value) 
-{
-	if CHECK_NAME(WRF_RESULT_STR, value)
-		handle_result(value->u.object.values[0].value);
-	else if CHECK_NAME(WRF_ERROR_STR, value)
-		handle_local_error(value->u.object.values[0].value);
-	else if CHECK_NAME(WRF_COMMAND_STATUS_STR, value)
-		handle_status(value->u.object.values[0].value);
-	else if CHECK_NAME(WRF_COMMAND_UPGRADE_STR, value)
-		handle_upgrade(value->u.object.values[0].value);
-	else if CHECK_NAME(WRF_COMMAND_SEND_FILE_MAX_PACKET_SIZE_STR, value)
-		handle_send_file(value->u.object.values[0].value);
-	else if CHECK_NAME(WRF_RESULT_TIME_STR, value)
-		handle_time(value->u.object.values[0].value);
-	else{
-		wrf_error error = { LIB_ERROR_UNKNOWN_OBJECT, LIB_ERROR_UNKNOWN_OBJECT_STR };
-		send_response(WRF_LOCAL_ERROR, &error);
-	}
+void wrf_get_upgrade(ota_params *upgrade_params)
+{
+	wrf_ctx_get_upgrade(_default_ctx, upgrade_params);
 }
 
-static void process_remote_response(json_value* value) 
+void wrf_init_send_file(char* file_name, int size)
 {
-	if CHECK_NAME(WRF_REMOTE_ERROR_CODE_STR, value)
-		handle_remote_error(value->u.object.values[0].value);
-	else{
-		wrf_error error;
-		INIT_ERROR(LIB_ERROR_RESULT_UNKNOWN, WRF_ERROR_UNKNOWN_STR)
-		send_response(WRF_REMOTE_ERROR, &error);
-	}
+	wrf_ctx_init_send_file(_default_ctx, file_name, size);
 }
 
-static bool process_object(json_value* value)
+void wrf_clear()
 {
-	bool handeled_by_dd = true;
-	if CHECK_NAME(WRF_LOCAL_RESPONSE_STR, value)
-		process_local_response(value->u.object.values[0].value);
-	else if CHECK_NAME(WRF_REMOTE_RESPONSE_STR, value)
-		process_remote_response(value->u.object.values[0].value);
-	else if CHECK_NAME(WRF_CONFIG_STR, value)
-		handle_configuartion(value->u.object.values[0].value);
-	else
-		handeled_by_dd = false;
+	wrf_ctx_clear(_default_ctx);
+}
 
-	return handeled_by_dd;
+void wrf_factory_reset()
+{
+	wrf_ctx_factory_reset(_default_ctx);
 }
 
-void wrf_handle_response(char* msg) {
-	json_char* json;
-	json_value* value;
+void wrf_ask_status()
+{
+	wrf_ctx_ask_status(_default_ctx);
+}
 
-	int len = strlen(msg);    
-	if(msg[len-1] == WRF_EOT)
-		len--;
-		
-	json = (json_char*)msg;
-	value = json_parse(json, len);
-	bool msg_proccesed = false;
+void wrf_get_time()
+{
+	wrf_ctx_get_time(_default_ctx);
+}
 
-	if (value && value->type == json_object)
-		msg_proccesed = process_object(value);
-	
-	if(!msg_proccesed)
-		send_response(WRF_MESSAGE, msg);
+void wrf_handle_response(char* msg)
+{
+	wrf_ctx_handle_response(_default_ctx, msg);
+}
 
-	json_value_free(value);
+void wrf_handle_frame(wrf_frame* frame, char* msg, size_t length)
+{
+	wrf_ctx_handle_frame(_default_ctx, frame, msg, length);
 }
+
 #pragma endregion
 
 #pragma region Helper Methods
@@ -547,6 +684,128 @@ void add_cmd_param(wrf_param param, char* dest)
 	}
 }
 
+#pragma region Encoder
+
+static void encoder_put(wrf_encoder* enc, const char* src, int length)
+{
+	while (length > 0 && !enc->overflow) {
+		int room = enc->size - enc->length;
+		if (room == 0) {
+			if (!enc->flush) {
+				enc->overflow = true;
+				return;
+			}
+			enc->flush((unsigned char*)enc->buffer, enc->length);
+			enc->flushed += enc->length;
+			enc->length = 0;
+			room = enc->size;
+		}
+		int n = length < room ? length : room;
+		memcpy(enc->buffer + enc->length, src, n);
+		enc->length += n;
+		src += n;
+		length -= n;
+	}
+}
+
+static void encoder_put_str(wrf_encoder* enc, const char* str)
+{
+	encoder_put(enc, str, strlen(str));
+}
+
+static void encoder_put_int(wrf_encoder* enc, int value)
+{
+	char digits[12];
+	int pos = sizeof(digits);
+	unsigned int u = value < 0 ? 0u - (unsigned int)value : (unsigned int)value;
+	do {
+		digits[--pos] = (char)('0' + u % 10);
+		u /= 10;
+	} while (u);
+	if (value < 0)
+		digits[--pos] = '-';
+	encoder_put(enc, digits + pos, sizeof(digits) - pos);
+}
+
+static void encoder_put_name(wrf_encoder* enc, const char* name)
+{
+	encoder_put(enc, ",\"", 2);
+	encoder_put_str(enc, name);
+	encoder_put(enc, "\":", 2);
+}
+
+void wrf_encoder_init(wrf_encoder* enc, char* buffer, int size)
+{
+	enc->buffer = buffer;
+	enc->size = size;
+	enc->length = 0;
+	enc->flushed = 0;
+	enc->overflow = false;
+	enc->flush = NULL;
+}
+
+void wrf_encoder_init_stream(wrf_encoder* enc, char* buffer, int size, wrf_write_string writer)
+{
+	wrf_encoder_init(enc, buffer, size);
+	enc->flush = writer;
+}
+
+void wrf_encoder_begin(wrf_encoder* enc, wrf_command cmd)
+{
+	static const char start[] = WRF_JSON_START "\"" WRF_COMMAND_STR "\":\"";
+	encoder_put(enc, start, sizeof(start) - 1);
+	encoder_put_str(enc, get_cmd_str(cmd));
+	encoder_put(enc, "\"", 1);
+}
+
+void wrf_encoder_add_param(wrf_encoder* enc, wrf_param* param)
+{
+	if (param->str_value)
+		wrf_encoder_add_str(enc, param->name, param->str_value);
+	else
+		wrf_encoder_add_int(enc, param->name, param->i_value);
+}
+
+void wrf_encoder_add_str(wrf_encoder* enc, const char* name, const char* value)
+{
+	encoder_put_name(enc, name);
+	encoder_put(enc, "\"", 1);
+	encoder_put_str(enc, value);
+	encoder_put(enc, "\"", 1);
+}
+
+void wrf_encoder_add_int(wrf_encoder* enc, const char* name, int value)
+{
+	encoder_put_name(enc, name);
+	encoder_put_int(enc, value);
+}
+
+void wrf_encoder_add_raw(wrf_encoder* enc, const char* raw)
+{
+	encoder_put_str(enc, raw);
+}
+
+int wrf_encoder_end(wrf_encoder* enc)
+{
+	static const char end[] = { '}', '}', WRF_EOT };
+	encoder_put(enc, end, sizeof(end));
+
+	if (enc->flush) {
+		enc->flush((unsigned char*)enc->buffer, enc->length);
+		enc->flushed += enc->length;
+		enc->length = 0;
+		return enc->flushed;
+	}
+
+	// Keep room for the zero termination
+	if (enc->overflow || enc->length >= enc->size)
+		return -1;
+	enc->buffer[enc->length] = 0x0;
+	return enc->length;
+}
+
+#pragma endregion
+
 char* get_cmd_str(wrf_command cmd)
 {
 	switch (cmd)
@@ -616,12 +875,8 @@ char* get_ota_module_str(wrf_ota_module module) {
 }
 
 wrf_ota_module get_ota_module(char* module) {
-	if (strcmp(module, WRF_OTA_WRF01_STR) == 0)
-		return OTA_WRF01;
-	else if (strcmp(module, WRF_OTA_CLIENT_STR) == 0)
-		return OTA_CLIENT;
-	else
-		return OTA_UKNOWN;
+	const wrf_keyword_entry* entry = wrf_keyword_find(module, WRF_KEYWORD_OTA_MODULE);
+	return entry ? (wrf_ota_module)entry->value : OTA_UKNOWN;
 }
 
 char* get_ota_protocol_str(wrf_ota_protocol protocol) {
@@ -640,65 +895,17 @@ char* get_ota_protocol_str(wrf_ota_protocol protocol) {
 
 wrf_connection_status get_status(char* status_str) 
 {
-	if (strcmp(status_str, WRF_IDLE_STR)== 0)
-		return WRF_IDLE;
-	else if (strcmp(status_str, WRF_CONNECTING_STR) == 0)
-		return WRF_CONNECTING;	
-	else if (strcmp(status_str, WRF_GOT_IP_STR) == 0)
-		return WRF_GOT_IP;
-	else if (strcmp(status_str, WRF_CONNECTION_FAILED_STR) == 0)
-		return WRF_CONNECTION_FAILED;
-	else if (strcmp(status_str, WRF_DNS_FAILED_STR) == 0)
-		return WRF_DNS_FAILED;
-	else if (strcmp(status_str, WRF_NO_AP_FOUND_STR) == 0)
-		return WRF_NO_AP_FOUND;
-	else if (strcmp(status_str, WRF_WRONG_PASSWORD_STR) == 0)
-		return WRF_WRONG_PASSWORD;
-	else return WRF_UNKNOWN;
+	const wrf_keyword_entry* entry = wrf_keyword_find(status_str, WRF_KEYWORD_CONNECTION_STATUS);
+	return entry ? (wrf_connection_status)entry->value : WRF_UNKNOWN;
 }
 
 wrf_error_code get_error_code(char* code_str) {
-	if (strcmp(code_str, WRF_ERROR_NONE_STR) == 0)
-		return WRF_ERROR_NONE;
-	else if (strcmp(code_str, WRF_ERROR_SYSTEM_BUSY_STR) == 0)
-		return WRF_ERROR_SYSTEM_BUSY;
-	else if (strcmp(code_str, WRF_ERROR_SEND_REQUEST_FAILED_STR) == 0)
-		return WRF_ERROR_SEND_REQUEST_FAILED;
-	else if (strcmp(code_str, WRF_ERROR_REVEICE_REQUEST_FAILED_STR) == 0)
-		return WRF_ERROR_REVEICE_REQUEST_FAILED;
-	else if (strcmp(code_str, WRF_ERROR_MASTER_REQUEST_FAILED_STR) == 0)
-		return WRF_ERROR_MASTER_REQUEST_FAILED;
-	else if (strcmp(code_str, WRF_ERROR_NOT_ONLINE_STR) == 0)
-		return WRF_ERROR_NOT_ONLINE;
-	else if (strcmp(code_str, WRF_ERROR_REMOTE_ERROR_STR) == 0)
-		return WRF_ERROR_REMOTE_ERROR;
-	else if (strcmp(code_str, WRF_ERROR_RX_OVERFLOW_STR) == 0)
-		return WRF_ERROR_RX_OVERFLOW;
-	else if (strcmp(code_str, WRF_ERROR_SET_AP_MODE_FAILED_STR) == 0)
-		return WRF_ERROR_SET_AP_MODE_FAILED;
-	else if (strcmp(code_str, WRF_ERROR_COMMAND_FAILED_STR) == 0)
-		return WRF_ERROR_COMMAND_FAILED;
-	else if (strcmp(code_str, WRF_ERROR_UPGRADE_STR) == 0)
-		return WRF_ERROR_UPGRADE;
-	else if (strcmp(code_str, WRF_ERROR_UNDEFINED_ERROR_STR) == 0)
-		return WRF_ERROR_UNDEFINED_ERROR;
-	else if (strcmp(code_str, WRF_ERROR_INVALID_JSON_STR) == 0)
-		return WRF_ERROR_INVALID_JSON;
-	else if (strcmp(code_str, WRF_ERROR_INVALID_INTROSPECT_STR) == 0)
-		return WRF_ERROR_INVALID_INTROSPECT;
-	else if (strcmp(code_str, WRF_ERROR_INVALID_HEADER_STR) == 0)
-		return WRF_ERROR_INVALID_HEADER;
-	else if (strcmp(code_str, WRF_ERROR_FORWARDING_ERROR_STR) == 0)
-		return WRF_ERROR_FORWARDING_ERROR;
-	else if (strcmp(code_str, WRF_ERROR_MISSING_HEADER_STR) == 0)
-		return WRF_ERROR_MISSING_HEADER;
-	else if (strcmp(code_str, WRF_ERROR_INVALID_TOKEN_STR) == 0)
-		return WRF_ERROR_INVALID_TOKEN;
-	else if (strcmp(code_str, WRF_ERROR_INVALID_APP_STR) == 0)
-		return WRF_ERROR_INVALID_APP;
-	else if (strcmp(code_str, WRF_ERROR_SMARTLINKUP_FAILED_STR) == 0)
-		return WRF_ERROR_SMARTLINKUP_FAILED;
-	else return LIB_ERROR_RESULT_UNKNOWN;
+	const wrf_keyword_entry* entry = wrf_keyword_lookup(code_str, strlen(code_str));
+	if (entry && (entry->keyword_class == WRF_KEYWORD_ERROR
+			|| entry->keyword_class == WRF_KEYWORD_LOCAL_ERROR
+			|| entry->keyword_class == WRF_KEYWORD_REMOTE_ERROR))
+		return (wrf_error_code)entry->value;
+	return LIB_ERROR_RESULT_UNKNOWN;
 }
 
 #pragma endregion
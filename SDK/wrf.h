@@ -29,6 +29,8 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include "json_stream.h"
 
 #define STX_CHAR ((char)0x02)
 #define ETX_CHAR ((char)0x03)
@@ -58,6 +60,28 @@
 #define WRF_OTA_MODULE_SIZE 2
 #define WRF_CRC_STRING_SIZE 4
 #define WRF_FILE_PACKET_OVERHEAD_SIZE 10
+
+// Holds any whole string token, see wrf_frame_feed
+#define WRF_FRAME_VALUE_SIZE JSON_STREAM_TOKEN_SIZE
+
+#ifndef WRF_MESSAGE_MAX_SIZE
+#define WRF_MESSAGE_MAX_SIZE 1024
+#endif
+
+/*	@brief	1 lets several threads send at once, see MpscQueue in @ref wrf_sdk.h.
+*			Needs C++11 atomics, so it is off by default.
+*/
+#ifndef WRF_QUEUE_MPSC
+#define WRF_QUEUE_MPSC 0
+#endif
+
+/*	@brief	1 builds commands in one static buffer of WRF_MESSAGE_MAX_SIZE bytes, which
+*			saves stack on small targets. 0 builds them on the stack, so contexts can
+*			send commands from several threads at once.
+*/
+#ifndef WRF_COMMAND_BUFFER_STATIC
+#define WRF_COMMAND_BUFFER_STATIC (!WRF_QUEUE_MPSC)
+#endif
 #pragma endregion
 
 #pragma region Strings
@@ -95,6 +119,7 @@
 #define WRF_OTA_WRF01_STR "WRF01"
 #define WRF_OTA_CLIENT_STR "CLIENT"
 #define WRF_SIZE_STR "length"
+#define WRF_CRC_STR "crc"
 
 #define WRF_COMMAND_SEND_FILE_STR "send_file"
 #define WRF_COMMAND_SEND_FILE_MAX_PACKET_SIZE_STR "max_packet_size"
@@ -139,6 +164,14 @@
 #define WRF_CONFIG_DEVICE_STATE_STR "device_state"
 #define WRF_CONFIG_RSSI_STR "rssi"
 
+#define WRF_STATUS_CONNECTION_STR "connection_status"
+#define WRF_STATUS_IP_STR "ip"
+#define WRF_STATUS_VISIBILITY_STR "visibility"
+#define WRF_STATUS_LAST_ERROR_STR "last_error"
+#define WRF_STATUS_LAST_ERROR_MSG_STR "last_error_msg"
+#define WRF_STATUS_TRANSFERS_STR "successful_transfers"
+#define WRF_STATUS_ON_STR "ON"
+
 #define WRF_ERROR_STR "error"
 #define WRF_REMOTE_ERROR_CODE_STR "ErrorCode"
 #define WRF_ERROR_NONE_STR "NONE"
@@ -176,6 +209,9 @@
 #define LIB_ERROR_PARSE_UPGRADE_STR "ERROR_PARSE_UPGRADE"
 #define LIB_ERROR_UNKNOWN_OBJECT_STR "ERROR_UNKNOWN_OBJECT"
 #define LIB_ERROR_PARSE_TIME_STR "ERROR_PARSE_TIME"
+#define LIB_ERROR_PARSE_CONFIG_STR "ERROR_PARSE_CONFIG"
+#define LIB_ERROR_RECEIVE_OVERFLOW_STR "ERROR_RECEIVE_OVERFLOW"
+#define LIB_ERROR_COMMAND_TOO_LONG_STR "ERROR_COMMAND_TOO_LONG"
 
 #define WRF_ERROR_UNKNOWN_STR "Wrf SDK does not recognize message"
 
@@ -243,7 +279,10 @@ typedef enum
 	LIB_ERROR_PARSE_UPGRADE,
 	LIB_ERROR_UNKNOWN_OBJECT,
 	LIB_ERROR_PARSE_TIME,
-	WRF_ERROR_NO_TIME
+	WRF_ERROR_NO_TIME,
+	LIB_ERROR_PARSE_CONFIG,
+	LIB_ERROR_RECEIVE_OVERFLOW,
+	LIB_ERROR_COMMAND_TOO_LONG
 }wrf_error_code;
 
 /*	@brief		Connection status codes 
@@ -295,6 +334,24 @@ typedef enum {
 	WRF_TIME,
 }wrf_result_code;
 
+/*	@brief		Kind of frame received from WRF01.
+*
+*	@note		Decided by @ref wrf_frame_feed while the frame is received.
+*/
+typedef enum {
+	WRF_FRAME_MESSAGE,			// Not a WRF01 response, handed to the application
+	WRF_FRAME_RESULT,
+	WRF_FRAME_LOCAL_ERROR,
+	WRF_FRAME_STATUS,
+	WRF_FRAME_UPGRADE,
+	WRF_FRAME_SEND_FILE,
+	WRF_FRAME_TIME,
+	WRF_FRAME_LOCAL_UNKNOWN,	// "devicedrive" object the library does not know
+	WRF_FRAME_REMOTE_ERROR,
+	WRF_FRAME_REMOTE_UNKNOWN,	// "DeviceDrive" object the library does not know
+	WRF_FRAME_CONFIG,
+}wrf_frame_kind;
+
 #pragma endregion
 
 #pragma region Structs
@@ -376,7 +433,7 @@ typedef struct {
 */
 typedef struct {
 	int size;
-	int crc;
+	uint32_t crc;
 }ota_packet;
 
 /*	@brief	Object holding information about pending upgrades-
@@ -394,6 +451,20 @@ typedef struct {
 	char* msg;
 } wrf_error;
 
+/*	@brief	Cursor for building a WRF01 command frame in a single pass.
+*
+*	@note	Initialize with @ref wrf_encoder_init or @ref wrf_encoder_init_stream.
+*			The encoder never allocates; it writes into the buffer it is given.
+*/
+typedef struct {
+	char* buffer;
+	int size;
+	int length;
+	int flushed;
+	bool overflow;
+	uint32_t(*flush)(unsigned char* buffer, int buflen);
+} wrf_encoder;
+
 typedef struct {
     uint64_t timestamp; 
     int week_day;   // 0-6 (Mon-Sun)
@@ -407,6 +478,44 @@ typedef struct {
     int dst;        // 1 is on, 0 is off
 } wrf_time; 
 
+struct wrf_schema;
+
+/*	@brief	A response being decoded into its struct as its tokens arrive.
+*
+*	@note	The fields are described in wrf_schema.c.
+*/
+typedef struct {
+	const struct wrf_schema* schema;
+	int field;				// Field of the last key, -1 if it is not in the schema
+	int text_length;		// Bytes of a string field written so far
+	int group;				// Group of the object the fields are in, -1 if none matches
+	uint32_t seen;			// One bit per field found
+	bool in_record;
+	bool found_record;
+	bool invalid;
+	union {
+		wrf_status status;
+		wrf_time time;
+		ota_packet packet;
+		wrf_module_list modules;
+		wrf_device_state device_state;
+	}out;
+}wrf_decoder;
+
+/*	@brief	State of a frame being received from WRF01.
+*
+*	@note	Feed every character of the frame, except EOT, to @ref wrf_frame_feed
+*			and call @ref wrf_handle_frame when EOT arrives.
+*/
+typedef struct {
+	json_stream stream;
+	wrf_frame_kind kind;
+	int root_member;
+	char value[WRF_FRAME_VALUE_SIZE];
+	bool value_truncated;
+	wrf_decoder decoder;
+}wrf_frame;
+
 #pragma endregion
 
 #pragma region Defined Functions
@@ -472,6 +581,25 @@ typedef struct {
 */
 typedef uint32_t(*wrf_write_string)(unsigned char* buffer, int buflen);
 
+/*	@brief		One piece of a message written with @ref wrf_write_segments.
+*/
+typedef struct {
+	const unsigned char* data;
+	int length;
+} wrf_segment;
+
+/*	@brief		Function for writing a message made of several segments to WRF01.
+*
+*	@details	This function is optional. When it is registered with @ref wrf_init_segments 
+*				the library uses it to add framing bytes (ETX, EOT, file packet headers)
+*				around a message without copying the message into a new buffer.
+*	@note		The segments must be written in order, as one continuous message.
+*
+*	@param[in]	segments	Array of segments to write.
+*	@param[in]	count		Number of segments in @ref segments.
+*/
+typedef uint32_t(*wrf_write_segments)(const wrf_segment* segments, int count);
+
 /*	@brief		Function defenition for handling responses from WRF01
 *	
 *	@details	A function must be implmented to handle the respnonse objects
@@ -486,6 +614,87 @@ typedef uint32_t(*wrf_write_string)(unsigned char* buffer, int buflen);
 */
 typedef void(*wrf_callback)(wrf_result_code code, void* object);
 
+typedef struct wrf_ctx wrf_ctx;
+
+/*	@brief		Same as @ref wrf_write_string, for the WRF01 of @ref ctx. */
+typedef uint32_t(*wrf_ctx_write_string)(wrf_ctx* ctx, unsigned char* buffer, int buflen);
+
+/*	@brief		Same as @ref wrf_write_segments, for the WRF01 of @ref ctx. */
+typedef uint32_t(*wrf_ctx_write_segments)(wrf_ctx* ctx, const wrf_segment* segments, int count);
+
+/*	@brief		Same as @ref wrf_callback, for responses from the WRF01 of @ref ctx. */
+typedef void(*wrf_ctx_callback)(wrf_ctx* ctx, wrf_result_code code, void* object);
+
+/*	@brief		Everything the library keeps about one WRF01.
+*
+*	@details	Every wrf_ function has a wrf_ctx_ version that takes the context first,
+*				so one program can drive several WRF01 modules. The wrf_ functions use
+*				the default context, see @ref wrf_default_ctx.
+*	@note		Set up with @ref wrf_ctx_init. @ref user_data is for the application.
+*/
+struct wrf_ctx {
+	wrf_ctx_write_string write_string;
+	wrf_ctx_write_segments write_segments;
+	wrf_ctx_callback on_response;
+	void* user_data;
+	size_t message_length;		// Of the WRF_MESSAGE being handled, without EOT
+};
+
+#pragma endregion
+
+#pragma region Contexts
+
+/*	@brief		Function for setting up a context.
+*
+*	@param[in]	ctx			Context to set up.
+*	@param[in]	write_uart	Pointer to the method writing to the uart of this WRF01.
+*	@param[in]	user_data	Anything the application wants to find in the context.
+*/
+void wrf_ctx_init(wrf_ctx* ctx, wrf_ctx_write_string write_uart, void* user_data);
+
+/*	@brief		Same as @ref wrf_init_segments, for @ref ctx. */
+void wrf_ctx_init_segments(wrf_ctx* ctx, wrf_ctx_write_segments write_segments);
+
+/*	@brief		Same as @ref wrf_on_response, for @ref ctx. */
+void wrf_ctx_on_response(wrf_ctx* ctx, wrf_ctx_callback callback);
+
+/*	@brief		Function for getting the context the wrf_ functions use.
+*
+*	@details	This is a built in context, set up by @ref wrf_init, @ref wrf_init_segments
+*				and @ref wrf_on_response, unless another one is set with @ref wrf_set_default_ctx.
+*/
+wrf_ctx* wrf_default_ctx();
+
+/*	@brief		Function for making the wrf_ functions use @ref ctx. NULL, or a call to
+*				@ref wrf_init, goes back to the built in context.
+*/
+void wrf_set_default_ctx(wrf_ctx* ctx);
+
+void wrf_ctx_send_message(wrf_ctx* ctx, char* message);
+/*	@brief		A command longer than WRF_MESSAGE_MAX_SIZE is not sent, and is reported
+*				as a WRF_LOCAL_ERROR with LIB_ERROR_COMMAND_TOO_LONG. The same goes for
+*				@ref wrf_ctx_send_introspect.
+*/
+void wrf_ctx_send_command(wrf_ctx* ctx, wrf_command cmd, wrf_param* params, int size);
+void wrf_ctx_receive_message(wrf_ctx* ctx);
+void wrf_ctx_send_without_receive(wrf_ctx* ctx, char* msg);
+void wrf_ctx_send_config(wrf_ctx* ctx, wrf_config *config);
+void wrf_ctx_send_introspect(wrf_ctx* ctx, char* introspect);
+void wrf_ctx_set_visible(wrf_ctx* ctx, int seconds);
+void wrf_ctx_smart_linkup(wrf_ctx* ctx, int seconds);
+void wrf_ctx_connect(wrf_ctx* ctx, bool silent);
+void wrf_ctx_reboot(wrf_ctx* ctx);
+void wrf_ctx_deep_sleep(wrf_ctx* ctx, int duration);
+void wrf_ctx_check_upgrade(wrf_ctx* ctx);
+void wrf_ctx_get_upgrade(wrf_ctx* ctx, ota_params *upgrade_params);
+void wrf_ctx_init_send_file(wrf_ctx* ctx, char* file_name, int size);
+void wrf_ctx_clear(wrf_ctx* ctx);
+void wrf_ctx_factory_reset(wrf_ctx* ctx);
+void wrf_ctx_ask_status(wrf_ctx* ctx);
+void wrf_ctx_get_time(wrf_ctx* ctx);
+void wrf_ctx_handle_response(wrf_ctx* ctx, char* msg);
+void wrf_ctx_handle_frame(wrf_ctx* ctx, wrf_frame* frame, char* msg, size_t length);
+
 #pragma endregion
 
 /*	@brief		Function for initiate the library.
@@ -494,9 +703,19 @@ typedef void(*wrf_callback)(wrf_result_code code, void* object);
 *
 *	@param[in]	write_uart	pointer to the method writing to the uart connected to WRF01.
 *	@note		write_uart must be implemented on the microcontroller used. 
+*				This sets up the built in context and makes it the default again.
 */
 void wrf_init(wrf_write_string write_uart);
 
+/*	@brief		Function for setting an optional vectored writer.
+*
+*	@details	Without a vectored writer, messages that need framing bytes are written 
+*				with one call to the @ref wrf_write_string per segment.
+*
+*	@param[in]	write_segments	pointer to the method writing segments to the uart, or NULL.
+*/
+void wrf_init_segments(wrf_write_segments write_segments);
+
 /*	@brief		Fuction for setting response callback.
 *
 *	@details	This function registrates the response callback.
@@ -510,7 +729,8 @@ void wrf_on_response(wrf_callback callback);
 /*	@brief		Function for sending messages to WRF01
 *
 *	@details	This message adds a EOT charcater to the message and uses the 
-*				@ref wrf_write_string to write message to the WRF01
+*				@ref wrf_write_segments, or @ref wrf_write_string, to write message to the WRF01.
+*				The message itself is not copied.
 *	@note		Before calling this method the WRF must have been initiated by @ref wrf_init
 *
 *	param[in]	message		message to be sent to WRF01
@@ -650,6 +870,28 @@ void wrf_get_time();
 *	@note		For this to work @ref wrf_on_response must have been called.
 */
 void wrf_handle_response(char* msg);
+
+/*	@brief		Function for preparing a frame for the next response.
+*/
+void wrf_frame_reset(wrf_frame* frame);
+
+/*	@brief		Function for feeding one received character to a frame.
+*
+*	@details	The frame is tokenized as it arrives, so the kind of response is known
+*				when EOT is received. Result and error frames need no further parsing.
+*/
+void wrf_frame_feed(wrf_frame* frame, char c);
+
+/*	@brief		Function for firing the callback of a received frame.
+*
+*	@details	Same as @ref wrf_handle_response, for a frame already fed to @ref wrf_frame_feed.
+*				The frame is reset afterwards.
+*
+*	@param[in]	frame	The frame state.
+*	@param[in]	msg		Zero terminated frame as received, EOT may be included.
+*	@param[in]	length	Length of @ref msg without EOT, as fed to @ref wrf_frame_feed.
+*/
+void wrf_handle_frame(wrf_frame* frame, char* msg, size_t length);
 #pragma endregion
 
 #pragma region Helper Methods
@@ -665,6 +907,62 @@ void wrf_handle_response(char* msg);
 */
 void add_cmd_param(wrf_param param, char* dest);
 
+/*	@brief		Function for preparing an encoder that writes into a buffer.
+*
+*	@details	The whole frame must fit in @ref buffer. If it does not, the encoder
+*				is marked as overflowed and @ref wrf_encoder_end returns -1.
+*
+*	@param[in]	enc		Encoder to initialize.
+*	@param[in]	buffer	Destination buffer.
+*	@param[in]	size	Size of @ref buffer in bytes.
+*/
+void wrf_encoder_init(wrf_encoder* enc, char* buffer, int size);
+
+/*	@brief		Function for preparing an encoder that streams to a writer.
+*
+*	@details	Every time @ref buffer is full it is handed to @ref writer and reused,
+*				so frames of any length can be built with a small buffer.
+*	@note		Only use this when @ref writer goes straight to the uart. 
+*				Writers that expect a complete frame per call, like the @ref WRF queue, 
+*				must use @ref wrf_encoder_init.
+*
+*	@param[in]	enc		Encoder to initialize.
+*	@param[in]	buffer	Chunk buffer.
+*	@param[in]	size	Size of @ref buffer in bytes.
+*	@param[in]	writer	Function receiving each chunk.
+*/
+void wrf_encoder_init_stream(wrf_encoder* enc, char* buffer, int size, wrf_write_string writer);
+
+/*	@brief		Function for starting a command frame, {"devicedrive":{"command":"<cmd>".
+*/
+void wrf_encoder_begin(wrf_encoder* enc, wrf_command cmd);
+
+/*	@brief		Function for adding a wrf_param, as string if @ref str_value is set and as integer if not.
+*/
+void wrf_encoder_add_param(wrf_encoder* enc, wrf_param* param);
+
+/*	@brief		Function for adding ,"name":"value" to the frame.
+*/
+void wrf_encoder_add_str(wrf_encoder* enc, const char* name, const char* value);
+
+/*	@brief		Function for adding ,"name":value to the frame.
+*/
+void wrf_encoder_add_int(wrf_encoder* enc, const char* name, int value);
+
+/*	@brief		Function for adding preformatted JSON to the frame as is.
+*/
+void wrf_encoder_add_raw(wrf_encoder* enc, const char* raw);
+
+/*	@brief		Function for closing the frame and appending EOT.
+*
+*	@details	The frame is zero terminated when the encoder writes to a buffer. 
+*				A streaming encoder writes the remaining bytes to its writer.
+*
+*	@retval		Length of the frame in bytes, EOT included.
+*	@retval		-1 if the frame did not fit in the buffer (never for a streaming encoder).
+*/
+int wrf_encoder_end(wrf_encoder* enc);
+
 /*	@brief		Function for getting wrf_command(enum) as string.
 *
 *	@param[in]	cmd		enum to translate.
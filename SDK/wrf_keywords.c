@@ -0,0 +1,71 @@
+/*	Copyright 2017 DeviceDrive AS
+*
+*	Licensed under the Apache License, Version 2.0 (the "License");
+*	you may not use this file except in compliance with the License.
+*	You may obtain a copy of the License at
+*
+*	http ://www.apache.org/licenses/LICENSE-2.0
+*
+*	Unless required by applicable law or agreed to in writing, software
+*	distributed under the License is distributed on an "AS IS" BASIS,
+*	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*	See the License for the specific language governing permissions and
+*	limitations under the License.
+*
+*/
+
+#include "wrf_keywords.h"
+#include "wrf_keywords_table.h"
+#include <string.h>
+
+/* Fails to compile if a keyword was added or removed without regenerating wrf_keywords_table.h,
+*  changed strings are found by wrf_keyword_table_is_current
+*/
+typedef char wrf_keyword_table_count_is_current[(WRF_KEYWORD_TABLE_COUNT == WRF_KEYWORD_COUNT) ? 1 : -1];
+
+const wrf_keyword_entry wrf_keywords[WRF_KEYWORD_COUNT] = {
+#define WRF_KEYWORD_ENTRY(NAME, STRING, CLASS, VALUE) { STRING, sizeof(STRING) - 1, WRF_KEYWORD_##CLASS, VALUE },
+	WRF_KEYWORD_LIST(WRF_KEYWORD_ENTRY)
+#undef WRF_KEYWORD_ENTRY
+};
+
+static unsigned int keyword_hash(const char* str, int length)
+{
+	return ((unsigned int)length * WRF_KEYWORD_HASH_A
+		+ (unsigned char)str[0] * WRF_KEYWORD_HASH_B
+		+ (unsigned char)str[length - 1] * WRF_KEYWORD_HASH_C
+		+ (unsigned char)str[length / 2]) & (WRF_KEYWORD_SLOTS - 1);
+}
+
+const wrf_keyword_entry* wrf_keyword_lookup(const char* str, int length)
+{
+	if (!str || length <= 0)
+		return NULL;
+
+	uint8_t slot = wrf_keyword_slots[keyword_hash(str, length)];
+	if (slot >= WRF_KEYWORD_COUNT)
+		return NULL;
+
+	const wrf_keyword_entry* entry = &wrf_keywords[slot];
+	if (entry->length != length || memcmp(entry->str, str, length) != 0)
+		return NULL;
+	return entry;
+}
+
+bool wrf_keyword_table_is_current(void)
+{
+	// FNV-1a, as in tools/wrf_keywords.py
+	uint32_t hash = 2166136261u;
+	for (int i = 0; i < WRF_KEYWORD_COUNT; i++)
+		for (int j = 0; j <= wrf_keywords[i].length; j++)
+			hash = (hash ^ (uint8_t)wrf_keywords[i].str[j]) * 16777619u;
+	return hash == WRF_KEYWORD_TABLE_HASH;
+}
+
+const wrf_keyword_entry* wrf_keyword_find(const char* str, wrf_keyword_class keyword_class)
+{
+	const wrf_keyword_entry* entry = wrf_keyword_lookup(str, str ? (int)strlen(str) : 0);
+	if (!entry || entry->keyword_class != keyword_class)
+		return NULL;
+	return entry;
+}
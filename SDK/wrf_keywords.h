@@ -0,0 +1,141 @@
+/*	Copyright 2017 DeviceDrive AS
+*
+*	Licensed under the Apache License, Version 2.0 (the "License");
+*	you may not use this file except in compliance with the License.
+*	You may obtain a copy of the License at
+*
+*	http ://www.apache.org/licenses/LICENSE-2.0
+*
+*	Unless required by applicable law or agreed to in writing, software
+*	distributed under the License is distributed on an "AS IS" BASIS,
+*	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*	See the License for the specific language governing permissions and
+*	limitations under the License.
+*
+*/
+
+/**@file
+*
+*	@brief		Keywords of the WRF01 responses
+*	@details	Every string the library looks up in a response is listed once in
+*				@ref WRF_KEYWORD_LIST, next to the enum value it stands for.
+*				@ref wrf_keyword_lookup finds a keyword with one hash and one compare.
+*
+*	@note		The hash slots are generated into wrf_keywords_table.h. Run
+*				tools/wrf_keywords.py after changing the list.
+*/
+
+#ifndef WRF_KEYWORDS_H__
+#define WRF_KEYWORDS_H__
+
+#include "wrf.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*	@brief	What a keyword is used for. */
+typedef enum {
+	WRF_KEYWORD_ROOT,				// Name of the root member, value is a wrf_frame_kind
+	WRF_KEYWORD_LOCAL_OBJECT,		// Name inside "devicedrive", value is a wrf_frame_kind
+	WRF_KEYWORD_REMOTE_OBJECT,		// Name inside "DeviceDrive", value is a wrf_frame_kind
+	WRF_KEYWORD_RESULT,				// Value is a wrf_result_code
+	WRF_KEYWORD_ERROR,				// Value is a wrf_error_code, not sent as an error
+	WRF_KEYWORD_LOCAL_ERROR,		// Value is a wrf_error_code reported by WRF01
+	WRF_KEYWORD_REMOTE_ERROR,		// Value is a wrf_error_code reported by the cloud
+	WRF_KEYWORD_CONNECTION_STATUS,	// Value is a wrf_connection_status
+	WRF_KEYWORD_OTA_MODULE,			// Value is a wrf_ota_module
+}wrf_keyword_class;
+
+/*	X(NAME, STRING, CLASS, VALUE) */
+#define WRF_KEYWORD_LIST(X)																					\
+	X(DEVICEDRIVE,				WRF_LOCAL_RESPONSE_STR,				ROOT,				WRF_FRAME_LOCAL_UNKNOWN)	\
+	X(DEVICEDRIVE_REMOTE,		WRF_REMOTE_RESPONSE_STR,			ROOT,				WRF_FRAME_REMOTE_UNKNOWN)	\
+	X(CONFIGURATION,			WRF_CONFIG_STR,						ROOT,				WRF_FRAME_CONFIG)			\
+	X(RESULT,					WRF_RESULT_STR,						LOCAL_OBJECT,		WRF_FRAME_RESULT)			\
+	X(ERROR,					WRF_ERROR_STR,						LOCAL_OBJECT,		WRF_FRAME_LOCAL_ERROR)		\
+	X(STATUS,					WRF_COMMAND_STATUS_STR,				LOCAL_OBJECT,		WRF_FRAME_STATUS)			\
+	X(UPGRADE,					WRF_COMMAND_UPGRADE_STR,			LOCAL_OBJECT,		WRF_FRAME_UPGRADE)			\
+	X(MAX_PACKET_SIZE,			WRF_COMMAND_SEND_FILE_MAX_PACKET_SIZE_STR, LOCAL_OBJECT, WRF_FRAME_SEND_FILE)		\
+	X(TIME,						WRF_RESULT_TIME_STR,				LOCAL_OBJECT,		WRF_FRAME_TIME)				\
+	X(ERROR_CODE,				WRF_REMOTE_ERROR_CODE_STR,			REMOTE_OBJECT,		WRF_FRAME_REMOTE_ERROR)		\
+	X(OK,						WRF_RESULT_OK_STR,					RESULT,				WRF_OK)						\
+	X(EMPTY,					WRF_RESULT_EMPTY_STR,				RESULT,				WRF_EMPTY)					\
+	X(SENT,						WRF_RESULT_SENT_STR,				RESULT,				WRF_SENT)					\
+	X(FILE_SENT,				WRF_RESULT_FILE_SENT_STR,			RESULT,				WRF_FILE_SENT)				\
+	X(FILE_CANCEL,				WRF_RESULT_FILE_CANCEL_STR,			RESULT,				WRF_FILE_CANCEL)			\
+	X(ERROR_NONE,				WRF_ERROR_NONE_STR,					ERROR,				WRF_ERROR_NONE)				\
+	X(SYSTEM_BUSY,				WRF_ERROR_SYSTEM_BUSY_STR,			LOCAL_ERROR,		WRF_ERROR_SYSTEM_BUSY)		\
+	X(SEND_REQUEST_FAILED,		WRF_ERROR_SEND_REQUEST_FAILED_STR,	LOCAL_ERROR,		WRF_ERROR_SEND_REQUEST_FAILED)		\
+	X(RECEIVE_REQUEST_FAILED,	WRF_ERROR_REVEICE_REQUEST_FAILED_STR, LOCAL_ERROR,		WRF_ERROR_REVEICE_REQUEST_FAILED)	\
+	X(MASTER_REQUEST_FAILED,	WRF_ERROR_MASTER_REQUEST_FAILED_STR, LOCAL_ERROR,		WRF_ERROR_MASTER_REQUEST_FAILED)	\
+	X(NOT_ONLINE,				WRF_ERROR_NOT_ONLINE_STR,			LOCAL_ERROR,		WRF_ERROR_NOT_ONLINE)		\
+	X(REMOTE_ERROR,				WRF_ERROR_REMOTE_ERROR_STR,			LOCAL_ERROR,		WRF_ERROR_REMOTE_ERROR)		\
+	X(RX_OVERFLOW,				WRF_ERROR_RX_OVERFLOW_STR,			LOCAL_ERROR,		WRF_ERROR_RX_OVERFLOW)		\
+	X(SET_AP_MODE_FAILED,		WRF_ERROR_SET_AP_MODE_FAILED_STR,	LOCAL_ERROR,		WRF_ERROR_SET_AP_MODE_FAILED)		\
+	X(UPGRADE_ERROR,			WRF_ERROR_UPGRADE_STR,				LOCAL_ERROR,		WRF_ERROR_UPGRADE)			\
+	X(COMMAND_FAILED,			WRF_ERROR_COMMAND_FAILED_STR,		LOCAL_ERROR,		WRF_ERROR_COMMAND_FAILED)	\
+	X(SMARTLINKUP_FAILED,		WRF_ERROR_SMARTLINKUP_FAILED_STR,	LOCAL_ERROR,		WRF_ERROR_SMARTLINKUP_FAILED)		\
+	X(NO_TIME,					WRF_ERROR_NO_TIME_STR,				LOCAL_ERROR,		WRF_ERROR_NO_TIME)			\
+	X(UNDEFINED_ERROR,			WRF_ERROR_UNDEFINED_ERROR_STR,		REMOTE_ERROR,		WRF_ERROR_UNDEFINED_ERROR)	\
+	X(INVALID_JSON,				WRF_ERROR_INVALID_JSON_STR,			REMOTE_ERROR,		WRF_ERROR_INVALID_JSON)		\
+	X(INVALID_INTROSPECT,		WRF_ERROR_INVALID_INTROSPECT_STR,	REMOTE_ERROR,		WRF_ERROR_INVALID_INTROSPECT)		\
+	X(INVALID_HEADER,			WRF_ERROR_INVALID_HEADER_STR,		REMOTE_ERROR,		WRF_ERROR_INVALID_HEADER)	\
+	X(FORWARDING_ERROR,			WRF_ERROR_FORWARDING_ERROR_STR,		REMOTE_ERROR,		WRF_ERROR_FORWARDING_ERROR)	\
+	X(MISSING_HEADER,			WRF_ERROR_MISSING_HEADER_STR,		REMOTE_ERROR,		WRF_ERROR_MISSING_HEADER)	\
+	X(INVALID_TOKEN,			WRF_ERROR_INVALID_TOKEN_STR,		REMOTE_ERROR,		WRF_ERROR_INVALID_TOKEN)	\
+	X(INVALID_APP,				WRF_ERROR_INVALID_APP_STR,			REMOTE_ERROR,		WRF_ERROR_INVALID_APP)		\
+	X(IDLE,						WRF_IDLE_STR,						CONNECTION_STATUS,	WRF_IDLE)					\
+	X(CONNECTING,				WRF_CONNECTING_STR,					CONNECTION_STATUS,	WRF_CONNECTING)				\
+	X(GOT_IP,					WRF_GOT_IP_STR,						CONNECTION_STATUS,	WRF_GOT_IP)					\
+	X(CONNECTION_FAILED,		WRF_CONNECTION_FAILED_STR,			CONNECTION_STATUS,	WRF_CONNECTION_FAILED)		\
+	X(DNS_FAILED,				WRF_DNS_FAILED_STR,					CONNECTION_STATUS,	WRF_DNS_FAILED)				\
+	X(NO_AP_FOUND,				WRF_NO_AP_FOUND_STR,				CONNECTION_STATUS,	WRF_NO_AP_FOUND)			\
+	X(WRONG_PASSWORD,			WRF_WRONG_PASSWORD_STR,				CONNECTION_STATUS,	WRF_WRONG_PASSWORD)			\
+	X(OTA_WRF01,				WRF_OTA_WRF01_STR,					OTA_MODULE,			OTA_WRF01)					\
+	X(OTA_CLIENT,				WRF_OTA_CLIENT_STR,					OTA_MODULE,			OTA_CLIENT)
+
+typedef enum {
+#define WRF_KEYWORD_ENUM(NAME, STRING, CLASS, VALUE) WRF_KW_##NAME,
+	WRF_KEYWORD_LIST(WRF_KEYWORD_ENUM)
+#undef WRF_KEYWORD_ENUM
+	WRF_KEYWORD_COUNT
+}wrf_keyword;
+
+/*	@brief	One entry of the keyword table. */
+typedef struct {
+	const char* str;
+	uint8_t length;
+	uint8_t keyword_class;
+	uint8_t value;
+}wrf_keyword_entry;
+
+extern const wrf_keyword_entry wrf_keywords[WRF_KEYWORD_COUNT];
+
+/*	@brief		Function for looking up a keyword.
+*
+*	@param[in]	str		String to look up, does not need to be zero terminated.
+*	@param[in]	length	Length of @ref str.
+*
+*	@retval		The keyword entry, or NULL if @ref str is not a keyword.
+*/
+const wrf_keyword_entry* wrf_keyword_lookup(const char* str, int length);
+
+/*	@brief		Function for looking up a zero terminated keyword of a given class.
+*
+*	@retval		The keyword entry, or NULL if @ref str is not a keyword of @ref keyword_class.
+*/
+const wrf_keyword_entry* wrf_keyword_find(const char* str, wrf_keyword_class keyword_class);
+
+/*	@brief		Function for checking that wrf_keywords_table.h was generated from the
+*				keyword strings in use. A stale table makes lookups fail.
+*
+*	@retval		true if the strings hash to what tools/wrf_keywords.py saw.
+*/
+bool wrf_keyword_table_is_current(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,43 @@
+/*	Generated by tools/wrf_keywords.py from wrf_keywords.h, do not edit. */
+
+#define WRF_KEYWORD_TABLE_COUNT 45
+#define WRF_KEYWORD_TABLE_HASH 0xB64A2B60u
+#define WRF_KEYWORD_SLOTS 128
+#define WRF_KEYWORD_HASH_A 1
+#define WRF_KEYWORD_HASH_B 58
+#define WRF_KEYWORD_HASH_C 45
+
+static const uint8_t wrf_keyword_slots[WRF_KEYWORD_SLOTS] = {
+	WRF_KW_UNDEFINED_ERROR, WRF_KEYWORD_COUNT, WRF_KW_CONNECTION_FAILED, WRF_KEYWORD_COUNT,
+	WRF_KEYWORD_COUNT, WRF_KEYWORD_COUNT, WRF_KEYWORD_COUNT, WRF_KEYWORD_COUNT,
+	WRF_KW_FILE_SENT, WRF_KEYWORD_COUNT, WRF_KW_NO_AP_FOUND, WRF_KW_GOT_IP,
+	WRF_KEYWORD_COUNT, WRF_KEYWORD_COUNT, WRF_KEYWORD_COUNT, WRF_KW_COMMAND_FAILED,
+	WRF_KW_INVALID_JSON, WRF_KW_INVALID_TOKEN, WRF_KEYWORD_COUNT, WRF_KEYWORD_COUNT,
+	WRF_KEYWORD_COUNT, WRF_KEYWORD_COUNT, WRF_KEYWORD_COUNT, WRF_KEYWORD_COUNT,
+	WRF_KW_SET_AP_MODE_FAILED, WRF_KW_DEVICEDRIVE_REMOTE, WRF_KW_SEND_REQUEST_FAILED, WRF_KEYWORD_COUNT,
+	WRF_KW_EMPTY, WRF_KEYWORD_COUNT, WRF_KW_OTA_WRF01, WRF_KW_ERROR_NONE,
+	WRF_KW_SMARTLINKUP_FAILED, WRF_KEYWORD_COUNT, WRF_KEYWORD_COUNT, WRF_KEYWORD_COUNT,
+	WRF_KW_FORWARDING_ERROR, WRF_KW_NOT_ONLINE, WRF_KEYWORD_COUNT, WRF_KW_DNS_FAILED,
+	WRF_KW_NO_TIME, WRF_KEYWORD_COUNT, WRF_KEYWORD_COUNT, WRF_KW_FILE_CANCEL,
+	WRF_KEYWORD_COUNT, WRF_KEYWORD_COUNT, WRF_KW_INVALID_INTROSPECT, WRF_KW_RX_OVERFLOW,
+	WRF_KEYWORD_COUNT, WRF_KEYWORD_COUNT, WRF_KEYWORD_COUNT, WRF_KW_RESULT,
+	WRF_KEYWORD_COUNT, WRF_KEYWORD_COUNT, WRF_KEYWORD_COUNT, WRF_KEYWORD_COUNT,
+	WRF_KEYWORD_COUNT, WRF_KEYWORD_COUNT, WRF_KEYWORD_COUNT, WRF_KEYWORD_COUNT,
+	WRF_KW_UPGRADE, WRF_KW_OTA_CLIENT, WRF_KEYWORD_COUNT, WRF_KW_STATUS,
+	WRF_KEYWORD_COUNT, WRF_KEYWORD_COUNT, WRF_KEYWORD_COUNT, WRF_KEYWORD_COUNT,
+	WRF_KEYWORD_COUNT, WRF_KEYWORD_COUNT, WRF_KW_CONFIGURATION, WRF_KEYWORD_COUNT,
+	WRF_KEYWORD_COUNT, WRF_KW_MISSING_HEADER, WRF_KEYWORD_COUNT, WRF_KW_SYSTEM_BUSY,
+	WRF_KEYWORD_COUNT, WRF_KEYWORD_COUNT, WRF_KEYWORD_COUNT, WRF_KEYWORD_COUNT,
+	WRF_KW_MASTER_REQUEST_FAILED, WRF_KEYWORD_COUNT, WRF_KEYWORD_COUNT, WRF_KEYWORD_COUNT,
+	WRF_KEYWORD_COUNT, WRF_KEYWORD_COUNT, WRF_KEYWORD_COUNT, WRF_KEYWORD_COUNT,
+	WRF_KEYWORD_COUNT, WRF_KW_DEVICEDRIVE, WRF_KEYWORD_COUNT, WRF_KEYWORD_COUNT,
+	WRF_KEYWORD_COUNT, WRF_KEYWORD_COUNT, WRF_KW_ERROR_CODE, WRF_KEYWORD_COUNT,
+	WRF_KEYWORD_COUNT, WRF_KW_INVALID_HEADER, WRF_KW_OK, WRF_KW_ERROR,
+	WRF_KW_SENT, WRF_KEYWORD_COUNT, WRF_KEYWORD_COUNT, WRF_KEYWORD_COUNT,
+	WRF_KEYWORD_COUNT, WRF_KW_REMOTE_ERROR, WRF_KEYWORD_COUNT, WRF_KEYWORD_COUNT,
+	WRF_KEYWORD_COUNT, WRF_KW_MAX_PACKET_SIZE, WRF_KW_INVALID_APP, WRF_KEYWORD_COUNT,
+	WRF_KEYWORD_COUNT, WRF_KEYWORD_COUNT, WRF_KEYWORD_COUNT, WRF_KW_RECEIVE_REQUEST_FAILED,
+	WRF_KEYWORD_COUNT, WRF_KEYWORD_COUNT, WRF_KW_CONNECTING, WRF_KEYWORD_COUNT,
+	WRF_KEYWORD_COUNT, WRF_KW_WRONG_PASSWORD, WRF_KW_TIME, WRF_KW_IDLE,
+	WRF_KEYWORD_COUNT, WRF_KEYWORD_COUNT, WRF_KW_UPGRADE_ERROR, WRF_KEYWORD_COUNT,
+};
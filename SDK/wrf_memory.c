@@ -0,0 +1,156 @@
+/*	Copyright 2017 DeviceDrive AS
+*
+*	Licensed under the Apache License, Version 2.0 (the "License");
+*	you may not use this file except in compliance with the License.
+*	You may obtain a copy of the License at
+*
+*	http ://www.apache.org/licenses/LICENSE-2.0
+*
+*	Unless required by applicable law or agreed to in writing, software
+*	distributed under the License is distributed on an "AS IS" BASIS,
+*	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*	See the License for the specific language governing permissions and
+*	limitations under the License.
+*
+*/
+
+#include "wrf_memory.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*	Every block starts with this header, so wrf_free knows what it gives back.
+*	The union keeps the memory behind it aligned for any type.
+*/
+typedef union {
+	struct {
+		size_t size;
+		uint8_t site;
+	}info;
+	double align_double;
+	void* align_pointer;
+	long long align_long;
+}block_header;
+
+static wrf_alloc_function* _alloc = NULL;
+static wrf_free_function* _free = NULL;
+static wrf_memory_stats _stats;
+
+#if WRF_MEMORY_ATOMIC
+#define COUNTER_LOAD(COUNTER) __atomic_load_n(&(COUNTER), __ATOMIC_RELAXED)
+#define COUNTER_ADD(COUNTER, VALUE) __atomic_add_fetch(&(COUNTER), (VALUE), __ATOMIC_RELAXED)
+#define COUNTER_SUB(COUNTER, VALUE) __atomic_sub_fetch(&(COUNTER), (VALUE), __ATOMIC_RELAXED)
+#define COUNTER_STORE(COUNTER, VALUE) __atomic_store_n(&(COUNTER), (VALUE), __ATOMIC_RELAXED)
+#else
+#define COUNTER_LOAD(COUNTER) (COUNTER)
+#define COUNTER_ADD(COUNTER, VALUE) ((COUNTER) += (VALUE))
+#define COUNTER_SUB(COUNTER, VALUE) ((COUNTER) -= (VALUE))
+#define COUNTER_STORE(COUNTER, VALUE) ((COUNTER) = (VALUE))
+#endif
+
+static const char* const _site_names[WRF_ALLOC_SITES] = {
+#define WRF_ALLOC_SITE_NAME(NAME, DESCRIPTION) DESCRIPTION,
+	WRF_ALLOC_SITE_LIST(WRF_ALLOC_SITE_NAME)
+#undef WRF_ALLOC_SITE_NAME
+};
+
+static void raise_peak(size_t* peak_bytes, size_t bytes_live)
+{
+#if WRF_MEMORY_ATOMIC
+	size_t peak = COUNTER_LOAD(*peak_bytes);
+	while (bytes_live > peak
+		&& !__atomic_compare_exchange_n(peak_bytes, &peak, bytes_live, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+#else
+	if (bytes_live > *peak_bytes)
+		*peak_bytes = bytes_live;
+#endif
+}
+
+void wrf_set_allocator(wrf_alloc_function* alloc, wrf_free_function* release)
+{
+	_alloc = alloc && release ? alloc : NULL;
+	_free = alloc && release ? release : NULL;
+}
+
+void* wrf_malloc(size_t size, wrf_alloc_site site)
+{
+	wrf_alloc_stats* counters = &_stats.sites[site];
+	block_header* block = NULL;
+	if (size <= (size_t)-1 - sizeof(block_header))
+		block = (block_header*)(_alloc ? _alloc(sizeof(block_header) + size) : malloc(sizeof(block_header) + size));
+	if (!block) {
+		COUNTER_ADD(counters->failed, 1);
+		COUNTER_ADD(_stats.failed, 1);
+		return NULL;
+	}
+
+	block->info.size = size;
+	block->info.site = (uint8_t)site;
+
+	COUNTER_ADD(counters->allocs, 1);
+	raise_peak(&counters->peak_bytes, COUNTER_ADD(counters->bytes_live, size));
+
+	COUNTER_ADD(_stats.allocs, 1);
+	raise_peak(&_stats.peak_bytes, COUNTER_ADD(_stats.bytes_live, size));
+
+	return block + 1;
+}
+
+void* wrf_calloc(size_t size, wrf_alloc_site site)
+{
+	void* ptr = wrf_malloc(size, site);
+	if (ptr)
+		memset(ptr, 0, size);
+	return ptr;
+}
+
+void wrf_free(void* ptr)
+{
+	if (!ptr)
+		return;
+
+	block_header* block = (block_header*)ptr - 1;
+	wrf_alloc_stats* counters = &_stats.sites[block->info.site];
+	COUNTER_ADD(counters->frees, 1);
+	COUNTER_SUB(counters->bytes_live, block->info.size);
+	COUNTER_ADD(_stats.frees, 1);
+	COUNTER_SUB(_stats.bytes_live, block->info.size);
+
+	if (_free)
+		_free(block);
+	else
+		free(block);
+}
+
+void wrf_get_memory_stats(wrf_memory_stats* stats)
+{
+#if WRF_MEMORY_ATOMIC
+	// Each counter is read as a whole, but they may be from different moments
+	stats->allocs = COUNTER_LOAD(_stats.allocs);
+	stats->frees = COUNTER_LOAD(_stats.frees);
+	stats->failed = COUNTER_LOAD(_stats.failed);
+	stats->bytes_live = COUNTER_LOAD(_stats.bytes_live);
+	stats->peak_bytes = COUNTER_LOAD(_stats.peak_bytes);
+	for (int i = 0; i < WRF_ALLOC_SITES; i++) {
+		stats->sites[i].allocs = COUNTER_LOAD(_stats.sites[i].allocs);
+		stats->sites[i].frees = COUNTER_LOAD(_stats.sites[i].frees);
+		stats->sites[i].failed = COUNTER_LOAD(_stats.sites[i].failed);
+		stats->sites[i].bytes_live = COUNTER_LOAD(_stats.sites[i].bytes_live);
+		stats->sites[i].peak_bytes = COUNTER_LOAD(_stats.sites[i].peak_bytes);
+	}
+#else
+	*stats = _stats;
+#endif
+}
+
+void wrf_reset_memory_peak()
+{
+	COUNTER_STORE(_stats.peak_bytes, COUNTER_LOAD(_stats.bytes_live));
+	for (int i = 0; i < WRF_ALLOC_SITES; i++)
+		COUNTER_STORE(_stats.sites[i].peak_bytes, COUNTER_LOAD(_stats.sites[i].bytes_live));
+}
+
+const char* wrf_alloc_site_name(wrf_alloc_site site)
+{
+	return (unsigned)site < WRF_ALLOC_SITES ? _site_names[site] : "unknown";
+}
@@ -0,0 +1,117 @@
+/*	Copyright 2017 DeviceDrive AS
+*
+*	Licensed under the Apache License, Version 2.0 (the "License");
+*	you may not use this file except in compliance with the License.
+*	You may obtain a copy of the License at
+*
+*	http ://www.apache.org/licenses/LICENSE-2.0
+*
+*	Unless required by applicable law or agreed to in writing, software
+*	distributed under the License is distributed on an "AS IS" BASIS,
+*	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*	See the License for the specific language governing permissions and
+*	limitations under the License.
+*
+*/
+
+/**@file
+*
+*	@brief		Heap use of the SDK
+*	@details	Every allocation the SDK makes goes through @ref wrf_malloc and
+*				@ref wrf_free, tagged with the place it is made for. The counters
+*				tell how much heap the SDK holds now and the most it has held, so
+*				it can be checked that the SDK fits beside the application.
+*
+*				The heap itself can be replaced with @ref wrf_set_allocator.
+*/
+
+#ifndef WRF_MEMORY_H__
+#define WRF_MEMORY_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*	@brief	1 updates the counters with atomic operations, so WRFs on several threads
+*			can allocate at once. Needs GCC or clang, and is off by default.
+*/
+#ifndef WRF_MEMORY_ATOMIC
+#define WRF_MEMORY_ATOMIC 0
+#endif
+
+/*	X(NAME, DESCRIPTION) */
+#define WRF_ALLOC_SITE_LIST(X)									\
+	X(INSTANCE,			"WRF instance")							\
+	X(RECEIVE_BUFFER,	"receive buffer")						\
+	X(RX_RING,			"receive ring")							\
+	X(QUEUE,			"send queue")							\
+	X(FILE_PACKET,		"file packet buffers")					\
+	X(MESSAGE_TAPE,		"message tape")							\
+	X(JSON,				"json_parse")							\
+
+/*	@brief	What an allocation is made for. */
+typedef enum {
+#define WRF_ALLOC_SITE_ENUM(NAME, DESCRIPTION) WRF_ALLOC_##NAME,
+	WRF_ALLOC_SITE_LIST(WRF_ALLOC_SITE_ENUM)
+#undef WRF_ALLOC_SITE_ENUM
+	WRF_ALLOC_SITES
+}wrf_alloc_site;
+
+/*	@brief	Counters of one allocation site. */
+typedef struct {
+	uint32_t allocs;				// Successful allocations
+	uint32_t frees;
+	uint32_t failed;				// Allocations the heap could not give
+	size_t bytes_live;				// Bytes held now
+	size_t peak_bytes;				// Most bytes held at once
+}wrf_alloc_stats;
+
+/*	@brief	Heap use of the whole SDK.
+*
+*	@details bytes_live and peak_bytes count what the SDK asked for, not what the
+*			 heap spends on bookkeeping.
+*/
+typedef struct {
+	uint32_t allocs;
+	uint32_t frees;
+	uint32_t failed;
+	size_t bytes_live;
+	size_t peak_bytes;
+	wrf_alloc_stats sites[WRF_ALLOC_SITES];
+}wrf_memory_stats;
+
+typedef void* wrf_alloc_function(size_t size);
+typedef void wrf_free_function(void* ptr);
+
+/*	@brief		Replaces malloc and free for everything the SDK allocates.
+*	@details	Call before anything is allocated, memory from one heap can not be
+*				given back to the other. NULL restores malloc and free.
+*/
+void wrf_set_allocator(wrf_alloc_function* alloc, wrf_free_function* release);
+
+/*	@brief	Allocates @ref size bytes for @ref site, NULL if the heap is out of memory. */
+void* wrf_malloc(size_t size, wrf_alloc_site site);
+
+/*	@brief	Allocates @ref size zeroed bytes for @ref site. */
+void* wrf_calloc(size_t size, wrf_alloc_site site);
+
+/*	@brief	Gives back memory from @ref wrf_malloc or @ref wrf_calloc. NULL is ignored. */
+void wrf_free(void* ptr);
+
+/*	@brief	Copies the counters into @ref stats. */
+void wrf_get_memory_stats(wrf_memory_stats* stats);
+
+/*	@brief	Starts measuring the peaks again from what is held now. */
+void wrf_reset_memory_peak();
+
+/*	@brief	Name of an allocation site, for printing. */
+const char* wrf_alloc_site_name(wrf_alloc_site site);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
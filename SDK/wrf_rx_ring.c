@@ -0,0 +1,128 @@
+/*	Copyright 2017 DeviceDrive AS
+*
+*	Licensed under the Apache License, Version 2.0 (the "License");
+*	you may not use this file except in compliance with the License.
+*	You may obtain a copy of the License at
+*
+*	http ://www.apache.org/licenses/LICENSE-2.0
+*
+*	Unless required by applicable law or agreed to in writing, software
+*	distributed under the License is distributed on an "AS IS" BASIS,
+*	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*	See the License for the specific language governing permissions and
+*	limitations under the License.
+*
+*/
+
+#include "wrf_rx_ring.h"
+
+/*	The GCC builtins give acquire and release on every target that has them.
+*	On single core AVR, and on x86 with MSVC, ordering against the compiler is
+*	all it takes.
+*/
+#if defined(__GNUC__) && !defined(__AVR__)
+#define LOAD_ACQUIRE(p)			__atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define STORE_RELEASE(p, v)		__atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define LOAD_RELAXED(p)			__atomic_load_n(p, __ATOMIC_RELAXED)
+#define STORE_RELAXED(p, v)		__atomic_store_n(p, v, __ATOMIC_RELAXED)
+#else
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define COMPILER_BARRIER()		_ReadWriteBarrier()
+#else
+#define COMPILER_BARRIER()		__asm__ __volatile__("" ::: "memory")
+#endif
+
+static wrf_rx_index load_acquire(volatile wrf_rx_index* p)
+{
+	wrf_rx_index value = *p;
+	COMPILER_BARRIER();
+	return value;
+}
+
+static void store_release(volatile wrf_rx_index* p, wrf_rx_index value)
+{
+	COMPILER_BARRIER();
+	*p = value;
+}
+
+#define LOAD_ACQUIRE(p)			load_acquire(p)
+#define STORE_RELEASE(p, v)		store_release(p, v)
+#define LOAD_RELAXED(p)			(*(p))
+#define STORE_RELAXED(p, v)		(*(p) = (v))
+#endif
+
+/*	Only the producer writes the count, so a load and a store do, without the
+*	read-modify-write Cortex-M0 does not have.
+*/
+static void add_overflows(wrf_rx_ring* ring, uint32_t count)
+{
+	STORE_RELAXED(&ring->overflows, LOAD_RELAXED(&ring->overflows) + count);
+}
+
+bool wrf_rx_ring_init(wrf_rx_ring* ring, uint8_t* data, size_t size)
+{
+	bool valid = data && size > 0 && size <= WRF_RX_RING_MAX_SIZE && (size & (size - 1)) == 0;
+	ring->data = valid ? data : NULL;
+	ring->size = valid ? (wrf_rx_index)size : 0;
+	ring->head = 0;
+	ring->tail = 0;
+	ring->overflows = 0;
+	return valid;
+}
+
+bool wrf_rx_ring_push(wrf_rx_ring* ring, uint8_t byte)
+{
+	wrf_rx_index head = ring->head;
+	if ((wrf_rx_index)(head - LOAD_ACQUIRE(&ring->tail)) >= ring->size) {
+		add_overflows(ring, 1);
+		return false;
+	}
+
+	ring->data[head & (ring->size - 1)] = byte;
+	STORE_RELEASE(&ring->head, (wrf_rx_index)(head + 1));
+	return true;
+}
+
+size_t wrf_rx_ring_write(wrf_rx_ring* ring, const uint8_t* data, size_t length)
+{
+	wrf_rx_index head = ring->head;
+	size_t room = ring->size - (wrf_rx_index)(head - LOAD_ACQUIRE(&ring->tail));
+	size_t count = length < room ? length : room;
+
+	for (size_t i = 0; i < count; i++)
+		ring->data[(wrf_rx_index)(head + i) & (ring->size - 1)] = data[i];
+	if (count < length)
+		add_overflows(ring, (uint32_t)(length - count));
+
+	STORE_RELEASE(&ring->head, (wrf_rx_index)(head + count));
+	return count;
+}
+
+size_t wrf_rx_ring_peek(wrf_rx_ring* ring, const uint8_t** data)
+{
+	wrf_rx_index tail = ring->tail;
+	size_t count = (wrf_rx_index)(LOAD_ACQUIRE(&ring->head) - tail);
+	if (count == 0)
+		return 0;
+
+	size_t offset = tail & (ring->size - 1);
+	size_t contiguous = ring->size - offset;
+	*data = ring->data + offset;
+	return count < contiguous ? count : contiguous;
+}
+
+void wrf_rx_ring_consume(wrf_rx_ring* ring, size_t length)
+{
+	STORE_RELEASE(&ring->tail, (wrf_rx_index)(ring->tail + length));
+}
+
+size_t wrf_rx_ring_count(wrf_rx_ring* ring)
+{
+	return (wrf_rx_index)(LOAD_ACQUIRE(&ring->head) - LOAD_ACQUIRE(&ring->tail));
+}
+
+uint32_t wrf_rx_ring_overflows(wrf_rx_ring* ring)
+{
+	return LOAD_RELAXED(&ring->overflows);
+}
@@ -0,0 +1,103 @@
+/*	Copyright 2017 DeviceDrive AS
+*
+*	Licensed under the Apache License, Version 2.0 (the "License");
+*	you may not use this file except in compliance with the License.
+*	You may obtain a copy of the License at
+*
+*	http ://www.apache.org/licenses/LICENSE-2.0
+*
+*	Unless required by applicable law or agreed to in writing, software
+*	distributed under the License is distributed on an "AS IS" BASIS,
+*	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*	See the License for the specific language governing permissions and
+*	limitations under the License.
+*
+*/
+
+/**@file
+*
+*	@brief		Receive ring between a UART interrupt and the main loop
+*	@details	A single producer, single consumer ring of bytes without locks.
+*				The UART interrupt only pushes received bytes, and the main loop
+*				takes them out and parses them, so no parsing or callbacks run in
+*				interrupt context. See @ref WRF::registerCharFromISR and
+*				@ref WRF::process.
+*
+*				Each index is written by one side only. The producer publishes a
+*				byte with a release store of head after writing it, and the
+*				consumer frees room with a release store of tail after reading.
+*
+*	@note		The ring must be fed by one producer and drained by one consumer.
+*				Bytes that do not fit are dropped and counted, see
+*				@ref wrf_rx_ring_overflows.
+*/
+
+#ifndef WRF_RX_RING_H__
+#define WRF_RX_RING_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*	@brief	Free running index. A byte wide index is read and written in one
+*			instruction on 8-bit AVR, so the ring is at most 128 bytes there.
+*/
+#if defined(__AVR__)
+typedef uint8_t wrf_rx_index;
+#define WRF_RX_RING_MAX_SIZE 128
+#else
+typedef uint32_t wrf_rx_index;
+#define WRF_RX_RING_MAX_SIZE 0x80000000UL
+#endif
+
+typedef struct {
+	uint8_t* data;
+	wrf_rx_index size;						// Power of 2, or 0 for a ring that takes nothing
+	volatile wrf_rx_index head;				// Written by the producer only
+	volatile wrf_rx_index tail;				// Written by the consumer only
+	volatile uint32_t overflows;			// Bytes dropped, written by the producer only
+}wrf_rx_ring;
+
+/*	@brief	Sets up the ring on @ref data.
+*
+*	@retval	false if @ref size is not a power of 2 up to WRF_RX_RING_MAX_SIZE.
+*			The ring then takes nothing and counts every byte as an overflow.
+*/
+bool wrf_rx_ring_init(wrf_rx_ring* ring, uint8_t* data, size_t size);
+
+/*	@brief	Producer side. Adds a byte, or counts it as an overflow if the ring is full. */
+bool wrf_rx_ring_push(wrf_rx_ring* ring, uint8_t byte);
+
+/*	@brief	Producer side. Adds as many bytes as fit, counts the rest as overflows
+*			and returns how many were added.
+*/
+size_t wrf_rx_ring_write(wrf_rx_ring* ring, const uint8_t* data, size_t length);
+
+/*	@brief	Consumer side. Points @ref data at the oldest bytes and returns how many
+*			can be read there in one piece. The bytes stay in the ring until
+*			@ref wrf_rx_ring_consume.
+*/
+size_t wrf_rx_ring_peek(wrf_rx_ring* ring, const uint8_t** data);
+
+/*	@brief	Consumer side. Frees the @ref length oldest bytes. */
+void wrf_rx_ring_consume(wrf_rx_ring* ring, size_t length);
+
+/*	@brief	Bytes in the ring. Exact on the consumer side, a snapshot elsewhere. */
+size_t wrf_rx_ring_count(wrf_rx_ring* ring);
+
+/*	@brief	Bytes dropped because the ring was full.
+*
+*	@note	On 8-bit targets the count is four bytes wide, so read it with the
+*			UART interrupt off if it must be exact.
+*/
+uint32_t wrf_rx_ring_overflows(wrf_rx_ring* ring);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // WRF_RX_RING_H__
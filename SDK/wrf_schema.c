@@ -0,0 +1,321 @@
+/*	Copyright 2017 DeviceDrive AS
+*
+*	Licensed under the Apache License, Version 2.0 (the "License");
+*	you may not use this file except in compliance with the License.
+*	You may obtain a copy of the License at
+*
+*	http ://www.apache.org/licenses/LICENSE-2.0
+*
+*	Unless required by applicable law or agreed to in writing, software
+*	distributed under the License is distributed on an "AS IS" BASIS,
+*	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*	See the License for the specific language governing permissions and
+*	limitations under the License.
+*
+*/
+
+#include "wrf_schema.h"
+#include "wrf_keywords.h"
+#include <limits.h>
+#include <stddef.h>
+#include <string.h>
+
+#define FIELD(KEY, INDEX, GROUP, TYPE, STRUCT, MEMBER, REQUIRED) \
+	{ KEY, INDEX, GROUP, TYPE, REQUIRED, offsetof(STRUCT, MEMBER), sizeof(((STRUCT*)0)->MEMBER) }
+
+#define MEMBER(KEY, TYPE, STRUCT, MEMBER, REQUIRED) \
+	FIELD(KEY, 0, WRF_FIELD_NO_GROUP, TYPE, STRUCT, MEMBER, REQUIRED)
+
+#define ELEMENT(INDEX, TYPE, STRUCT, MEMBER, REQUIRED) \
+	FIELD(NULL, INDEX, WRF_FIELD_NO_GROUP, TYPE, STRUCT, MEMBER, REQUIRED)
+
+#define NUM_FIELDS(FIELDS) (uint8_t)(sizeof(FIELDS) / sizeof(FIELDS[0]))
+
+#pragma region Schemas
+
+/*	{"devicedrive":{"status":{"connection_status":"GOT_IP","ip":"192.168.1.20",...}}} */
+static const wrf_field status_fields[] = {
+	MEMBER(WRF_STATUS_CONNECTION_STR,		WRF_FIELD_CONNECTION_STATUS,	wrf_status, connection_status,			true),
+	MEMBER(WRF_STATUS_IP_STR,				WRF_FIELD_STRING,				wrf_status, ip_addr,					true),
+	MEMBER(WRF_STATUS_VISIBILITY_STR,		WRF_FIELD_ON_OFF,				wrf_status, visibility_status,			false),
+	MEMBER(WRF_STATUS_LAST_ERROR_STR,		WRF_FIELD_ERROR_CODE,			wrf_status, last_error_code,			false),
+	MEMBER(WRF_STATUS_LAST_ERROR_MSG_STR,	WRF_FIELD_STRING,				wrf_status, last_error_msg,				false),
+	MEMBER(WRF_STATUS_TRANSFERS_STR,		WRF_FIELD_INT,					wrf_status, successful_transfer_count,	false),
+};
+
+const wrf_schema wrf_status_schema = {
+	WRF_STATUS, LIB_ERROR_PARSE_STATUS, LIB_ERROR_PARSE_STATUS_STR,
+	3, false, NULL, status_fields, NUM_FIELDS(status_fields)
+};
+
+/*	{"devicedrive":{"time":[timestamp,week_day,day,month,year,hour,minute,second,timezone,dst]}} */
+static const wrf_field time_fields[] = {
+	ELEMENT(0, WRF_FIELD_UINT64,	wrf_time, timestamp,	true),
+	ELEMENT(1, WRF_FIELD_INT,		wrf_time, week_day,		true),
+	ELEMENT(2, WRF_FIELD_INT,		wrf_time, day,			true),
+	ELEMENT(3, WRF_FIELD_INT,		wrf_time, month,		true),
+	ELEMENT(4, WRF_FIELD_INT,		wrf_time, year,			true),
+	ELEMENT(5, WRF_FIELD_INT,		wrf_time, hour,			true),
+	ELEMENT(6, WRF_FIELD_INT,		wrf_time, minute,		true),
+	ELEMENT(7, WRF_FIELD_INT,		wrf_time, second,		true),
+	ELEMENT(8, WRF_FIELD_INT,		wrf_time, timezone,		false),
+	ELEMENT(9, WRF_FIELD_INT,		wrf_time, dst,			false),
+};
+
+const wrf_schema wrf_time_schema = {
+	WRF_TIME, LIB_ERROR_PARSE_TIME, LIB_ERROR_PARSE_TIME_STR,
+	3, true, NULL, time_fields, NUM_FIELDS(time_fields)
+};
+
+/*	{"devicedrive":{"upgrade":{"length":20480,"crc":305419896}}} */
+static const wrf_field ota_packet_fields[] = {
+	MEMBER(WRF_SIZE_STR,	WRF_FIELD_INT,	ota_packet, size,	true),
+	MEMBER(WRF_CRC_STR,		WRF_FIELD_UINT32,	ota_packet, crc,	true),
+};
+
+const wrf_schema wrf_ota_packet_schema = {
+	WRF_UPGRADE_PACKAGE, LIB_ERROR_PARSE_UPGRADE, LIB_ERROR_PARSE_UPGRADE_STR,
+	3, false, NULL, ota_packet_fields, NUM_FIELDS(ota_packet_fields)
+};
+
+/*	{"devicedrive":{"upgrade":["WRF01","CLIENT"]}} */
+static const wrf_field module_list_fields[] = {
+	ELEMENT(WRF_FIELD_ANY_INDEX, WRF_FIELD_OTA_MODULE, wrf_module_list, modules, false),
+};
+
+const wrf_schema wrf_module_list_schema = {
+	WRF_UPGRADE_PENDING, LIB_ERROR_PARSE_UPGRADE, LIB_ERROR_PARSE_UPGRADE_STR,
+	3, true, NULL, module_list_fields, NUM_FIELDS(module_list_fields)
+};
+
+/*	{"configuration":{"mac":"A020A6123456"},"device_state":{"rssi":"-55"}} */
+enum { GROUP_CONFIGURATION, GROUP_DEVICE_STATE };
+
+static const char* const device_state_groups[] = { WRF_CONFIG_STR, WRF_CONFIG_DEVICE_STATE_STR, NULL };
+
+static const wrf_field device_state_fields[] = {
+	FIELD(WRF_CONFIG_MAC_STR,	0, GROUP_CONFIGURATION,	WRF_FIELD_STRING,	wrf_device_state, mac,	true),
+	FIELD(WRF_CONFIG_RSSI_STR,	0, GROUP_DEVICE_STATE,	WRF_FIELD_INT,		wrf_device_state, rssi,	false),
+};
+
+const wrf_schema wrf_device_state_schema = {
+	WRF_CONFIG, LIB_ERROR_PARSE_CONFIG, LIB_ERROR_PARSE_CONFIG_STR,
+	2, false, device_state_groups, device_state_fields, NUM_FIELDS(device_state_fields)
+};
+
+#pragma endregion
+
+#pragma region Decoder
+
+bool wrf_parse_integer(const char* text, int length, int64_t* value)
+{
+	int i = 0;
+	bool negative = length > 0 && text[0] == '-';
+	if (negative)
+		i++;
+	if (i == length)
+		return false;
+
+	uint64_t result = 0;
+	for (; i < length; i++) {
+		if (text[i] < '0' || text[i] > '9')
+			return false;
+		unsigned digit = (unsigned)(text[i] - '0');
+		if (result > (UINT64_MAX - digit) / 10)
+			return false;
+		result = result * 10 + digit;
+	}
+
+	if (result > (uint64_t)INT64_MAX + (negative ? 1 : 0))
+		return false;
+	*value = negative ? (int64_t)(0 - result) : (int64_t)result;
+	return true;
+}
+
+static int find_group(const wrf_schema* schema, const char* name)
+{
+	for (int i = 0; schema->groups[i]; i++)
+		if (strcmp(schema->groups[i], name) == 0)
+			return i;
+	return -1;
+}
+
+static int find_field(const wrf_schema* schema, int group, const char* key, int index)
+{
+	for (int i = 0; i < schema->num_fields; i++) {
+		const wrf_field* field = &schema->fields[i];
+		if (field->group != group)
+			continue;
+		if (key ? strcmp(field->key, key) == 0 : (field->index == index || field->index == WRF_FIELD_ANY_INDEX))
+			return i;
+	}
+	return -1;
+}
+
+static bool is_text(const json_token* token)
+{
+	return token->type == JSON_TOKEN_STRING && !token->truncated;
+}
+
+/*	Writes the value of @ref token to the field, returns false if it has the wrong type
+*	or does not fit.
+*/
+static bool write_field(wrf_decoder* decoder, const wrf_field* field, const json_token* token)
+{
+	char* dst = (char*)&decoder->out + field->offset;
+	int64_t number;
+
+	switch (field->type)
+	{
+	case WRF_FIELD_STRING:
+	{
+		if (token->type != JSON_TOKEN_STRING && token->type != JSON_TOKEN_STRING_PART)
+			return false;
+		int room = field->size - 1 - decoder->text_length;
+		int length = token->length < room ? token->length : room;
+		memcpy(dst + decoder->text_length, token->text, length);
+		decoder->text_length += length;
+		dst[decoder->text_length] = 0x0;
+		if (token->type == JSON_TOKEN_STRING_PART)
+			return true;
+		decoder->text_length = 0;
+		break;
+	}
+	case WRF_FIELD_INT:
+	case WRF_FIELD_UINT32:
+	case WRF_FIELD_UINT64:
+		if ((token->type != JSON_TOKEN_NUMBER && token->type != JSON_TOKEN_STRING) || token->truncated
+				|| !wrf_parse_integer(token->text, token->length, &number))
+			return false;
+		if (field->type == WRF_FIELD_INT) {
+			if (number < INT_MIN || number > INT_MAX)
+				return false;
+			*(int*)dst = (int)number;
+		}
+		else if (field->type == WRF_FIELD_UINT32) {
+			if (number < 0 || number > UINT32_MAX)
+				return false;
+			*(uint32_t*)dst = (uint32_t)number;
+		}
+		else if (number < 0)
+			return false;
+		else
+			*(uint64_t*)dst = (uint64_t)number;
+		break;
+	case WRF_FIELD_ON_OFF:
+		if (!is_text(token))
+			return false;
+		*(bool*)dst = strcmp(token->text, WRF_STATUS_ON_STR) == 0;
+		break;
+	case WRF_FIELD_CONNECTION_STATUS:
+		if (!is_text(token))
+			return false;
+		*(wrf_connection_status*)dst = get_status((char*)token->text);
+		break;
+	case WRF_FIELD_ERROR_CODE:
+		if (!is_text(token))
+			return false;
+		*(wrf_error_code*)dst = get_error_code((char*)token->text);
+		break;
+	case WRF_FIELD_OTA_MODULE:
+	{
+		if (!is_text(token))
+			return false;
+		wrf_module_list* list = (wrf_module_list*)dst;
+		if (list->size < WRF_OTA_MODULE_SIZE)
+			list->modules[list->size++] = get_ota_module((char*)token->text);
+		break;
+	}
+	default:
+		return false;
+	}
+
+	decoder->seen |= 1UL << (field - decoder->schema->fields);
+	return true;
+}
+
+void wrf_decoder_start(wrf_decoder* decoder, const wrf_schema* schema)
+{
+	decoder->schema = schema;
+	decoder->field = -1;
+	decoder->text_length = 0;
+	decoder->seen = 0;
+	decoder->in_record = false;
+	decoder->found_record = false;
+	decoder->invalid = false;
+	// Fields a response leaves out keep their zero value
+	if (schema)
+		memset(&decoder->out, 0, sizeof(decoder->out));
+	// Fields without a group match until a schema with groups names one
+	decoder->group = WRF_FIELD_NO_GROUP;
+}
+
+void wrf_decoder_feed(wrf_decoder* decoder, const json_token* token)
+{
+	const wrf_schema* schema = decoder->schema;
+	if (!schema || decoder->invalid || token->depth < schema->depth - 1)
+		return;
+
+	// The value holding the fields, or the members naming a group
+	if (token->depth == schema->depth - 1) {
+		bool is_record = schema->groups ? decoder->group >= 0 : token->index == 0;
+		switch (token->type)
+		{
+		case JSON_TOKEN_KEY:
+			if (schema->groups)
+				decoder->group = find_group(schema, token->text);
+			break;
+		case JSON_TOKEN_OBJECT_BEGIN:
+		case JSON_TOKEN_ARRAY_BEGIN:
+			if (!is_record)
+				break;
+			if ((token->type == JSON_TOKEN_ARRAY_BEGIN) != schema->is_array) {
+				decoder->invalid = true;
+				break;
+			}
+			decoder->in_record = true;
+			decoder->found_record = true;
+			decoder->field = -1;
+			break;
+		case JSON_TOKEN_OBJECT_END:
+		case JSON_TOKEN_ARRAY_END:
+			decoder->in_record = false;
+			break;
+		default:
+			if (is_record)
+				decoder->invalid = true;
+			break;
+		}
+		return;
+	}
+
+	// Values nested in a field are skipped with the field
+	if (!decoder->in_record || token->depth != schema->depth)
+		return;
+
+	if (token->type == JSON_TOKEN_KEY) {
+		decoder->field = find_field(schema, decoder->group, token->text, 0);
+		decoder->text_length = 0;
+		return;
+	}
+	if (token->type == JSON_TOKEN_OBJECT_END || token->type == JSON_TOKEN_ARRAY_END)
+		return;
+
+	int field = schema->is_array ? find_field(schema, decoder->group, NULL, token->index) : decoder->field;
+	if (field >= 0 && !write_field(decoder, &schema->fields[field], token))
+		decoder->invalid = true;
+}
+
+bool wrf_decoder_done(const wrf_decoder* decoder)
+{
+	const wrf_schema* schema = decoder->schema;
+	if (!schema || decoder->invalid || !decoder->found_record)
+		return false;
+
+	for (int i = 0; i < schema->num_fields; i++)
+		if (schema->fields[i].required && !(decoder->seen & (1UL << i)))
+			return false;
+	return true;
+}
+
+#pragma endregion
@@ -0,0 +1,117 @@
+/*	Copyright 2017 DeviceDrive AS
+*
+*	Licensed under the Apache License, Version 2.0 (the "License");
+*	you may not use this file except in compliance with the License.
+*	You may obtain a copy of the License at
+*
+*	http ://www.apache.org/licenses/LICENSE-2.0
+*
+*	Unless required by applicable law or agreed to in writing, software
+*	distributed under the License is distributed on an "AS IS" BASIS,
+*	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*	See the License for the specific language governing permissions and
+*	limitations under the License.
+*
+*/
+
+/**@file
+*
+*	@brief		Response structs described as tables
+*	@details	Each response struct the library fills in is described by a
+*				@ref wrf_schema: which member or array position goes to which
+*				offset in the struct, and how the value is read. A
+*				@ref wrf_decoder follows the tokens of a frame as they arrive
+*				and writes each value straight into the struct.
+*
+*				Members may come in any order, members that are not in the
+*				schema are skipped, and a response is only rejected when a
+*				required field is missing or has the wrong type.
+*/
+
+#ifndef WRF_SCHEMA_H__
+#define WRF_SCHEMA_H__
+
+#include "wrf.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*	@brief	How a value is read. */
+typedef enum {
+	WRF_FIELD_STRING,				// char[size], cut to fit
+	WRF_FIELD_INT,					// int, from a number or a string of digits in its range
+	WRF_FIELD_UINT32,				// uint32_t, from a number or a string of digits in its range
+	WRF_FIELD_UINT64,				// uint64_t, from a number or a string of digits
+	WRF_FIELD_ON_OFF,				// bool, true for "ON"
+	WRF_FIELD_CONNECTION_STATUS,	// wrf_connection_status, WRF_UNKNOWN if not known
+	WRF_FIELD_ERROR_CODE,			// wrf_error_code, LIB_ERROR_RESULT_UNKNOWN if not known
+	WRF_FIELD_OTA_MODULE,			// Added to a wrf_module_list
+}wrf_field_type;
+
+/*	@brief	Field matching every element of an array. */
+#define WRF_FIELD_ANY_INDEX -1
+
+/*	@brief	Field without a group. */
+#define WRF_FIELD_NO_GROUP -1
+
+typedef struct {
+	const char* key;		// Member name, NULL for array elements
+	int8_t index;			// Array position, or WRF_FIELD_ANY_INDEX
+	int8_t group;			// Index in wrf_schema.groups, or WRF_FIELD_NO_GROUP
+	uint8_t type;			// wrf_field_type
+	bool required;
+	uint16_t offset;		// In the response struct
+	uint16_t size;			// Of the destination
+}wrf_field;
+
+/*	@brief	Description of one response.
+*
+*	@details	The fields are the members (or elements, with @ref is_array) of the
+*				value at depth - 1. Without groups that is the first value of the
+*				response object, as in {"devicedrive":{"status":{...}}}. With groups
+*				the fields are spread over several named objects, as in
+*				{"configuration":{...},"device_state":{...}}.
+*/
+typedef struct wrf_schema {
+	wrf_result_code result;
+	wrf_error_code error;			// Sent when the response can not be decoded
+	const char* error_str;
+	uint8_t depth;					// Depth of the field keys, see @ref json_token
+	bool is_array;
+	const char* const* groups;		// NULL terminated, or NULL
+	const wrf_field* fields;
+	uint8_t num_fields;
+}wrf_schema;
+
+extern const wrf_schema wrf_status_schema;
+extern const wrf_schema wrf_time_schema;
+extern const wrf_schema wrf_ota_packet_schema;
+extern const wrf_schema wrf_module_list_schema;
+extern const wrf_schema wrf_device_state_schema;
+
+/*	@brief	Function for starting to decode a response described by @ref schema. */
+void wrf_decoder_start(wrf_decoder* decoder, const wrf_schema* schema);
+
+/*	@brief	Function for feeding a token of the frame to the decoder. */
+void wrf_decoder_feed(wrf_decoder* decoder, const json_token* token);
+
+/*	@brief		Function for checking the result after the whole frame is fed.
+*
+*	@retval		true	if the struct in decoder->out is complete.
+*/
+bool wrf_decoder_done(const wrf_decoder* decoder);
+
+/*	@brief		Function for reading an integer from the text of a token.
+*
+*	@details	Accepts an optional '-' followed by decimal digits and nothing else.
+*
+*	@retval		false	if @ref text is not such a number or does not fit in 64 bits.
+*/
+bool wrf_parse_integer(const char* text, int length, int64_t* value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -17,44 +17,128 @@
 #include "wrf_sdk.h"
 #include <stdio.h>
 #include "crc32.h"
+#if WRF_QUEUE_MPSC
+#include <new>
+#endif
 
 #pragma region MessageQueue Implementation
 
-Queue::Queue(int max_queue_size){
+#define QUEUE_WRAP 0xFFFF
+
+Queue::Queue(int max_queue_size, int capacity){
 	_count = 0;
 	_size = max_queue_size;
+	_capacity = capacity;
 	_first = _last = 0;
-	_data = (char**)malloc(_size * sizeof(char*));
+	_data = (char*)wrf_malloc(_capacity, WRF_ALLOC_QUEUE);
 }
 
 Queue::~Queue(){
 	clear();
-	free(_data);
+	wrf_free(_data);
 }
 
-bool Queue::push(char* str){
-	if (_count >= _size) return false;
+void* Queue::operator new(size_t size){
+	return wrf_malloc(size, WRF_ALLOC_INSTANCE);
+}
 
-	int len = strlen(str);
-	_data[_last] = (char*)malloc(len+1);
-	strcpy(_data[_last++], str);
+void Queue::operator delete(void* ptr){
+	wrf_free(ptr);
+}
+
+int Queue::recordSize(int length){
+	return WRF_QUEUE_HEADER_SIZE + length + 1;
+}
+
+int Queue::readLength(int offset){
+	return (unsigned char)_data[offset] | ((unsigned char)_data[offset + 1] << 8);
+}
+
+void Queue::writeLength(int offset, int length){
+	_data[offset] = (char)(length & 0xFF);
+	_data[offset + 1] = (char)(length >> 8);
+}
+
+/*	Finds room for a message of @ref length bytes and stores its header. Returns
+*	where the message goes, or NULL if it does not fit.
+*/
+char* Queue::reserve(int length){
+	if (_count >= _size || length >= QUEUE_WRAP)
+		return NULL;
+
+	int need = recordSize(length);
+	int start = _last;
+	if (_count == 0) {
+		_first = _last = start = 0;
+		if (need > _capacity)
+			return NULL;
+	}
+	else if (_last > _first) {
+		if (need > _capacity - _last) {
+			// Does not fit at the end, start over in front of the first message
+			if (need > _first)
+				return NULL;
+			if (_capacity - _last >= WRF_QUEUE_HEADER_SIZE)
+				writeLength(_last, QUEUE_WRAP);
+			start = 0;
+		}
+	}
+	else if (need > _first - _last)
+		return NULL;
+
+	writeLength(start, length);
+	_last = start + need;
+	if (_last >= _capacity)
+		_last = 0;
 	_count++;
-	if (_last >= _size) _last = 0;
+	return _data + start + WRF_QUEUE_HEADER_SIZE;
+}
+
+bool Queue::push(char* str){
+	int len = strlen(str);
+	char* dst = reserve(len);
+	if (!dst) return false;
+
+	memcpy(dst, str, len + 1);
+	return true;
+}
+
+bool Queue::push(const wrf_segment* segments, int count){
+	int len = 0;
+	for (int i = 0; i < count; i++)
+		len += segments[i].length;
+	char* dst = reserve(len);
+	if (!dst) return false;
+
+	for (int i = 0; i < count; i++) {
+		memcpy(dst, segments[i].data, segments[i].length);
+		dst += segments[i].length;
+	}
+	*dst = 0x0;
 	return true;
 }
+
 char* Queue::peek(){
-	return _data[_first];
+	return _data + _first + WRF_QUEUE_HEADER_SIZE;
+}
+
+char* Queue::peek(int* length){
+	*length = readLength(_first);
+	return peek();
 }
 
 void Queue::pop(){
-	free(_data[_first++]);
+	_first += recordSize(readLength(_first));
 	_count--;
-	if (_first >= _size) _first = 0;
+	if (_count == 0)
+		_first = _last = 0;
+	else if (_capacity - _first < WRF_QUEUE_HEADER_SIZE || readLength(_first) == QUEUE_WRAP)
+		_first = 0;
 }
 
 void  Queue::clear(){
-	while (!empty())
-		pop();
+	_count = 0;
+	_first = _last = 0;
 }
 bool Queue::empty() {
 	return _count == 0;
@@ -66,32 +150,172 @@ int  Queue::count(){
 
 #pragma endregion
 
+#if WRF_QUEUE_MPSC
+#pragma region MpscQueue Implementation
+
+MpscQueue::MpscQueue(int max_queue_size, int capacity)
+	: _free(max_queue_size), _tail(0)
+{
+	uint32_t slots = 1;
+	while (slots < (uint32_t)max_queue_size)
+		slots <<= 1;
+
+	_head = 0;
+	_mask = slots - 1;
+	_size = max_queue_size;
+	_slot_size = max_queue_size > 0 ? capacity / max_queue_size : 0;
+	_stride = (int)((sizeof(Slot) + _slot_size + alignof(Slot) - 1) / alignof(Slot) * alignof(Slot));
+	_data = (char*)wrf_malloc((size_t)_stride * slots, WRF_ALLOC_QUEUE);
+	if (!_data) {
+		_free = 0;
+		_size = _slot_size = 0;
+		return;
+	}
+	for (uint32_t i = 0; i < slots; i++)
+		new (slot(i)) Slot{ { i }, 0 };
+}
+
+MpscQueue::~MpscQueue(){
+	wrf_free(_data);
+}
+
+void* MpscQueue::operator new(size_t size){
+	return wrf_malloc(size, WRF_ALLOC_INSTANCE);
+}
+
+void MpscQueue::operator delete(void* ptr){
+	wrf_free(ptr);
+}
+
+MpscQueue::Slot* MpscQueue::slot(uint32_t ticket){
+	return (Slot*)(_data + (size_t)(ticket & _mask) * _stride);
+}
+
+/*	Takes a free slot and returns where the message goes, or NULL if the queue is
+*	full or the message too long. Neither step waits for other producers.
+*
+*	A producer can get a slot whose last message was freed by a pop it did not see
+*	itself. Then a producer holding an earlier ticket did, and the acq_rel ticket
+*	counter passes that on.
+*/
+char* MpscQueue::reserve(int length, uint32_t* ticket){
+	if (length >= _slot_size)
+		return NULL;
+	if (_free.fetch_sub(1, std::memory_order_acquire) <= 0) {
+		_free.fetch_add(1, std::memory_order_relaxed);
+		return NULL;
+	}
+
+	*ticket = _tail.fetch_add(1, std::memory_order_acq_rel);
+	return (char*)slot(*ticket) + sizeof(Slot);
+}
+
+void MpscQueue::publish(uint32_t ticket, int length){
+	Slot* s = slot(ticket);
+	s->length = length;
+	s->sequence.store(ticket + 1, std::memory_order_release);
+}
+
+bool MpscQueue::push(char* str){
+	int len = strlen(str);
+	uint32_t ticket;
+	char* dst = reserve(len, &ticket);
+	if (!dst) return false;
+
+	memcpy(dst, str, len + 1);
+	publish(ticket, len);
+	return true;
+}
+
+bool MpscQueue::push(const wrf_segment* segments, int count){
+	int len = 0;
+	for (int i = 0; i < count; i++)
+		len += segments[i].length;
+	uint32_t ticket;
+	char* dst = reserve(len, &ticket);
+	if (!dst) return false;
+
+	for (int i = 0, offset = 0; i < count; offset += segments[i].length, i++)
+		memcpy(dst + offset, segments[i].data, segments[i].length);
+	dst[len] = 0x0;
+	publish(ticket, len);
+	return true;
+}
+
+char* MpscQueue::peek(){
+	return (char*)slot(_head) + sizeof(Slot);
+}
+
+char* MpscQueue::peek(int* length){
+	*length = slot(_head)->length;
+	return peek();
+}
+
+void MpscQueue::pop(){
+	slot(_head)->sequence.store(_head + _mask + 1, std::memory_order_relaxed);
+	_head++;
+	_free.fetch_add(1, std::memory_order_release);
+}
+
+void MpscQueue::clear(){
+	while (!empty())
+		pop();
+}
+
+/*	A message is only there once it is copied in. Messages pushed after one that
+*	is still being copied wait behind it.
+*/
+bool MpscQueue::empty(){
+	return slot(_head)->sequence.load(std::memory_order_acquire) != _head + 1;
+}
+
+int MpscQueue::count(){
+	int count = _size - _free.load(std::memory_order_relaxed);
+	return count < 0 ? 0 : count > _size ? _size : count;
+}
+
+#pragma endregion
+#endif
+
 #pragma region WRF_SDK Implementation
 
 WRF *WRF::instance;
 
 WRF::WRF() {};
 
-WRF::WRF(wrf_write_string writer, int receive_buffer_size, int queue_size)
+WRF::WRF(wrf_write_string writer, int receive_buffer_size, int queue_size, int queue_buffer_size)
 {
-	init_instance(writer, receive_buffer_size, queue_size);
+	init_instance(writer, receive_buffer_size, queue_size, queue_buffer_size);
 }
 
 WRF::~WRF()
 {
+	if (instance == this) {
+		instance = NULL;
+		wrf_set_default_ctx(NULL);
+	}
 	clearQueue();
-	free(_receive_buffer.data);
+	freeFilePacketBuffers();
+	wrf_free(_receive_buffer.data);
+	wrf_free(_rx_ring.data);
+	wrf_free(_message_tape);
 	delete _queue;
 }
 
-void WRF::init_instance(wrf_write_string writer, int receive_buffer_size, int queue_size)
+void WRF::init_instance(wrf_write_string writer, int receive_buffer_size, int queue_size, int queue_buffer_size)
 {
 	_uart_writer = writer;
+	_uart_segment_writer = NULL;
 	_uart_log = NULL;
-	_queue = new Queue(queue_size);
+	wrf_ctx_init(&_ctx, add_message_to_queue, this);
+	wrf_ctx_init_segments(&_ctx, add_segments_to_queue);
+	wrf_ctx_on_response(&_ctx, handle_response);
+	_queue = new SendQueue(queue_size, queue_buffer_size);
 	_receive_buffer.allocated = receive_buffer_size;
 	_receive_buffer.length = 0;
-	_receive_buffer.data = (char*)malloc(_receive_buffer.allocated);
+	_receive_buffer.data = (char*)wrf_malloc(_receive_buffer.allocated, WRF_ALLOC_RECEIVE_BUFFER);
+	wrf_rx_ring_init(&_rx_ring, NULL, 0);
+	wrf_frame_reset(&_frame);
 	_is_sending = false;
 	_wrf_mode = NORMAL;
 }
@@ -103,8 +327,7 @@ void WRF::setInstance(WRF * new_instance)
 	if (instance)
 		freeInstance();
 	instance = new_instance;
-	wrf_init((wrf_write_string)add_message_to_queue);
-	wrf_on_response(handle_response);
+	wrf_set_default_ctx(&instance->_ctx);
 }
 
 void WRF::set_handle_response_override(pre_handle_response handler)
@@ -112,12 +335,11 @@ void WRF::set_handle_response_override(pre_handle_response handler)
 	response_handler_override = handler;
 }
 
-WRF* WRF::createInstance(wrf_write_string writer, int receive_buffer_size, int queue_size)
+WRF* WRF::createInstance(wrf_write_string writer, int receive_buffer_size, int queue_size, int queue_buffer_size)
 {
 	if (!instance) {
-		instance = new WRF(writer, receive_buffer_size, queue_size);
-		wrf_init((wrf_write_string)add_message_to_queue);
-		wrf_on_response(handle_response);
+		instance = new WRF(writer, receive_buffer_size, queue_size, queue_buffer_size);
+		wrf_set_default_ctx(&instance->_ctx);
 		return instance;
 	}
 	return NULL;
@@ -134,148 +356,455 @@ void WRF::freeInstance()
 	instance = NULL;
 }
 
+WRF* WRF::create(WrfWriter* writer, void* user_data, int receive_buffer_size, int queue_size, int queue_buffer_size)
+{
+	WRF* wrf = new WRF(NULL, receive_buffer_size, queue_size, queue_buffer_size);
+	wrf->_writer = writer;
+	wrf->_user_data = user_data;
+	return wrf;
+}
+
+void* WRF::operator new(size_t size)
+{
+	return wrf_malloc(size, WRF_ALLOC_INSTANCE);
+}
+
+void WRF::operator delete(void* ptr)
+{
+	wrf_free(ptr);
+}
+
+#pragma endregion
+
+#pragma region Trace
+
+#if WRF_TRACE
+void WRF::trace(wrf_trace_type type, int arg)
+{
+	if (!_trace_clock)
+		return;
+
+	wrf_trace_event* event = &_trace[_trace_next];
+	event->time = _trace_clock();
+	event->type = (uint8_t)type;
+	event->reserved = 0;
+	event->arg = (uint16_t)arg;
+
+	_trace_next = (_trace_next + 1) % WRF_TRACE_SIZE;
+	if (_trace_count < WRF_TRACE_SIZE)
+		_trace_count++;
+	else
+		_trace_dropped++;
+}
+
+void WRF::setTraceClock(wrf_trace_clock* clock)
+{
+	_trace_clock = clock;
+}
+
+int WRF::getTrace(wrf_trace_event* dst, int max)
+{
+	int count = _trace_count < max ? _trace_count : max;
+	// The newest count events, oldest first
+	int first = (_trace_next - count + WRF_TRACE_SIZE) % WRF_TRACE_SIZE;
+	for (int i = 0; i < count; i++)
+		dst[i] = _trace[(first + i) % WRF_TRACE_SIZE];
+	return count;
+}
+
+void WRF::dumpTrace(wrf_write_string writer)
+{
+	unsigned char buffer[WRF_TRACE_HEADER_SIZE];
+	wrf_trace_encode_header(buffer, _trace_count, _trace_dropped);
+	writer(buffer, WRF_TRACE_HEADER_SIZE);
+
+	int first = (_trace_next - _trace_count + WRF_TRACE_SIZE) % WRF_TRACE_SIZE;
+	for (int i = 0; i < _trace_count; i++) {
+		wrf_trace_encode_event(buffer, &_trace[(first + i) % WRF_TRACE_SIZE]);
+		writer(buffer, WRF_TRACE_EVENT_SIZE);
+	}
+}
+
+void WRF::clearTrace()
+{
+	_trace_next = 0;
+	_trace_count = 0;
+	_trace_dropped = 0;
+}
+#endif
+
+#pragma endregion
+
+#pragma region Memory
+
+wrf_memory_stats WRF::getMemoryStats()
+{
+	wrf_memory_stats stats;
+	wrf_get_memory_stats(&stats);
+	return stats;
+}
+
+void WRF::resetMemoryPeak()
+{
+	wrf_reset_memory_peak();
+}
+
 #pragma endregion
 
 #pragma region Handle responses and queue
 
-void WRF::handle_response(wrf_result_code code, void * object)
+void WRF::handle_response(wrf_ctx* ctx, wrf_result_code code, void * object)
+{
+	((WRF*)ctx->user_data)->handleResponse(code, object);
+}
+
+bool WRF::preHandleResponse(wrf_result_code code, void * object)
+{
+	return response_handler_override && response_handler_override(code, object);
+}
+
+void WRF::handleResponse(wrf_result_code code, void * object)
 {
-	bool has_been_handeled = false;
-	if (instance->response_handler_override)
-		has_been_handeled = instance->response_handler_override(code, object);
+	if (_response_cb)
+		_response_cb(this, code, object);
 
-	if (!has_been_handeled) {
+	if (!preHandleResponse(code, object)) {
 		bool is_busy = false;
+		// A command that was too long was never sent, so it is not an answer and
+		// may come from any thread that sends
+		bool is_answer = code != WRF_LOCAL_ERROR || ((wrf_error*)object)->code != LIB_ERROR_COMMAND_TOO_LONG;
+		if (is_answer)
+			WRF_TRACE_EVENT(this, WRF_TRACE_PARSE_DONE, code);
 		switch (code)
 		{
 		case WRF_MESSAGE:
-			if (instance->_message_received_cb)
-				instance->_message_received_cb((char*)object);
+			if (_message_parsed_cb)
+				parseMessage((char*)object, _ctx.message_length);
+			if (_message_received_cb)
+				_message_received_cb((char*)object);
 			break;
 		case WRF_LOCAL_ERROR:
 		case WRF_REMOTE_ERROR:
-			if (((wrf_error*)object)->code == WRF_ERROR_NOT_ONLINE && instance->_not_connected_cb)
-				instance->_not_connected_cb();
-			if (instance->_error_cb)
-				instance->_error_cb((wrf_error*)object);
-			if (((wrf_error*)object)->code == WRF_ERROR_SYSTEM_BUSY)
+			if (((wrf_error*)object)->code == WRF_ERROR_NOT_ONLINE && _not_connected_cb)
+				_not_connected_cb();
+			if (_error_cb)
+				_error_cb((wrf_error*)object);
+			if (((wrf_error*)object)->code == WRF_ERROR_SYSTEM_BUSY) {
+				WRF_TRACE_EVENT(this, WRF_TRACE_SYSTEM_BUSY, 0);
 				is_busy = true;
+			}
 			break;
 		case WRF_CONFIG:
-			if (instance->_connect_cb)
-				instance->_connect_cb((wrf_device_state*)object);
+			if (_connect_cb)
+				_connect_cb((wrf_device_state*)object);
 			break;
 		case WRF_STATUS:
-			if (instance->_status_received_cb)
-				instance->_status_received_cb((wrf_status*)object);
+			if (_status_received_cb)
+				_status_received_cb((wrf_status*)object);
 			break;
 		case WRF_SENT:
-			if (instance->_message_sent_cb)
-				instance->_message_sent_cb();
+			if (_message_sent_cb)
+				_message_sent_cb();
 			break;
 		case WRF_UPGRADE_PENDING:
-			if (instance->_pending_upgrades_cb)
-				instance->_pending_upgrades_cb((wrf_module_list*)object);
+			if (_pending_upgrades_cb)
+				_pending_upgrades_cb((wrf_module_list*)object);
 			break;
 		case WRF_TIME:
-			if (instance->_time_cb)
-				instance->_time_cb((wrf_time*)object);
+			if (_time_cb)
+				_time_cb((wrf_time*)object);
 			break;
 
 		case WRF_EMPTY:
 		case WRF_OK:
 			break;
 		case WRF_UPGRADE_PACKAGE:
-			if (instance->_client_packet_cb)
-				instance->_client_packet_cb((ota_packet*)object);
+			if (_client_packet_cb)
+				_client_packet_cb((ota_packet*)object);
+			break;
 		case WRF_FILE_SENT:
-			if (instance->_send_file_cb) {
+			if (_send_file_cb) {
 				wrf_send_file_status status;
 				status.code = code;
 				status.msg = (char*)WRF_RESULT_FILE_SENT_STR;
-				instance->_send_file_cb(&status);
+				_send_file_cb(&status);
 			}
 			break;
 		case WRF_FILE_CANCEL:
-			if (instance->_send_file_cb) {
+			if (_send_file_cb) {
 				wrf_send_file_status status;
 				status.code = code;
 				status.msg = (char*)WRF_RESULT_FILE_CANCEL_STR;
-				instance->_send_file_cb(&status);
+				_send_file_cb(&status);
 			}
 			break;
 		case WRF_SEND_FILE:
 			char* response = (char*)object;
-			instance->max_packet_size = atoi(response);
-			instance->_wrf_mode = FILE_TRANSFER;
-			instance->sendNextFilePacket();
+			startFileTransfer(atoi(response));
 			break;
 		}
-		if (instance->_is_sending && !is_busy && !instance->_queue->empty())
-			instance->_queue->pop();
+		if (!is_answer)
+			return;
+		if (_is_sending && !is_busy && !_queue->empty())
+			_queue->pop();
 		if (is_busy)
-			instance->_is_sending = true; // Keep awaiting response
+			_is_sending = true; // Keep awaiting response
 		else
-			instance->_is_sending = false;
+			_is_sending = false;
+		WRF_TRACE_EVENT(this, WRF_TRACE_CALLBACK, code);
 	}
 }
 
-void WRF::add_message_to_queue(char * msg)
+uint32_t WRF::add_message_to_queue(wrf_ctx* ctx, unsigned char * msg, int length)
+{
+	wrf_segment segment = { msg, length };
+	return add_segments_to_queue(ctx, &segment, 1);
+}
+
+uint32_t WRF::add_segments_to_queue(wrf_ctx* ctx, const wrf_segment* segments, int count)
 {
-	instance->_queue->push(msg);
+	WRF* wrf = (WRF*)ctx->user_data;
+	if (!wrf->_queue->push(segments, count))
+		return 1;
+#if !WRF_QUEUE_MPSC
+	// The trace is written by one thread only, so pushes from other threads are not in it
+	WRF_TRACE_EVENT(wrf, WRF_TRACE_ENQUEUE, wrf->_queue->count());
+#endif
+	return 0;
+}
+
+void WRF::setSegmentWriter(wrf_write_segments writer)
+{
+	_uart_segment_writer = writer;
+}
+
+void WRF::setWriter(WrfWriter* writer)
+{
+	_writer = writer;
+}
+
+void WRF::setUserData(void* user_data)
+{
+	_user_data = user_data;
+}
+
+void* WRF::getUserData()
+{
+	return _user_data;
+}
+
+wrf_ctx* WRF::getContext()
+{
+	return &_ctx;
+}
+
+void WRF::writeSegments(const wrf_segment* segments, int count)
+{
+	if (_writer) {
+		_writer(this, segments, count);
+		return;
+	}
+	if (_uart_segment_writer) {
+		_uart_segment_writer(segments, count);
+		return;
+	}
+	for (int i = 0; i < count; i++)
+		_uart_writer((unsigned char*)segments[i].data, segments[i].length);
 }
 
 void WRF::registerChar(char byte)
 {
-	switch (_wrf_mode) {
-	case NORMAL:
-		_receive_buffer.data[_receive_buffer.length++] = byte;
+	// Most bytes only need storing, which does not need the searches in receiveFrame
+	if (_wrf_mode == NORMAL && byte != (char)WRF_EOT && byte != ETX_CHAR) {
+		if (_receive_buffer.length == 0 && !_receive_overflow)
+			WRF_TRACE_EVENT(this, WRF_TRACE_RX_FIRST, 0);
+		if (_receive_buffer.length + 2 < _receive_buffer.allocated && !_receive_overflow) {
+			_receive_buffer.data[_receive_buffer.length++] = byte;
+			wrf_frame_feed(&_frame, byte);
+		}
+		else
+			_receive_overflow = true;
+	}
+	else
+		registerBytes((const uint8_t*)&byte, 1);
+}
+
+void WRF::registerString(char * str)
+{
+	registerBytes((const uint8_t*)str, strlen(str));
+}
 
-		if (byte == ETX_CHAR && _receive_buffer.length >= 2)
-		{
-			if (_receive_buffer.data[_receive_buffer.length - 2] == STX_CHAR
-				&& _power_up_cb) {
+void WRF::registerBytes(const uint8_t* data, size_t length)
+{
+	const uint8_t* end = data + length;
+	while (data < end) {
+		// A frame can start a file transfer, so the mode is checked per frame
+		if (_wrf_mode == FILE_TRANSFER)
+			receiveFileReply(*data++);
+		else
+			data = receiveFrame(data, end);
+	}
+}
+
+/*	@brief	Takes bytes up to and including the first EOT or ETX, and returns where it stopped. */
+const uint8_t* WRF::receiveFrame(const uint8_t* data, const uint8_t* end)
+{
+	if (_receive_buffer.length == 0 && !_receive_overflow)
+		WRF_TRACE_EVENT(this, WRF_TRACE_RX_FIRST, 0);
+
+	size_t available = end - data;
+	const uint8_t* stop = (const uint8_t*)memchr(data, WRF_EOT, available);
+	const uint8_t* etx = (const uint8_t*)memchr(data, ETX_CHAR, stop ? stop - data : available);
+	if (etx)
+		stop = etx;
+	if (!stop) {
+		appendToFrame(data, available);
+		return end;
+	}
+
+	if (*stop == ETX_CHAR) {
+		bool after_stx = stop > data ? stop[-1] == STX_CHAR
+			: _receive_buffer.length > 0 && _receive_buffer.data[_receive_buffer.length - 1] == STX_CHAR;
+		if (after_stx) {
+			// Power up is not part of a frame
+			_receive_buffer.length = 0;
+			_receive_overflow = false;
+			wrf_frame_reset(&_frame);
+			WRF_TRACE_EVENT(this, WRF_TRACE_POWER_UP, 0);
+			if (_power_up_cb) {
 				_is_sending = false;
 				_power_up_cb();
 			}
-
-		}
-		else if (byte == (char)WRF_EOT)
-		{
-			_receive_buffer.data[_receive_buffer.length] = 0x0;
-			wrf_handle_response(_receive_buffer.data);
-			_receive_buffer.length = 0;
-			_receive_buffer.data[_receive_buffer.length] = 0x0;
-		}
-		break;
-	case FILE_TRANSFER:
-		if (byte == ACK_CHAR) {
-			instance->sendNextFilePacket();
-		}
-		else if (byte == NAK_CHAR) {
-			instance->resendFilePacket();
 		}
-		else if (byte == CAN_CHAR) {
-			instance->abortFileTransfer();
-		}
-		break;
+		else
+			appendToFrame(data, stop - data + 1);
+		return stop + 1;
 	}
+
+	appendToFrame(data, stop - data);
+	endFrame();
+	return stop + 1;
 }
 
-void WRF::registerString(char * str)
+/*	@brief	Stores and parses part of a frame. Room is kept for the EOT and the zero terminator. */
+void WRF::appendToFrame(const uint8_t* data, size_t length)
 {
-	int len = strlen(str);
-	for (int i = 0; i < len; i++)
-		registerChar(str[i]);
+	size_t room = _receive_buffer.allocated - 2 - _receive_buffer.length;
+	if (length > room || _receive_overflow) {
+		_receive_overflow = true;
+		return;
+	}
+
+	memcpy(_receive_buffer.data + _receive_buffer.length, data, length);
+	_receive_buffer.length += length;
+	for (size_t i = 0; i < length; i++)
+		wrf_frame_feed(&_frame, (char)data[i]);
+}
+
+void WRF::endFrame()
+{
+	if (_receive_overflow) {
+		_receive_buffer.length = 0;
+		_receive_overflow = false;
+		wrf_frame_reset(&_frame);
+		wrf_error error = { LIB_ERROR_RECEIVE_OVERFLOW, (char*)LIB_ERROR_RECEIVE_OVERFLOW_STR };
+		handleResponse(WRF_LOCAL_ERROR, &error);
+		return;
+	}
+
+	_receive_buffer.data[_receive_buffer.length++] = WRF_EOT;
+	_receive_buffer.data[_receive_buffer.length] = 0x0;
+	WRF_TRACE_EVENT(this, WRF_TRACE_RX_EOT, _receive_buffer.length);
+	wrf_ctx_handle_frame(&_ctx, &_frame, _receive_buffer.data, _receive_buffer.length - 1);
+	_receive_buffer.length = 0;
+	_receive_buffer.data[_receive_buffer.length] = 0x0;
+}
+
+/*	The tape points into the message, so the callback gets the text and the
+*	values of the one parse.
+*/
+void WRF::parseMessage(const char* msg, size_t length)
+{
+	json_tape tape;
+	if (json_tape_parse(&tape, msg, length, _message_tape, _message_tape_size))
+		_message_parsed_cb(&tape, msg, length, WRF_PARSE_OK);
+	else
+		_message_parsed_cb(NULL, msg, length, tape.too_large ? WRF_PARSE_TOO_LARGE : WRF_PARSE_NOT_JSON);
+}
+
+void WRF::receiveFileReply(uint8_t byte)
+{
+	if (byte == ACK_CHAR) {
+		WRF_TRACE_EVENT(this, WRF_TRACE_FILE_ACK, file_packets[file_packet_current].length);
+		sendNextFilePacket();
+	}
+	else if (byte == NAK_CHAR) {
+		WRF_TRACE_EVENT(this, WRF_TRACE_FILE_NAK, file_packets[file_packet_current].length);
+		resendFilePacket();
+	}
+	else if (byte == CAN_CHAR) {
+		WRF_TRACE_EVENT(this, WRF_TRACE_FILE_CAN, file_packets[file_packet_current].length);
+		abortFileTransfer();
+	}
+}
+
+bool WRF::enableReceiveRing(int size)
+{
+	wrf_free(_rx_ring.data);
+	uint8_t* data = size > 0 ? (uint8_t*)wrf_malloc(size, WRF_ALLOC_RX_RING) : NULL;
+	if (wrf_rx_ring_init(&_rx_ring, data, size))
+		return true;
+
+	wrf_free(data);
+	return false;
+}
+
+bool WRF::registerCharFromISR(char byte)
+{
+	return wrf_rx_ring_push(&_rx_ring, (uint8_t)byte);
+}
+
+int WRF::registerBytesFromISR(const uint8_t* data, int length)
+{
+	return (int)wrf_rx_ring_write(&_rx_ring, data, length);
+}
+
+uint32_t WRF::getReceiveOverflows()
+{
+	return wrf_rx_ring_overflows(&_rx_ring);
+}
+
+void WRF::process()
+{
+	// At most one ring of bytes, so an interrupt that keeps up cannot hold the loop here
+	size_t left = _rx_ring.size;
+	const uint8_t* data;
+	size_t length;
+	while (left > 0 && (length = wrf_rx_ring_peek(&_rx_ring, &data)) > 0) {
+		if (length > left)
+			length = left;
+		registerBytes(data, length);
+		wrf_rx_ring_consume(&_rx_ring, length);
+		left -= length;
+	}
+
+	handleSendQueue();
 }
 
 void WRF::handleSendQueue()
 {
-	if (!_queue->empty() && !instance->_is_sending && instance->_wrf_mode == NORMAL)
+	if (!_queue->empty() && !_is_sending && _wrf_mode == NORMAL)
 	{
-		char* msg = _queue->peek();
-		_uart_writer((unsigned char*)msg, strlen(msg));
-		instance->_is_sending = true;
+		int length;
+		char* msg = _queue->peek(&length);
+		WRF_TRACE_EVENT(this, WRF_TRACE_TX_START, length);
+		if (_writer) {
+			wrf_segment segment = { (const unsigned char*)msg, length };
+			_writer(this, &segment, 1);
+		}
+		else
+			_uart_writer((unsigned char*)msg, length);
+		_is_sending = true;
 	}
 }
 
@@ -300,23 +829,23 @@ bool WRF::isQueueEmpty()
 
 void WRF::send_config(wrf_config &config)
 {
-	wrf_send_config(&config);
+	wrf_ctx_send_config(&_ctx, &config);
 }
 
 
 void WRF::connect()
 {
-	wrf_connect(false);
+	wrf_ctx_connect(&_ctx, false);
 }
 
 void WRF::poll()
 {
-	wrf_receive_message();	
+	wrf_ctx_receive_message(&_ctx);	
 }
 
 void WRF::checkPendingUpgrades()
 {
-	wrf_check_upgrade();
+	wrf_ctx_check_upgrade(&_ctx);
 }
 
 void WRF::startWrfUpgrade()
@@ -327,104 +856,216 @@ void WRF::startWrfUpgrade()
 	params.file_no = 0;
 	params.pin_toggle = (char*)"";
 	params.protocol = PROTOCOL_RAW;
-	wrf_get_upgrade(&params);
+	wrf_ctx_get_upgrade(&_ctx, &params);
 }
 
 void WRF::startClientUpgrade(ota_params & params)
 {
-	wrf_get_upgrade(&params);
+	wrf_ctx_get_upgrade(&_ctx, &params);
 }
 
 void WRF::send(char * raw_string)
 {
-	wrf_send_message(raw_string);
+	wrf_ctx_send_message(&_ctx, raw_string);
 }
 
 void WRF::sendWithoutReceive(char* msg)
 {
-	wrf_send_without_receive(msg);
+	wrf_ctx_send_without_receive(&_ctx, msg);
 }
 
 void WRF::sendCommand(wrf_command cmd, wrf_param * params, int num_params)
 {
-	wrf_send_command(cmd, params, num_params);
+	wrf_ctx_send_command(&_ctx, cmd, params, num_params);
 }
 
 void WRF::sendFile(char* file_name, int file_size, packet_handler handler)
 {
 	this->_packet_handler = handler;
+	this->_file_reader = NULL;
+	this->file_size = file_size;
+	wrf_ctx_init_send_file(&_ctx, file_name, file_size);
+}
+
+void WRF::sendFile(char* file_name, int file_size, file_reader* reader)
+{
+	this->_packet_handler = NULL;
+	this->_file_reader = reader;
 	this->file_size = file_size;
-	wrf_init_send_file(file_name, file_size);
+	wrf_ctx_init_send_file(&_ctx, file_name, file_size);
 }
 
-void WRF::sendFilePacket(bool resend)
+void WRF::startFileTransfer(int max_packet_size)
 {
-	packet_bytes_sent = 0;
-	if (bytes_sent_ack == file_size) {
-		// Complete file sent
-		wrf_send_message((char*)"");
-		bytes_sent_ack = 0;
-		file_size = 0;
-		max_packet_size = 0;
-		instance->_wrf_mode = NORMAL;
+	this->max_packet_size = max_packet_size;
+	_wrf_mode = FILE_TRANSFER;
+	bytes_prepared = 0;
+	bytes_sent_ack = 0;
+	file_packet_current = 0;
+	file_packets_ready = 0;
+	file_packet_on_wire = false;
+	file_packet_requested = false;
+
+	// Handler packets are copied as well, so a handler can reuse its buffer
+	if (file_size > 0) {
+		for (int i = 0; i < WRF_FILE_PACKET_SLOTS; i++)
+			file_packet_buffers[i] = (unsigned char*)wrf_malloc(max_packet_size, WRF_ALLOC_FILE_PACKET);
+		if (!file_packet_buffers[0] || !file_packet_buffers[1]) {
+			abortFileTransfer();
+			return;
+		}
 	}
-	else {
-		// Remaingn data to send
+
+	if (file_size == 0)
+		completeFileTransfer();
+	else
+		prepareFilePackets();
+}
+
+/*	Asks the handler for packets until both slots are filled or the whole file
+*	is prepared.
+*/
+void WRF::prepareFilePackets()
+{
+	while (_wrf_mode == FILE_TRANSFER && !file_packet_requested &&
+		file_packets_ready < WRF_FILE_PACKET_SLOTS && bytes_prepared < file_size)
+	{
 		int packet_size = max_packet_size;
-		int remainig_file_size = file_size - bytes_sent_ack;
+		int remainig_file_size = file_size - bytes_prepared;
 		if (remainig_file_size < max_packet_size)
 			packet_size = remainig_file_size;
 
-		if (resend)
-		{
-			_uart_writer(data_packet, packet_size + WRF_FILE_PACKET_OVERHEAD_SIZE);
-		}
+		file_packet_requested = true;
+		if (_file_reader)
+			readFilePacket(packet_size);
 		else
-		{
 			_packet_handler(packet_size);
+	}
+}
+
+void WRF::readFilePacket(int packet_size)
+{
+	int slot = (file_packet_current + file_packets_ready) % WRF_FILE_PACKET_SLOTS;
+	int length = _file_reader(bytes_prepared, file_packet_buffers[slot], packet_size);
+	if (length <= 0 || length > packet_size) {
+		abortFileTransfer();
+		if (_send_file_cb) {
+			wrf_send_file_status status;
+			status.code = WRF_FILE_CANCEL;
+			status.msg = (char*)WRF_RESULT_FILE_CANCEL_STR;
+			_send_file_cb(&status);
 		}
+		return;
 	}
+	frameFilePacket(file_packet_buffers[slot], length);
 }
 
 void WRF::sendFilePacket(unsigned char* src, int length)
 {
-	data_packet = (unsigned char*)malloc(max_packet_size + WRF_FILE_PACKET_OVERHEAD_SIZE);
-	packet_bytes_sent = length;
-	unsigned int crc = calcCrc(src, length);
-	data_packet[0] = STX_CHAR;
-	memcpy(&data_packet[1], &length, sizeof(int32_t));
-	memcpy(&data_packet[5], src, length);
-	memcpy(&data_packet[length + 5], (char*)&crc, sizeof(int32_t));
-	data_packet[length + 9] = WRF_EOT;
-	_uart_writer(data_packet, length + WRF_FILE_PACKET_OVERHEAD_SIZE);
+	if (!file_packet_requested || length <= 0 || length > max_packet_size)
+		return;
+	int slot = (file_packet_current + file_packets_ready) % WRF_FILE_PACKET_SLOTS;
+	memcpy(file_packet_buffers[slot], src, length);
+	frameFilePacket(file_packet_buffers[slot], length);
+}
+
+void WRF::frameFilePacket(const unsigned char* src, int length)
+{
+	int slot = (file_packet_current + file_packets_ready) % WRF_FILE_PACKET_SLOTS;
+	file_packet* packet = &file_packets[slot];
+	uint32_t crc = crc32_final(crc32_update(crc32_init(), src, length));
+	packet->header[0] = STX_CHAR;
+	memcpy(&packet->header[1], &length, sizeof(int32_t));
+	memcpy(&packet->trailer[0], (char*)&crc, sizeof(int32_t));
+	packet->trailer[4] = WRF_EOT;
+	packet->data = src;
+	packet->length = length;
+
+	bytes_prepared += length;
+	file_packets_ready++;
+	file_packet_requested = false;
+
+	if (!file_packet_on_wire)
+		writeFilePacket();
+	prepareFilePackets();
+}
+
+void WRF::writeFilePacket()
+{
+	file_packet* packet = &file_packets[file_packet_current];
+	wrf_segment segments[3] = {
+		{ packet->header, sizeof(packet->header) },
+		{ packet->data, packet->length },
+		{ packet->trailer, sizeof(packet->trailer) }
+	};
+	file_packet_on_wire = true;
+	WRF_TRACE_EVENT(this, WRF_TRACE_FILE_PACKET, packet->length);
+	writeSegments(segments, 3);
+}
+
+void WRF::completeFileTransfer()
+{
+	wrf_ctx_send_message(&_ctx, (char*)"");
+	bytes_prepared = 0;
+	bytes_sent_ack = 0;
+	file_size = 0;
+	max_packet_size = 0;
+	file_packets_ready = 0;
+	file_packet_on_wire = false;
+	freeFilePacketBuffers();
+	_wrf_mode = NORMAL;
+}
+
+void WRF::freeFilePacketBuffers()
+{
+	for (int i = 0; i < WRF_FILE_PACKET_SLOTS; i++) {
+		wrf_free(file_packet_buffers[i]);
+		file_packet_buffers[i] = NULL;
+	}
 }
 
 void WRF::sendNextFilePacket()
 {
-	free(data_packet);
-	bytes_sent_ack += packet_bytes_sent;
-	sendFilePacket(false);
+	if (!file_packet_on_wire)
+		return;
+
+	file_packet_on_wire = false;
+	bytes_sent_ack += file_packets[file_packet_current].length;
+	file_packet_current = (file_packet_current + 1) % WRF_FILE_PACKET_SLOTS;
+	file_packets_ready--;
+
+	if (file_packets_ready > 0)
+		writeFilePacket();
+	else if (bytes_sent_ack == file_size) {
+		completeFileTransfer();
+		return;
+	}
+	prepareFilePackets();
 }
 
 void WRF::resendFilePacket()
 {
-	sendFilePacket(true);
+	if (file_packet_on_wire)
+		writeFilePacket();
 }
 
 void WRF::abortFileTransfer()
 {
-	free(data_packet);
-	instance->_wrf_mode = NORMAL;
+	file_packets_ready = 0;
+	file_packet_on_wire = false;
+	file_packet_requested = false;
+	freeFilePacketBuffers();
+	_wrf_mode = NORMAL;
 }
 
 void WRF::sendIntrospect(char * introspect)
 {
-	wrf_send_introspect(introspect);
+	wrf_ctx_send_introspect(&_ctx, introspect);
 }
 
 void WRF::setVisibility(int seconds)
 {
-	wrf_set_visible(seconds);
+	wrf_ctx_set_visible(&_ctx, seconds);
 }
 
 void WRF::setVisibility(int seconds, bool trigger_connect_cb)
@@ -442,37 +1083,37 @@ void WRF::setVisibility(int seconds, bool trigger_connect_cb)
 
 void WRF::smartLinkUp(int seconds)
 {
-	wrf_smart_linkup(seconds);
+	wrf_ctx_smart_linkup(&_ctx, seconds);
 }
 
 void WRF::reboot()
 {
-	wrf_reboot();
+	wrf_ctx_reboot(&_ctx);
 }
 
 void WRF::deepSleep(int duration)
 {
-	wrf_deep_sleep( duration);
+	wrf_ctx_deep_sleep(&_ctx, duration);
 }
 
 void WRF::clear()
 {
-	wrf_clear();
+	wrf_ctx_clear(&_ctx);
 }
 
 void WRF::factoryReset()
 {
-	wrf_factory_reset();
+	wrf_ctx_factory_reset(&_ctx);
 }
 
 void WRF::requestStatus()
 {
-	wrf_ask_status();
+	wrf_ctx_ask_status(&_ctx);
 }
 
 void WRF::requestTime()
 {
-	wrf_get_time();
+	wrf_ctx_get_time(&_ctx);
 }
 
 #pragma endregion
@@ -505,6 +1146,16 @@ void WRF::onMessageReceived(WrfMessageReceivedCallback * message_received_cb)
 	_message_received_cb = message_received_cb;
 }
 
+void WRF::onMessageParsed(WrfMessageParsedCallback * message_parsed_cb)
+{
+	_message_parsed_cb = message_parsed_cb;
+	if (message_parsed_cb && !_message_tape) {
+		uint32_t size = (uint32_t)_receive_buffer.allocated / WRF_MESSAGE_TAPE_RATIO + 1;
+		_message_tape = (uint32_t*)wrf_malloc(size * sizeof(uint32_t), WRF_ALLOC_MESSAGE_TAPE);
+		_message_tape_size = _message_tape ? size : 0;
+	}
+}
+
 void WRF::onPendingUpgrades(WrfUpgradeCallback * pending_upgrades_cb)
 {
 	_pending_upgrades_cb = pending_upgrades_cb;
@@ -535,6 +1186,11 @@ void WRF::onTimeReceived(WrfTimeRecevedCallback* time_cb)
 	_time_cb = time_cb;
 }
 
+void WRF::onResponse(WrfResponseCallback* response_cb)
+{
+	_response_cb = response_cb;
+}
+
 #pragma endregion
 
 #pragma endregion
\ No newline at end of file
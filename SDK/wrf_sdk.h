@@ -18,8 +18,11 @@
 *
 *	@brief	WRF01 cpp module and a Queue
 *	
-*	@details This WRF01 cpp module wraps the C parser (@ref wrf.h) into a singelton object
+*	@details This WRF01 cpp module wraps the C parser (@ref wrf.h) into an object
 *			 which is easy to use. It handles the WRF01 and queues messages. 
+*			 Each WRF has its own wrf_ctx, so a program can drive several WRF01
+*			 modules with @ref WRF::create. @ref WRF::createInstance keeps one
+*			 default WRF, which the wrf_ functions of @ref wrf.h go to.
 *			 We strongly recommend tha user of this module to take a look at
 *			 WRF01 serial specification which can be found at
 *			 https://devicedrive.com/downloads/
@@ -40,30 +43,124 @@
 extern "C" {
 #include "wrf.h"
 #include "crc32.h"
+#include "wrf_memory.h"
+#include "wrf_trace.h"
+#include "wrf_rx_ring.h"
+#include "json_tape.h"
 #include "stdlib.h"
 #include "string.h"
 }
+#if WRF_QUEUE_MPSC
+#include <atomic>
+#endif
 
 #pragma region Message Queue
 
+/*	@brief	Bytes reserved for queued messages, including a
+*			WRF_QUEUE_HEADER_SIZE byte header and a zero terminator per message.
+*/
+#ifndef WRF_QUEUE_BUFFER_SIZE
+#define WRF_QUEUE_BUFFER_SIZE 2048
+#endif
+
+#define WRF_QUEUE_HEADER_SIZE 2
+
+/*	@brief	Bytes of receive buffer per tape entry for @ref WRF::onMessageParsed. A cloud
+*			message takes about one entry per 7 characters, and no JSON more than one
+*			per 2, so 2 parses every message that fits the receive buffer.
+*/
+#ifndef WRF_MESSAGE_TAPE_RATIO
+#define WRF_MESSAGE_TAPE_RATIO 4
+#endif
+
+/*	@brief	Queue of messages stored back to back in one ring of bytes.
+*
+*	@details Each message is kept contiguous behind a length header, so it can be
+*			 written to the UART straight from the ring. A message that does not fit
+*			 before the end of the ring starts over at the beginning.
+*/
 class Queue
 {
 private:
 	int _count;
 	int _size;
+	int _capacity;
 	int _first, _last;
-	char** _data;
+	char* _data;
+
+	int recordSize(int length);
+	int readLength(int offset);
+	void writeLength(int offset, int length);
+	char* reserve(int length);
 public:
-	Queue(int max_queue_size);
+	Queue(int max_queue_size, int capacity = WRF_QUEUE_BUFFER_SIZE);
 	~Queue();
 
+	static void* operator new(size_t size);
+	static void operator delete(void* ptr);
+
+	bool push(char* str);
+	bool push(const wrf_segment* segments, int count);
+	char* peek();
+	char* peek(int* length);
+	void pop();
+	void clear();
+	bool empty();
+	int count();
+};
+
+#if WRF_QUEUE_MPSC
+/*	@brief	Queue of messages that any number of threads can push to at once, while
+*			one thread, the one running handleSendQueue, takes them out.
+*
+*	@details Messages go in fixed slots of capacity / max_queue_size bytes, a zero
+*			 terminator included, so a push never waits for another one: room is
+*			 taken from a counter of free slots, a slot from a ticket counter, and
+*			 the slot is marked ready when the message is copied in. Messages are
+*			 sent in ticket order. The number of slots is rounded up to a power of
+*			 2, so up to twice the capacity can be allocated.
+*/
+class MpscQueue
+{
+private:
+	struct Slot {
+		std::atomic<uint32_t> sequence;		// Ticket + 1 when ready, the next ticket for it when free
+		int length;
+	};
+
+	std::atomic<int> _free;
+	std::atomic<uint32_t> _tail;
+	uint32_t _head;							// Only used by the consumer
+	uint32_t _mask;
+	int _size;
+	int _slot_size;
+	int _stride;
+	char* _data;
+
+	Slot* slot(uint32_t ticket);
+	char* reserve(int length, uint32_t* ticket);
+	void publish(uint32_t ticket, int length);
+public:
+	MpscQueue(int max_queue_size, int capacity = WRF_QUEUE_BUFFER_SIZE);
+	~MpscQueue();
+
+	static void* operator new(size_t size);
+	static void operator delete(void* ptr);
+
 	bool push(char* str);
+	bool push(const wrf_segment* segments, int count);
 	char* peek();
+	char* peek(int* length);
 	void pop();
 	void clear();
 	bool empty();
 	int count();
 };
+
+typedef MpscQueue SendQueue;
+#else
+typedef Queue SendQueue;
+#endif
 #pragma endregion
 
 #pragma region Buffer
@@ -84,6 +181,16 @@ typedef struct {
 	int sent_bytes;
 }send_file_file_struct;
 
+/*	@brief	A framed file packet: STX, length, payload, CRC32 and EOT. */
+typedef struct {
+	unsigned char header[5];
+	unsigned char trailer[5];
+	const unsigned char* data;
+	int length;
+}file_packet;
+
+#define WRF_FILE_PACKET_SLOTS 2
+
 #pragma endregion
 
 #pragma region Emums
@@ -93,17 +200,30 @@ enum wrf_operating_mode {
 	FILE_TRANSFER
 };
 
+enum wrf_parse_result {
+	WRF_PARSE_OK,
+	WRF_PARSE_NOT_JSON,
+	WRF_PARSE_TOO_LARGE			// More values, keys or nesting than the tape holds
+};
+
 #pragma endregion
 
 #define ACK_CHAR ((char)0x06)
 #define NAK_CHAR ((char)0x15)
 #define CAN_CHAR ((char)0x18)
 
+#if WRF_TRACE
+#define WRF_TRACE_EVENT(wrf, type, arg) (wrf)->trace(type, arg)
+#else
+#define WRF_TRACE_EVENT(wrf, type, arg) ((void)0)
+#endif
+
 
 #pragma region Callback definitions
 typedef void WrfCallback();
 typedef void WrfErrorCallback(wrf_error *error);
 typedef void WrfMessageReceivedCallback(char* msg);
+typedef void WrfMessageParsedCallback(const json_tape* message, const char* raw, size_t length, wrf_parse_result result);
 typedef void WrfUpgradeCallback(wrf_module_list* list);
 typedef void WrfConnectCallback(wrf_device_state* state);
 typedef void WrfStatusReceivedCallback(wrf_status* status);
@@ -133,6 +253,36 @@ typedef bool pre_handle_response(wrf_result_code code, void * object);
 *	@param		max_length	Maximum length of data that can be written to wrf
 */
 typedef void packet_handler(int max_length);
+
+/*	@brief		Function signature for reading the file during file sending.
+*
+*	@details	Called with the offset of the next packet every time there is room
+*				for one, so the file can be read in parts from flash, an SD card or
+*				anything else instead of being held in RAM.
+*
+*	@param		offset		Position in the file to read from.
+*	@param		dst			Where to put the data.
+*	@param		max_length	Maximum number of bytes to read.
+*
+*	@retval		Number of bytes read. 0 or less cancels the transfer.
+*/
+typedef int file_reader(int offset, unsigned char* dst, int max_length);
+
+class WRF;
+
+/*	@brief		Function signature for writing to the WRF01 of @ref wrf.
+*
+*	@details	Used by WRFs made with @ref WRF::create, so one function can serve
+*				the UARTs of several WRF01 modules. The segments must be written in
+*				order, as one continuous message.
+*/
+typedef uint32_t WrfWriter(WRF* wrf, const wrf_segment* segments, int count);
+
+/*	@brief		Function signature for getting every response of @ref wrf, before the
+*				callback for its kind. See @ref WRF::onResponse.
+*/
+typedef void WrfResponseCallback(WRF* wrf, wrf_result_code code, void* object);
+
 class WRF {
 
 protected:
@@ -141,6 +291,9 @@ protected:
 	WrfCallback* _not_connected_cb = NULL;
 	WrfCallback* _power_up_cb = NULL;
 	WrfMessageReceivedCallback* _message_received_cb = NULL;
+	WrfMessageParsedCallback* _message_parsed_cb = NULL;
+	uint32_t* _message_tape = NULL;		// Entries for @ref onMessageParsed, allocated with it
+	uint32_t _message_tape_size = 0;
 	WrfErrorCallback* _error_cb = NULL;
 	WrfConnectCallback* _connect_cb = NULL;
 	WrfStatusReceivedCallback* _status_received_cb = NULL;
@@ -149,51 +302,161 @@ protected:
 	WRFClientPacketCallback* _client_packet_cb = NULL;
 	pre_handle_response* response_handler_override = NULL;
 	packet_handler* _packet_handler = NULL;
+	file_reader* _file_reader = NULL;
 	WrfTimeRecevedCallback* _time_cb = NULL;
+	WrfResponseCallback* _response_cb = NULL;
 	
 	wrf_write_string _uart_writer;
+	wrf_write_segments _uart_segment_writer;
 	wrf_write_string _uart_log;
+	WrfWriter* _writer = NULL;
+	void* _user_data = NULL;
+
+	wrf_ctx _ctx;
 
 	buffer _receive_buffer;
-	Queue* _queue;
+	wrf_rx_ring _rx_ring;
+	wrf_frame _frame;
+	SendQueue* _queue;
 	bool _is_sending;
 	static WRF *instance;
 
 	WRF();
-	WRF(wrf_write_string writer, int receive_buffer_size, int queue_size);
-	~WRF();
+	WRF(wrf_write_string writer, int receive_buffer_size, int queue_size, int queue_buffer_size);
 
-	void init_instance(wrf_write_string writer, int receive_buffer_size, int queue_size);
+	void init_instance(wrf_write_string writer, int receive_buffer_size, int queue_size, int queue_buffer_size = WRF_QUEUE_BUFFER_SIZE);
 	void set_handle_response_override(pre_handle_response handler);
 
 	static void setInstance(WRF* instance);
-	static void handle_response(wrf_result_code code, void* object);
-	static void add_message_to_queue(char* msg);
+	static void handle_response(wrf_ctx* ctx, wrf_result_code code, void* object);
+	static uint32_t add_message_to_queue(wrf_ctx* ctx, unsigned char* msg, int length);
+	static uint32_t add_segments_to_queue(wrf_ctx* ctx, const wrf_segment* segments, int count);
+
+	void handleResponse(wrf_result_code code, void* object);
+	/*	@brief	Sees every response first, like the handler set with @ref set_handle_response_override.
+	*
+	*	@retval	true if the WRF should not handle it.
+	*/
+	virtual bool preHandleResponse(wrf_result_code code, void* object);
+	void writeSegments(const wrf_segment* segments, int count);
+
+#if WRF_TRACE
+	wrf_trace_event _trace[WRF_TRACE_SIZE];
+	int _trace_next = 0;
+	int _trace_count = 0;
+	uint32_t _trace_dropped = 0;
+	wrf_trace_clock* _trace_clock = NULL;
+
+	void trace(wrf_trace_type type, int arg);
+#endif
 
 private:
 	wrf_operating_mode _wrf_mode;
-
-	unsigned char *data_packet = NULL;
-
-	int packet_bytes_sent = 0;
+	bool _receive_overflow = false;		// Dropping the rest of a frame that did not fit
+
+	const uint8_t* receiveFrame(const uint8_t* data, const uint8_t* end);
+	void appendToFrame(const uint8_t* data, size_t length);
+	void endFrame();
+	void receiveFileReply(uint8_t byte);
+	void parseMessage(const char* msg, size_t length);
+
+	/*	While one packet waits for ACK, the next one is already framed in the other
+	*	slot, so an ACK only has to start writing it.
+	*/
+	file_packet file_packets[WRF_FILE_PACKET_SLOTS];
+	int file_packet_current = 0;		// Slot of the packet on the wire or next to go
+	int file_packets_ready = 0;			// Framed packets, starting at file_packet_current
+	bool file_packet_on_wire = false;
+	bool file_packet_requested = false;	// Waiting for sendFilePacket from the handler
+
+	unsigned char* file_packet_buffers[WRF_FILE_PACKET_SLOTS] = { NULL };
+
+	int bytes_prepared = 0;
 	int bytes_sent_ack = 0;
 	int file_size = 0;
 	int max_packet_size = 0;
 
-	void sendFilePacket(bool resend);
+	void startFileTransfer(int max_packet_size);
+	void prepareFilePackets();
+	void readFilePacket(int packet_size);
+	void frameFilePacket(const unsigned char* src, int length);
+	void freeFilePacketBuffers();
+	void writeFilePacket();
+	void completeFileTransfer();
 	void sendNextFilePacket();
 	void resendFilePacket();
 	void abortFileTransfer();
 
 public :
-	static WRF* createInstance(wrf_write_string writer, int receive_buffer_size, int queue_size);
+	static WRF* createInstance(wrf_write_string writer, int receive_buffer_size, int queue_size, int queue_buffer_size = WRF_QUEUE_BUFFER_SIZE);
 	static WRF* getInstance();
 	static void freeInstance();
 
-	//void set_uart_buffer_writer(wrf_write_buffer writer);
+	/*	@brief	Makes a WRF for one more WRF01, beside the instance. Free it with delete.
+	*
+	*	@note	@ref writer is given the WRF, find the UART with @ref getUserData.
+	*			Callbacks without a WRF parameter can not tell the WRFs apart, so
+	*			use @ref onResponse, or different callbacks per WRF.
+	*/
+	static WRF* create(WrfWriter* writer, void* user_data, int receive_buffer_size, int queue_size, int queue_buffer_size = WRF_QUEUE_BUFFER_SIZE);
+	virtual ~WRF();
+
+	/*	@brief	The WRF, its buffers and queue are allocated through @ref wrf_malloc. */
+	static void* operator new(size_t size);
+	static void operator delete(void* ptr);
+
+#if WRF_TRACE
+	/*	@brief	Starts tracing, every event is stamped with @ref clock. NULL stops it. */
+	void setTraceClock(wrf_trace_clock* clock);
+	/*	@brief	Copies up to @ref max events to @ref dst, oldest first, and returns how many. */
+	int getTrace(wrf_trace_event* dst, int max);
+	/*	@brief	Writes the trace in the dump format of @ref wrf_trace.h. */
+	void dumpTrace(wrf_write_string writer);
+	void clearTrace();
+#endif
+
+	/*	@brief	Heap the SDK holds now and the most it has held, see @ref wrf_memory.h. */
+	static wrf_memory_stats getMemoryStats();
+	static void resetMemoryPeak();
+
+	void setSegmentWriter(wrf_write_segments writer);
+	/*	@brief	Writes with @ref writer instead of the wrf_write_string and segment writer. */
+	void setWriter(WrfWriter* writer);
+	void setUserData(void* user_data);
+	void* getUserData();
+	/*	@brief	The context for calling the wrf_ctx_ functions of @ref wrf.h on this WRF. */
+	wrf_ctx* getContext();
 
 	void registerChar(char byte);
 	void registerString(char* str);
+	/*	@brief	Takes any number of received bytes at once, e.g. all a UART FIFO holds.
+	*
+	*	@note	A frame longer than the receive buffer, less two bytes for EOT and a
+	*			zero terminator, is dropped and reported as LIB_ERROR_RECEIVE_OVERFLOW
+	*			when its EOT arrives.
+	*/
+	void registerBytes(const uint8_t* data, size_t length);
+
+	/*	@brief	Lets a UART interrupt hand over received bytes with @ref registerCharFromISR.
+	*			@ref size bytes are allocated for the ring, and must be a power of 2.
+	*
+	*	@note	Call it before the interrupt is enabled. Bytes are then parsed in
+	*			@ref process, and should not be given to @ref registerChar as well.
+	*/
+	bool enableReceiveRing(int size);
+	/*	@brief	Safe to call from one interrupt. Only stores the byte, a full ring drops it.
+	*
+	*	@retval	false if the byte was dropped, see @ref getReceiveOverflows.
+	*/
+	bool registerCharFromISR(char byte);
+	/*	@brief	Same as @ref registerCharFromISR, for a UART that hands over several bytes. */
+	int registerBytesFromISR(const uint8_t* data, int length);
+	/*	@brief	Bytes an interrupt could not store since @ref enableReceiveRing. */
+	uint32_t getReceiveOverflows();
+	/*	@brief	The main loop step: parses what the interrupt received and sends the
+	*			next queued message. Callbacks are run from here.
+	*/
+	void process();
 	void handleSendQueue();
 	int getQueueCount();
 	void clearQueue();
@@ -212,7 +475,11 @@ public :
 	void sendWithoutReceive(char* msg);
 	void sendCommand(wrf_command cmd, wrf_param* params, int num_params);
 
+	/*	@note	Two buffers of the maximum packet size are allocated while the file is sent. */
 	void sendFile(char* file_name, int file_size, packet_handler handler); 
+	/*	@note	Two buffers of the maximum packet size are allocated while the file is sent. */
+	void sendFile(char* file_name, int file_size, file_reader* reader);
+	/*	@note	@ref src is copied, so it can be reused as soon as this returns. */
 	void sendFilePacket(unsigned char* src, int length);
 
 	void sendIntrospect(char* introspect);
@@ -232,6 +499,15 @@ public :
 	
 	void onPowerUp(WrfCallback *power_up_cb); 
 	void onMessageReceived(WrfMessageReceivedCallback *message_received_cb);
+	/*	@brief	Called with each message from the cloud parsed onto a tape, see
+	*			@ref json_tape.h, and its text without EOT. Both are valid until the
+	*			callback returns. The tape is NULL unless the result is WRF_PARSE_OK:
+	*			WRF_PARSE_TOO_LARGE if the message has more values and keys than one
+	*			per WRF_MESSAGE_TAPE_RATIO bytes of receive buffer, or is nested
+	*			deeper than JSON_TAPE_MAX_DEPTH. Called before the callback of
+	*			@ref onMessageReceived. The tape is allocated on the first call.
+	*/
+	void onMessageParsed(WrfMessageParsedCallback *message_parsed_cb);
 	void onPendingUpgrades(WrfUpgradeCallback *pending_upgrades_cb);
 	void onNotConnected(WrfCallback *not_connected_cb);
 	void onStatusReceived(WrfStatusReceivedCallback *status_received_cb);
@@ -239,4 +515,6 @@ public :
 
 	void onReceivedClientUpgrade(WRFClientPacketCallback* client_packet_cb);
 	void onTimeReceived(WrfTimeRecevedCallback* time_cb);
+	/*	@brief	Called with every response, before the callback for its kind. */
+	void onResponse(WrfResponseCallback* response_cb);
 };
\ No newline at end of file
@@ -0,0 +1,85 @@
+/*	Copyright 2017 DeviceDrive AS
+*
+*	Licensed under the Apache License, Version 2.0 (the "License");
+*	you may not use this file except in compliance with the License.
+*	You may obtain a copy of the License at
+*
+*	http ://www.apache.org/licenses/LICENSE-2.0
+*
+*	Unless required by applicable law or agreed to in writing, software
+*	distributed under the License is distributed on an "AS IS" BASIS,
+*	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*	See the License for the specific language governing permissions and
+*	limitations under the License.
+*
+*/
+
+#include "wrf_trace.h"
+#include <string.h>
+
+static const char* const _event_names[WRF_TRACE_EVENT_TYPES] = {
+#define WRF_TRACE_EVENT_NAME(NAME, DESCRIPTION, ARG) DESCRIPTION,
+	WRF_TRACE_EVENT_LIST(WRF_TRACE_EVENT_NAME)
+#undef WRF_TRACE_EVENT_NAME
+};
+
+static void write16(unsigned char* dst, uint16_t value)
+{
+	dst[0] = (unsigned char)value;
+	dst[1] = (unsigned char)(value >> 8);
+}
+
+static void write32(unsigned char* dst, uint32_t value)
+{
+	write16(dst, (uint16_t)value);
+	write16(dst + 2, (uint16_t)(value >> 16));
+}
+
+static uint16_t read16(const unsigned char* src)
+{
+	return (uint16_t)(src[0] | (src[1] << 8));
+}
+
+static uint32_t read32(const unsigned char* src)
+{
+	return read16(src) | ((uint32_t)read16(src + 2) << 16);
+}
+
+void wrf_trace_encode_header(unsigned char* dst, int count, uint32_t dropped)
+{
+	memcpy(dst, WRF_TRACE_MAGIC, 4);
+	dst[4] = WRF_TRACE_VERSION;
+	dst[5] = WRF_TRACE_EVENT_SIZE;
+	write16(dst + 6, (uint16_t)count);
+	write32(dst + 8, dropped);
+}
+
+int wrf_trace_decode_header(const unsigned char* src, uint32_t* dropped)
+{
+	if (memcmp(src, WRF_TRACE_MAGIC, 4) != 0 || src[4] != WRF_TRACE_VERSION || src[5] != WRF_TRACE_EVENT_SIZE)
+		return -1;
+	if (dropped)
+		*dropped = read32(src + 8);
+	return read16(src + 6);
+}
+
+void wrf_trace_encode_event(unsigned char* dst, const wrf_trace_event* event)
+{
+	write32(dst, event->time);
+	dst[4] = event->type;
+	dst[5] = 0;
+	write16(dst + 6, event->arg);
+}
+
+void wrf_trace_decode_event(const unsigned char* src, wrf_trace_event* event)
+{
+	event->time = read32(src);
+	event->type = src[4];
+	event->reserved = 0;
+	event->arg = read16(src + 6);
+}
+
+const char* wrf_trace_event_name(int type)
+{
+	return type >= 0 && type < WRF_TRACE_EVENT_TYPES ? _event_names[type] : "unknown";
+}
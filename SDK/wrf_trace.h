@@ -0,0 +1,106 @@
+/*	Copyright 2017 DeviceDrive AS
+*
+*	Licensed under the Apache License, Version 2.0 (the "License");
+*	you may not use this file except in compliance with the License.
+*	You may obtain a copy of the License at
+*
+*	http ://www.apache.org/licenses/LICENSE-2.0
+*
+*	Unless required by applicable law or agreed to in writing, software
+*	distributed under the License is distributed on an "AS IS" BASIS,
+*	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*	See the License for the specific language governing permissions and
+*	limitations under the License.
+*
+*/
+
+/**@file
+*
+*	@brief		Protocol event trace
+*	@details	With WRF_TRACE set to 1 the WRF keeps the last WRF_TRACE_SIZE protocol
+*				events in a ring, each stamped with a clock given by the application.
+*				A dump of the ring can be turned into the time every message spent
+*				in the queue, on the link and in the WRF01, in parsing and in the
+*				callbacks with SDK.HOST/trace/wrf_trace_decode.
+*
+*				With WRF_TRACE 0, the default, the trace is left out of the build.
+*
+*	@note		Dump format, all numbers little endian:
+*				"WRFT", version, event size, count (2 bytes), dropped (4 bytes),
+*				then count events of time (4 bytes), type, 0, arg (2 bytes),
+*				oldest first.
+*/
+
+#ifndef WRF_TRACE_H__
+#define WRF_TRACE_H__
+
+#include <stdint.h>
+
+#ifndef WRF_TRACE
+#define WRF_TRACE 0
+#endif
+
+/*	@brief	Number of events kept, older events are overwritten. */
+#ifndef WRF_TRACE_SIZE
+#define WRF_TRACE_SIZE 64
+#endif
+
+#define WRF_TRACE_MAGIC "WRFT"
+#define WRF_TRACE_VERSION 1
+#define WRF_TRACE_HEADER_SIZE 12
+#define WRF_TRACE_EVENT_SIZE 8
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*	X(NAME, DESCRIPTION, ARG) */
+#define WRF_TRACE_EVENT_LIST(X)																\
+	X(ENQUEUE,		"enqueue",		"messages in the queue")								\
+	X(TX_START,		"tx start",		"message length")										\
+	X(RX_FIRST,		"rx first",		"0")													\
+	X(RX_EOT,		"rx eot",		"frame length")											\
+	X(PARSE_DONE,	"parse done",	"wrf_result_code")										\
+	X(CALLBACK,		"callback",		"wrf_result_code, after the callback returned")			\
+	X(SYSTEM_BUSY,	"system busy",	"0")													\
+	X(POWER_UP,		"power up",		"0")													\
+	X(FILE_PACKET,	"file packet",	"packet length")										\
+	X(FILE_ACK,		"file ack",		"packet length")										\
+	X(FILE_NAK,		"file nak",		"packet length")										\
+	X(FILE_CAN,		"file can",		"packet length")										\
+
+typedef enum {
+#define WRF_TRACE_EVENT_ENUM(NAME, DESCRIPTION, ARG) WRF_TRACE_##NAME,
+	WRF_TRACE_EVENT_LIST(WRF_TRACE_EVENT_ENUM)
+#undef WRF_TRACE_EVENT_ENUM
+	WRF_TRACE_EVENT_TYPES
+}wrf_trace_type;
+
+typedef struct {
+	uint32_t time;
+	uint8_t type;		// wrf_trace_type
+	uint8_t reserved;
+	uint16_t arg;
+}wrf_trace_event;
+
+/*	@brief	Time stamp source, for example micros() on Arduino. */
+typedef uint32_t wrf_trace_clock();
+
+/*	@brief	Writes the dump header to @ref dst, WRF_TRACE_HEADER_SIZE bytes. */
+void wrf_trace_encode_header(unsigned char* dst, int count, uint32_t dropped);
+
+/*	@brief	Reads a dump header, returns the number of events or -1 if it is not one. */
+int wrf_trace_decode_header(const unsigned char* src, uint32_t* dropped);
+
+/*	@brief	Writes one event to @ref dst, WRF_TRACE_EVENT_SIZE bytes. */
+void wrf_trace_encode_event(unsigned char* dst, const wrf_trace_event* event);
+
+void wrf_trace_decode_event(const unsigned char* src, wrf_trace_event* event);
+
+const char* wrf_trace_event_name(int type);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
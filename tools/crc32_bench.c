@@ -0,0 +1,130 @@
+/*	Copyright 2017 DeviceDrive AS
+*
+*	Licensed under the Apache License, Version 2.0 (the "License");
+*	you may not use this file except in compliance with the License.
+*	You may obtain a copy of the License at
+*
+*	http ://www.apache.org/licenses/LICENSE-2.0
+*
+*	Unless required by applicable law or agreed to in writing, software
+*	distributed under the License is distributed on an "AS IS" BASIS,
+*	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+*	See the License for the specific language governing permissions and
+*	limitations under the License.
+*
+*/
+
+/*	Host benchmark of the CRC32 variants in SDK/crc32.c against the table per call
+*	implementation it replaced. Build and run on a POSIX host:
+*
+*		cc -O2 -DCRC32_SLICES=8 -ISDK tools/crc32_bench.c SDK/crc32.c -o crc32_bench
+*		./crc32_bench [packet size] [megabytes]
+*/
+
+#include "crc32.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#if CRC32_SLICES != 8
+#error "Build the benchmark with -DCRC32_SLICES=8 to compare all variants"
+#endif
+
+typedef uint32_t(*crc_function)(unsigned char* buffer, int size);
+
+/*	The implementation before the static tables: builds the table on every call. */
+static uint32_t legacy_calc_crc(unsigned char* buffer, int size)
+{
+	unsigned int* crc_table = (unsigned int*)malloc(256 * 4);
+	for (unsigned int i = 0; i < 256; i++) {
+		unsigned int c = i;
+		for (int j = 0; j < 8; j++)
+			c = (c & 1) ? 0xedb88320L ^ (c >> 1) : c >> 1;
+		crc_table[i] = c;
+	}
+	unsigned int crc = crc32(0xffffffff, crc_table, buffer, size);
+	free(crc_table);
+	return ~crc;
+}
+
+static uint32_t slice1(unsigned char* buffer, int size)
+{
+	return crc32_final(crc32_update_slice1(crc32_init(), buffer, size));
+}
+
+static uint32_t slice4(unsigned char* buffer, int size)
+{
+	return crc32_final(crc32_update_slice4(crc32_init(), buffer, size));
+}
+
+static uint32_t slice8(unsigned char* buffer, int size)
+{
+	return crc32_final(crc32_update_slice8(crc32_init(), buffer, size));
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char** argv)
+{
+	int packet_size = argc > 1 ? atoi(argv[1]) : 1024;
+	int megabytes = argc > 2 ? atoi(argv[2]) : 64;
+	if (packet_size <= 0 || megabytes <= 0) {
+		fprintf(stderr, "usage: %s [packet size] [megabytes]\n", argv[0]);
+		return 1;
+	}
+
+	static const struct {
+		const char* name;
+		crc_function function;
+	}variants[] = {
+		{ "table per call", legacy_calc_crc },
+		{ "slice-by-1", slice1 },
+		{ "slice-by-4", slice4 },
+		{ "slice-by-8", slice8 },
+	};
+	const int num_variants = sizeof(variants) / sizeof(variants[0]);
+
+	unsigned char check[] = "123456789";
+	unsigned char* buffer = (unsigned char*)malloc(packet_size);
+	for (int i = 0; i < packet_size; i++)
+		buffer[i] = (unsigned char)(i * 131 + 7);
+
+	uint32_t expected = legacy_calc_crc(buffer, packet_size);
+	for (int v = 0; v < num_variants; v++) {
+		if (variants[v].function(check, 9) != 0xCBF43926 || variants[v].function(buffer, packet_size) != expected) {
+			fprintf(stderr, "%s gives a wrong checksum\n", variants[v].name);
+			return 1;
+		}
+	}
+
+	// Feeding in odd sized parts must give the same result
+	uint32_t crc = crc32_init();
+	for (int offset = 0; offset < packet_size; offset += 7)
+		crc = crc32_update(crc, buffer + offset, packet_size - offset < 7 ? packet_size - offset : 7);
+	if (crc32_final(crc) != expected) {
+		fprintf(stderr, "crc32_update in parts gives a wrong checksum\n");
+		return 1;
+	}
+
+	long iterations = (long)megabytes * 1024 * 1024 / packet_size;
+	if (iterations < 1)
+		iterations = 1;
+	printf("%d byte packets, %ld packets per variant\n", packet_size, iterations);
+
+	volatile uint32_t sink = 0;
+	for (int v = 0; v < num_variants; v++) {
+		double start = now();
+		for (long i = 0; i < iterations; i++)
+			sink ^= variants[v].function(buffer, packet_size);
+		double seconds = now() - start;
+		printf("%-16s %10.1f MB/s\n", variants[v].name, iterations * (double)packet_size / seconds / (1024 * 1024));
+	}
+
+	free(buffer);
+	return 0;
+}
@@ -0,0 +1,76 @@
+#!/usr/bin/env python3
+#	Copyright 2017 DeviceDrive AS
+#
+#	Licensed under the Apache License, Version 2.0 (the "License");
+#	you may not use this file except in compliance with the License.
+#	You may obtain a copy of the License at
+#
+#	http ://www.apache.org/licenses/LICENSE-2.0
+#
+#	Unless required by applicable law or agreed to in writing, software
+#	distributed under the License is distributed on an "AS IS" BASIS,
+#	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#	See the License for the specific language governing permissions and
+#	limitations under the License.
+
+"""Generates SDK/crc32_table.h, the lookup tables of the slice-by-N CRC32 in
+SDK/crc32.c. Row k holds the CRC of a byte followed by k zero bytes.
+
+    python3 tools/crc32_table.py
+"""
+
+import os
+
+SDK = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "SDK")
+POLYNOMIAL = 0xEDB88320
+ROWS = 8
+
+
+def crc_byte(c):
+	for _ in range(8):
+		c = (c >> 1) ^ POLYNOMIAL if c & 1 else c >> 1
+	return c
+
+
+def tables():
+	rows = [[crc_byte(i) for i in range(256)]]
+	for _ in range(1, ROWS):
+		prev = rows[-1]
+		rows.append([(v >> 8) ^ rows[0][v & 0xFF] for v in prev])
+	return rows
+
+
+def write_row(out, row):
+	out.append("\t{")
+	for i in range(0, 256, 8):
+		out.append("\t\t" + ", ".join("0x%08X" % v for v in row[i:i + 8]) + ",")
+	out.append("\t},")
+
+
+def main():
+	rows = tables()
+	out = [
+		"/*\tGenerated by tools/crc32_table.py, do not edit. */",
+		"",
+		"#ifndef CRC32_TABLE_H__",
+		"#define CRC32_TABLE_H__",
+		"",
+		"static const uint32_t crc32_table[CRC32_SLICES][256] = {",
+	]
+	write_row(out, rows[0])
+	out.append("#if CRC32_SLICES >= 4")
+	for row in rows[1:4]:
+		write_row(out, row)
+	out.append("#endif")
+	out.append("#if CRC32_SLICES >= 8")
+	for row in rows[4:8]:
+		write_row(out, row)
+	out.append("#endif")
+	out += ["};", "", "#endif", ""]
+
+	with open(os.path.join(SDK, "crc32_table.h"), "w", newline="\n") as f:
+		f.write("\n".join(out))
+
+
+if __name__ == "__main__":
+	main()
@@ -0,0 +1,102 @@
+#!/usr/bin/env python3
+#	Copyright 2017 DeviceDrive AS
+#
+#	Licensed under the Apache License, Version 2.0 (the "License");
+#	you may not use this file except in compliance with the License.
+#	You may obtain a copy of the License at
+#
+#	http ://www.apache.org/licenses/LICENSE-2.0
+#
+#	Unless required by applicable law or agreed to in writing, software
+#	distributed under the License is distributed on an "AS IS" BASIS,
+#	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+#	See the License for the specific language governing permissions and
+#	limitations under the License.
+
+"""Generates SDK/wrf_keywords_table.h from the keyword list in SDK/wrf_keywords.h.
+
+Finds multipliers for the hash in wrf_keywords.c that give every keyword its
+own slot. Run it from anywhere after adding, removing or renaming a keyword:
+
+    python3 tools/wrf_keywords.py
+"""
+
+import os
+import re
+import sys
+
+SDK = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "SDK")
+
+
+def read_strings():
+	strings = {}
+	with open(os.path.join(SDK, "wrf.h")) as f:
+		for m in re.finditer(r'#define\s+(\w+)\s+"([^"]*)"', f.read()):
+			strings[m.group(1)] = m.group(2)
+	return strings
+
+
+def read_keywords(strings):
+	with open(os.path.join(SDK, "wrf_keywords.h")) as f:
+		text = f.read()
+	keywords = []
+	for m in re.finditer(r'X\((\w+),\s*(\w+_STR),\s*(\w+),\s*(\w+)\)', text):
+		keywords.append((m.group(1), strings[m.group(2)]))
+	return keywords
+
+
+def keyword_hash(s, a, b, c, slots):
+	n = len(s)
+	return (n * a + ord(s[0]) * b + ord(s[n - 1]) * c + ord(s[n // 2])) & (slots - 1)
+
+
+def strings_hash(keywords):
+	"""FNV-1a over the strings in list order, each with its zero terminator."""
+	h = 2166136261
+	for _, s in keywords:
+		for byte in s.encode() + b"\0":
+			h = ((h ^ byte) * 16777619) & 0xFFFFFFFF
+	return h
+
+
+def search(keywords):
+	slots = 32
+	while slots < 1024:
+		if slots >= len(keywords):
+			for a in range(1, 64):
+				for b in range(1, 64):
+					for c in range(1, 64):
+						used = set(keyword_hash(s, a, b, c, slots) for _, s in keywords)
+						if len(used) == len(keywords):
+							return slots, a, b, c
+		slots *= 2
+	sys.exit("No perfect hash found")
+
+
+def main():
+	keywords = read_keywords(read_strings())
+	slots, a, b, c = search(keywords)
+	table = ["WRF_KEYWORD_COUNT"] * slots
+	for name, s in keywords:
+		table[keyword_hash(s, a, b, c, slots)] = "WRF_KW_" + name
+
+	out = []
+	out.append("/*	Generated by tools/wrf_keywords.py from wrf_keywords.h, do not edit. */\n")
+	out.append("#define WRF_KEYWORD_TABLE_COUNT %d" % len(keywords))
+	out.append("#define WRF_KEYWORD_TABLE_HASH 0x%08Xu" % strings_hash(keywords))
+	out.append("#define WRF_KEYWORD_SLOTS %d" % slots)
+	out.append("#define WRF_KEYWORD_HASH_A %d" % a)
+	out.append("#define WRF_KEYWORD_HASH_B %d" % b)
+	out.append("#define WRF_KEYWORD_HASH_C %d" % c)
+	out.append("")
+	out.append("static const uint8_t wrf_keyword_slots[WRF_KEYWORD_SLOTS] = {")
+	for i in range(0, slots, 4):
+		out.append("\t" + " ".join("%s," % t for t in table[i:i + 4]))
+	out.append("};")
+	with open(os.path.join(SDK, "wrf_keywords_table.h"), "w") as f:
+		f.write("\n".join(out) + "\n")
+	print("%d keywords in %d slots" % (len(keywords), slots))
+
+
+if __name__ == "__main__":
+	main()